@@ -0,0 +1,223 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "lib/extras/codestream_stats.h"
+
+#include <numeric>
+#include <utility>
+
+#include "jxl/decode.h"
+#include "lib/extras/time.h"
+#include "lib/jxl/base/padded_bytes.h"
+#include "lib/jxl/color_encoding_internal.h"
+#include "lib/jxl/common.h"
+#include "lib/jxl/dec_bit_reader.h"
+#include "lib/jxl/dec_cache.h"
+#include "lib/jxl/dec_frame.h"
+#include "lib/jxl/fields.h"
+#include "lib/jxl/headers.h"
+#include "lib/jxl/icc_codec.h"
+#include "lib/jxl/image_bundle.h"
+#include "lib/jxl/image_metadata.h"
+
+namespace jxl {
+namespace {
+
+Status DecodeHeaders(BitReader* reader, CodecMetadata* metadata) {
+  JXL_RETURN_IF_ERROR(ReadSizeHeader(reader, &metadata->size));
+  JXL_RETURN_IF_ERROR(ReadImageMetadata(reader, &metadata->m));
+  metadata->transform_data.nonserialized_xyb_encoded =
+      metadata->m.xyb_encoded;
+  JXL_RETURN_IF_ERROR(Bundle::Read(reader, &metadata->transform_data));
+  if (metadata->m.color_encoding.WantICC()) {
+    PaddedBytes icc;
+    JXL_RETURN_IF_ERROR(ReadICC(reader, &icc));
+    JXL_RETURN_IF_ERROR(metadata->m.color_encoding.SetICC(std::move(icc)));
+  }
+  return true;
+}
+
+uint64_t TotalACTokens(const FrameDecoder& frame_decoder) {
+  uint64_t total = 0;
+  for (const std::vector<uint64_t>& counts : frame_decoder.ACTokenCounts()) {
+    total = std::accumulate(counts.begin(), counts.end(), total);
+  }
+  return total;
+}
+
+void SetSectionKind(const FrameDecoder& frame_decoder,
+                    SectionStats* section) {
+  const FrameDimensions frame_dim =
+      frame_decoder.GetFrameHeader().ToFrameDimensions();
+  const size_t ac_global_id = 1 + frame_dim.num_dc_groups;
+  if (frame_decoder.NumSections() == 1) {
+    section->kind = SectionKind::kAll;
+  } else if (section->id == 0) {
+    section->kind = SectionKind::kDCGlobal;
+  } else if (section->id < ac_global_id) {
+    section->kind = SectionKind::kDCGroup;
+    section->group = section->id - 1;
+  } else if (section->id == ac_global_id) {
+    section->kind = SectionKind::kACGlobal;
+  } else {
+    const size_t ac_index = section->id - ac_global_id - 1;
+    section->kind = SectionKind::kACGroup;
+    section->group = ac_index % frame_dim.num_groups;
+    section->pass = ac_index / frame_dim.num_groups;
+  }
+}
+
+Status DecodeFrameSections(const CodecMetadata& metadata, bool count_ac_tokens,
+                           PassesDecoderState* dec_state, BitReader* reader,
+                           FrameStats* frame) {
+  frame->offset = reader->TotalBitsConsumed() / kBitsPerByte;
+  ImageBundle decoded(&metadata.m);
+  FrameDecoder frame_decoder(dec_state, metadata, /*pool=*/nullptr);
+  frame_decoder.SetCountACTokens(count_ac_tokens);
+  JXL_RETURN_IF_ERROR(frame_decoder.InitFrame(
+      reader, &decoded, /*is_preview=*/false, /*allow_partial_frames=*/false,
+      /*allow_partial_dc_global=*/false));
+
+  const FrameHeader& frame_header = frame_decoder.GetFrameHeader();
+  const FrameDimensions frame_dim = frame_header.ToFrameDimensions();
+  frame->encoding = frame_header.encoding;
+  frame->frame_type = frame_header.frame_type;
+  frame->name = frame_header.name;
+  frame->xsize = frame_dim.xsize;
+  frame->ysize = frame_dim.ysize;
+  frame->num_passes = frame_header.passes.num_passes;
+  frame->num_groups = frame_dim.num_groups;
+  frame->num_dc_groups = frame_dim.num_dc_groups;
+  frame->group_dim = frame_dim.group_dim;
+  frame->is_last = frame_header.is_last;
+
+  const size_t pos = reader->TotalBitsConsumed() / kBitsPerByte;
+  frame->header_size = pos - frame->offset;
+  uint64_t sections_size = 0;
+  uint64_t num_ac_tokens = 0;
+  for (size_t i = 0; i < frame_decoder.NumSections(); i++) {
+    SectionStats section;
+    section.id = i;
+    SetSectionKind(frame_decoder, &section);
+    section.offset = pos + frame_decoder.SectionOffsets()[i];
+    section.size = frame_decoder.SectionSizes()[i];
+    sections_size += section.size;
+    if (section.offset + section.size > reader->TotalBytes()) {
+      return JXL_FAILURE("Premature end of stream.");
+    }
+
+    BitReader section_reader(Span<const uint8_t>(
+        reader->FirstByte() + section.offset, section.size));
+    Status close_ok = true;
+    {
+      BitReaderScopedCloser section_closer(&section_reader, &close_ok);
+      FrameDecoder::SectionInfo section_info{&section_reader, i};
+      FrameDecoder::SectionStatus section_status;
+      const double start = Now();
+      JXL_RETURN_IF_ERROR(
+          frame_decoder.ProcessSections(&section_info, 1, &section_status));
+      section.decode_seconds = Now() - start;
+      if (section_status != FrameDecoder::kDone) {
+        return JXL_FAILURE("Invalid section %zu status: %d", i,
+                           section_status);
+      }
+    }
+    JXL_RETURN_IF_ERROR(close_ok);
+
+    if (count_ac_tokens) {
+      const uint64_t new_num_ac_tokens = TotalACTokens(frame_decoder);
+      section.num_ac_tokens = new_num_ac_tokens - num_ac_tokens;
+      num_ac_tokens = new_num_ac_tokens;
+    }
+    frame->sections.push_back(section);
+  }
+  reader->SkipBits(sections_size * kBitsPerByte);
+
+  if (count_ac_tokens && frame->encoding == FrameEncoding::kVarDCT) {
+    frame->ac_token_counts = frame_decoder.ACTokenCounts();
+    frame->num_histograms = dec_state->shared->num_histograms;
+    frame->num_block_ctxs = dec_state->shared->block_ctx_map.num_ctxs;
+    frame->num_ac_contexts = dec_state->shared->block_ctx_map.NumACContexts();
+  }
+
+  const double start = Now();
+  JXL_RETURN_IF_ERROR(frame_decoder.FinalizeFrame());
+  frame->finalize_seconds = Now() - start;
+  return true;
+}
+
+}  // namespace
+
+const char* SectionKindName(SectionKind kind) {
+  switch (kind) {
+    case SectionKind::kAll:
+      return "All";
+    case SectionKind::kDCGlobal:
+      return "DCGlobal";
+    case SectionKind::kDCGroup:
+      return "DCGroup";
+    case SectionKind::kACGlobal:
+      return "ACGlobal";
+    case SectionKind::kACGroup:
+      return "ACGroup";
+  }
+  return "?";
+}
+
+uint64_t FrameStats::TotalSize() const {
+  uint64_t total = header_size;
+  for (const SectionStats& section : sections) total += section.size;
+  return total;
+}
+
+Status ComputeCodestreamStats(const Span<const uint8_t> codestream,
+                              bool count_ac_tokens, CodestreamStats* stats) {
+  JxlSignature signature =
+      JxlSignatureCheck(codestream.data(), codestream.size());
+  if (signature == JXL_SIG_CONTAINER) {
+    return JXL_FAILURE("Container format is not supported, only codestreams");
+  }
+  if (signature != JXL_SIG_CODESTREAM) {
+    return JXL_FAILURE("File does not start with a JPEG XL codestream");
+  }
+
+  *stats = CodestreamStats();
+  CodecMetadata metadata;
+  Status ret = true;
+  {
+    BitReader reader(codestream);
+    BitReaderScopedCloser reader_closer(&reader, &ret);
+    (void)reader.ReadFixedBits<16>();  // skip marker
+
+    JXL_RETURN_IF_ERROR(DecodeHeaders(&reader, &metadata));
+    stats->xsize = metadata.xsize();
+    stats->ysize = metadata.ysize();
+    JXL_RETURN_IF_ERROR(reader.JumpToByteBoundary());
+    stats->header_size = reader.TotalBitsConsumed() / kBitsPerByte;
+
+    if (metadata.m.have_preview) {
+      JXL_RETURN_IF_ERROR(SkipFrame(metadata, &reader, /*is_preview=*/true));
+      JXL_RETURN_IF_ERROR(reader.JumpToByteBoundary());
+      stats->preview_size =
+          reader.TotalBitsConsumed() / kBitsPerByte - stats->header_size;
+    }
+
+    // Reference and DC frames are kept in the decoder state for the frames
+    // that use them.
+    PassesDecoderState dec_state;
+    JXL_RETURN_IF_ERROR(dec_state.output_encoding_info.Set(
+        metadata,
+        ColorEncoding::LinearSRGB(metadata.m.color_encoding.IsGray())));
+    do {
+      stats->frames.emplace_back();
+      JXL_RETURN_IF_ERROR(DecodeFrameSections(metadata, count_ac_tokens,
+                                              &dec_state, &reader,
+                                              &stats->frames.back()));
+    } while (!stats->frames.back().is_last);
+  }
+  return ret;
+}
+
+}  // namespace jxl
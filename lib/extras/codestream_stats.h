@@ -0,0 +1,104 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef LIB_EXTRAS_CODESTREAM_STATS_H_
+#define LIB_EXTRAS_CODESTREAM_STATS_H_
+
+// Bitstream-level statistics of a JPEG XL codestream: where the bytes of each
+// frame go (per TOC section, i.e. per pass and group), how long each section
+// takes to decode, and how many AC tokens are read per context.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "lib/jxl/base/span.h"
+#include "lib/jxl/base/status.h"
+#include "lib/jxl/frame_header.h"
+
+namespace jxl {
+
+// Kind of a TOC section. Frames with a single group and a single pass have
+// only one section (kAll), which contains all the others.
+enum class SectionKind { kAll, kDCGlobal, kDCGroup, kACGlobal, kACGroup };
+
+const char* SectionKindName(SectionKind kind);
+
+struct SectionStats {
+  size_t id = 0;  // Index in the TOC.
+  SectionKind kind = SectionKind::kAll;
+  // Index of the DC group (kDCGroup) or group (kACGroup), otherwise 0.
+  size_t group = 0;
+  size_t pass = 0;  // Only meaningful for kACGroup.
+  // Position in the codestream, in bytes. Sections may be stored in a
+  // different order than the TOC if the TOC is permuted.
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  // Time spent in FrameDecoder::ProcessSections for this section alone,
+  // including the reconstruction of pixels it triggers.
+  double decode_seconds = 0.0;
+  // Number of AC tokens read from this section, if counted.
+  uint64_t num_ac_tokens = 0;
+};
+
+struct FrameStats {
+  FrameEncoding encoding = FrameEncoding::kVarDCT;
+  FrameType frame_type = FrameType::kRegularFrame;
+  std::string name;
+  size_t xsize = 0;
+  size_t ysize = 0;
+  size_t num_passes = 0;
+  size_t num_groups = 0;
+  size_t num_dc_groups = 0;
+  size_t group_dim = 0;
+  bool is_last = false;
+
+  // Offset of the frame header in the codestream and size of the frame header
+  // and TOC, in bytes.
+  uint64_t offset = 0;
+  uint64_t header_size = 0;
+
+  // In TOC order.
+  std::vector<SectionStats> sections;
+  // Time spent in FrameDecoder::FinalizeFrame.
+  double finalize_seconds = 0.0;
+
+  // Only for VarDCT frames with counted AC tokens: number of tokens read per
+  // pass and context, indexed as in FrameDecoder::ACTokenCounts. Context
+  // `ctx` belongs to histogram ctx / num_ac_contexts; within a histogram, the
+  // first num_block_ctxs * kNonZeroBuckets contexts code the number of
+  // non-zeros of a block (block context = ctx % num_block_ctxs), the others
+  // code coefficients (block context = offset / kZeroDensityContextCount).
+  std::vector<std::vector<uint64_t>> ac_token_counts;
+  size_t num_histograms = 0;
+  size_t num_block_ctxs = 0;
+  size_t num_ac_contexts = 0;
+
+  uint64_t TotalSize() const;
+};
+
+struct CodestreamStats {
+  size_t xsize = 0;
+  size_t ysize = 0;
+  // Signature, image headers and ICC profile.
+  uint64_t header_size = 0;
+  uint64_t preview_size = 0;
+  std::vector<FrameStats> frames;
+};
+
+// Decodes every frame of `codestream` one TOC section at a time (without a
+// thread pool, in TOC order) and records its layout and decoding times. If
+// `count_ac_tokens`, also counts the AC tokens read per context, which
+// disables the fast entropy decoding paths and thus slows down AC groups.
+// The preview frame is skipped. Only bare codestreams are supported, not the
+// container format.
+Status ComputeCodestreamStats(Span<const uint8_t> codestream,
+                              bool count_ac_tokens, CodestreamStats* stats);
+
+}  // namespace jxl
+
+#endif  // LIB_EXTRAS_CODESTREAM_STATS_H_
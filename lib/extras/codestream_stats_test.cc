@@ -0,0 +1,128 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "lib/extras/codestream_stats.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <numeric>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/extras/codec.h"
+#include "lib/jxl/base/padded_bytes.h"
+#include "lib/jxl/enc_cache.h"
+#include "lib/jxl/enc_file.h"
+#include "lib/jxl/enc_params.h"
+#include "lib/jxl/testdata.h"
+#include "lib/jxl/toc.h"
+
+namespace jxl {
+namespace {
+
+PaddedBytes EncodeTestImage(const CompressParams& cparams) {
+  const PaddedBytes orig =
+      ReadTestData("wesaturate/500px/u76c0g_bliznaca_srgb8.png");
+  CodecInOut io;
+  EXPECT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io));
+  io.ShrinkTo(300, 300);
+  PassesEncoderState enc_state;
+  PaddedBytes compressed;
+  EXPECT_TRUE(EncodeFile(cparams, &io, &enc_state, &compressed));
+  return compressed;
+}
+
+void CheckLayout(const PaddedBytes& compressed, const CodestreamStats& stats) {
+  ASSERT_EQ(1u, stats.frames.size());
+  const FrameStats& frame = stats.frames[0];
+  EXPECT_TRUE(frame.is_last);
+  EXPECT_EQ(300u, frame.xsize);
+  EXPECT_EQ(300u, frame.ysize);
+  EXPECT_EQ(stats.header_size + stats.preview_size, frame.offset);
+  EXPECT_EQ(compressed.size(), frame.offset + frame.TotalSize());
+  ASSERT_EQ(NumTocEntries(frame.num_groups, frame.num_dc_groups,
+                          frame.num_passes, /*has_ac_global=*/true),
+            frame.sections.size());
+  uint64_t end = frame.offset + frame.header_size;
+  for (size_t i = 0; i < frame.sections.size(); i++) {
+    const SectionStats& section = frame.sections[i];
+    EXPECT_EQ(i, section.id);
+    EXPECT_EQ(end, section.offset);
+    end += section.size;
+    if (section.kind == SectionKind::kACGroup) {
+      EXPECT_EQ(section.id, AcGroupIndex(section.pass, section.group,
+                                         frame.num_groups, frame.num_dc_groups,
+                                         /*has_ac_global=*/true));
+    }
+  }
+}
+
+TEST(CodestreamStatsTest, VarDCTPasses) {
+  CompressParams cparams;
+  cparams.progressive_mode = true;
+  const PaddedBytes compressed = EncodeTestImage(cparams);
+
+  CodestreamStats stats;
+  ASSERT_TRUE(ComputeCodestreamStats(Span<const uint8_t>(compressed),
+                                     /*count_ac_tokens=*/true, &stats));
+  CheckLayout(compressed, stats);
+  const FrameStats& frame = stats.frames[0];
+  EXPECT_EQ(FrameEncoding::kVarDCT, frame.encoding);
+  EXPECT_GT(frame.num_passes, 1u);
+  EXPECT_EQ(4u, frame.num_groups);
+
+  // Every AC token is read by an AC group section, and every pass has some.
+  ASSERT_EQ(frame.num_passes, frame.ac_token_counts.size());
+  std::vector<uint64_t> section_tokens(frame.num_passes);
+  for (const SectionStats& section : frame.sections) {
+    if (section.kind != SectionKind::kACGroup) {
+      EXPECT_EQ(0u, section.num_ac_tokens);
+      continue;
+    }
+    section_tokens[section.pass] += section.num_ac_tokens;
+  }
+  for (size_t pass = 0; pass < frame.num_passes; pass++) {
+    const std::vector<uint64_t>& counts = frame.ac_token_counts[pass];
+    EXPECT_GE(counts.size(), frame.num_histograms * frame.num_ac_contexts);
+    const uint64_t total = std::accumulate(counts.begin(), counts.end(),
+                                           static_cast<uint64_t>(0));
+    EXPECT_GT(total, 0u);
+    EXPECT_EQ(section_tokens[pass], total);
+  }
+
+  CodestreamStats uncounted;
+  ASSERT_TRUE(ComputeCodestreamStats(Span<const uint8_t>(compressed),
+                                     /*count_ac_tokens=*/false, &uncounted));
+  CheckLayout(compressed, uncounted);
+  EXPECT_TRUE(uncounted.frames[0].ac_token_counts.empty());
+}
+
+TEST(CodestreamStatsTest, Modular) {
+  CompressParams cparams;
+  cparams.modular_mode = true;
+  const PaddedBytes compressed = EncodeTestImage(cparams);
+
+  CodestreamStats stats;
+  ASSERT_TRUE(ComputeCodestreamStats(Span<const uint8_t>(compressed),
+                                     /*count_ac_tokens=*/true, &stats));
+  CheckLayout(compressed, stats);
+  EXPECT_EQ(FrameEncoding::kModular, stats.frames[0].encoding);
+  EXPECT_TRUE(stats.frames[0].ac_token_counts.empty());
+}
+
+TEST(CodestreamStatsTest, RejectsInvalidInput) {
+  const PaddedBytes compressed = EncodeTestImage(CompressParams());
+  CodestreamStats stats;
+  EXPECT_FALSE(ComputeCodestreamStats(
+      Span<const uint8_t>(compressed.data(), compressed.size() / 2),
+      /*count_ac_tokens=*/true, &stats));
+  const uint8_t garbage[16] = {1, 2, 3};
+  EXPECT_FALSE(ComputeCodestreamStats(Span<const uint8_t>(garbage, 16),
+                                      /*count_ac_tokens=*/true, &stats));
+}
+
+}  // namespace
+}  // namespace jxl
@@ -366,6 +366,22 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderSubscribeEvents(JxlDecoder* dec,
 JXL_EXPORT JxlDecoderStatus
 JxlDecoderSetKeepOrientation(JxlDecoder* dec, JXL_BOOL keep_orientation);
 
+/**
+ * Returns how much memory of the given category the decoder has obtained from
+ * its memory manager. Image planes, byte buffers, entropy tables and scratch
+ * buffers allocated during JxlDecoderProcessInput and JxlDecoderFlushImage,
+ * including on the threads of the parallel runner, are routed through the
+ * memory manager passed to JxlDecoderCreate and accounted here.
+ *
+ * @param dec decoder object
+ * @param category the subsystem to query
+ * @param usage output memory usage
+ * @return JXL_DEC_SUCCESS if no error, JXL_DEC_ERROR if @p category is invalid.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderGetMemoryUsage(const JxlDecoder* dec,
+                                                     JxlMemoryCategory category,
+                                                     JxlMemoryUsage* usage);
+
 /**
  * Decodes JPEG XL file using the available bytes. Requires input has been
  * set with JxlDecoderSetInput. After JxlDecoderProcessInput, input can
@@ -100,6 +100,22 @@ JXL_EXPORT void JxlEncoderReset(JxlEncoder* enc);
  */
 JXL_EXPORT void JxlEncoderDestroy(JxlEncoder* enc);
 
+/**
+ * Returns how much memory of the given category the encoder has obtained from
+ * its memory manager. Image planes, byte buffers and scratch buffers allocated
+ * while adding frames and processing output, including on the threads of the
+ * parallel runner, are routed through the memory manager passed to
+ * JxlEncoderCreate and accounted here.
+ *
+ * @param enc encoder object
+ * @param category the subsystem to query
+ * @param usage output memory usage
+ * @return JXL_ENC_SUCCESS if no error, JXL_ENC_ERROR if @p category is invalid.
+ */
+JXL_EXPORT JxlEncoderStatus JxlEncoderGetMemoryUsage(const JxlEncoder* enc,
+                                                     JxlMemoryCategory category,
+                                                     JxlMemoryUsage* usage);
+
 /**
  * Set the parallel runner for multithreading. May only be set before starting
  * encoding.
@@ -304,6 +320,36 @@ JxlEncoderOptionsSetLossless(JxlEncoderOptions* options, JXL_BOOL lossless);
 JXL_EXPORT JxlEncoderStatus
 JxlEncoderOptionsSetDecodingSpeed(JxlEncoderOptions* options, int tier);
 
+/**
+ * Sets whether the encoder embeds a preview image, generated by downsampling
+ * the first frame so that it is at most 256 pixels wide and high. Images that
+ * already fit in that size get no preview. Only the options used for the first
+ * frame are taken into account. Default is false.
+ *
+ * @param options set of encoder options to update with the new mode.
+ * @param generate_preview whether to generate and embed a preview.
+ * @return JXL_ENC_SUCCESS if the operation was successful, JXL_ENC_ERROR
+ * otherwise.
+ */
+JXL_EXPORT JxlEncoderStatus JxlEncoderOptionsSetGeneratePreview(
+    JxlEncoderOptions* options, JXL_BOOL generate_preview);
+
+/**
+ * Sets whether lossy frames are encoded in realtime mode, for streams of
+ * similar frames such as screen or camera captures: all blocks use the 8x8
+ * DCT, the frame-wide heuristics are skipped, and the AC histograms of the
+ * first realtime frame are reused by the following realtime frames of the same
+ * encoder, until JxlEncoderReset. This trades compression for encoding speed.
+ * Has no effect on lossless frames. Default is false.
+ *
+ * @param options set of encoder options to update with the new mode.
+ * @param realtime whether to encode in realtime mode.
+ * @return JXL_ENC_SUCCESS if the operation was successful, JXL_ENC_ERROR
+ * otherwise.
+ */
+JXL_EXPORT JxlEncoderStatus
+JxlEncoderOptionsSetRealtime(JxlEncoderOptions* options, JXL_BOOL realtime);
+
 /**
  * Sets encoder effort/speed level without affecting decoding speed. Valid
  * values are, from faster to slower speed: 3:falcon 4:cheetah 5:hare 6:wombat
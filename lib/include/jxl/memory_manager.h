@@ -12,6 +12,7 @@
 #define JXL_MEMORY_MANAGER_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #if defined(__cplusplus) || defined(c_plusplus)
 extern "C" {
@@ -60,6 +61,41 @@ typedef struct JxlMemoryManagerStruct {
   /* TODO(deymo): Add cache-aligned alloc/free functions here. */
 } JxlMemoryManager;
 
+/**
+ * Subsystems for which the memory obtained from a ::JxlMemoryManager is
+ * accounted separately, see JxlDecoderGetMemoryUsage and
+ * JxlEncoderGetMemoryUsage.
+ */
+typedef enum {
+  /** Image planes: decoded and intermediate pixels. */
+  JXL_MEMORY_IMAGES = 0,
+
+  /** Byte buffers such as bitstreams and ICC profiles. */
+  JXL_MEMORY_BYTES = 1,
+
+  /** Entropy decoding tables and LZ77 windows. */
+  JXL_MEMORY_ENTROPY_TABLES = 2,
+
+  /** Per-thread transient scratch buffers. */
+  JXL_MEMORY_SCRATCH = 3,
+
+  /** Other large buffers. */
+  JXL_MEMORY_OTHER = 4,
+} JxlMemoryCategory;
+
+/**
+ * Memory usage of one ::JxlMemoryCategory, in bytes requested from the
+ * ::JxlMemoryManager (including alignment overhead).
+ */
+typedef struct {
+  /** Bytes currently allocated. */
+  uint64_t bytes_in_use;
+  /** Maximum of bytes_in_use since the encoder or decoder was created. */
+  uint64_t max_bytes_in_use;
+  /** Number of allocations made since the encoder or decoder was created. */
+  uint64_t num_allocations;
+} JxlMemoryUsage;
+
 #if defined(__cplusplus) || defined(c_plusplus)
 }
 #endif
@@ -127,6 +127,7 @@ set(JPEGXL_INTERNAL_SOURCES_DEC
   jxl/icc_codec.h
   jxl/icc_codec_common.cc
   jxl/icc_codec_common.h
+  jxl/idct_int16-inl.h
   jxl/image.cc
   jxl/image.h
   jxl/image_bundle.cc
@@ -222,6 +223,8 @@ set(JPEGXL_INTERNAL_SOURCES_ENC
   jxl/enc_color_management.h
   jxl/enc_comparator.cc
   jxl/enc_comparator.h
+  jxl/enc_content_analysis.cc
+  jxl/enc_content_analysis.h
   jxl/enc_context_map.cc
   jxl/enc_context_map.h
   jxl/enc_detect_dots.cc
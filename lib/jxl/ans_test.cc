@@ -13,6 +13,7 @@
 #include "lib/jxl/ans_params.h"
 #include "lib/jxl/aux_out_fwd.h"
 #include "lib/jxl/base/span.h"
+#include "lib/jxl/base/thread_pool_internal.h"
 #include "lib/jxl/dec_ans.h"
 #include "lib/jxl/dec_bit_reader.h"
 #include "lib/jxl/enc_ans.h"
@@ -186,6 +187,137 @@ TEST(ANSTest, UintConfigRoundtrip) {
   }
 }
 
+TEST(ANSTest, ParallelHistogramsMatchSerial) {
+  std::mt19937_64 rng;
+  std::geometric_distribution<int> dist(0.05);
+  constexpr size_t kNumContexts = 8;
+  std::vector<std::vector<Token>> streams(37);
+  for (size_t i = 0; i < streams.size(); i++) {
+    for (size_t j = 0; j < 1000 + 50 * i; j++) {
+      streams[i].emplace_back((i + j) % kNumContexts, dist(rng));
+    }
+  }
+  HistogramParams params;
+  params.uint_method = HistogramParams::HybridUintMethod::kBest;
+
+  auto encode = [&](ThreadPool* pool) {
+    auto tokens = streams;
+    EntropyEncodingData codes;
+    std::vector<uint8_t> context_map;
+    BitWriter writer;
+    BuildAndEncodeHistograms(params, kNumContexts, tokens, &codes,
+                             &context_map, &writer, 0, nullptr, pool);
+    for (const std::vector<Token>& stream : tokens) {
+      WriteTokens(stream, codes, context_map, &writer, 0, nullptr);
+    }
+    writer.ZeroPadToByte();
+    return std::vector<uint8_t>(writer.GetSpan().data(),
+                                writer.GetSpan().data() +
+                                    writer.GetSpan().size());
+  };
+  ThreadPoolInternal pool(4);
+  EXPECT_EQ(encode(nullptr), encode(&pool));
+}
+
+void TestFastPathRoundtrip(bool ans) {
+  std::mt19937_64 rng;
+  std::geometric_distribution<int> dist(0.2);
+  constexpr size_t kNumContexts = 20;
+  std::vector<std::vector<Token>> input_values(1);
+  for (size_t i = 0; i < 100000; i++) {
+    // Mostly small values, with some that need many raw bits.
+    uint32_t value =
+        i % 97 == 0 ? static_cast<uint32_t>(rng() >> 40) : dist(rng);
+    input_values[0].emplace_back(i % kNumContexts, value);
+  }
+  HistogramParams params;
+  params.lz77_method = HistogramParams::LZ77Method::kNone;
+  params.force_huffman = !ans;
+
+  std::vector<uint8_t> context_map;
+  EntropyEncodingData codes;
+  BitWriter writer;
+  {
+    auto input_values_copy = input_values;
+    BuildAndEncodeHistograms(params, kNumContexts, input_values_copy, &codes,
+                             &context_map, &writer, 0, nullptr);
+    WriteTokens(input_values_copy[0], codes, context_map, &writer, 0, nullptr);
+    writer.ZeroPadToByte();
+  }
+
+  BitReader br(writer.GetSpan());
+  std::vector<uint8_t> dec_context_map;
+  ANSCode decoded_codes;
+  // The ANS alias tables are built on a thread pool after reading all the
+  // histograms, as for the AC histograms of frames.
+  ASSERT_TRUE(DecodeHistograms(&br, kNumContexts, &decoded_codes,
+                               &dec_context_map, /*disallow_lz77=*/false,
+                               /*defer_alias_tables=*/ans));
+  ThreadPoolInternal pool(4);
+  ASSERT_TRUE(InitAliasTables(&decoded_codes, 1, &pool));
+  ANSSymbolReader reader(&decoded_codes, &br);
+  EXPECT_EQ(reader.UsesFastPrefixPath(), !ans);
+  EXPECT_EQ(reader.UsesFastANSPath(), ans);
+  for (const Token& symbol : input_values[0]) {
+    const size_t ctx = dec_context_map[symbol.context];
+    ASSERT_EQ(ans ? reader.ReadHybridUintClusteredANS(ctx, &br)
+                  : reader.ReadHybridUintClusteredPrefix(ctx, &br),
+              symbol.value);
+  }
+  EXPECT_TRUE(reader.CheckANSFinalState());
+  EXPECT_TRUE(br.Close());
+}
+
+TEST(ANSTest, PrefixCodeFastPathRoundtrip) { TestFastPathRoundtrip(false); }
+TEST(ANSTest, ANSFastPathRoundtrip) { TestFastPathRoundtrip(true); }
+
+void TestMissingSymbolsRoundtrip(bool ans) {
+  std::mt19937_64 rng;
+  std::geometric_distribution<int> dist(0.3);
+  constexpr size_t kNumContexts = 10;
+  // The histograms are built from small values of half of the contexts only.
+  std::vector<std::vector<Token>> sample(1);
+  for (size_t i = 0; i < 10000; i++) {
+    sample[0].emplace_back(i % (kNumContexts / 2), dist(rng));
+  }
+  HistogramParams params;
+  params.lz77_method = HistogramParams::LZ77Method::kNone;
+  params.force_huffman = !ans;
+  params.add_missing_symbols = true;
+
+  std::vector<uint8_t> context_map;
+  EntropyEncodingData codes;
+  BitWriter writer;
+  BuildAndEncodeHistograms(params, kNumContexts, sample, &codes, &context_map,
+                           &writer, 0, nullptr);
+  // Other values and contexts can still be encoded.
+  std::vector<Token> input_values;
+  for (size_t i = 0; i < 10000; i++) {
+    input_values.emplace_back(rng() % kNumContexts,
+                              static_cast<uint32_t>(rng() >> (40 + i % 24)));
+  }
+  WriteTokens(input_values, codes, context_map, &writer, 0, nullptr);
+  writer.ZeroPadToByte();
+
+  BitReader br(writer.GetSpan());
+  std::vector<uint8_t> dec_context_map;
+  ANSCode decoded_codes;
+  ASSERT_TRUE(
+      DecodeHistograms(&br, kNumContexts, &decoded_codes, &dec_context_map));
+  ANSSymbolReader reader(&decoded_codes, &br);
+  for (const Token& symbol : input_values) {
+    ASSERT_EQ(reader.ReadHybridUint(symbol.context, &br, dec_context_map),
+              symbol.value);
+  }
+  EXPECT_TRUE(reader.CheckANSFinalState());
+  EXPECT_TRUE(br.Close());
+}
+
+TEST(ANSTest, PrefixCodeMissingSymbolsRoundtrip) {
+  TestMissingSymbolsRoundtrip(false);
+}
+TEST(ANSTest, ANSMissingSymbolsRoundtrip) { TestMissingSymbolsRoundtrip(true); }
+
 void TestCheckpointing(bool ans, bool lz77) {
   std::vector<std::vector<Token>> input_values(1);
   for (size_t i = 0; i < 1024; i++) {
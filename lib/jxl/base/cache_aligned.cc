@@ -11,7 +11,15 @@
 // Disabled: slower than malloc + alignment.
 #define JXL_USE_MMAP 0
 
-#if JXL_USE_MMAP
+// Large allocations can be backed by transparent huge pages, see
+// CacheAligned::SetHugePageThreshold.
+#if defined(__linux__)
+#define JXL_HAVE_HUGE_PAGES 1
+#else
+#define JXL_HAVE_HUGE_PAGES 0
+#endif
+
+#if JXL_USE_MMAP || JXL_HAVE_HUGE_PAGES
 #include <sys/mman.h>
 #endif
 
@@ -29,6 +37,11 @@ namespace {
 struct AllocationHeader {
   void* allocated;
   size_t allocated_size;
+  // Whether `allocated` was obtained from mmap rather than malloc.
+  bool mmapped;
+  // If not null, `allocated` was obtained from this target instead.
+  AllocationTarget* target;
+  AllocationKind kind;
   uint8_t left_padding[hwy::kMaxVectorSize];
 };
 #pragma pack(pop)
@@ -36,6 +49,49 @@ struct AllocationHeader {
 std::atomic<uint64_t> num_allocations{0};
 std::atomic<uint64_t> bytes_in_use{0};
 std::atomic<uint64_t> max_bytes_in_use{0};
+std::atomic<size_t> huge_page_threshold{0};
+thread_local AllocationTarget* current_target = nullptr;
+
+void UpdateMax(std::atomic<uint64_t>* max, const uint64_t value) {
+  uint64_t expected_max = max->load(std::memory_order_acquire);
+  for (;;) {
+    const uint64_t desired = std::max(expected_max, value);
+    if (max->compare_exchange_strong(expected_max, desired,
+                                     std::memory_order_acq_rel)) {
+      break;
+    }
+  }
+}
+
+#if JXL_HAVE_HUGE_PAGES
+// Size of a transparent huge page on x86 and (with 4K base pages) Arm.
+constexpr size_t kHugePageSize = size_t{2} << 20;
+
+// Returns `size` (a multiple of kHugePageSize) bytes aligned to kHugePageSize,
+// so that the kernel can back all of them with huge pages, or nullptr.
+void* AllocateHugePages(const size_t size) {
+  // mmap only guarantees page alignment: map one more huge page and unmap the
+  // unaligned head and the rest of the tail.
+  const size_t mapped_size = size + kHugePageSize;
+  void* mapped = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) return nullptr;
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(mapped);
+  const uintptr_t aligned =
+      (begin + kHugePageSize - 1) & ~(uintptr_t{kHugePageSize} - 1);
+  const size_t head = aligned - begin;
+  if (head != 0) munmap(mapped, head);
+  if (head != kHugePageSize) {
+    munmap(reinterpret_cast<void*>(aligned + size), kHugePageSize - head);
+  }
+  void* allocated = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+  // Only a hint: fails harmlessly if THP are disabled system-wide.
+  (void)madvise(allocated, size, MADV_HUGEPAGE);
+#endif
+  return allocated;
+}
+#endif  // JXL_HAVE_HUGE_PAGES
 
 }  // namespace
 
@@ -51,6 +107,47 @@ void CacheAligned::PrintStats() {
          double(max_bytes_in_use.load(std::memory_order_relaxed)));
 }
 
+void* AllocationTarget::Alloc(const size_t size, const AllocationKind kind) {
+  void* allocated = memory_manager_.alloc(memory_manager_.opaque, size);
+  if (allocated == nullptr) return nullptr;
+  AddUsage(size, kind);
+  return allocated;
+}
+
+void AllocationTarget::Free(void* address, const size_t size,
+                            const AllocationKind kind) {
+  RemoveUsage(size, kind);
+  memory_manager_.free(memory_manager_.opaque, address);
+}
+
+void AllocationTarget::AddUsage(const size_t size, const AllocationKind kind) {
+  Usage& usage = usage_[static_cast<size_t>(kind)];
+  usage.num_allocations.fetch_add(1, std::memory_order_relaxed);
+  const uint64_t prev_bytes =
+      usage.bytes_in_use.fetch_add(size, std::memory_order_acq_rel);
+  UpdateMax(&usage.max_bytes_in_use, prev_bytes + size);
+}
+
+void AllocationTarget::RemoveUsage(const size_t size,
+                                   const AllocationKind kind) {
+  usage_[static_cast<size_t>(kind)].bytes_in_use.fetch_sub(
+      size, std::memory_order_acq_rel);
+}
+
+AllocationTarget* CacheAligned::CurrentTarget() { return current_target; }
+
+void CacheAligned::SetCurrentTarget(AllocationTarget* target) {
+  current_target = target;
+}
+
+void CacheAligned::SetHugePageThreshold(const size_t bytes) {
+  huge_page_threshold.store(bytes, std::memory_order_relaxed);
+}
+
+size_t CacheAligned::HugePageThreshold() {
+  return huge_page_threshold.load(std::memory_order_relaxed);
+}
+
 size_t CacheAligned::NextOffset() {
   static std::atomic<uint32_t> next{0};
   constexpr uint32_t kGroups = CacheAligned::kAlias / CacheAligned::kAlignment;
@@ -58,7 +155,8 @@ size_t CacheAligned::NextOffset() {
   return CacheAligned::kAlignment * group;
 }
 
-void* CacheAligned::Allocate(const size_t payload_size, size_t offset) {
+void* CacheAligned::Allocate(const size_t payload_size, size_t offset,
+                             const AllocationKind kind) {
   JXL_ASSERT(payload_size <= std::numeric_limits<size_t>::max() / 2);
   JXL_ASSERT((offset % kAlignment == 0) && offset <= kAlias);
 
@@ -80,13 +178,37 @@ void* CacheAligned::Allocate(const size_t payload_size, size_t offset) {
       mmap(nullptr, allocated_size, PROT_READ | PROT_WRITE, flags, -1, 0);
   if (allocated == MAP_FAILED) return nullptr;
   const uintptr_t aligned = reinterpret_cast<uintptr_t>(allocated);
+  const bool mmapped = true;
+  AllocationTarget* const target = nullptr;
 #else
-  const size_t allocated_size = kAlias + offset + payload_size;
-  void* allocated = malloc(allocated_size);
-  if (allocated == nullptr) return nullptr;
-  // Always round up even if already aligned - we already asked for kAlias
-  // extra bytes and there's no way to give them back.
-  uintptr_t aligned = reinterpret_cast<uintptr_t>(allocated) + kAlias;
+  size_t allocated_size = kAlias + offset + payload_size;
+  void* allocated = nullptr;
+  bool mmapped = false;
+  AllocationTarget* const target = current_target;
+#if JXL_HAVE_HUGE_PAGES
+  const size_t threshold = HugePageThreshold();
+  if ((target == nullptr || target->AllowsHugePages()) && threshold != 0 &&
+      payload_size >= threshold) {
+    // Whole huge pages; page-aligned memory is already aligned to kAlias.
+    allocated_size = (offset + payload_size + kHugePageSize - 1) &
+                     ~(kHugePageSize - 1);
+    allocated = AllocateHugePages(allocated_size);
+    mmapped = allocated != nullptr;
+    if (mmapped && target != nullptr) target->AddUsage(allocated_size, kind);
+  }
+#endif
+  if (!mmapped) {
+    allocated_size = kAlias + offset + payload_size;
+    allocated = target != nullptr ? target->Alloc(allocated_size, kind)
+                                  : malloc(allocated_size);
+    if (allocated == nullptr) return nullptr;
+  }
+  uintptr_t aligned = reinterpret_cast<uintptr_t>(allocated);
+  if (!mmapped) {
+    // Always round up even if already aligned - we already asked for kAlias
+    // extra bytes and there's no way to give them back.
+    aligned += kAlias;
+  }
   static_assert((kAlias & (kAlias - 1)) == 0, "kAlias must be a power of 2");
   static_assert(kAlias >= kAlignment, "Cannot align to more than kAlias");
   aligned &= ~(kAlias - 1);
@@ -111,15 +233,7 @@ void* CacheAligned::Allocate(const size_t payload_size, size_t offset) {
   num_allocations.fetch_add(1, std::memory_order_relaxed);
   const uint64_t prev_bytes =
       bytes_in_use.fetch_add(allocated_size, std::memory_order_acq_rel);
-  uint64_t expected_max = max_bytes_in_use.load(std::memory_order_acquire);
-  for (;;) {
-    const uint64_t desired =
-        std::max(expected_max, prev_bytes + allocated_size);
-    if (max_bytes_in_use.compare_exchange_strong(expected_max, desired,
-                                                 std::memory_order_acq_rel)) {
-      break;
-    }
-  }
+  UpdateMax(&max_bytes_in_use, prev_bytes + allocated_size);
 
   const uintptr_t payload = aligned + offset;  // still aligned
 
@@ -127,6 +241,9 @@ void* CacheAligned::Allocate(const size_t payload_size, size_t offset) {
   AllocationHeader* header = reinterpret_cast<AllocationHeader*>(payload) - 1;
   header->allocated = allocated;
   header->allocated_size = allocated_size;
+  header->mmapped = mmapped;
+  header->target = target;
+  header->kind = kind;
 
   return JXL_ASSUME_ALIGNED(reinterpret_cast<void*>(payload), 64);
 }
@@ -144,11 +261,21 @@ void CacheAligned::Free(const void* aligned_pointer) {
   bytes_in_use.fetch_add(~header->allocated_size + 1,
                          std::memory_order_acq_rel);
 
-#if JXL_USE_MMAP
-  munmap(header->allocated, header->allocated_size);
-#else
-  free(header->allocated);
+  if (header->target != nullptr) {
+    if (!header->mmapped) {
+      header->target->Free(header->allocated, header->allocated_size,
+                           header->kind);
+      return;
+    }
+    header->target->RemoveUsage(header->allocated_size, header->kind);
+  }
+#if JXL_USE_MMAP || JXL_HAVE_HUGE_PAGES
+  if (header->mmapped) {
+    munmap(header->allocated, header->allocated_size);
+    return;
+  }
 #endif
+  free(header->allocated);
 }
 
 }  // namespace jxl
@@ -11,17 +11,81 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <memory>
 
+#include "jxl/memory_manager.h"
 #include "lib/jxl/base/compiler_specific.h"
 
 namespace jxl {
 
+// Subsystems whose allocations are counted separately. Values match
+// JxlMemoryCategory.
+enum class AllocationKind : uint8_t {
+  kImage = 0,          // Plane pixels.
+  kBytes = 1,          // PaddedBytes: bitstreams, ICC profiles etc.
+  kEntropyTables = 2,  // Entropy decoding tables and LZ77 windows.
+  kScratch = 3,        // Per-thread temporary buffers.
+  kOther = 4,
+};
+static constexpr size_t kNumAllocationKinds = 5;
+
+// Memory manager that receives the CacheAligned allocations made while it is
+// the current target (see ScopedAllocationTarget), with per-kind statistics.
+// Must outlive all allocations made through it.
+class AllocationTarget {
+ public:
+  struct Usage {
+    std::atomic<uint64_t> bytes_in_use{0};
+    std::atomic<uint64_t> max_bytes_in_use{0};
+    std::atomic<uint64_t> num_allocations{0};
+  };
+
+  // `memory_manager` must have non-null alloc and free functions. If
+  // `allow_huge_pages`, allocations above the huge-page threshold bypass it
+  // (but are still counted); callers pass true only if it merely calls
+  // malloc.
+  explicit AllocationTarget(const JxlMemoryManager& memory_manager,
+                            bool allow_huge_pages = false)
+      : memory_manager_(memory_manager), allow_huge_pages_(allow_huge_pages) {}
+  AllocationTarget(const AllocationTarget&) = delete;
+  AllocationTarget& operator=(const AllocationTarget&) = delete;
+
+  void* Alloc(size_t size, AllocationKind kind);
+  void Free(void* address, size_t size, AllocationKind kind);
+
+  // Only count allocations made without the memory manager.
+  void AddUsage(size_t size, AllocationKind kind);
+  void RemoveUsage(size_t size, AllocationKind kind);
+
+  const Usage& GetUsage(AllocationKind kind) const {
+    return usage_[static_cast<size_t>(kind)];
+  }
+
+  bool AllowsHugePages() const { return allow_huge_pages_; }
+
+ private:
+  JxlMemoryManager memory_manager_;
+  const bool allow_huge_pages_;
+  Usage usage_[kNumAllocationKinds];
+};
+
 // Functions that depend on the cache line size.
 class CacheAligned {
  public:
   static void PrintStats();
 
+  // CacheAligned allocations of at least `bytes` (any kind, e.g. planes of
+  // large images but also entropy tables or bitstreams) are requested directly
+  // from the OS, aligned to 2 MiB and advised to use transparent huge pages,
+  // which reduces TLB misses. 0 (the default) disables this. Process-wide;
+  // only has an effect on Linux. Does not apply while the current allocation
+  // target (see ScopedAllocationTarget) disallows huge pages, e.g. within
+  // JxlDecoder/JxlEncoder calls of instances created with a custom
+  // JxlMemoryManager.
+  static void SetHugePageThreshold(size_t bytes);
+  static size_t HugePageThreshold();
+
   static constexpr size_t kPointerSize = sizeof(void*);
   static constexpr size_t kCacheLineSize = 64;
   // To avoid RFOs, match L2 fill size (pairs of lines).
@@ -37,13 +101,42 @@ class CacheAligned {
   // This reduces cache conflicts and load/store stalls, especially with large
   // allocations that would otherwise have similar alignments. At least
   // `payload_size` (which can be zero) bytes will be accessible.
-  static void* Allocate(size_t payload_size, size_t offset);
+  static void* Allocate(size_t payload_size, size_t offset,
+                        AllocationKind kind = AllocationKind::kOther);
 
-  static void* Allocate(const size_t payload_size) {
-    return Allocate(payload_size, NextOffset());
+  static void* Allocate(const size_t payload_size,
+                        AllocationKind kind = AllocationKind::kOther) {
+    return Allocate(payload_size, NextOffset(), kind);
   }
 
   static void Free(const void* aligned_pointer);
+
+  // Target of the allocations made by the calling thread; nullptr (the
+  // default) means malloc.
+  static AllocationTarget* CurrentTarget();
+  static void SetCurrentTarget(AllocationTarget* target);
+};
+
+// Makes `target` the current allocation target of the calling thread until
+// destruction. ThreadPool tasks inherit the target of the thread calling Run.
+// Objects that may outlive the target, such as function-local statics, must be
+// created with a nullptr target.
+class ScopedAllocationTarget {
+ public:
+  explicit ScopedAllocationTarget(AllocationTarget* target)
+      : previous_(CacheAligned::CurrentTarget()) {
+    if (target != previous_) CacheAligned::SetCurrentTarget(target);
+  }
+  ~ScopedAllocationTarget() {
+    if (CacheAligned::CurrentTarget() != previous_) {
+      CacheAligned::SetCurrentTarget(previous_);
+    }
+  }
+  ScopedAllocationTarget(const ScopedAllocationTarget&) = delete;
+  ScopedAllocationTarget& operator=(const ScopedAllocationTarget&) = delete;
+
+ private:
+  AllocationTarget* const previous_;
 };
 
 // Avoids the need for a function pointer (deleter) in CacheAlignedUniquePtr.
@@ -56,16 +149,18 @@ struct CacheAlignedDeleter {
 using CacheAlignedUniquePtr = std::unique_ptr<uint8_t[], CacheAlignedDeleter>;
 
 // Does not invoke constructors.
-static inline CacheAlignedUniquePtr AllocateArray(const size_t bytes) {
+static inline CacheAlignedUniquePtr AllocateArray(
+    const size_t bytes, AllocationKind kind = AllocationKind::kOther) {
   return CacheAlignedUniquePtr(
-      static_cast<uint8_t*>(CacheAligned::Allocate(bytes)),
+      static_cast<uint8_t*>(CacheAligned::Allocate(bytes, kind)),
       CacheAlignedDeleter());
 }
 
-static inline CacheAlignedUniquePtr AllocateArray(const size_t bytes,
-                                                  const size_t offset) {
+static inline CacheAlignedUniquePtr AllocateArray(
+    const size_t bytes, const size_t offset,
+    AllocationKind kind = AllocationKind::kOther) {
   return CacheAlignedUniquePtr(
-      static_cast<uint8_t*>(CacheAligned::Allocate(bytes, offset)),
+      static_cast<uint8_t*>(CacheAligned::Allocate(bytes, offset, kind)),
       CacheAlignedDeleter());
 }
 
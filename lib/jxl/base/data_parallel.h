@@ -14,6 +14,7 @@
 
 #include "jxl/parallel_runner.h"
 #include "lib/jxl/base/bits.h"
+#include "lib/jxl/base/cache_aligned.h"
 #include "lib/jxl/base/status.h"
 
 namespace jxl {
@@ -69,12 +70,15 @@ class ThreadPool {
   class RunCallState final {
    public:
     RunCallState(const InitFunc& init_func, const DataFunc& data_func)
-        : init_func_(init_func), data_func_(data_func) {}
+        : init_func_(init_func),
+          data_func_(data_func),
+          allocation_target_(CacheAligned::CurrentTarget()) {}
 
     // JxlParallelRunInit interface.
     static int CallInitFunc(void* jpegxl_opaque, size_t num_threads) {
       const auto* self =
           static_cast<RunCallState<InitFunc, DataFunc>*>(jpegxl_opaque);
+      ScopedAllocationTarget scope(self->allocation_target_);
       // Returns -1 when the internal init function returns false Status to
       // indicate an error.
       return self->init_func_(num_threads) ? 0 : -1;
@@ -85,12 +89,15 @@ class ThreadPool {
                              size_t thread_id) {
       const auto* self =
           static_cast<RunCallState<InitFunc, DataFunc>*>(jpegxl_opaque);
+      ScopedAllocationTarget scope(self->allocation_target_);
       return self->data_func_(value, thread_id);
     }
 
    private:
     const InitFunc& init_func_;
     const DataFunc& data_func_;
+    // Allocations made by tasks go where those of the caller of Run go.
+    AllocationTarget* const allocation_target_;
   };
 
   // Default JxlParallelRunner used when no runner is provided by the
@@ -14,7 +14,8 @@ void PaddedBytes::IncreaseCapacityTo(size_t capacity) {
   new_capacity = std::max<size_t>(64, new_capacity);
 
   // BitWriter writes up to 7 bytes past the end.
-  CacheAlignedUniquePtr new_data = AllocateArray(new_capacity + 8);
+  CacheAlignedUniquePtr new_data =
+      AllocateArray(new_capacity + 8, AllocationKind::kBytes);
   if (new_data == nullptr) {
     // Allocation failed, discard all data to ensure this is noticed.
     size_ = capacity_ = 0;
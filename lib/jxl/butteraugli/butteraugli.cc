@@ -1784,6 +1784,26 @@ ButteraugliComparator::ButteraugliComparator(const Image3F& rgb0,
   sub_.reset(new ButteraugliComparator(SubSample2x(rgb0), params));
 }
 
+ButteraugliComparator::ButteraugliComparator(size_t xsize, size_t ysize,
+                                             const ButteraugliParams& params)
+    : xsize_(xsize), ysize_(ysize), params_(params), temp_(xsize_, ysize_) {}
+
+std::unique_ptr<ButteraugliComparator> ButteraugliComparator::Clone() const {
+  std::unique_ptr<ButteraugliComparator> clone(
+      new ButteraugliComparator(xsize_, ysize_, params_));
+  if (xsize_ < 8 || ysize_ < 8) {
+    return clone;
+  }
+  for (size_t i = 0; i < 2; ++i) {
+    clone->pi0_.uhf[i] = CopyImage(pi0_.uhf[i]);
+    clone->pi0_.hf[i] = CopyImage(pi0_.hf[i]);
+  }
+  clone->pi0_.mf = CopyImage(pi0_.mf);
+  clone->pi0_.lf = CopyImage(pi0_.lf);
+  clone->sub_ = sub_->Clone();
+  return clone;
+}
+
 void ButteraugliComparator::Mask(ImageF* BUTTERAUGLI_RESTRICT mask) const {
   HWY_DYNAMIC_DISPATCH(MaskPsychoImage)
   (pi0_, pi0_, xsize_, ysize_, params_, Temp(), &blur_temp_, mask, nullptr);
@@ -183,7 +183,16 @@ class ButteraugliComparator {
 
   void Mask(ImageF *BUTTERAUGLI_RESTRICT mask) const;
 
+  // Returns a comparator for the same reference image that does not share the
+  // temporary storage of this one, so that both can compute diffmaps
+  // concurrently. Copies the preprocessed reference instead of recomputing it.
+  std::unique_ptr<ButteraugliComparator> Clone() const;
+
  private:
+  // Only allocates the temporary storage, for Clone().
+  ButteraugliComparator(size_t xsize, size_t ysize,
+                        const ButteraugliParams &params);
+
   Image3F *Temp() const;
   void ReleaseTemp() const;
 
@@ -7,6 +7,9 @@
 
 #include "gtest/gtest.h"
 #include "jxl/butteraugli_cxx.h"
+#include "lib/jxl/butteraugli/butteraugli.h"
+#include "lib/jxl/image.h"
+#include "lib/jxl/image_test_utils.h"
 #include "lib/jxl/test_utils.h"
 
 TEST(ButteraugliTest, Lossless) {
@@ -100,3 +103,19 @@ TEST(ButteraugliTest, Api) {
 
   EXPECT_NE(distance1, distance2);
 }
+
+TEST(ButteraugliTest, Clone) {
+  jxl::Image3F orig(171, 219);
+  jxl::RandomFillImage(&orig, 0.0f, 1.0f, 7);
+  jxl::Image3F distorted(171, 219);
+  jxl::RandomFillImage(&distorted, 0.0f, 1.0f, 8);
+
+  jxl::ButteraugliParams params;
+  jxl::ButteraugliComparator comparator(orig, params);
+  std::unique_ptr<jxl::ButteraugliComparator> clone = comparator.Clone();
+  jxl::ImageF diffmap(171, 219);
+  comparator.Diffmap(distorted, diffmap);
+  jxl::ImageF clone_diffmap(171, 219);
+  clone->Diffmap(distorted, clone_diffmap);
+  jxl::VerifyEqual(diffmap, clone_diffmap);
+}
@@ -13,6 +13,7 @@
 #include "lib/jxl/ans_params.h"
 #include "lib/jxl/aux_out.h"
 #include "lib/jxl/aux_out_fwd.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/padded_bytes.h"
 #include "lib/jxl/base/profiler.h"
 #include "lib/jxl/base/span.h"
@@ -43,13 +44,11 @@ uint32_t CoeffOrderContext(uint32_t val) {
 }
 
 namespace {
-Status ReadPermutation(size_t skip, size_t size, coeff_order_t* order,
-                       BitReader* br, ANSSymbolReader* reader,
-                       const std::vector<uint8_t>& context_map) {
-  std::vector<LehmerT> lehmer(size);
-  // temp space needs to be as large as the next power of 2, so doubling the
-  // allocated size is enough.
-  std::vector<uint32_t> temp(size * 2);
+// Reads the Lehmer code of a permutation of `size` elements whose first
+// `skip` elements are fixed.
+Status ReadLehmerCode(size_t skip, size_t size, LehmerT* lehmer, BitReader* br,
+                      ANSSymbolReader* reader,
+                      const std::vector<uint8_t>& context_map) {
   uint32_t end =
       reader->ReadHybridUint(CoeffOrderContext(size), br, context_map) + skip;
   if (end > size) {
@@ -64,11 +63,17 @@ Status ReadPermutation(size_t skip, size_t size, coeff_order_t* order,
       return JXL_FAILURE("Invalid lehmer code");
     }
   }
-  if (order == nullptr) return true;
-  DecodeLehmerCode(lehmer.data(), temp.data(), size, order);
   return true;
 }
 
+void DecodePermutationFromLehmer(const LehmerT* lehmer, size_t size,
+                                 coeff_order_t* order) {
+  // temp space needs to be as large as the next power of 2, so doubling the
+  // allocated size is enough.
+  std::vector<uint32_t> temp(size * 2);
+  DecodeLehmerCode(lehmer, temp.data(), size, order);
+}
+
 }  // namespace
 
 Status DecodePermutation(size_t skip, size_t size, coeff_order_t* order,
@@ -78,37 +83,20 @@ Status DecodePermutation(size_t skip, size_t size, coeff_order_t* order,
   JXL_RETURN_IF_ERROR(
       DecodeHistograms(br, kPermutationContexts, &code, &context_map));
   ANSSymbolReader reader(&code, br);
+  std::vector<LehmerT> lehmer(size);
   JXL_RETURN_IF_ERROR(
-      ReadPermutation(skip, size, order, br, &reader, context_map));
+      ReadLehmerCode(skip, size, lehmer.data(), br, &reader, context_map));
   if (!reader.CheckANSFinalState()) {
     return JXL_FAILURE("Invalid ANS stream");
   }
+  if (order != nullptr) DecodePermutationFromLehmer(lehmer.data(), size, order);
   return true;
 }
 
-namespace {
-
-Status DecodeCoeffOrder(AcStrategy acs, coeff_order_t* order, BitReader* br,
-                        ANSSymbolReader* reader,
-                        const std::vector<uint8_t>& context_map) {
-  PROFILER_FUNC;
-  const size_t llf = acs.covered_blocks_x() * acs.covered_blocks_y();
-  const size_t size = kDCTBlockSize * llf;
-
-  JXL_RETURN_IF_ERROR(
-      ReadPermutation(llf, size, order, br, reader, context_map));
-  if (order == nullptr) return true;
-  const coeff_order_t* natural_coeff_order = acs.NaturalCoeffOrder();
-  for (size_t k = 0; k < size; ++k) {
-    order[k] = natural_coeff_order[order[k]];
-  }
-  return true;
-}
-
-}  // namespace
-
 Status DecodeCoeffOrders(uint16_t used_orders, uint32_t used_acs,
-                         coeff_order_t* order, BitReader* br) {
+                         coeff_order_t* order, BitReader* br,
+                         ThreadPool* pool) {
+  PROFILER_FUNC;
   uint16_t computed = 0;
   std::vector<uint8_t> context_map;
   ANSCode code;
@@ -124,6 +112,16 @@ Status DecodeCoeffOrders(uint16_t used_orders, uint32_t used_acs,
     if ((used_acs & (1 << o)) == 0) continue;
     acs_mask |= 1 << kStrategyOrder[o];
   }
+  // Only reading the permutations is sequential; they are turned into
+  // coefficient orders afterwards, in parallel.
+  struct PendingOrder {
+    uint8_t raw_strategy;
+    coeff_order_t* dest;
+    // Empty for the default order.
+    std::vector<LehmerT> lehmer;
+  };
+  std::vector<PendingOrder> pending;
+  std::vector<LehmerT> unused_lehmer;
   for (uint8_t o = 0; o < AcStrategy::kNumValidStrategies; ++o) {
     uint8_t ord = kStrategyOrder[o];
     if (computed & (1 << ord)) continue;
@@ -134,20 +132,47 @@ Status DecodeCoeffOrders(uint16_t used_orders, uint32_t used_acs,
       // No need to set the default order if no ACS uses this order.
       if (used) {
         for (size_t c = 0; c < 3; c++) {
-          SetDefaultOrder(acs, &order[CoeffOrderOffset(ord, c)]);
+          pending.push_back({o, &order[CoeffOrderOffset(ord, c)], {}});
         }
       }
     } else {
+      const size_t llf = acs.covered_blocks_x() * acs.covered_blocks_y();
+      const size_t size = kDCTBlockSize * llf;
       for (size_t c = 0; c < 3; c++) {
-        coeff_order_t* dest = used ? &order[CoeffOrderOffset(ord, c)] : nullptr;
-        JXL_RETURN_IF_ERROR(
-            DecodeCoeffOrder(acs, dest, br, reader.get(), context_map));
+        LehmerT* lehmer;
+        if (used) {
+          pending.push_back({o, &order[CoeffOrderOffset(ord, c)],
+                             std::vector<LehmerT>(size)});
+          lehmer = pending.back().lehmer.data();
+        } else {
+          unused_lehmer.assign(size, 0);
+          lehmer = unused_lehmer.data();
+        }
+        JXL_RETURN_IF_ERROR(ReadLehmerCode(llf, size, lehmer, br,
+                                           reader.get(), context_map));
       }
     }
   }
   if (used_orders && !reader->CheckANSFinalState()) {
     return JXL_FAILURE("Invalid ANS stream");
   }
+  JXL_RETURN_IF_ERROR(RunOnPool(
+      pool, 0, pending.size(), ThreadPool::SkipInit(),
+      [&](const uint32_t task, size_t /* thread */) {
+        const PendingOrder& p = pending[task];
+        const AcStrategy acs = AcStrategy::FromRawStrategy(p.raw_strategy);
+        if (p.lehmer.empty()) {
+          SetDefaultOrder(acs, p.dest);
+          return;
+        }
+        const size_t size = p.lehmer.size();
+        DecodePermutationFromLehmer(p.lehmer.data(), size, p.dest);
+        const coeff_order_t* natural_coeff_order = acs.NaturalCoeffOrder();
+        for (size_t k = 0; k < size; ++k) {
+          p.dest[k] = natural_coeff_order[p.dest[k]];
+        }
+      },
+      "DecodeCoeffOrders"));
   return true;
 }
 
@@ -12,6 +12,7 @@
 #include "lib/jxl/ac_strategy.h"
 #include "lib/jxl/aux_out_fwd.h"
 #include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/coeff_order_fwd.h"
 #include "lib/jxl/common.h"
@@ -55,8 +56,10 @@ uint32_t CoeffOrderContext(uint32_t val);
 
 void SetDefaultOrder(AcStrategy acs, coeff_order_t* JXL_RESTRICT order);
 
+// The permutations are read sequentially and decoded on `pool`.
 Status DecodeCoeffOrders(uint16_t used_orders, uint32_t used_acs,
-                         coeff_order_t* order, BitReader* br);
+                         coeff_order_t* order, BitReader* br,
+                         ThreadPool* pool = nullptr);
 
 Status DecodePermutation(size_t skip, size_t size, coeff_order_t* order,
                          BitReader* br);
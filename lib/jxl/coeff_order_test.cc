@@ -25,7 +25,7 @@ namespace {
 void RoundtripPermutation(coeff_order_t* perm, coeff_order_t* out, size_t len,
                           size_t* size) {
   BitWriter writer;
-  EncodePermutation(perm, 0, len, &writer, 0, nullptr);
+  EncodePermutation(perm, 0, len, &writer, 0, HistogramParams(), nullptr);
   writer.ZeroPadToByte();
   Status status = true;
   {
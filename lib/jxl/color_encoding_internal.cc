@@ -10,6 +10,7 @@
 #include <array>
 #include <cmath>
 
+#include "lib/jxl/base/cache_aligned.h"
 #include "lib/jxl/color_management.h"
 #include "lib/jxl/common.h"
 #include "lib/jxl/fields.h"
@@ -305,8 +306,12 @@ Status CustomTransferFunction::SetGamma(double gamma) {
 
 namespace {
 
+// Only for the process-wide encodings of SRGB() and LinearSRGB().
 std::array<ColorEncoding, 2> CreateC2(const Primaries pr,
                                       const TransferFunction tf) {
+  // They may be first used by an encoder or decoder, whose allocation target
+  // does not live as long as they do.
+  ScopedAllocationTarget no_target(nullptr);
   std::array<ColorEncoding, 2> c2;
 
   {
@@ -7,6 +7,7 @@
 
 #include <cmath>
 #include <numeric>
+#include <random>
 
 #undef HWY_TARGET_INCLUDE
 #define HWY_TARGET_INCLUDE "lib/jxl/dct_test.cc"
@@ -19,6 +20,7 @@
 #include "lib/jxl/dct-inl.h"
 #include "lib/jxl/dct_for_test.h"
 #include "lib/jxl/dct_scales.h"
+#include "lib/jxl/idct_int16-inl.h"
 #include "lib/jxl/image.h"
 #include "lib/jxl/test_utils.h"
 
@@ -346,6 +348,113 @@ void TestSlowInverseShard(size_t shard) {
   TestSlowInverse<32>(1E-5f, 32 * shard, 32 * (shard + 1));
 }
 
+// The int16 IDCT must stay within a quarter of an 8-bit level of the float one
+// on the blocks it accepts, and accept blocks of (roughly JPEG-quantized)
+// samples in [0, 1] that are not too noisy.
+void TestInt16IDCT() {
+  std::mt19937 rng(17);
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+  double max_error = 0.0;
+  double total_error = 0.0;
+  size_t num_samples = 0;
+  size_t num_smooth_rejected = 0;
+  for (size_t iter = 0; iter < 1000; iter++) {
+    const size_t num_blocks = iter % kIDCTInt16Blocks + 1;
+    HWY_ALIGN int16_t mem[kIDCTInt16MemSize] = {};
+    HWY_ALIGN float expected[kIDCTInt16Blocks][64];
+    HWY_ALIGN float actual[kIDCTInt16Blocks][64];
+    float* pixels[kIDCTInt16Blocks];
+    size_t num_accepted = 0;
+    for (size_t b = 0; b < num_blocks; b++) {
+      HWY_ALIGN float block[64];
+      HWY_ALIGN float coefficients[64];
+      HWY_ALIGN float scratch_space[64];
+      const float x0 = dist(rng);
+      const float y0 = dist(rng);
+      for (size_t i = 0; i < 64; i++) {
+        block[i] = dist(rng);
+        // Hard edges.
+        if (iter % 4 == 1) block[i] = block[i] < 0.5f ? 0.0f : 1.0f;
+        // One straight edge, as in most blocks of actual images.
+        if (iter % 4 == 2) {
+          block[i] = (i % 8) * x0 + (i / 8) * y0 < 4.0f ? 0.1f : 0.9f;
+        }
+        // Gradients with a little noise.
+        if (iter % 4 == 3) {
+          block[i] = ((i % 8) * x0 + (i / 8) * y0) / 16 + 0.05f * block[i];
+        }
+      }
+      ComputeTransposedScaledDCT<8>()(DCTFrom(block, 8), coefficients,
+                                      scratch_space);
+      for (size_t i = 0; i < 64; i++) {
+        coefficients[i] = std::round(coefficients[i] * 255 / 4) * 4 / 255;
+      }
+      if (!LoadCoefficientsInt16(coefficients, num_accepted, mem)) {
+        if (iter % 4 == 3) num_smooth_rejected++;
+        continue;
+      }
+      ComputeTransposedScaledIDCT<8>()(coefficients,
+                                       DCTTo(expected[num_accepted], 8),
+                                       scratch_space);
+      pixels[num_accepted] = actual[num_accepted];
+      num_accepted++;
+    }
+    IDCT8x8Int16(mem, pixels, num_accepted, 8);
+    for (size_t b = 0; b < num_accepted; b++) {
+      for (size_t i = 0; i < 64; i++) {
+        const double error = std::abs(actual[b][i] - expected[b][i]) * 255;
+        max_error = std::max(max_error, error);
+        total_error += error;
+        num_samples++;
+      }
+    }
+  }
+  EXPECT_EQ(0u, num_smooth_rejected);
+  EXPECT_GT(num_samples, 0u);
+  EXPECT_LT(max_error, 0.25);
+  EXPECT_LT(total_error / num_samples, 0.02);
+}
+
+// Blocks close to the magnitude limit must not overflow, whatever the signs
+// of their coefficients, and blocks beyond it must be rejected.
+void TestInt16IDCTLimit() {
+  std::mt19937 rng(18);
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+  double max_error = 0.0;
+  for (size_t iter = 0; iter < 1000; iter++) {
+    HWY_ALIGN float coefficients[64];
+    float magnitude = 0.0f;
+    for (size_t i = 0; i < 64; i++) {
+      // Few large coefficients, so that some outputs get close to the limit.
+      float v = dist(rng);
+      v = v * v * v * v;
+      coefficients[i] = dist(rng) < 0.5f ? -v : v;
+      magnitude += v * kIDCTInt16Weights[i];
+    }
+    const float target = kIDCTInt16MaxMagnitude * (iter % 2 ? 0.99f : 1.01f);
+    for (size_t i = 0; i < 64; i++) coefficients[i] *= target / magnitude;
+
+    HWY_ALIGN int16_t mem[kIDCTInt16MemSize] = {};
+    if (!LoadCoefficientsInt16(coefficients, 0, mem)) {
+      EXPECT_EQ(0u, iter % 2);
+      continue;
+    }
+    EXPECT_EQ(1u, iter % 2);
+    HWY_ALIGN float expected[64];
+    HWY_ALIGN float actual[64];
+    HWY_ALIGN float scratch_space[64];
+    float* pixels[1] = {actual};
+    ComputeTransposedScaledIDCT<8>()(coefficients, DCTTo(expected, 8),
+                                     scratch_space);
+    IDCT8x8Int16(mem, pixels, 1, 8);
+    for (size_t i = 0; i < 64; i++) {
+      max_error = std::max<double>(max_error,
+                                   std::abs(actual[i] - expected[i]) * 255);
+    }
+  }
+  EXPECT_LT(max_error, 0.25);
+}
+
 // NOLINTNEXTLINE(google-readability-namespace-comments)
 }  // namespace HWY_NAMESPACE
 }  // namespace jxl
@@ -363,6 +472,8 @@ HWY_EXPORT_AND_TEST_P(TransposeTest, InverseTest);
 HWY_EXPORT_AND_TEST_P(TransposeTest, ColumnDctRoundtrip);
 HWY_EXPORT_AND_TEST_P(TransposeTest, TestRectInverse);
 HWY_EXPORT_AND_TEST_P(TransposeTest, TestRectTranspose);
+HWY_EXPORT_AND_TEST_P(TransposeTest, TestInt16IDCT);
+HWY_EXPORT_AND_TEST_P(TransposeTest, TestInt16IDCTLimit);
 
 // Tests in the DctShardedTest class are sharded for N=32.
 class DctShardedTest : public ::hwy::TestWithParamTargetAndT<uint32_t> {};
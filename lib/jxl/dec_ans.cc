@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 
+#include <utility>
 #include <vector>
 
 #include "lib/jxl/ans_common.h"
@@ -188,7 +189,7 @@ Status ReadHistogram(int precision_bits, std::vector<int>* counts,
 
 Status DecodeANSCodes(const size_t num_histograms,
                       const size_t max_alphabet_size, BitReader* in,
-                      ANSCode* result) {
+                      ANSCode* result, bool defer_alias_tables) {
   result->degenerate_symbols.resize(num_histograms, -1);
   if (result->use_prefix_code) {
     JXL_ASSERT(max_alphabet_size <= 1 << PREFIX_MAX_BITS);
@@ -226,9 +227,11 @@ Status DecodeANSCodes(const size_t num_histograms,
     JXL_ASSERT(max_alphabet_size <= ANS_MAX_ALPHABET_SIZE);
     result->alias_tables =
         AllocateArray(num_histograms * (1 << result->log_alpha_size) *
-                      sizeof(AliasTable::Entry));
+                          sizeof(AliasTable::Entry),
+                      AllocationKind::kEntropyTables);
     AliasTable::Entry* alias_tables =
         reinterpret_cast<AliasTable::Entry*>(result->alias_tables.get());
+    if (defer_alias_tables) result->pending_counts.resize(num_histograms);
     for (size_t c = 0; c < num_histograms; ++c) {
       std::vector<int> counts;
       if (!ReadHistogram(ANS_LOG_TAB_SIZE, &counts, in)) {
@@ -254,6 +257,10 @@ Status DecodeANSCodes(const size_t num_histograms,
         }
       }
       result->degenerate_symbols[c] = degenerate_symbol;
+      if (defer_alias_tables) {
+        result->pending_counts[c] = std::move(counts);
+        continue;
+      }
       InitAliasTable(counts, ANS_TAB_SIZE, result->log_alpha_size,
                      alias_tables + c * (1 << result->log_alpha_size));
     }
@@ -330,7 +337,8 @@ void ANSCode::UpdateMaxNumBits(size_t ctx, size_t symbol) {
 }
 
 Status DecodeHistograms(BitReader* br, size_t num_contexts, ANSCode* code,
-                        std::vector<uint8_t>* context_map, bool disallow_lz77) {
+                        std::vector<uint8_t>* context_map, bool disallow_lz77,
+                        bool defer_alias_tables) {
   PROFILER_FUNC;
   JXL_RETURN_IF_ERROR(Bundle::Read(br, &code->lz77));
   if (code->lz77.enabled) {
@@ -358,7 +366,8 @@ Status DecodeHistograms(BitReader* br, size_t num_contexts, ANSCode* code,
       DecodeUintConfigs(code->log_alpha_size, &code->uint_config, br));
   const size_t max_alphabet_size = 1 << code->log_alpha_size;
   JXL_RETURN_IF_ERROR(
-      DecodeANSCodes(num_histograms, max_alphabet_size, br, code));
+      DecodeANSCodes(num_histograms, max_alphabet_size, br, code,
+                     defer_alias_tables));
   // When using LZ77, flat codes might result in valid codestreams with
   // histograms that potentially allow very large bit counts.
   // TODO(veluca): in principle, a valid codestream might contain a histogram
@@ -372,4 +381,30 @@ Status DecodeHistograms(BitReader* br, size_t num_contexts, ANSCode* code,
   return true;
 }
 
+Status InitAliasTables(ANSCode* codes, size_t num_codes, ThreadPool* pool) {
+  PROFILER_FUNC;
+  std::vector<std::pair<ANSCode*, size_t>> tables;
+  for (size_t i = 0; i < num_codes; i++) {
+    for (size_t c = 0; c < codes[i].pending_counts.size(); c++) {
+      tables.emplace_back(&codes[i], c);
+    }
+  }
+  JXL_RETURN_IF_ERROR(RunOnPool(
+      pool, 0, tables.size(), ThreadPool::SkipInit(),
+      [&](const uint32_t task, size_t /* thread */) {
+        ANSCode* code = tables[task].first;
+        const size_t c = tables[task].second;
+        AliasTable::Entry* alias_tables =
+            reinterpret_cast<AliasTable::Entry*>(code->alias_tables.get());
+        InitAliasTable(std::move(code->pending_counts[c]), ANS_TAB_SIZE,
+                       code->log_alpha_size,
+                       alias_tables + c * (1 << code->log_alpha_size));
+      },
+      "InitAliasTables"));
+  for (size_t i = 0; i < num_codes; i++) {
+    codes[i].pending_counts.clear();
+  }
+  return true;
+}
+
 }  // namespace jxl
@@ -21,6 +21,7 @@
 #include "lib/jxl/base/byte_order.h"
 #include "lib/jxl/base/cache_aligned.h"
 #include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/dec_bit_reader.h"
 #include "lib/jxl/dec_huffman.h"
 #include "lib/jxl/field_encodings.h"
@@ -139,6 +140,9 @@ struct ANSCode {
   std::vector<HuffmanDecodingData> huffman_data;
   std::vector<HybridUintConfig> uint_config;
   std::vector<int> degenerate_symbols;
+  // Distributions of the ANS histograms whose alias tables have not been
+  // built yet, see InitAliasTables.
+  std::vector<std::vector<int>> pending_counts;
   bool use_prefix_code;
   uint8_t log_alpha_size;  // for ANS.
   LZ77Params lz77;
@@ -167,10 +171,13 @@ class ANSSymbolReader {
     } else {
       state_ = (ANS_SIGNATURE << 16u);
     }
+    fast_prefix_path_ = use_prefix_code_ && !code->lz77.enabled;
+    fast_ans_path_ = !use_prefix_code_ && !code->lz77.enabled;
     if (!code->lz77.enabled) return;
     // a std::vector incurs unacceptable decoding speed loss because of
     // initialization.
-    lz77_window_storage_ = AllocateArray(kWindowSize * sizeof(uint32_t));
+    lz77_window_storage_ = AllocateArray(kWindowSize * sizeof(uint32_t),
+                                         AllocationKind::kEntropyTables);
     lz77_window_ = reinterpret_cast<uint32_t*>(lz77_window_storage_.get());
     lz77_ctx_ = code->lz77.nonserialized_distance_context;
     lz77_length_uint_ = code->lz77.length_uint_config;
@@ -271,7 +278,32 @@ class ANSSymbolReader {
     return static_cast<uint32_t>(ret);
   }
 
-  // Takes a *clustered* idx.
+  // Takes a *clustered* idx. Only valid if UsesFastPrefixPath().
+  JXL_INLINE size_t ReadHybridUintClusteredPrefix(size_t ctx,
+                                                  BitReader* JXL_RESTRICT br) {
+    br->Refill();  // covers ReadSymbol + PeekBits
+    const size_t token = huffman_data_[ctx].ReadSymbol(br);
+    return ReadHybridUintConfig(configs[ctx], token, br);
+  }
+
+  // Whether all symbols are prefix coded and there are no LZ77 copies: there
+  // is then no state between symbols besides the BitReader position.
+  bool UsesFastPrefixPath() const { return fast_prefix_path_; }
+
+  // Takes a *clustered* idx. Only valid if UsesFastANSPath().
+  JXL_INLINE size_t ReadHybridUintClusteredANS(size_t ctx,
+                                               BitReader* JXL_RESTRICT br) {
+    br->Refill();  // covers ReadSymbolANSWithoutRefill + PeekBits
+    const size_t token = ReadSymbolANSWithoutRefill(ctx, br);
+    return ReadHybridUintConfig(configs[ctx], token, br);
+  }
+
+  // Whether all symbols are ANS coded and there are no LZ77 copies.
+  bool UsesFastANSPath() const { return fast_ans_path_; }
+
+  // Takes a *clustered* idx. Callers that decode many symbols should check
+  // UsesFastPrefixPath() or UsesFastANSPath() once and call the specialized
+  // functions instead.
   size_t ReadHybridUintClustered(size_t ctx, BitReader* JXL_RESTRICT br) {
     if (JXL_UNLIKELY(num_to_copy_ > 0)) {
       size_t ret = lz77_window_[(copy_pos_++) & kWindowMask];
@@ -397,6 +429,8 @@ class ANSSymbolReader {
   const AliasTable::Entry* JXL_RESTRICT alias_tables_;  // not owned
   const HuffmanDecodingData* huffman_data_;
   bool use_prefix_code_;
+  bool fast_prefix_path_ = false;
+  bool fast_ans_path_ = false;
   uint32_t state_ = ANS_SIGNATURE << 16u;
   const HybridUintConfig* JXL_RESTRICT configs;
   uint32_t log_alpha_size_;
@@ -418,9 +452,16 @@ class ANSSymbolReader {
   uint32_t num_special_distances_;
 };
 
+// If `defer_alias_tables` is true, the ANS alias tables are only allocated,
+// and InitAliasTables must be called before creating an ANSSymbolReader.
 Status DecodeHistograms(BitReader* br, size_t num_contexts, ANSCode* code,
                         std::vector<uint8_t>* context_map,
-                        bool disallow_lz77 = false);
+                        bool disallow_lz77 = false,
+                        bool defer_alias_tables = false);
+
+// Builds the deferred alias tables of all the histograms of `codes`, in
+// parallel.
+Status InitAliasTables(ANSCode* codes, size_t num_codes, ThreadPool* pool);
 
 // Exposed for tests.
 Status DecodeUintConfigs(size_t log_alpha_size,
@@ -8,6 +8,8 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 #include <hwy/base.h>  // HWY_ALIGN_MAX
 
 #include "lib/jxl/ac_strategy.h"
@@ -75,6 +77,9 @@ struct PassesDecoderState {
   // Whether to use int16 float-XYB-to-uint8-srgb conversion.
   bool fast_xyb_srgb8_conversion;
 
+  // Whether the DCT8 blocks of recompressed JPEGs may use the int16 IDCT.
+  bool fast_jpeg_idct;
+
   // If true, rgb_output or callback output is RGBA using 4 instead of 3 bytes
   // per pixel.
   bool rgb_output_is_rgba;
@@ -92,6 +97,10 @@ struct PassesDecoderState {
   // Keep track of the transform types used.
   std::atomic<uint32_t> used_acs{0};
 
+  // Whether AC groups count the tokens they read per context, in
+  // GroupDecCache::ac_token_counts. Used for bitstream statistics only.
+  bool count_ac_tokens = false;
+
   // Storage for coefficients if in "accumulate" mode.
   std::unique_ptr<ACImage> coefficients = make_unique<ACImageT<int32_t>>(0, 0);
 
@@ -139,7 +148,10 @@ struct PassesDecoderState {
   std::vector<Image3F> padded_upsampling_input_storage;
   std::vector<Image3F> upsampling_input_storage;
   size_t upsampler_arena_size = 0;
-  std::vector<hwy::AlignedFreeUniquePtr<float[]>> upsampler_storage;
+  std::vector<CacheAlignedUniquePtr> upsampler_storage;
+  float* upsampler_arena(size_t thread) {
+    return reinterpret_cast<float*>(upsampler_storage[thread].get());
+  }
   // We keep four arrays, one per upsampling level, to reduce memory usage in
   // the common case of no upsampling.
   std::vector<Image3F> output_pixel_data_storage[4] = {};
@@ -186,7 +198,8 @@ struct PassesDecoderState {
         kApplyImageFeaturesTileDim * shared->frame_header.upsampling);
     if (arena_size > upsampler_arena_size) upsampler_storage.clear();
     for (size_t _ = upsampler_storage.size(); _ < num_threads; _++) {
-      upsampler_storage.emplace_back(hwy::AllocateAligned<float>(arena_size));
+      upsampler_storage.emplace_back(
+          AllocateArray(arena_size * sizeof(float), AllocationKind::kScratch));
     }
     upsampler_arena_size = arena_size;
     for (size_t _ = group_data.size(); _ < num_threads; _++) {
@@ -263,6 +276,7 @@ struct PassesDecoderState {
     pixel_callback = nullptr;
     rgb_output_is_rgba = false;
     fast_xyb_srgb8_conversion = false;
+    fast_jpeg_idct = false;
     used_acs = 0;
 
     group_border_assigner.Init(shared->frame_dim);
@@ -373,16 +387,19 @@ struct GroupDecCache {
       max_block_area_ = max_block_area;
       // We need 3x float blocks for dequantized coefficients and 1x for scratch
       // space for transforms.
-      float_memory_ = hwy::AllocateAligned<float>(max_block_area_ * 4);
+      float_memory_ = AllocateArray(max_block_area_ * 4 * sizeof(float),
+                                    AllocationKind::kScratch);
       // We need 3x int32 or int16 blocks for quantized coefficients.
-      int32_memory_ = hwy::AllocateAligned<int32_t>(max_block_area_ * 3);
-      int16_memory_ = hwy::AllocateAligned<int16_t>(max_block_area_ * 3);
+      int32_memory_ = AllocateArray(max_block_area_ * 3 * sizeof(int32_t),
+                                    AllocationKind::kScratch);
+      int16_memory_ = AllocateArray(max_block_area_ * 3 * sizeof(int16_t),
+                                    AllocationKind::kScratch);
     }
 
-    dec_group_block = float_memory_.get();
+    dec_group_block = reinterpret_cast<float*>(float_memory_.get());
     scratch_space = dec_group_block + max_block_area_ * 3;
-    dec_group_qblock = int32_memory_.get();
-    dec_group_qblock16 = int16_memory_.get();
+    dec_group_qblock = reinterpret_cast<int32_t*>(int32_memory_.get());
+    dec_group_qblock16 = reinterpret_cast<int16_t*>(int16_memory_.get());
   }
 
   // Scratch space used by DecGroupImpl().
@@ -399,10 +416,14 @@ struct GroupDecCache {
   // AC decoding
   Image3I num_nzeroes[kMaxNumPasses];
 
+  // Number of AC tokens read per pass and (non-clustered) context. Only
+  // filled if PassesDecoderState::count_ac_tokens is set.
+  std::vector<uint32_t> ac_token_counts[kMaxNumPasses];
+
  private:
-  hwy::AlignedFreeUniquePtr<float[]> float_memory_;
-  hwy::AlignedFreeUniquePtr<int32_t[]> int32_memory_;
-  hwy::AlignedFreeUniquePtr<int16_t[]> int16_memory_;
+  CacheAlignedUniquePtr float_memory_;
+  CacheAlignedUniquePtr int32_memory_;
+  CacheAlignedUniquePtr int16_memory_;
   size_t max_block_area_ = 0;
 };
 
@@ -334,6 +334,11 @@ Status FrameDecoder::InitFrame(BitReader* JXL_RESTRICT br, ImageBundle* decoded,
   processed_section_.resize(section_offsets_.size());
   max_passes_ = frame_header_.passes.num_passes;
   num_renders_ = 0;
+  for (GroupDecCache& cache : group_dec_caches_) {
+    for (std::vector<uint32_t>& counts : cache.ac_token_counts) {
+      counts.clear();
+    }
+  }
 
   return true;
 }
@@ -481,18 +486,23 @@ Status FrameDecoder::ProcessACGlobal(BitReader* br) {
           used_orders, dec_state_->used_acs,
           &dec_state_->shared_storage
                .coeff_orders[i * dec_state_->shared_storage.coeff_order_size],
-          br));
+          br, pool_));
       size_t num_contexts =
           dec_state_->shared->num_histograms *
           dec_state_->shared_storage.block_ctx_map.NumACContexts();
       JXL_RETURN_IF_ERROR(DecodeHistograms(
-          br, num_contexts, &dec_state_->code[i], &dec_state_->context_map[i]));
+          br, num_contexts, &dec_state_->code[i], &dec_state_->context_map[i],
+          /*disallow_lz77=*/false, /*defer_alias_tables=*/true));
       // Add extra values to enable the cheat in hot loop of DecodeACVarBlock.
       dec_state_->context_map[i].resize(
           num_contexts + kZeroDensityContextLimit - kZeroDensityContextCount);
       max_num_bits_ac =
           std::max(max_num_bits_ac, dec_state_->code[i].max_num_bits);
     }
+    // The alias tables of all the passes are built together.
+    JXL_RETURN_IF_ERROR(InitAliasTables(
+        dec_state_->code.data(),
+        dec_state_->shared_storage.frame_header.passes.num_passes, pool_));
     max_num_bits_ac += CeilLog2Nonzero(
         dec_state_->shared_storage.frame_header.passes.num_passes);
     // 16-bit buffer for decoding to JPEG are not implemented.
@@ -827,6 +837,22 @@ Status FrameDecoder::Flush() {
   return true;
 }
 
+std::vector<std::vector<uint64_t>> FrameDecoder::ACTokenCounts() const {
+  std::vector<std::vector<uint64_t>> counts(frame_header_.passes.num_passes);
+  for (size_t i = 0; i < counts.size(); i++) {
+    for (const GroupDecCache& cache : group_dec_caches_) {
+      const std::vector<uint32_t>& cache_counts = cache.ac_token_counts[i];
+      if (counts[i].size() < cache_counts.size()) {
+        counts[i].resize(cache_counts.size());
+      }
+      for (size_t ctx = 0; ctx < cache_counts.size(); ctx++) {
+        counts[i][ctx] += cache_counts[ctx];
+      }
+    }
+  }
+  return counts;
+}
+
 int FrameDecoder::SavedAs(const FrameHeader& header) {
   if (header.frame_type == FrameType::kDCFrame) {
     // bits 16, 32, 64, 128 for DC level
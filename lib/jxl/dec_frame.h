@@ -8,6 +8,8 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/span.h"
@@ -128,6 +130,18 @@ class FrameDecoder {
 
   // TODO(veluca): remove once we remove --downsampling flag.
   void SetMaxPasses(size_t max_passes) { max_passes_ = max_passes; }
+
+  // If enabled, the AC groups processed afterwards count how many tokens they
+  // read per context, see ACTokenCounts. This disables the fast symbol
+  // decoding paths, so it is only meant for bitstream statistics.
+  void SetCountACTokens(bool count) { dec_state_->count_ac_tokens = count; }
+
+  // Returns, for each pass, the number of AC tokens read so far in this frame
+  // per (non-clustered) AC context: the context index is the one used to look
+  // up the pass's context map, i.e. histogram selector * NumACContexts plus
+  // the BlockCtxMap context. Only VarDCT frames read AC tokens. Entries are
+  // empty if token counting is disabled or no AC group was processed.
+  std::vector<std::vector<uint64_t>> ACTokenCounts() const;
   const FrameHeader& GetFrameHeader() const { return frame_header_; }
 
   // Returns whether a DC image has been decoded, accessible at low resolution
@@ -147,8 +161,12 @@ class FrameDecoder {
   // orientation. Performing this operation is not yet supported, so this
   // results in not setting the buffer if the image has a non-identity EXIF
   // orientation. When outputting to the ImageBundle, no orientation is undone.
+  //
+  // @param is_recompressed_jpeg: if true, the file carries JPEG reconstruction
+  // data, i.e. the frame holds the DCT coefficients of a JPEG.
   void MaybeSetRGB8OutputBuffer(uint8_t* rgb_output, size_t stride,
-                                bool is_rgba, bool undo_orientation) const {
+                                bool is_rgba, bool undo_orientation,
+                                bool is_recompressed_jpeg) const {
     if (!CanDoLowMemoryPath(undo_orientation)) return;
     dec_state_->rgb_output = rgb_output;
     dec_state_->rgb_output_is_rgba = is_rgba;
@@ -161,6 +179,18 @@ class FrameDecoder {
         HasFastXYBTosRGB8() && frame_header_.needs_color_transform()) {
       dec_state_->fast_xyb_srgb8_conversion = true;
     }
+    // The int16 IDCT of recompressed JPEGs changes the 8-bit output by one
+    // level on about 1.2% of the samples compared to the float IDCT, which is
+    // within what JPEG decoders differ by; chroma upsampling and color
+    // conversion stay in float. Whether the quantization tables are JPEG ones
+    // is checked again per group.
+    if (is_recompressed_jpeg && !decoded_->metadata()->xyb_encoded &&
+        frame_header_.encoding == FrameEncoding::kVarDCT &&
+        frame_header_.color_transform != ColorTransform::kXYB &&
+        !frame_header_.loop_filter.gab &&
+        frame_header_.loop_filter.epf_iters == 0) {
+      dec_state_->fast_jpeg_idct = true;
+    }
 #endif
   }
 
@@ -35,6 +35,7 @@
 #include "lib/jxl/dec_xyb.h"
 #include "lib/jxl/entropy_coder.h"
 #include "lib/jxl/epf.h"
+#include "lib/jxl/idct_int16-inl.h"
 #include "lib/jxl/opsin_params.h"
 #include "lib/jxl/quant_weights.h"
 #include "lib/jxl/quantizer-inl.h"
@@ -65,6 +66,13 @@ enum DrawMode {
   kOnlyImageFeatures = 2,
 };
 
+// Whether the frame uses the quantization tables of a recompressed JPEG.
+bool HasJPEGQuantTable(const DequantMatrices& matrices) {
+  const std::vector<QuantEncoding>& qe = matrices.encodings();
+  return !qe.empty() && qe[0].mode == QuantEncoding::Mode::kQuantModeRAW &&
+         std::abs(qe[0].qraw.qtable_den - 1.f / (8 * 255)) <= 1e-8f;
+}
+
 }  // namespace jxl
 #endif  // LIB_JXL_DEC_GROUP_CC
 
@@ -217,13 +225,12 @@ Status DecodeGroupImpl(GetBlock* JXL_RESTRICT get_block,
     jpeg_is_gray = (decoded->jpeg_data->components.size() == 1);
     jpeg_c_map = JpegOrder(dec_state->shared->frame_header.color_transform,
                            jpeg_is_gray);
-    const std::vector<QuantEncoding>& qe =
-        dec_state->shared->matrices.encodings();
-    if (qe.empty() || qe[0].mode != QuantEncoding::Mode::kQuantModeRAW ||
-        std::abs(qe[0].qraw.qtable_den - 1.f / (8 * 255)) > 1e-8f) {
+    if (!HasJPEGQuantTable(dec_state->shared->matrices)) {
       return JXL_FAILURE(
           "Quantization table is not a JPEG quantization table.");
     }
+    const std::vector<QuantEncoding>& qe =
+        dec_state->shared->matrices.encodings();
     for (size_t c = 0; c < 3; c++) {
       if (dec_state->shared->frame_header.color_transform ==
           ColorTransform::kNone) {
@@ -242,6 +249,12 @@ Status DecodeGroupImpl(GetBlock* JXL_RESTRICT get_block,
     }
   }
 
+  // Pixels of recompressed JPEGs that are decoded to 8 bits can use the
+  // (less precise) int16 IDCT for their DCT8 blocks.
+  const bool int16_idct = !decoded->IsJPEG() && dec_state->fast_jpeg_idct &&
+                          HasJPEGQuantTable(dec_state->shared->matrices);
+  HWY_ALIGN int16_t int16_idct_mem[kIDCTInt16MemSize] = {};
+
   size_t hshift[3] = {cs.HShift(0), cs.HShift(1), cs.HShift(2)};
   size_t vshift[3] = {cs.VShift(0), cs.VShift(1), cs.VShift(2)};
   Rect r[3];
@@ -419,14 +432,41 @@ Status DecodeGroupImpl(GetBlock* JXL_RESTRICT get_block,
               dec_state->output_encoding_info.opsin_params.quant_biases, qblock,
               block);
 
-          for (size_t c : {1, 0, 2}) {
-            if ((sbx[c] << hshift[c] != bx) || (sby[c] << vshift[c] != by)) {
-              continue;
+          if (int16_idct && acs.Strategy() == AcStrategy::Type::DCT) {
+            // Transform the channels kIDCTInt16Blocks at a time, and those
+            // with too large coefficients for 16 bits in float.
+            float* JXL_RESTRICT pending[kIDCTInt16Blocks];
+            size_t num_pending = 0;
+            for (size_t c : {1, 0, 2}) {
+              if ((sbx[c] << hshift[c] != bx) || (sby[c] << vshift[c] != by)) {
+                continue;
+              }
+              float* JXL_RESTRICT idct_pos = idct_row[c] + sbx[c] * kBlockDim;
+              if (!LoadCoefficientsInt16(block + c * size, num_pending,
+                                         int16_idct_mem)) {
+                TransformToPixels(acs.Strategy(), block + c * size, idct_pos,
+                                  idct_stride, group_dec_cache->scratch_space);
+                continue;
+              }
+              pending[num_pending++] = idct_pos;
+              if (num_pending == kIDCTInt16Blocks) {
+                IDCT8x8Int16(int16_idct_mem, pending, num_pending, idct_stride);
+                num_pending = 0;
+              }
+            }
+            if (num_pending != 0) {
+              IDCT8x8Int16(int16_idct_mem, pending, num_pending, idct_stride);
+            }
+          } else {
+            for (size_t c : {1, 0, 2}) {
+              if ((sbx[c] << hshift[c] != bx) || (sby[c] << vshift[c] != by)) {
+                continue;
+              }
+              // IDCT
+              float* JXL_RESTRICT idct_pos = idct_row[c] + sbx[c] * kBlockDim;
+              TransformToPixels(acs.Strategy(), block + c * size, idct_pos,
+                                idct_stride, group_dec_cache->scratch_space);
             }
-            // IDCT
-            float* JXL_RESTRICT idct_pos = idct_row[c] + sbx[c] * kBlockDim;
-            TransformToPixels(acs.Strategy(), block + c * size, idct_pos,
-                              idct_stride, group_dec_cache->scratch_space);
           }
         }
         bx += llf_x;
@@ -452,6 +492,54 @@ HWY_AFTER_NAMESPACE();
 #if HWY_ONCE
 namespace jxl {
 namespace {
+// How DecodeACCoefficients reads symbols; the choice is made once per block
+// instead of once per coefficient.
+enum class ACSymbolPath { kPrefix, kANS, kGeneric };
+
+// Decodes the non-LLF coefficients of a block, in coefficient order, until
+// `nzeros` non-zero ones have been read, and adds them (shifted left by
+// `shift`) to `block`. `ctx_map` maps ZeroDensityContext values of the block
+// context to clustered contexts. If `count_tokens`, also increments
+// `token_counts` at the ZeroDensityContext of every token. Returns the number
+// of non-zeros that are still missing when the end of the block is reached.
+template <ACType ac_type, ACSymbolPath path, bool count_tokens>
+JXL_INLINE size_t DecodeACCoefficients(
+    size_t nzeros, size_t size, size_t log2_covered_blocks,
+    const uint8_t* JXL_RESTRICT ctx_map,
+    const coeff_order_t* JXL_RESTRICT order, size_t shift,
+    BitReader* JXL_RESTRICT br, ANSSymbolReader* JXL_RESTRICT decoder,
+    ACPtr block, uint32_t* JXL_RESTRICT token_counts) {
+  const size_t covered_blocks = 1 << log2_covered_blocks;
+  size_t prev = (nzeros > size / 16 ? 0 : 1);
+  for (size_t k = covered_blocks; k < size && nzeros != 0; ++k) {
+    const size_t raw_ctx = ZeroDensityContext(nzeros, k, covered_blocks,
+                                              log2_covered_blocks, prev);
+    if (count_tokens) ++token_counts[raw_ctx];
+    const size_t ctx = ctx_map[raw_ctx];
+    const size_t u_coeff =
+        path == ACSymbolPath::kPrefix
+            ? decoder->ReadHybridUintClusteredPrefix(ctx, br)
+            : path == ACSymbolPath::kANS
+                  ? decoder->ReadHybridUintClusteredANS(ctx, br)
+                  : decoder->ReadHybridUintClustered(ctx, br);
+    // Hand-rolled version of UnpackSigned, shifting before the conversion to
+    // signed integer to avoid undefined behavior of shifting negative
+    // numbers.
+    const size_t magnitude = u_coeff >> 1;
+    const size_t neg_sign = (~u_coeff) & 1;
+    const intptr_t coeff =
+        static_cast<intptr_t>((magnitude ^ (neg_sign - 1)) << shift);
+    if (ac_type == ACType::k16) {
+      block.ptr16[order[k]] += coeff;
+    } else {
+      block.ptr32[order[k]] += coeff;
+    }
+    prev = static_cast<size_t>(u_coeff != 0);
+    nzeros -= prev;
+  }
+  return nzeros;
+}
+
 // Decode quantized AC coefficients of DCT blocks.
 // LLF components in the output block will not be modified.
 template <ACType ac_type>
@@ -466,7 +554,7 @@ Status DecodeACVarBlock(size_t ctx_offset, size_t log2_covered_blocks,
                         const std::vector<uint8_t>& context_map,
                         const uint8_t* qdc_row, const int32_t* qf_row,
                         const BlockCtxMap& block_ctx_map, ACPtr block,
-                        size_t shift = 0) {
+                        size_t shift, uint32_t* JXL_RESTRICT token_counts) {
   PROFILER_FUNC;
   // Equal to number of LLF coefficients.
   const size_t covered_blocks = 1 << log2_covered_blocks;
@@ -483,6 +571,7 @@ Status DecodeACVarBlock(size_t ctx_offset, size_t log2_covered_blocks,
       block_ctx_map.NonZeroContext(predicted_nzeros, block_ctx) + ctx_offset;
 
   size_t nzeros = decoder->ReadHybridUint(nzero_ctx, br, context_map);
+  if (JXL_UNLIKELY(token_counts != nullptr)) ++token_counts[nzero_ctx];
   if (nzeros + covered_blocks > size) {
     return JXL_FAILURE("Invalid AC: nzeros too large");
   }
@@ -499,26 +588,23 @@ Status DecodeACVarBlock(size_t ctx_offset, size_t log2_covered_blocks,
   // Skip LLF
   {
     PROFILER_ZONE("AcDecSkipLLF, reader");
-    size_t prev = (nzeros > size / 16 ? 0 : 1);
-    for (size_t k = covered_blocks; k < size && nzeros != 0; ++k) {
-      const size_t ctx =
-          histo_offset + ZeroDensityContext(nzeros, k, covered_blocks,
-                                            log2_covered_blocks, prev);
-      const size_t u_coeff = decoder->ReadHybridUint(ctx, br, context_map);
-      // Hand-rolled version of UnpackSigned, shifting before the conversion to
-      // signed integer to avoid undefined behavior of shifting negative
-      // numbers.
-      const size_t magnitude = u_coeff >> 1;
-      const size_t neg_sign = (~u_coeff) & 1;
-      const intptr_t coeff =
-          static_cast<intptr_t>((magnitude ^ (neg_sign - 1)) << shift);
-      if (ac_type == ACType::k16) {
-        block.ptr16[order[k]] += coeff;
-      } else {
-        block.ptr32[order[k]] += coeff;
-      }
-      prev = static_cast<size_t>(u_coeff != 0);
-      nzeros -= prev;
+    const uint8_t* JXL_RESTRICT ctx_map = context_map.data() + histo_offset;
+    if (JXL_UNLIKELY(token_counts != nullptr)) {
+      nzeros = DecodeACCoefficients<ac_type, ACSymbolPath::kGeneric, true>(
+          nzeros, size, log2_covered_blocks, ctx_map, order, shift, br,
+          decoder, block, token_counts + histo_offset);
+    } else if (decoder->UsesFastANSPath()) {
+      nzeros = DecodeACCoefficients<ac_type, ACSymbolPath::kANS, false>(
+          nzeros, size, log2_covered_blocks, ctx_map, order, shift, br,
+          decoder, block, nullptr);
+    } else if (decoder->UsesFastPrefixPath()) {
+      nzeros = DecodeACCoefficients<ac_type, ACSymbolPath::kPrefix, false>(
+          nzeros, size, log2_covered_blocks, ctx_map, order, shift, br,
+          decoder, block, nullptr);
+    } else {
+      nzeros = DecodeACCoefficients<ac_type, ACSymbolPath::kGeneric, false>(
+          nzeros, size, log2_covered_blocks, ctx_map, order, shift, br,
+          decoder, block, nullptr);
     }
     if (JXL_UNLIKELY(nzeros != 0)) {
       return JXL_FAILURE(
@@ -568,7 +654,8 @@ struct GetBlockFromBitstream : public GetBlock {
             row_nzeros_top[pass][c], nzeros_stride, c, sbx, sby, bx, acs,
             &coeff_orders[pass * coeff_order_size], readers[pass],
             &decoders[pass], context_map[pass], quant_dc_row, qf_row,
-            *block_ctx_map, block[c], shift_for_pass[pass]));
+            *block_ctx_map, block[c], shift_for_pass[pass],
+            token_counts[pass]));
       }
     }
     return true;
@@ -609,6 +696,14 @@ struct GetBlockFromBitstream : public GetBlock {
 
       decoders[pass] =
           ANSSymbolReader(&dec_state->code[pass + first_pass], readers[pass]);
+
+      token_counts[pass] = nullptr;
+      if (dec_state->count_ac_tokens) {
+        std::vector<uint32_t>& counts =
+            group_dec_cache->ac_token_counts[pass + first_pass];
+        counts.resize(context_map[pass].size());
+        token_counts[pass] = counts.data();
+      }
     }
     nzeros_stride = group_dec_cache->num_nzeroes[0].PixelsPerRow();
     for (size_t i = 0; i < num_passes; i++) {
@@ -627,6 +722,7 @@ struct GetBlockFromBitstream : public GetBlock {
   BitReader* JXL_RESTRICT* JXL_RESTRICT readers;
   size_t num_passes;
   size_t ctx_offset[kMaxNumPasses];
+  uint32_t* JXL_RESTRICT token_counts[kMaxNumPasses];
   size_t nzeros_stride;
   int32_t* JXL_RESTRICT row_nzeros[kMaxNumPasses][3];
   const int32_t* JXL_RESTRICT row_nzeros_top[kMaxNumPasses][3];
@@ -721,7 +817,7 @@ Status DecodeGroup(BitReader* JXL_RESTRICT* JXL_RESTRICT readers,
         static_cast<ssize_t>(src_rect.y0()) -
             static_cast<ssize_t>(copy_rect.y0()),
         dec_state->shared->frame_dim.ysize_blocks,
-        dec_state->upsampler_storage[thread].get());
+        dec_state->upsampler_arena(thread));
     draw = kOnlyImageFeatures;
   }
 
@@ -9,6 +9,7 @@
 #include <memory>
 #include <vector>
 
+#include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/dec_bit_reader.h"
 #include "lib/jxl/huffman_table.h"
 
@@ -22,7 +23,20 @@ struct HuffmanDecodingData {
   // Returns false if the Huffman code lengths can not de decoded.
   bool ReadFromBitStream(size_t alphabet_size, BitReader* br);
 
-  uint16_t ReadSymbol(BitReader* br) const;
+  // Requires at least 15 (PREFIX_MAX_BITS) valid bits in `br`'s buffer.
+  JXL_INLINE uint16_t ReadSymbol(BitReader* br) const {
+    const HuffmanCode* table = table_.data();
+    table += br->PeekBits(kHuffmanTableBits);
+    size_t n_bits = table->bits;
+    if (JXL_UNLIKELY(n_bits > kHuffmanTableBits)) {
+      br->Consume(kHuffmanTableBits);
+      n_bits -= kHuffmanTableBits;
+      table += table->value;
+      table += br->PeekBits(n_bits);
+    }
+    br->Consume(table->bits);
+    return table->value;
+  }
 
   std::vector<HuffmanCode> table_;
 };
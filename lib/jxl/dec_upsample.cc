@@ -63,15 +63,19 @@ void InitKernel(const float* weights, CacheAlignedUniquePtr* kernel_storage,
   }
 }
 
-template <size_t N, size_t x_repeat>
-void Upsample(const ImageF& src, const Rect& src_rect, ImageF* dst,
-              const Rect& dst_rect, const float* kernels,
+// Upsamples C planes that share the same geometry at once: every kernel
+// vector is loaded once and applied to all the planes.
+template <size_t N, size_t x_repeat, size_t C>
+void Upsample(const ImageF* const* src, const Rect& src_rect,
+              ImageF* const* dst, const Rect& dst_rect, const float* kernels,
               ssize_t image_y_offset, size_t image_ysize, float* arena) {
   constexpr const size_t M = 2 * Upsampler::filter_radius() + 1;
   constexpr const size_t M2 = M / 2;
   JXL_DASSERT(src_rect.x0() >= M2);
   const size_t src_x_limit = src_rect.x0() + src_rect.xsize() + M2;
-  JXL_DASSERT(src_x_limit <= src.xsize());
+  for (size_t c = 0; c < C; c++) {
+    JXL_DASSERT(src_x_limit <= src[c]->xsize());
+  }
   JXL_ASSERT(DivCeil(dst_rect.xsize(), N) <= src_rect.xsize());
   // TODO(eustas): add proper (src|dst) ysize check that accounts for mirroring.
 
@@ -90,23 +94,31 @@ void Upsample(const ImageF& src, const Rect& src_rect, ImageF* dst,
   // Round-down to complete vectors.
   const size_t dsx_v = V * (dsx / V);
 
-  float* JXL_RESTRICT in = arena;
-  arena += RoundUpTo(num_coeffs, V);
-  float* JXL_RESTRICT out = arena;
-  arena += stride;
-  float* JXL_RESTRICT raw_min_row = arena;
-  arena += RoundUpTo(dsx + V, V);
-  float* JXL_RESTRICT raw_max_row = arena;
-  arena += RoundUpTo(dsx + V, V);
-  float* JXL_RESTRICT min_row = arena;
-  arena += RoundUpTo(rsx * N + V, V);
-  float* JXL_RESTRICT max_row = arena;
-  arena += RoundUpTo(rsx * N + V, V);
-
-  memset(raw_min_row + dsx_v, 0, sizeof(float) * (V + dsx - dsx_v));
-  memset(raw_max_row + dsx_v, 0, sizeof(float) * (V + dsx - dsx_v));
-  memset(min_row + dst_rect.xsize(), 0, sizeof(float) * V);
-  memset(max_row + dst_rect.xsize(), 0, sizeof(float) * V);
+  float* JXL_RESTRICT in[C];
+  float* JXL_RESTRICT out[C];
+  float* JXL_RESTRICT raw_min_row[C];
+  float* JXL_RESTRICT raw_max_row[C];
+  float* JXL_RESTRICT min_row[C];
+  float* JXL_RESTRICT max_row[C];
+  for (size_t c = 0; c < C; c++) {
+    in[c] = arena;
+    arena += RoundUpTo(num_coeffs, V);
+    out[c] = arena;
+    arena += stride;
+    raw_min_row[c] = arena;
+    arena += RoundUpTo(dsx + V, V);
+    raw_max_row[c] = arena;
+    arena += RoundUpTo(dsx + V, V);
+    min_row[c] = arena;
+    arena += RoundUpTo(rsx * N + V, V);
+    max_row[c] = arena;
+    arena += RoundUpTo(rsx * N + V, V);
+
+    memset(raw_min_row[c] + dsx_v, 0, sizeof(float) * (V + dsx - dsx_v));
+    memset(raw_max_row[c] + dsx_v, 0, sizeof(float) * (V + dsx - dsx_v));
+    memset(min_row[c] + dst_rect.xsize(), 0, sizeof(float) * V);
+    memset(max_row[c] + dst_rect.xsize(), 0, sizeof(float) * V);
+  }
 
   // For min/max reduction.
   const size_t span_tail_len = M % V;
@@ -119,85 +131,92 @@ void Upsample(const ImageF& src, const Rect& src_rect, ImageF* dst,
   // sx and sy correspond to offset in source image.
   // x and y correspond to top-left pixel offset in upsampled output image.
   for (size_t y = 0; y < dst_rect.ysize(); y += N) {
-    const float* src_rows[M];
+    const float* src_rows[C][M];
     const size_t sy = y / N;
     const ssize_t top = static_cast<ssize_t>(sy + src_rect.y0() - M2);
     for (size_t iy = 0; iy < M; iy++) {
       const ssize_t image_y = top + iy + image_y_offset;
-      src_rows[iy] = src.Row(Mirror(image_y, image_ysize) - image_y_offset);
+      const size_t row = Mirror(image_y, image_ysize) - image_y_offset;
+      for (size_t c = 0; c < C; c++) src_rows[c][iy] = src[c]->Row(row);
     }
     const size_t sx0 = src_rect.x0() - M2;
-    for (size_t sx = 0; sx < dsx_v; sx += V) {
-      static_assert(M == 5, "Filter diameter is expected to be 5");
-      const auto r0 = LoadU(df, src_rows[0] + sx0 + sx);
-      const auto r1 = LoadU(df, src_rows[1] + sx0 + sx);
-      const auto r2 = LoadU(df, src_rows[2] + sx0 + sx);
-      const auto r3 = LoadU(df, src_rows[3] + sx0 + sx);
-      const auto r4 = LoadU(df, src_rows[4] + sx0 + sx);
-      const auto min0 = Min(r0, r1);
-      const auto max0 = Max(r0, r1);
-      const auto min1 = Min(r2, r3);
-      const auto max1 = Max(r2, r3);
-      const auto min2 = Min(min0, r4);
-      const auto max2 = Max(max0, r4);
-      Store(Min(min1, min2), df, raw_min_row + sx);
-      Store(Max(max1, max2), df, raw_max_row + sx);
-    }
-    for (size_t sx = dsx_v; sx < dsx; sx++) {
-      static_assert(M == 5, "Filter diameter is expected to be 5");
-      const auto r0 = src_rows[0][sx0 + sx];
-      const auto r1 = src_rows[1][sx0 + sx];
-      const auto r2 = src_rows[2][sx0 + sx];
-      const auto r3 = src_rows[3][sx0 + sx];
-      const auto r4 = src_rows[4][sx0 + sx];
-      const auto min0 = std::min(r0, r1);
-      const auto max0 = std::max(r0, r1);
-      const auto min1 = std::min(r2, r3);
-      const auto max1 = std::max(r2, r3);
-      const auto min2 = std::min(min0, r4);
-      const auto max2 = std::max(max0, r4);
-      raw_min_row[sx] = std::min(min1, min2);
-      raw_max_row[sx] = std::max(max1, max2);
-    }
-
-    for (size_t sx = 0; sx < rsx; sx++) {
-      decltype(Zero(df)) min, max;
-      if (has_span_tail) {
-        auto dummy = Set(df, raw_min_row[sx]);
-        min = IfThenElse(span_tail_mask,
-                         LoadU(df, raw_min_row + sx + span_tail_start), dummy);
-        max = IfThenElse(span_tail_mask,
-                         LoadU(df, raw_max_row + sx + span_tail_start), dummy);
-      } else {
-        min = LoadU(df, raw_min_row + sx);
-        max = LoadU(df, raw_max_row + sx);
+    for (size_t c = 0; c < C; c++) {
+      for (size_t sx = 0; sx < dsx_v; sx += V) {
+        static_assert(M == 5, "Filter diameter is expected to be 5");
+        const auto r0 = LoadU(df, src_rows[c][0] + sx0 + sx);
+        const auto r1 = LoadU(df, src_rows[c][1] + sx0 + sx);
+        const auto r2 = LoadU(df, src_rows[c][2] + sx0 + sx);
+        const auto r3 = LoadU(df, src_rows[c][3] + sx0 + sx);
+        const auto r4 = LoadU(df, src_rows[c][4] + sx0 + sx);
+        const auto min0 = Min(r0, r1);
+        const auto max0 = Max(r0, r1);
+        const auto min1 = Min(r2, r3);
+        const auto max1 = Max(r2, r3);
+        const auto min2 = Min(min0, r4);
+        const auto max2 = Max(max0, r4);
+        Store(Min(min1, min2), df, raw_min_row[c] + sx);
+        Store(Max(max1, max2), df, raw_max_row[c] + sx);
       }
-      for (size_t fx = span_start; fx < span_tail_start; fx += V) {
-        min = Min(LoadU(df, raw_min_row + sx + fx), min);
-        max = Max(LoadU(df, raw_max_row + sx + fx), max);
+      for (size_t sx = dsx_v; sx < dsx; sx++) {
+        static_assert(M == 5, "Filter diameter is expected to be 5");
+        const auto r0 = src_rows[c][0][sx0 + sx];
+        const auto r1 = src_rows[c][1][sx0 + sx];
+        const auto r2 = src_rows[c][2][sx0 + sx];
+        const auto r3 = src_rows[c][3][sx0 + sx];
+        const auto r4 = src_rows[c][4][sx0 + sx];
+        const auto min0 = std::min(r0, r1);
+        const auto max0 = std::max(r0, r1);
+        const auto min1 = std::min(r2, r3);
+        const auto max1 = std::max(r2, r3);
+        const auto min2 = std::min(min0, r4);
+        const auto max2 = std::max(max0, r4);
+        raw_min_row[c][sx] = std::min(min1, min2);
+        raw_max_row[c][sx] = std::max(max1, max2);
       }
-      min = MinOfLanes(min);
-      max = MaxOfLanes(max);
-      for (size_t lx = 0; lx < N; lx += V) {
-        StoreU(min, df, min_row + N * sx + lx);
-        StoreU(max, df, max_row + N * sx + lx);
+
+      for (size_t sx = 0; sx < rsx; sx++) {
+        decltype(Zero(df)) min, max;
+        if (has_span_tail) {
+          auto dummy = Set(df, raw_min_row[c][sx]);
+          min = IfThenElse(span_tail_mask,
+                           LoadU(df, raw_min_row[c] + sx + span_tail_start),
+                           dummy);
+          max = IfThenElse(span_tail_mask,
+                           LoadU(df, raw_max_row[c] + sx + span_tail_start),
+                           dummy);
+        } else {
+          min = LoadU(df, raw_min_row[c] + sx);
+          max = LoadU(df, raw_max_row[c] + sx);
+        }
+        for (size_t fx = span_start; fx < span_tail_start; fx += V) {
+          min = Min(LoadU(df, raw_min_row[c] + sx + fx), min);
+          max = Max(LoadU(df, raw_max_row[c] + sx + fx), max);
+        }
+        min = MinOfLanes(min);
+        max = MaxOfLanes(max);
+        for (size_t lx = 0; lx < N; lx += V) {
+          StoreU(min, df, min_row[c] + N * sx + lx);
+          StoreU(max, df, max_row[c] + N * sx + lx);
+        }
       }
     }
 
     for (size_t x = 0; x < dst_rect.xsize(); x += NX) {
       const size_t sx = x / N;
       const size_t xbase = sx + sx0;
-      // Copy input pixels for "linearization".
-      for (size_t iy = 0; iy < M; iy++) {
-        memcpy(in + MX * iy, src_rows[iy] + xbase, MX * sizeof(float));
-      }
-      if (x_repeat > 1) {
-        // Even if filter coeffs contain 0 at "undefined" values, the result
-        // might be undefined, because NaN will poison the sum.
-        if (JXL_UNLIKELY(xbase + MX > src_x_limit)) {
-          for (size_t iy = 0; iy < M; iy++) {
-            for (size_t ix = src_x_limit - xbase; ix < MX; ++ix) {
-              in[MX * iy + ix] = 0.0f;
+      for (size_t c = 0; c < C; c++) {
+        // Copy input pixels for "linearization".
+        for (size_t iy = 0; iy < M; iy++) {
+          memcpy(in[c] + MX * iy, src_rows[c][iy] + xbase, MX * sizeof(float));
+        }
+        if (x_repeat > 1) {
+          // Even if filter coeffs contain 0 at "undefined" values, the result
+          // might be undefined, because NaN will poison the sum.
+          if (JXL_UNLIKELY(xbase + MX > src_x_limit)) {
+            for (size_t iy = 0; iy < M; iy++) {
+              for (size_t ix = src_x_limit - xbase; ix < MX; ++ix) {
+                in[c][MX * iy + ix] = 0.0f;
+              }
             }
           }
         }
@@ -207,47 +226,56 @@ void Upsample(const ImageF& src, const Rect& src_rect, ImageF* dst,
       constexpr size_t tail_length = num_coeffs - tail;
       for (size_t kernel_idx = 0; kernel_idx < num_kernels; kernel_idx += V) {
         const float* JXL_RESTRICT kernel_base = kernels + kernel_idx;
-        decltype(Zero(df)) results[U];
+        decltype(Zero(df)) results[C][U];
         for (size_t i = 0; i < U; i++) {
-          results[i] = Set(df, in[i]) * Load(df, kernel_base + i * stride);
+          const auto k = Load(df, kernel_base + i * stride);
+          for (size_t c = 0; c < C; c++) {
+            results[c][i] = Set(df, in[c][i]) * k;
+          }
         }
         for (size_t i = U; i < tail; i += U) {
           for (size_t j = 0; j < U; ++j) {
-            results[j] =
-                MulAdd(Set(df, in[i + j]),
-                       Load(df, kernel_base + (i + j) * stride), results[j]);
+            const auto k = Load(df, kernel_base + (i + j) * stride);
+            for (size_t c = 0; c < C; c++) {
+              results[c][j] = MulAdd(Set(df, in[c][i + j]), k, results[c][j]);
+            }
           }
         }
         for (size_t i = 0; i < tail_length; ++i) {
-          results[i] =
-              MulAdd(Set(df, in[tail + i]),
-                     Load(df, kernel_base + (tail + i) * stride), results[i]);
+          const auto k = Load(df, kernel_base + (tail + i) * stride);
+          for (size_t c = 0; c < C; c++) {
+            results[c][i] = MulAdd(Set(df, in[c][tail + i]), k, results[c][i]);
+          }
+        }
+        for (size_t c = 0; c < C; c++) {
+          auto result = results[c][0];
+          for (size_t i = 1; i < U; ++i) result += results[c][i];
+          Store(result, df, out[c] + kernel_idx);
         }
-        auto result = results[0];
-        for (size_t i = 1; i < U; ++i) result += results[i];
-        Store(result, df, out + kernel_idx);
       }
       const size_t oy_max = std::min<size_t>(dst_rect.ysize(), y + N);
       const size_t ox_max = std::min<size_t>(dst_rect.xsize(), x + NX);
       const size_t copy_len = ox_max - x;
       const size_t copy_last = RoundUpTo(copy_len, V);
-      if (JXL_LIKELY(x + copy_last <= dst_rect.xsize())) {
-        for (size_t dx = 0; dx < copy_len; dx += V) {
-          auto min = LoadU(df, min_row + x + dx);
-          auto max = LoadU(df, max_row + x + dx);
-          float* pixels = out;
-          for (size_t oy = sy * N; oy < oy_max; ++oy, pixels += NX) {
-            StoreU(Clamp(LoadU(df, pixels + dx), min, max), df,
-                   dst_rect.Row(dst, oy) + x + dx);
+      for (size_t c = 0; c < C; c++) {
+        if (JXL_LIKELY(x + copy_last <= dst_rect.xsize())) {
+          for (size_t dx = 0; dx < copy_len; dx += V) {
+            auto min = LoadU(df, min_row[c] + x + dx);
+            auto max = LoadU(df, max_row[c] + x + dx);
+            float* pixels = out[c];
+            for (size_t oy = sy * N; oy < oy_max; ++oy, pixels += NX) {
+              StoreU(Clamp(LoadU(df, pixels + dx), min, max), df,
+                     dst_rect.Row(dst[c], oy) + x + dx);
+            }
           }
-        }
-      } else {
-        for (size_t dx = 0; dx < copy_len; dx++) {
-          auto min = min_row[x + dx];
-          auto max = max_row[x + dx];
-          float* pixels = out;
-          for (size_t oy = sy * N; oy < oy_max; ++oy, pixels += NX) {
-            dst_rect.Row(dst, oy)[x + dx] = Clamp1(pixels[dx], min, max);
+        } else {
+          for (size_t dx = 0; dx < copy_len; dx++) {
+            auto min = min_row[c][x + dx];
+            auto max = max_row[c][x + dx];
+            float* pixels = out[c];
+            for (size_t oy = sy * N; oy < oy_max; ++oy, pixels += NX) {
+              dst_rect.Row(dst[c], oy)[x + dx] = Clamp1(pixels[dx], min, max);
+            }
           }
         }
       }
@@ -255,34 +283,56 @@ void Upsample(const ImageF& src, const Rect& src_rect, ImageF* dst,
   }
 }
 
+template <size_t N, size_t x_repeat>
+void UpsampleChannels(const ImageF* const* src, const Rect& src_rect,
+                      ImageF* const* dst, const Rect& dst_rect,
+                      const float* kernels, ssize_t image_y_offset,
+                      size_t image_ysize, float* arena, size_t num_channels) {
+  if (num_channels == 3) {
+    Upsample<N, x_repeat, 3>(src, src_rect, dst, dst_rect, kernels,
+                             image_y_offset, image_ysize, arena);
+  } else {
+    for (size_t c = 0; c < num_channels; c++) {
+      Upsample<N, x_repeat, 1>(src + c, src_rect, dst + c, dst_rect, kernels,
+                               image_y_offset, image_ysize, arena);
+    }
+  }
+}
+
 }  // namespace
 
-void UpsampleRect(size_t upsampling, const float* kernels, const ImageF& src,
-                  const Rect& src_rect, ImageF* dst, const Rect& dst_rect,
+void UpsampleRect(size_t upsampling, const float* kernels,
+                  const ImageF* const* src, const Rect& src_rect,
+                  ImageF* const* dst, const Rect& dst_rect,
                   ssize_t image_y_offset, size_t image_ysize, float* arena,
-                  size_t x_repeat) {
+                  size_t x_repeat, size_t num_channels) {
   if (upsampling == 1) return;
   if (upsampling == 2) {
     if (x_repeat == 1) {
-      Upsample</*N=*/2, /*x_repeat=*/1>(src, src_rect, dst, dst_rect, kernels,
-                                        image_y_offset, image_ysize, arena);
+      UpsampleChannels</*N=*/2, /*x_repeat=*/1>(
+          src, src_rect, dst, dst_rect, kernels, image_y_offset, image_ysize,
+          arena, num_channels);
     } else if (x_repeat == 2) {
-      Upsample</*N=*/2, /*x_repeat=*/2>(src, src_rect, dst, dst_rect, kernels,
-                                        image_y_offset, image_ysize, arena);
+      UpsampleChannels</*N=*/2, /*x_repeat=*/2>(
+          src, src_rect, dst, dst_rect, kernels, image_y_offset, image_ysize,
+          arena, num_channels);
     } else if (x_repeat == 4) {
-      Upsample</*N=*/2, /*x_repeat=*/4>(src, src_rect, dst, dst_rect, kernels,
-                                        image_y_offset, image_ysize, arena);
+      UpsampleChannels</*N=*/2, /*x_repeat=*/4>(
+          src, src_rect, dst, dst_rect, kernels, image_y_offset, image_ysize,
+          arena, num_channels);
     } else {
       JXL_ABORT("Not implemented");
     }
   } else if (upsampling == 4) {
     JXL_ASSERT(x_repeat == 1);
-    Upsample</*N=*/4, /*x_repeat=*/1>(src, src_rect, dst, dst_rect, kernels,
-                                      image_y_offset, image_ysize, arena);
+    UpsampleChannels</*N=*/4, /*x_repeat=*/1>(src, src_rect, dst, dst_rect,
+                                              kernels, image_y_offset,
+                                              image_ysize, arena, num_channels);
   } else if (upsampling == 8) {
     JXL_ASSERT(x_repeat == 1);
-    Upsample</*N=*/8, /*x_repeat=*/1>(src, src_rect, dst, dst_rect, kernels,
-                                      image_y_offset, image_ysize, arena);
+    UpsampleChannels</*N=*/8, /*x_repeat=*/1>(src, src_rect, dst, dst_rect,
+                                              kernels, image_y_offset,
+                                              image_ysize, arena, num_channels);
   } else {
     JXL_ABORT("Not implemented");
   }
@@ -345,11 +395,13 @@ size_t Upsampler::GetArenaSize(size_t max_dst_xsize) {
   constexpr size_t X = max_x_repeat();
   constexpr const size_t MX = M + X - 1;
   constexpr const size_t N = max_upsampling();
+  // Color channels are upsampled together, each with its own buffers.
+  constexpr size_t C = 3;
   // TODO(eustas): raw_(min|max)_row and (min|max)_row could overlap almost
   // completely.
-  return RoundUpTo(N * N * X, V) + RoundUpTo(M * MX, V) +
-         2 * RoundUpTo(DivCeil(max_dst_xsize, 8) * 4 + 2 * M2 + V, V) +
-         2 * RoundUpTo(max_dst_xsize + V, V);
+  return C * (RoundUpTo(N * N * X, V) + RoundUpTo(M * MX, V) +
+              2 * RoundUpTo(DivCeil(max_dst_xsize, 8) * 4 + 2 * M2 + V, V) +
+              2 * RoundUpTo(max_dst_xsize + V, V));
 }
 
 void Upsampler::UpsampleRect(const ImageF& src, const Rect& src_rect,
@@ -358,9 +410,12 @@ void Upsampler::UpsampleRect(const ImageF& src, const Rect& src_rect,
                              float* arena) const {
   JXL_CHECK(arena);
   JXL_CHECK_IMAGE_INITIALIZED(src, src_rect);
+  const ImageF* srcs[1] = {&src};
+  ImageF* dsts[1] = {dst};
   HWY_DYNAMIC_DISPATCH(UpsampleRect)
-  (upsampling_, reinterpret_cast<float*>(kernel_storage_.get()), src, src_rect,
-   dst, dst_rect, image_y_offset, image_ysize, arena, x_repeat_);
+  (upsampling_, reinterpret_cast<float*>(kernel_storage_.get()), srcs,
+   src_rect, dsts, dst_rect, image_y_offset, image_ysize, arena, x_repeat_,
+   /*num_channels=*/1);
   JXL_CHECK_IMAGE_INITIALIZED(*dst, dst_rect);
 }
 
@@ -369,11 +424,14 @@ void Upsampler::UpsampleRect(const Image3F& src, const Rect& src_rect,
                              ssize_t image_y_offset, size_t image_ysize,
                              float* arena) const {
   PROFILER_FUNC;
+  JXL_CHECK(arena);
   JXL_CHECK_IMAGE_INITIALIZED(src, src_rect);
-  for (size_t c = 0; c < 3; c++) {
-    UpsampleRect(src.Plane(c), src_rect, &dst->Plane(c), dst_rect,
-                 image_y_offset, image_ysize, arena);
-  }
+  const ImageF* srcs[3] = {&src.Plane(0), &src.Plane(1), &src.Plane(2)};
+  ImageF* dsts[3] = {&dst->Plane(0), &dst->Plane(1), &dst->Plane(2)};
+  HWY_DYNAMIC_DISPATCH(UpsampleRect)
+  (upsampling_, reinterpret_cast<float*>(kernel_storage_.get()), srcs,
+   src_rect, dsts, dst_rect, image_y_offset, image_ysize, arena, x_repeat_,
+   /*num_channels=*/3);
   JXL_CHECK_IMAGE_INITIALIZED(*dst, dst_rect);
 }
 
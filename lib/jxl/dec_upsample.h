@@ -39,6 +39,8 @@ struct Upsampler {
   // height of the frame that the source area belongs to (not the buffer);
   // `image_y_offset` is the difference between `src.y0()` and the corresponding
   // y value in the full frame.
+  // The three planes of an Image3F are processed together, sharing the
+  // kernel loads.
   void UpsampleRect(const Image3F& src, const Rect& src_rect, Image3F* dst,
                     const Rect& dst_rect, ssize_t image_y_offset,
                     size_t image_ysize, float* arena) const;
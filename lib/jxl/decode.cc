@@ -375,9 +375,14 @@ struct ExtraChannelOutput {
 
 // NOLINTNEXTLINE(clang-analyzer-optin.performance.Padding)
 struct JxlDecoderStruct {
-  JxlDecoderStruct() = default;
+  explicit JxlDecoderStruct(const JxlMemoryManager& manager)
+      : memory_manager(manager),
+        allocation_target(manager, jxl::MemoryManagerIsDefault(manager)) {}
 
   JxlMemoryManager memory_manager;
+  // Receives the large internal allocations; must be destroyed after all
+  // members that may own such allocations.
+  jxl::AllocationTarget allocation_target;
   std::unique_ptr<jxl::ThreadPool> thread_pool;
 
   DecoderStage stage;
@@ -390,6 +395,9 @@ struct JxlDecoderStruct {
   // "jxlp" boxes and it is possible (and permitted) that the last one is not a
   // final box that uses size 0 to indicate the end.
   bool last_codestream_seen;
+  // Whether a JPEG reconstruction ("jbrd") box was seen, which always precedes
+  // the codestream of a recompressed JPEG.
+  bool jpeg_reconstruction_box_seen;
   bool got_basic_info;
   size_t header_except_icc_bits = 0;  // To skip everything before ICC.
   bool got_all_headers;               // Codestream metadata headers.
@@ -543,6 +551,7 @@ void JxlDecoderReset(JxlDecoder* dec) {
   dec->got_signature = false;
   dec->first_codestream_seen = false;
   dec->last_codestream_seen = false;
+  dec->jpeg_reconstruction_box_seen = false;
   dec->got_basic_info = false;
   dec->header_except_icc_bits = 0;
   dec->got_all_headers = false;
@@ -608,8 +617,7 @@ JxlDecoder* JxlDecoderCreate(const JxlMemoryManager* memory_manager) {
       jxl::MemoryManagerAlloc(&local_memory_manager, sizeof(JxlDecoder));
   if (!alloc) return nullptr;
   // Placement new constructor on allocated memory
-  JxlDecoder* dec = new (alloc) JxlDecoder();
-  dec->memory_manager = local_memory_manager;
+  JxlDecoder* dec = new (alloc) JxlDecoder(local_memory_manager);
 
   JxlDecoderReset(dec);
 
@@ -624,6 +632,15 @@ void JxlDecoderDestroy(JxlDecoder* dec) {
   }
 }
 
+JxlDecoderStatus JxlDecoderGetMemoryUsage(const JxlDecoder* dec,
+                                          JxlMemoryCategory category,
+                                          JxlMemoryUsage* usage) {
+  if (!jxl::GetMemoryUsage(dec->allocation_target, category, usage)) {
+    return JXL_API_ERROR("Invalid memory category");
+  }
+  return JXL_DEC_SUCCESS;
+}
+
 void JxlDecoderRewind(JxlDecoder* dec) {
   int keep_orientation = dec->keep_orientation;
   int events_wanted = dec->orig_events_wanted;
@@ -1270,7 +1287,7 @@ JxlDecoderStatus JxlDecoderProcessInternal(JxlDecoder* dec, const uint8_t* in,
         dec->frame_dec->MaybeSetRGB8OutputBuffer(
             reinterpret_cast<uint8_t*>(dec->image_out_buffer),
             GetStride(dec, dec->image_out_format), is_rgba,
-            !dec->keep_orientation);
+            !dec->keep_orientation, dec->jpeg_reconstruction_box_seen);
       }
 
       const bool little_endian =
@@ -1436,6 +1453,7 @@ size_t JxlDecoderReleaseJPEGBuffer(JxlDecoder* dec) {
 }
 
 JxlDecoderStatus JxlDecoderProcessInput(JxlDecoder* dec) {
+  jxl::ScopedAllocationTarget allocation_scope(&dec->allocation_target);
   const uint8_t** next_in = &dec->next_in;
   size_t* avail_in = &dec->avail_in;
   if (dec->stage == DecoderStage::kInited) {
@@ -1586,6 +1604,7 @@ JxlDecoderStatus JxlDecoderProcessInput(JxlDecoder* dec) {
 
         dec->box_begin = box_start;
         dec->box_end = dec->file_pos + box_start + box_size;
+        if (strcmp(type, "jbrd") == 0) dec->jpeg_reconstruction_box_seen = true;
         if (strcmp(type, "jxlc") == 0 || strcmp(type, "jxlp") == 0) {
           size_t codestream_size = contents_size;
           // Whether this is the last codestream box, either when it is a jxlc
@@ -2004,6 +2023,7 @@ JxlDecoderStatus PrepareSizeCheck(const JxlDecoder* dec,
 }  // namespace
 
 JxlDecoderStatus JxlDecoderFlushImage(JxlDecoder* dec) {
+  jxl::ScopedAllocationTarget allocation_scope(&dec->allocation_target);
   if (!dec->image_out_buffer) return JXL_DEC_ERROR;
   if (!dec->sections || dec->sections->section_info.empty()) {
     return JXL_DEC_ERROR;
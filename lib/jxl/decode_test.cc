@@ -7,7 +7,9 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <atomic>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -809,6 +811,136 @@ TEST(DecodeTest, CustomAllocTest) {
   EXPECT_LE(1, counters.frees);
 }
 
+TEST(DecodeTest, MemoryUsageTest) {
+  struct CalledCounters {
+    std::atomic<int> allocs{0};
+    std::atomic<int> frees{0};
+  } counters;
+
+  JxlMemoryManager mm;
+  mm.opaque = &counters;
+  mm.alloc = [](void* opaque, size_t size) {
+    reinterpret_cast<CalledCounters*>(opaque)->allocs++;
+    return malloc(size);
+  };
+  mm.free = [](void* opaque, void* address) {
+    reinterpret_cast<CalledCounters*>(opaque)->frees++;
+    free(address);
+  };
+
+  size_t xsize = 123, ysize = 77;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::CompressParams cparams;
+  jxl::PaddedBytes compressed = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      cparams, kCSBF_None, JXL_ORIENT_IDENTITY, /*add_preview=*/false);
+
+  JxlDecoder* dec = JxlDecoderCreate(&mm);
+  const int initial_allocs = counters.allocs;
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 0};
+  std::vector<uint8_t> pixels2 = jxl::DecodeWithAPI(
+      dec, jxl::Span<const uint8_t>(compressed.data(), compressed.size()),
+      format, /*use_callback=*/false, /*set_buffer_early=*/false,
+      /*use_resizable_runner=*/false);
+  EXPECT_EQ(xsize * ysize * 3, pixels2.size());
+  EXPECT_LT(initial_allocs, counters.allocs);
+
+  JxlMemoryUsage usage;
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderGetMemoryUsage(dec, JXL_MEMORY_IMAGES, &usage));
+  EXPECT_LT(0u, usage.num_allocations);
+  EXPECT_LE(xsize * ysize * 3 * sizeof(float), usage.max_bytes_in_use);
+  EXPECT_LE(usage.bytes_in_use, usage.max_bytes_in_use);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderGetMemoryUsage(dec, JXL_MEMORY_ENTROPY_TABLES, &usage));
+  EXPECT_LT(0u, usage.num_allocations);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderGetMemoryUsage(dec, JXL_MEMORY_SCRATCH, &usage));
+  EXPECT_LT(0u, usage.num_allocations);
+  EXPECT_EQ(JXL_DEC_ERROR,
+            JxlDecoderGetMemoryUsage(
+                dec, static_cast<JxlMemoryCategory>(100), &usage));
+
+  JxlDecoderDestroy(dec);
+  EXPECT_EQ(counters.allocs, counters.frees);
+}
+
+TEST(DecodeTest, StaticsOutliveDecoderTest) {
+  // Overwrites freed memory, so that using it afterwards gives wrong values.
+  struct CalledCounters {
+    std::atomic<int> allocs{0};
+    std::atomic<int> frees{0};
+  } counters;
+  constexpr size_t kHeaderSize = 64;
+  JxlMemoryManager mm;
+  mm.opaque = &counters;
+  mm.alloc = [](void* opaque, size_t size) -> void* {
+    reinterpret_cast<CalledCounters*>(opaque)->allocs++;
+    uint8_t* allocated = static_cast<uint8_t*>(malloc(kHeaderSize + size));
+    if (allocated == nullptr) return nullptr;
+    memcpy(allocated, &size, sizeof(size));
+    return allocated + kHeaderSize;
+  };
+  mm.free = [](void* opaque, void* address) {
+    reinterpret_cast<CalledCounters*>(opaque)->frees++;
+    uint8_t* allocated = static_cast<uint8_t*>(address) - kHeaderSize;
+    size_t size;
+    memcpy(&size, allocated, sizeof(size));
+    memset(allocated, 0xA5, kHeaderSize + size);
+    free(allocated);
+  };
+
+  // Nothing before the decoder uses the process-wide color encodings, so they
+  // are first created while decoding (when the test runs in its own process).
+  const jxl::PaddedBytes compressed =
+      jxl::ReadTestData("jxl/blending/cropped_traffic_light.jxl");
+  JxlDecoder* dec = JxlDecoderCreate(&mm);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  JxlPixelFormat format = {3, JXL_TYPE_FLOAT, JXL_LITTLE_ENDIAN, 0};
+  std::vector<uint8_t> pixels;
+  size_t num_frames = 0;
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec);
+    if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+      size_t buffer_size;
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderImageOutBufferSize(dec, &format, &buffer_size));
+      pixels.resize(buffer_size);
+      EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBuffer(
+                                     dec, &format, pixels.data(), buffer_size));
+    } else if (status == JXL_DEC_FULL_IMAGE) {
+      num_frames++;
+    } else {
+      EXPECT_EQ(JXL_DEC_SUCCESS, status);
+      break;
+    }
+  }
+  EXPECT_NE(0u, num_frames);
+  JxlDecoderDestroy(dec);
+  EXPECT_EQ(counters.allocs, counters.frees);
+
+  for (bool is_gray : {false, true}) {
+    for (jxl::TransferFunction tf :
+         {jxl::TransferFunction::kSRGB, jxl::TransferFunction::kLinear}) {
+      jxl::ColorEncoding expected;
+      ASSERT_TRUE(expected.SetSRGB(
+          is_gray ? jxl::ColorSpace::kGray : jxl::ColorSpace::kRGB));
+      expected.tf.SetTransferFunction(tf);
+      ASSERT_TRUE(expected.CreateICC());
+      const jxl::ColorEncoding& actual =
+          tf == jxl::TransferFunction::kSRGB
+              ? jxl::ColorEncoding::SRGB(is_gray)
+              : jxl::ColorEncoding::LinearSRGB(is_gray);
+      ASSERT_EQ(expected.ICC().size(), actual.ICC().size());
+      EXPECT_EQ(0, memcmp(expected.ICC().data(), actual.ICC().data(),
+                          expected.ICC().size()));
+    }
+  }
+}
+
 // TODO(lode): add multi-threaded test when multithreaded pixel decoding from
 // API is implemented.
 TEST(DecodeTest, DefaultParallelRunnerTest) {
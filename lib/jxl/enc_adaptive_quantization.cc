@@ -731,6 +731,31 @@ constexpr float kDcQuantPow = 0.57f;
 static const float kDcQuant = 1.12f;
 static const float kAcQuant = 0.7886f;
 
+// Multipliers that map the butteraugli distance of images downsampled by 2 and
+// by 4 to the full-resolution one: downsampling averages away part of the
+// error, and butteraugli sees the remaining one at a lower angular frequency.
+// These are the 75th percentiles of the ratio of full-resolution to proxy tile
+// distances on the 500px test images at distances 1 to 3, so that the proxy
+// rather overestimates the distance of a tile.
+constexpr float kProxyDistanceMul2 = 2.2f;
+constexpr float kProxyDistanceMul4 = 5.1f;
+
+// Returns the color planes of `image` in linear sRGB, box-downsampled by
+// `factor`, as the input of the butteraugli proxy.
+ImageBundle DownsampleForProxy(const ImageBundle& image, size_t factor,
+                               ThreadPool* pool) {
+  const ColorEncoding& c_linear = ColorEncoding::LinearSRGB(image.IsGray());
+  ImageMetadata metadata = *image.metadata();
+  ImageBundle store(&metadata);
+  const ImageBundle* linear;
+  JXL_CHECK(TransformIfNeeded(image, c_linear, pool, &store, &linear));
+  Image3F color = CopyImage(linear->color());
+  DownsampleImage(&color, factor);
+  ImageBundle downsampled(image.metadata());
+  downsampled.SetFromImage(std::move(color), c_linear);
+  return downsampled;
+}
+
 void FindBestQuantization(const ImageBundle& linear, const Image3F& opsin,
                           PassesEncoderState* enc_state, ThreadPool* pool,
                           AuxOut* aux_out) {
@@ -748,8 +773,27 @@ void FindBestQuantization(const ImageBundle& linear, const Image3F& opsin,
   if (fabs(params.intensity_target - 255.0f) < 1e-3) {
     params.intensity_target = 80.0f;
   }
+  // With a proxy, both images are compared at 1/factor of the resolution, and
+  // each 8x8 block of the quant field follows the matching tile of
+  // 8/factor x 8/factor pixels of the distance map. Butteraugli does not
+  // measure anything on images smaller than 8x8, so small images are always
+  // compared at full resolution.
+  size_t proxy_factor = cparams.butteraugli_proxy_downsampling;
+  JXL_ASSERT(proxy_factor == 1 || proxy_factor == 2 || proxy_factor == 4);
+  if (DivCeil(linear.xsize(), proxy_factor) < 8 ||
+      DivCeil(linear.ysize(), proxy_factor) < 8) {
+    proxy_factor = 1;
+  }
+  const float proxy_mul = proxy_factor == 4   ? kProxyDistanceMul4
+                          : proxy_factor == 2 ? kProxyDistanceMul2
+                                              : 1.0f;
   JxlButteraugliComparator comparator(params);
-  JXL_CHECK(comparator.SetReferenceImage(linear));
+  if (proxy_factor > 1) {
+    JXL_CHECK(comparator.SetReferenceImage(
+        DownsampleForProxy(linear, proxy_factor, pool)));
+  } else {
+    JXL_CHECK(comparator.SetReferenceImage(linear));
+  }
   bool lower_is_better =
       (comparator.GoodQualityScore() < comparator.BadQualityScore());
   const float initial_quant_dc = InitialQuantDC(butteraugli_target);
@@ -778,6 +822,11 @@ void FindBestQuantization(const ImageBundle& linear, const Image3F& opsin,
     iters = 2;
   }
   for (int i = 0; i < iters + 1; ++i) {
+    // The last round only measures the final quant field, which is only of use
+    // for debugging.
+    if (i == iters && !WantDebugOutput(aux_out) && !FLAGS_log_search_state) {
+      break;
+    }
     if (FLAGS_dump_quant_state) {
       printf("\nQuantization field:\n");
       for (size_t y = 0; y < quant_field.ysize(); ++y) {
@@ -792,12 +841,20 @@ void FindBestQuantization(const ImageBundle& linear, const Image3F& opsin,
     PROFILER_ZONE("enc Butteraugli");
     float score;
     ImageF diffmap;
-    JXL_CHECK(comparator.CompareWith(linear, &diffmap, &score));
+    if (proxy_factor > 1) {
+      JXL_CHECK(comparator.CompareWith(
+          DownsampleForProxy(linear, proxy_factor, pool), &diffmap, &score));
+      score *= proxy_mul;
+      diffmap = ScaleImage(proxy_mul, diffmap);
+    } else {
+      JXL_CHECK(comparator.CompareWith(linear, &diffmap, &score));
+    }
     if (!lower_is_better) {
       score = -score;
       diffmap = ScaleImage(-1.0f, diffmap);
     }
-    tile_distmap = TileDistMap(diffmap, 8, 0, enc_state->shared.ac_strategy);
+    tile_distmap = TileDistMap(diffmap, kBlockDim / proxy_factor, 0,
+                               enc_state->shared.ac_strategy);
     if (WantDebugOutput(aux_out)) {
       aux_out->DumpImage(("dec" + ToString(i)).c_str(), *linear.color());
       DumpHeatmaps(aux_out, butteraugli_target, quant_field, tile_distmap,
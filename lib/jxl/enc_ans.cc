@@ -21,6 +21,7 @@
 #include "lib/jxl/aux_out.h"
 #include "lib/jxl/aux_out_fwd.h"
 #include "lib/jxl/base/bits.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/dec_ans.h"
 #include "lib/jxl/enc_cluster.h"
 #include "lib/jxl/enc_context_map.h"
@@ -535,11 +536,46 @@ template void EncodeUintConfigs(const std::vector<HybridUintConfig>&,
 
 namespace {
 
+// Calls `visit(token, histograms)` for every token of every stream, where
+// `histograms` has `histograms_out->size()` entries. Streams are processed in
+// parallel on `pool` into per-thread histograms which are then summed into
+// `histograms_out`; since counts are simply added, the result is the same as
+// for a single serial pass.
+template <typename Visitor>
+void AddTokensToHistograms(const std::vector<std::vector<Token>>& tokens,
+                           ThreadPool* pool, const Visitor& visit,
+                           std::vector<Histogram>* histograms_out) {
+  if (pool == nullptr || tokens.size() < 2) {
+    for (const std::vector<Token>& stream : tokens) {
+      for (const Token& token : stream) visit(token, histograms_out);
+    }
+    return;
+  }
+  std::vector<std::vector<Histogram>> partial;
+  RunOnPool(
+      pool, 0, tokens.size(),
+      [&](size_t num_threads) {
+        partial.resize(num_threads,
+                       std::vector<Histogram>(histograms_out->size()));
+        return true;
+      },
+      [&](const uint32_t i, size_t thread) {
+        for (const Token& token : tokens[i]) visit(token, &partial[thread]);
+      },
+      "AddTokensToHistograms");
+  for (const std::vector<Histogram>& histograms : partial) {
+    for (size_t i = 0; i < histograms.size(); i++) {
+      (*histograms_out)[i].AddHistogram(histograms[i]);
+    }
+  }
+}
+
 void ChooseUintConfigs(const HistogramParams& params,
                        const std::vector<std::vector<Token>>& tokens,
                        const std::vector<uint8_t>& context_map,
                        std::vector<Histogram>* clustered_histograms,
-                       EntropyEncodingData* codes, size_t* log_alpha_size) {
+                       EntropyEncodingData* codes, size_t* log_alpha_size,
+                       ThreadPool* pool) {
   codes->uint_config.resize(clustered_histograms->size());
   if (params.uint_method == HistogramParams::HybridUintMethod::kNone) return;
   if (params.uint_method == HistogramParams::HybridUintMethod::kContextMap) {
@@ -588,63 +624,80 @@ void ChooseUintConfigs(const HistogramParams& params,
     };
   }
 
-  std::vector<float> costs(clustered_histograms->size(),
-                           std::numeric_limits<float>::max());
-  std::vector<uint32_t> extra_bits(clustered_histograms->size());
-  std::vector<uint8_t> is_valid(clustered_histograms->size());
+  const size_t num_histograms = clustered_histograms->size();
   size_t max_alpha =
       codes->use_prefix_code ? PREFIX_MAX_ALPHABET_SIZE : ANS_MAX_ALPHABET_SIZE;
-  for (HybridUintConfig cfg : configs) {
-    std::fill(is_valid.begin(), is_valid.end(), true);
-    std::fill(extra_bits.begin(), extra_bits.end(), 0);
-
-    for (size_t i = 0; i < clustered_histograms->size(); i++) {
-      (*clustered_histograms)[i].Clear();
-    }
-    for (size_t i = 0; i < tokens.size(); ++i) {
-      for (size_t j = 0; j < tokens[i].size(); ++j) {
-        const Token token = tokens[i][j];
-        // TODO(veluca): do not ignore lz77 commands.
-        if (token.is_lz77_length) continue;
-        size_t histo = context_map[token.context];
-        uint32_t tok, nbits, bits;
-        cfg.Encode(token.value, &tok, &nbits, &bits);
-        if (tok >= max_alpha ||
-            (codes->lz77.enabled && tok >= codes->lz77.min_symbol)) {
-          is_valid[histo] = false;
-          continue;
+  // Cost of each histogram for each of the configs, or infinity if the config
+  // cannot be used for that histogram. Configs are evaluated independently
+  // (and in parallel); the best one is then chosen in the original order, so
+  // that ties are broken in the same way regardless of the number of threads.
+  std::vector<float> config_costs(configs.size() * num_histograms);
+  RunOnPool(
+      pool, 0, configs.size(), ThreadPool::SkipInit(),
+      [&](const uint32_t cfg_idx, size_t /* thread */) {
+        const HybridUintConfig cfg = configs[cfg_idx];
+        std::vector<Histogram> histograms(num_histograms);
+        std::vector<uint32_t> extra_bits(num_histograms);
+        std::vector<uint8_t> is_valid(num_histograms, true);
+        for (size_t i = 0; i < tokens.size(); ++i) {
+          for (size_t j = 0; j < tokens[i].size(); ++j) {
+            const Token token = tokens[i][j];
+            // TODO(veluca): do not ignore lz77 commands.
+            if (token.is_lz77_length) continue;
+            size_t histo = context_map[token.context];
+            uint32_t tok, nbits, bits;
+            cfg.Encode(token.value, &tok, &nbits, &bits);
+            if (tok >= max_alpha ||
+                (codes->lz77.enabled && tok >= codes->lz77.min_symbol)) {
+              is_valid[histo] = false;
+              continue;
+            }
+            extra_bits[histo] += nbits;
+            histograms[histo].Add(tok);
+          }
         }
-        extra_bits[histo] += nbits;
-        (*clustered_histograms)[histo].Add(tok);
-      }
-    }
+        float* JXL_RESTRICT costs = &config_costs[cfg_idx * num_histograms];
+        for (size_t i = 0; i < num_histograms; i++) {
+          costs[i] = is_valid[i]
+                         ? histograms[i].PopulationCost() + extra_bits[i]
+                         : std::numeric_limits<float>::infinity();
+        }
+      },
+      "ChooseUintConfigs");
 
-    for (size_t i = 0; i < clustered_histograms->size(); i++) {
-      if (!is_valid[i]) continue;
-      float cost = (*clustered_histograms)[i].PopulationCost() + extra_bits[i];
+  std::vector<float> costs(num_histograms, std::numeric_limits<float>::max());
+  for (size_t cfg_idx = 0; cfg_idx < configs.size(); cfg_idx++) {
+    for (size_t i = 0; i < num_histograms; i++) {
+      float cost = config_costs[cfg_idx * num_histograms + i];
       if (cost < costs[i]) {
-        codes->uint_config[i] = cfg;
+        codes->uint_config[i] = configs[cfg_idx];
         costs[i] = cost;
       }
     }
   }
 
   // Rebuild histograms.
-  for (size_t i = 0; i < clustered_histograms->size(); i++) {
+  for (size_t i = 0; i < num_histograms; i++) {
     (*clustered_histograms)[i].Clear();
   }
+  AddTokensToHistograms(
+      tokens, pool,
+      [&](const Token& token, std::vector<Histogram>* histograms) {
+        uint32_t tok, nbits, bits;
+        size_t histo = context_map[token.context];
+        (token.is_lz77_length ? codes->lz77.length_uint_config
+                              : codes->uint_config[histo])
+            .Encode(token.value, &tok, &nbits, &bits);
+        tok += token.is_lz77_length ? codes->lz77.min_symbol : 0;
+        (*histograms)[histo].Add(tok);
+      },
+      clustered_histograms);
   *log_alpha_size = 4;
-  for (size_t i = 0; i < tokens.size(); ++i) {
-    for (size_t j = 0; j < tokens[i].size(); ++j) {
-      const Token token = tokens[i][j];
-      uint32_t tok, nbits, bits;
-      size_t histo = context_map[token.context];
-      (token.is_lz77_length ? codes->lz77.length_uint_config
-                            : codes->uint_config[histo])
-          .Encode(token.value, &tok, &nbits, &bits);
-      tok += token.is_lz77_length ? codes->lz77.min_symbol : 0;
-      (*clustered_histograms)[histo].Add(tok);
-      while (tok >= (1u << *log_alpha_size)) (*log_alpha_size)++;
+  for (const Histogram& histogram : *clustered_histograms) {
+    for (size_t tok = histogram.data_.size(); tok > 0; tok--) {
+      if (histogram.data_[tok - 1] == 0) continue;
+      while (tok - 1 >= (1u << *log_alpha_size)) (*log_alpha_size)++;
+      break;
     }
   }
 #if JXL_ENABLE_ASSERT
@@ -663,12 +716,30 @@ class HistogramBuilder {
     histograms_[histo_idx].Add(symbol);
   }
 
+  // Adds the symbols of all `tokens`, using `uint_config` for non-LZ77 tokens.
+  void VisitTokens(const std::vector<std::vector<Token>>& tokens,
+                   const HybridUintConfig& uint_config,
+                   const LZ77Params& lz77, ThreadPool* pool) {
+    AddTokensToHistograms(
+        tokens, pool,
+        [&](const Token& token, std::vector<Histogram>* histograms) {
+          uint32_t tok, nbits, bits;
+          (token.is_lz77_length ? lz77.length_uint_config : uint_config)
+              .Encode(token.value, &tok, &nbits, &bits);
+          tok += token.is_lz77_length ? lz77.min_symbol : 0;
+          JXL_DASSERT(token.context < histograms->size());
+          (*histograms)[token.context].Add(tok);
+        },
+        &histograms_);
+  }
+
   // NOTE: `layer` is only for clustered_entropy; caller does ReclaimAndCharge.
   size_t BuildAndStoreEntropyCodes(
       const HistogramParams& params,
       const std::vector<std::vector<Token>>& tokens, EntropyEncodingData* codes,
       std::vector<uint8_t>* context_map, bool use_prefix_code,
-      BitWriter* writer, size_t layer, AuxOut* aux_out) const {
+      BitWriter* writer, size_t layer, AuxOut* aux_out,
+      ThreadPool* pool) const {
     size_t cost = 0;
     codes->encoding_info.clear();
     std::vector<Histogram> clustered_histograms(histograms_);
@@ -696,7 +767,8 @@ class HistogramBuilder {
         }
       }
       if (writer != nullptr) {
-        EncodeContextMap(*context_map, clustered_histograms.size(), writer);
+        EncodeContextMap(*context_map, clustered_histograms.size(),
+                         params.force_huffman, writer);
       }
     }
     if (aux_out != nullptr) {
@@ -712,7 +784,24 @@ class HistogramBuilder {
       codes->uint_config.resize(1, HybridUintConfig(7, 0, 0));
     } else {
       ChooseUintConfigs(params, tokens, *context_map, &clustered_histograms,
-                        codes, &log_alpha_size);
+                        codes, &log_alpha_size, pool);
+      if (params.add_missing_symbols) {
+        JXL_ASSERT(!codes->lz77.enabled);
+        // Counts of 1 after clustering cost much less than adding the
+        // missing symbols to the (often sparse) histogram of every context.
+        for (size_t c = 0; c < clustered_histograms.size(); ++c) {
+          uint32_t max_token, nbits, bits;
+          codes->uint_config[c].Encode(~0u, &max_token, &nbits, &bits);
+          Histogram& histogram = clustered_histograms[c];
+          for (uint32_t i = 0; i <= max_token; i++) {
+            if (i >= histogram.data_.size() || histogram.data_[i] == 0) {
+              histogram.Add(i);
+            }
+          }
+          log_alpha_size = std::max<size_t>(log_alpha_size,
+                                            CeilLog2Nonzero(max_token + 1));
+        }
+      }
     }
     if (log_alpha_size < 5) log_alpha_size = 5;
     SizeWriter size_writer;  // Used if writer == nullptr to estimate costs.
@@ -1445,7 +1534,7 @@ size_t BuildAndEncodeHistograms(const HistogramParams& params,
                                 EntropyEncodingData* codes,
                                 std::vector<uint8_t>* context_map,
                                 BitWriter* writer, size_t layer,
-                                AuxOut* aux_out) {
+                                AuxOut* aux_out, ThreadPool* pool) {
   size_t total_bits = 0;
   codes->lz77.nonserialized_distance_context = num_contexts;
   std::vector<std::vector<Token>> tokens_lz77;
@@ -1481,6 +1570,9 @@ size_t BuildAndEncodeHistograms(const HistogramParams& params,
     tokens = std::move(tokens_lz77);
   }
   size_t total_tokens = 0;
+  for (const std::vector<Token>& stream : tokens) {
+    total_tokens += stream.size();
+  }
   // Build histograms.
   HistogramBuilder builder(num_contexts);
   HybridUintConfig uint_config;  //  Default config for clustering.
@@ -1491,17 +1583,7 @@ size_t BuildAndEncodeHistograms(const HistogramParams& params,
   if (ans_fuzzer_friendly_) {
     uint_config = HybridUintConfig(10, 0, 0);
   }
-  for (size_t i = 0; i < tokens.size(); ++i) {
-    for (size_t j = 0; j < tokens[i].size(); ++j) {
-      const Token token = tokens[i][j];
-      total_tokens++;
-      uint32_t tok, nbits, bits;
-      (token.is_lz77_length ? codes->lz77.length_uint_config : uint_config)
-          .Encode(token.value, &tok, &nbits, &bits);
-      tok += token.is_lz77_length ? codes->lz77.min_symbol : 0;
-      builder.VisitSymbol(tok, token.context);
-    }
-  }
+  builder.VisitTokens(tokens, uint_config, codes->lz77, pool);
 
   bool use_prefix_code =
       params.force_huffman || total_tokens < 100 ||
@@ -1520,9 +1602,9 @@ size_t BuildAndEncodeHistograms(const HistogramParams& params,
   }
 
   // Encode histograms.
-  total_bits += builder.BuildAndStoreEntropyCodes(params, tokens, codes,
-                                                  context_map, use_prefix_code,
-                                                  writer, layer, aux_out);
+  total_bits += builder.BuildAndStoreEntropyCodes(
+      params, tokens, codes, context_map, use_prefix_code, writer, layer,
+      aux_out, pool);
   allotment.FinishedHistogram(writer);
   ReclaimAndCharge(writer, &allotment, layer, aux_out);
 
@@ -1551,7 +1633,8 @@ size_t WriteTokens(const std::vector<Token>& tokens,
       //               codes.encoding_info[histo][tok].bits);
       // writer->Write(nbits, bits);
       uint64_t data = codes.encoding_info[histo][tok].bits;
-      data |= bits << codes.encoding_info[histo][tok].depth;
+      data |= static_cast<uint64_t>(bits)
+              << codes.encoding_info[histo][tok].depth;
       writer->Write(codes.encoding_info[histo][tok].depth + nbits, data);
       num_extra_bits += nbits;
     }
@@ -23,6 +23,7 @@
 #include "lib/jxl/aux_out.h"
 #include "lib/jxl/aux_out_fwd.h"
 #include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/dec_ans.h"
 #include "lib/jxl/enc_ans_params.h"
@@ -107,14 +108,16 @@ float ANSPopulationCost(const ANSHistBin* data, size_t alphabet_size);
 // Apply context clustering, compute histograms and encode them. Returns an
 // estimate of the total bits used for encoding the stream. If `writer` ==
 // nullptr, the bit estimate will not take into account the context map (which
-// does not get written if `num_contexts` == 1).
+// does not get written if `num_contexts` == 1). If `pool` is not null, the
+// histograms of the different token streams are accumulated in parallel; the
+// output does not depend on the number of threads.
 size_t BuildAndEncodeHistograms(const HistogramParams& params,
                                 size_t num_contexts,
                                 std::vector<std::vector<Token>>& tokens,
                                 EntropyEncodingData* codes,
                                 std::vector<uint8_t>* context_map,
                                 BitWriter* writer, size_t layer,
-                                AuxOut* aux_out);
+                                AuxOut* aux_out, ThreadPool* pool = nullptr);
 
 // Write the tokens to a string.
 void WriteTokens(const std::vector<Token>& tokens,
@@ -68,6 +68,10 @@ struct HistogramParams {
   std::vector<size_t> image_widths;
   size_t max_histograms = ~0;
   bool force_huffman = false;
+  // If true, the entropy codes can encode every token of their HybridUint
+  // configs, not only the ones that were used to build them, so that they can
+  // be reused for other data. Requires lz77_method == kNone.
+  bool add_missing_symbols = false;
 };
 
 }  // namespace jxl
@@ -19,6 +19,7 @@
 #include "lib/jxl/coeff_order_fwd.h"
 #include "lib/jxl/common.h"
 #include "lib/jxl/dct_util.h"
+#include "lib/jxl/enc_bit_writer.h"
 #include "lib/jxl/enc_ans.h"
 #include "lib/jxl/enc_heuristics.h"
 #include "lib/jxl/enc_params.h"
@@ -54,11 +55,27 @@ struct PassesEncoderState {
     std::vector<std::vector<Token>> ac_tokens;
     std::vector<uint8_t> context_map;
     EntropyEncodingData codes;
+    // Only used with cparams.streaming_histograms: the histograms, and the
+    // entropy-coded AC tokens of each group, written during tokenization.
+    BitWriter encoded_histograms;
+    std::vector<BitWriter> encoded_ac_groups;
   };
 
   std::vector<PassData> passes;
   std::vector<uint8_t> histogram_idx;
 
+  // Only used with cparams.realtime: the AC histograms of each pass, kept
+  // across frames. They can encode any AC token, so they remain valid for as
+  // long as the number of AC contexts does not change. Clearing this forces
+  // the next frame to estimate new ones, e.g. after a scene change.
+  struct RealtimeHistograms {
+    size_t num_contexts = 0;
+    std::vector<uint8_t> context_map;
+    EntropyEncodingData codes;
+    BitWriter encoded_histograms;
+  };
+  std::vector<RealtimeHistograms> realtime_histograms;
+
   // Coefficient orders that are non-default.
   std::vector<uint32_t> used_orders;
 
@@ -85,6 +102,11 @@ struct EncCache {
 
   // TokenizeCoefficients
   Image3I num_nzeroes;
+  // Tokens of the group being tokenized, reused across groups so that the
+  // worst-case reservation is paid once per thread. With streaming histograms
+  // they are entropy-coded directly from here; otherwise they are copied into
+  // the exactly sized PassData::ac_tokens of the group.
+  std::vector<Token> tokens;
 };
 
 }  // namespace jxl
@@ -11,6 +11,7 @@
 #include "lib/jxl/ans_params.h"
 #include "lib/jxl/aux_out.h"
 #include "lib/jxl/aux_out_fwd.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/padded_bytes.h"
 #include "lib/jxl/base/profiler.h"
 #include "lib/jxl/base/span.h"
@@ -29,35 +30,46 @@ namespace jxl {
 
 uint32_t ComputeUsedOrders(const SpeedTier speed,
                            const AcStrategyImage& ac_strategy,
-                           const Rect& rect) {
+                           const Rect& rect, ThreadPool* pool) {
   // Use default orders for small images.
   if (ac_strategy.xsize() < 5 && ac_strategy.ysize() < 5) return 0;
 
   // Only uses DCT8 = 0, so bitfield = 1.
   if (speed >= SpeedTier::kFalcon) return 1;
 
-  uint32_t ret = 0;
-  size_t xsize_blocks = rect.xsize();
-  size_t ysize_blocks = rect.ysize();
+  // Per-thread bitfields, OR-ed together at the end.
+  std::vector<uint32_t> used(1);
+  const size_t xsize_blocks = rect.xsize();
   // TODO(veluca): precompute when doing DCT.
-  for (size_t by = 0; by < ysize_blocks; ++by) {
-    AcStrategyRow acs_row = ac_strategy.ConstRow(rect, by);
-    for (size_t bx = 0; bx < xsize_blocks; ++bx) {
-      int ord = kStrategyOrder[acs_row[bx].RawStrategy()];
-      // Do not customize coefficient orders for blocks bigger than 32x32.
-      if (ord > 6) {
-        continue;
-      }
-      ret |= 1u << ord;
-    }
-  }
+  RunOnPool(
+      pool, 0, rect.ysize(),
+      [&](const size_t num_threads) {
+        used.resize(num_threads);
+        return true;
+      },
+      [&](const uint32_t by, const size_t thread) {
+        AcStrategyRow acs_row = ac_strategy.ConstRow(rect, by);
+        uint32_t ret = 0;
+        for (size_t bx = 0; bx < xsize_blocks; ++bx) {
+          int ord = kStrategyOrder[acs_row[bx].RawStrategy()];
+          // Do not customize coefficient orders for blocks bigger than 32x32.
+          if (ord > 6) {
+            continue;
+          }
+          ret |= 1u << ord;
+        }
+        used[thread] |= ret;
+      },
+      "ComputeUsedOrders");
+  uint32_t ret = 0;
+  for (uint32_t u : used) ret |= u;
   return ret;
 }
 
 void ComputeCoeffOrder(SpeedTier speed, const ACImage& acs,
                        const AcStrategyImage& ac_strategy,
                        const FrameDimensions& frame_dim, uint32_t& used_orders,
-                       coeff_order_t* JXL_RESTRICT order) {
+                       coeff_order_t* JXL_RESTRICT order, ThreadPool* pool) {
   std::vector<int32_t> num_zeros(kCoeffOrderMaxSize);
   // If compressing at high speed and only using 8x8 DCTs, only consider a
   // subset of blocks.
@@ -72,23 +84,31 @@ void ComputeCoeffOrder(SpeedTier speed, const ACImage& acs,
   if (used_orders != 0) {
     uint64_t threshold =
         (std::numeric_limits<uint64_t>::max() >> 32) * block_fraction;
-    uint64_t s[2] = {0x94D049BB133111EBull, 0xBF58476D1CE4E5B9ull};
-    // Xorshift128+ adapted from xorshift128+-inl.h
-    auto use_sample = [&]() {
-      auto s1 = s[0];
-      const auto s0 = s[1];
-      const auto bits = s1 + s0;  // b, c
-      s[0] = s0;
-      s1 ^= s1 << 23;
-      s1 ^= s0 ^ (s1 >> 18) ^ (s0 >> 5);
-      s[1] = s1;
-      return (bits >> 32) <= threshold;
-    };
+    // Each thread counts the zero coefficients of its groups separately, the
+    // per-thread counts are added up below.
+    std::vector<std::vector<int32_t>> thread_num_zeros;
 
     // Count number of zero coefficients, separately for each DCT band.
     // TODO(veluca): precompute when doing DCT.
-    for (size_t group_index = 0; group_index < frame_dim.num_groups;
-         group_index++) {
+    const auto count_group = [&](const uint32_t group_index,
+                                 const size_t thread) {
+      std::vector<int32_t>& group_num_zeros = thread_num_zeros[thread];
+      if (group_num_zeros.empty()) group_num_zeros.resize(kCoeffOrderMaxSize);
+      // Xorshift128+ adapted from xorshift128+-inl.h, seeded per group so that
+      // the sample does not depend on the order in which groups are visited.
+      uint64_t s[2] = {0x94D049BB133111EBull ^ group_index,
+                       0xBF58476D1CE4E5B9ull};
+      auto use_sample = [&]() {
+        auto s1 = s[0];
+        const auto s0 = s[1];
+        const auto bits = s1 + s0;  // b, c
+        s[0] = s0;
+        s1 ^= s1 << 23;
+        s1 ^= s0 ^ (s1 >> 18) ^ (s0 >> 5);
+        s[1] = s1;
+        return (bits >> 32) <= threshold;
+      };
+
       const size_t gx = group_index % frame_dim.xsize_groups;
       const size_t gy = group_index / frame_dim.xsize_groups;
       const Rect rect(gx * kGroupDimInBlocks, gy * kGroupDimInBlocks,
@@ -115,27 +135,46 @@ void ComputeCoeffOrder(SpeedTier speed, const ACImage& acs,
             if (type == ACType::k16) {
               for (size_t k = 0; k < size; k++) {
                 bool is_zero = rows[c].ptr16[ac_offset + k] == 0;
-                num_zeros[order_offset + k] += is_zero ? 1 : 0;
+                group_num_zeros[order_offset + k] += is_zero ? 1 : 0;
               }
             } else {
               for (size_t k = 0; k < size; k++) {
                 bool is_zero = rows[c].ptr32[ac_offset + k] == 0;
-                num_zeros[order_offset + k] += is_zero ? 1 : 0;
-              }
-            }
-            // Ensure LLFs are first in the order.
-            size_t cx = acs.covered_blocks_x();
-            size_t cy = acs.covered_blocks_y();
-            CoefficientLayout(&cy, &cx);
-            for (size_t iy = 0; iy < cy; iy++) {
-              for (size_t ix = 0; ix < cx; ix++) {
-                num_zeros[order_offset + iy * kBlockDim * cx + ix] = -1;
+                group_num_zeros[order_offset + k] += is_zero ? 1 : 0;
               }
             }
           }
           ac_offset += size;
         }
       }
+    };
+    RunOnPool(
+        pool, 0, frame_dim.num_groups,
+        [&](const size_t num_threads) {
+          thread_num_zeros.resize(num_threads);
+          return true;
+        },
+        count_group, "CountZeros");
+    for (const std::vector<int32_t>& counts : thread_num_zeros) {
+      if (counts.empty()) continue;
+      for (size_t i = 0; i < kCoeffOrderMaxSize; i++) {
+        num_zeros[i] += counts[i];
+      }
+    }
+    // Ensure LLFs are first in the order.
+    for (uint8_t o = 0; o < AcStrategy::kNumValidStrategies; ++o) {
+      AcStrategy acs = AcStrategy::FromRawStrategy(o);
+      size_t cx = acs.covered_blocks_x();
+      size_t cy = acs.covered_blocks_y();
+      CoefficientLayout(&cy, &cx);
+      for (size_t c = 0; c < 3; ++c) {
+        const size_t order_offset = CoeffOrderOffset(kStrategyOrder[o], c);
+        for (size_t iy = 0; iy < cy; iy++) {
+          for (size_t ix = 0; ix < cx; ix++) {
+            num_zeros[order_offset + iy * kBlockDim * cx + ix] = -1;
+          }
+        }
+      }
     }
   }
   struct PosAndCount {
@@ -220,12 +259,13 @@ void TokenizePermutation(const coeff_order_t* JXL_RESTRICT order, size_t skip,
 
 void EncodePermutation(const coeff_order_t* JXL_RESTRICT order, size_t skip,
                        size_t size, BitWriter* writer, int layer,
+                       const HistogramParams& histogram_params,
                        AuxOut* aux_out) {
   std::vector<std::vector<Token>> tokens(1);
   TokenizePermutation(order, skip, size, &tokens[0]);
   std::vector<uint8_t> context_map;
   EntropyEncodingData codes;
-  BuildAndEncodeHistograms(HistogramParams(), kPermutationContexts, tokens,
+  BuildAndEncodeHistograms(histogram_params, kPermutationContexts, tokens,
                            &codes, &context_map, writer, layer, aux_out);
   WriteTokens(tokens[0], codes, context_map, writer, layer, aux_out);
 }
@@ -246,6 +286,7 @@ void EncodeCoeffOrder(const coeff_order_t* JXL_RESTRICT order, AcStrategy acs,
 void EncodeCoeffOrders(uint16_t used_orders,
                        const coeff_order_t* JXL_RESTRICT order,
                        BitWriter* writer, size_t layer,
+                       const HistogramParams& histogram_params,
                        AuxOut* JXL_RESTRICT aux_out) {
   auto mem = hwy::AllocateAligned<coeff_order_t>(AcStrategy::kMaxCoeffArea);
   uint16_t computed = 0;
@@ -265,7 +306,7 @@ void EncodeCoeffOrders(uint16_t used_orders,
   if (used_orders != 0) {
     std::vector<uint8_t> context_map;
     EntropyEncodingData codes;
-    BuildAndEncodeHistograms(HistogramParams(), kPermutationContexts, tokens,
+    BuildAndEncodeHistograms(histogram_params, kPermutationContexts, tokens,
                              &codes, &context_map, writer, layer, aux_out);
     WriteTokens(tokens[0], codes, context_map, writer, layer, aux_out);
   }
@@ -12,12 +12,14 @@
 #include "lib/jxl/ac_strategy.h"
 #include "lib/jxl/aux_out_fwd.h"
 #include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/coeff_order.h"
 #include "lib/jxl/coeff_order_fwd.h"
 #include "lib/jxl/common.h"
 #include "lib/jxl/dct_util.h"
 #include "lib/jxl/dec_bit_reader.h"
+#include "lib/jxl/enc_ans_params.h"
 #include "lib/jxl/enc_bit_writer.h"
 #include "lib/jxl/enc_params.h"
 
@@ -25,19 +27,21 @@ namespace jxl {
 
 // Orders that are actually used in part of image. `rect` is in block units.
 uint32_t ComputeUsedOrders(SpeedTier speed, const AcStrategyImage& ac_strategy,
-                           const Rect& rect);
+                           const Rect& rect, ThreadPool* pool);
 
 // Modify zig-zag order, so that DCT bands with more zeros go later.
 // Order of DCT bands with same number of zeros is untouched, so
-// permutation will be cheaper to encode.
+// permutation will be cheaper to encode. The number of zeros is counted on
+// `pool`, one group per task.
 void ComputeCoeffOrder(SpeedTier speed, const ACImage& acs,
                        const AcStrategyImage& ac_strategy,
                        const FrameDimensions& frame_dim, uint32_t& used_orders,
-                       coeff_order_t* JXL_RESTRICT order);
+                       coeff_order_t* JXL_RESTRICT order, ThreadPool* pool);
 
 void EncodeCoeffOrders(uint16_t used_orders,
                        const coeff_order_t* JXL_RESTRICT order,
                        BitWriter* writer, size_t layer,
+                       const HistogramParams& histogram_params,
                        AuxOut* JXL_RESTRICT aux_out);
 
 // Encoding/decoding of a single permutation. `size`: number of elements in the
@@ -45,6 +49,7 @@ void EncodeCoeffOrders(uint16_t used_orders,
 // permutation.
 void EncodePermutation(const coeff_order_t* JXL_RESTRICT order, size_t skip,
                        size_t size, BitWriter* writer, int layer,
+                       const HistogramParams& histogram_params,
                        AuxOut* aux_out);
 
 }  // namespace jxl
@@ -0,0 +1,90 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "lib/jxl/enc_content_analysis.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+#include "lib/jxl/base/profiler.h"
+#include "lib/jxl/common.h"
+
+namespace jxl {
+
+namespace {
+
+// Same tolerance as the screenshot-like area detection in
+// enc_patch_dictionary.cc.
+constexpr float kSameTolerance = 1e-4f;
+
+uint64_t HashFloats(uint64_t h, const float* JXL_RESTRICT row, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    uint32_t bits;
+    memcpy(&bits, row + i, sizeof(bits));
+    h = (h ^ bits) * 0x100000001B3ull;
+  }
+  return h;
+}
+
+}  // namespace
+
+ContentAnalysis AnalyzeContent(const Image3F& opsin, ThreadPool* pool) {
+  PROFILER_FUNC;
+  ContentAnalysis result;
+  const size_t xsize_blocks = DivCeil(opsin.xsize(), kBlockDim);
+  const size_t ysize_blocks = DivCeil(opsin.ysize(), kBlockDim);
+  if (xsize_blocks == 0 || ysize_blocks == 0) return result;
+
+  // Hash of the contents of each non-flat block, 0 for flat blocks.
+  std::vector<uint64_t> hashes(xsize_blocks * ysize_blocks);
+  const auto process_row = [&](const uint32_t by, size_t /* thread */) {
+    const size_t y0 = by * kBlockDim;
+    const size_t y1 = std::min(y0 + kBlockDim, opsin.ysize());
+    for (size_t bx = 0; bx < xsize_blocks; bx++) {
+      const size_t x0 = bx * kBlockDim;
+      const size_t x1 = std::min(x0 + kBlockDim, opsin.xsize());
+      bool block_flat = true;
+      uint64_t hash = 0xCBF29CE484222325ull;
+      for (size_t c = 0; c < 3; c++) {
+        const float ref = opsin.ConstPlaneRow(c, y0)[x0];
+        for (size_t y = y0; y < y1; y++) {
+          const float* JXL_RESTRICT row = opsin.ConstPlaneRow(c, y);
+          for (size_t x = x0; x < x1; x++) {
+            if (std::abs(row[x] - ref) > kSameTolerance) block_flat = false;
+          }
+          hash = HashFloats(hash, row + x0, x1 - x0);
+        }
+      }
+      hashes[by * xsize_blocks + bx] = block_flat ? 0 : (hash | 1);
+    }
+  };
+  RunOnPool(pool, 0, ysize_blocks, ThreadPool::SkipInit(), process_row,
+            "AnalyzeContent");
+
+  std::unordered_map<uint64_t, uint32_t> block_counts;
+  for (const uint64_t hash : hashes) {
+    if (hash != 0) block_counts[hash]++;
+  }
+  size_t non_flat_blocks = 0;
+  size_t repeated_blocks = 0;
+  for (const auto& kv : block_counts) {
+    non_flat_blocks += kv.second;
+    if (kv.second > 1) repeated_blocks += kv.second;
+  }
+
+  result.num_blocks = hashes.size();
+  result.repeated_fraction =
+      non_flat_blocks == 0
+          ? 0.0f
+          : static_cast<float>(repeated_blocks) / non_flat_blocks;
+  return result;
+}
+
+}  // namespace jxl
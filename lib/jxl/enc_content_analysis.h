@@ -0,0 +1,42 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef LIB_JXL_ENC_CONTENT_ANALYSIS_H_
+#define LIB_JXL_ENC_CONTENT_ANALYSIS_H_
+
+// Cheap pre-analysis of the image content, used to decide which of the
+// (expensive) encoder detectors are worth running on a given frame.
+
+#include <stddef.h>
+
+#include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/image.h"
+
+namespace jxl {
+
+struct ContentAnalysis {
+  // Number of 8x8 blocks that were analyzed.
+  size_t num_blocks = 0;
+  // Fraction of non-flat 8x8 blocks that have an exact duplicate elsewhere in
+  // the image (repeated glyphs, icons, UI elements).
+  float repeated_fraction = 0.0f;
+
+  // Screenshots, text and UI rather than photographic content. Flat areas and
+  // few colors are not enough: dark skies and starfields have both. Textured
+  // blocks that repeat bit-exactly, however, do not occur in camera images.
+  bool LikelySynthetic() const { return repeated_fraction > 0.1f; }
+  // Whether searching for dots (small Gaussian ellipses, e.g. stars in
+  // astrophotography) is likely to find anything.
+  bool WantDots() const { return !LikelySynthetic(); }
+};
+
+// Computes the statistics above in a single pass over the pixels of `opsin`
+// (XYB), hashing each 8x8 block; only one hash per block is kept, i.e. the
+// merge runs at the resolution of the DC image. `opsin` is not modified.
+ContentAnalysis AnalyzeContent(const Image3F& opsin, ThreadPool* pool);
+
+}  // namespace jxl
+
+#endif  // LIB_JXL_ENC_CONTENT_ANALYSIS_H_
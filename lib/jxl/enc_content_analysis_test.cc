@@ -0,0 +1,74 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "lib/jxl/enc_content_analysis.h"
+
+#include <cmath>
+
+#include "gtest/gtest.h"
+#include "lib/jxl/base/thread_pool_internal.h"
+#include "lib/jxl/image_ops.h"
+#include "lib/jxl/image_test_utils.h"
+
+namespace jxl {
+namespace {
+
+TEST(EncContentAnalysisTest, Noise) {
+  Image3F image(256, 192);
+  RandomFillImage(&image, 0.0f, 0.5f, 17);
+  ThreadPoolInternal pool(4);
+  const ContentAnalysis content = AnalyzeContent(image, &pool);
+  EXPECT_EQ(content.num_blocks, 32u * 24u);
+  EXPECT_EQ(content.repeated_fraction, 0.0f);
+  EXPECT_FALSE(content.LikelySynthetic());
+  EXPECT_TRUE(content.WantDots());
+}
+
+TEST(EncContentAnalysisTest, Starfield) {
+  // Mostly exactly flat black sky, and sparse stars.
+  Image3F image(256, 192);
+  ZeroFillImage(&image);
+  for (size_t i = 0; i < 40; i++) {
+    const int cx = 5 + (i * 53) % 246;
+    const int cy = 5 + (i * 37) % 182;
+    for (size_t c = 0; c < 3; c++) {
+      for (int y = cy - 2; y <= cy + 2; y++) {
+        float* JXL_RESTRICT row = image.PlaneRow(c, y);
+        for (int x = cx - 2; x <= cx + 2; x++) {
+          const float d2 = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+          row[x] += (0.2f + 0.003f * i) * std::exp(-d2 / 2.0f);
+        }
+      }
+    }
+  }
+  const ContentAnalysis content = AnalyzeContent(image, /*pool=*/nullptr);
+  EXPECT_FALSE(content.LikelySynthetic());
+  EXPECT_TRUE(content.WantDots());
+}
+
+TEST(EncContentAnalysisTest, RepeatedGlyphsOnFlatBackground) {
+  Image3F image(256, 192);
+  FillImage(0.3f, &image);
+  // Draw the same "glyph" at block-aligned positions.
+  for (size_t gy = 0; gy < image.ysize(); gy += 32) {
+    for (size_t gx = 0; gx < image.xsize(); gx += 32) {
+      for (size_t c = 0; c < 3; c++) {
+        for (size_t y = 0; y < 8; y++) {
+          float* JXL_RESTRICT row = image.PlaneRow(c, gy + y);
+          for (size_t x = 0; x < 8; x++) {
+            if ((x * 3 + y * 5) % 7 < 3) row[gx + x] = 0.05f * c;
+          }
+        }
+      }
+    }
+  }
+  const ContentAnalysis content = AnalyzeContent(image, /*pool=*/nullptr);
+  EXPECT_EQ(content.repeated_fraction, 1.0f);
+  EXPECT_TRUE(content.LikelySynthetic());
+  EXPECT_FALSE(content.WantDots());
+}
+
+}  // namespace
+}  // namespace jxl
@@ -56,7 +56,8 @@ std::vector<uint8_t> MoveToFrontTransform(const std::vector<uint8_t>& v) {
 }  // namespace
 
 void EncodeContextMap(const std::vector<uint8_t>& context_map,
-                      size_t num_histograms, BitWriter* writer) {
+                      size_t num_histograms, bool force_huffman,
+                      BitWriter* writer) {
   if (num_histograms == 1) {
     // Simple code
     writer->Write(1, 1);
@@ -77,6 +78,7 @@ void EncodeContextMap(const std::vector<uint8_t>& context_map,
   }
   HistogramParams params;
   params.uint_method = HistogramParams::HybridUintMethod::kContextMap;
+  params.force_huffman = force_huffman;
   size_t ans_cost = BuildAndEncodeHistograms(
       params, 1, tokens, &codes, &dummy_context_map, nullptr, 0, nullptr);
   size_t mtf_cost = BuildAndEncodeHistograms(
@@ -105,8 +107,8 @@ void EncodeContextMap(const std::vector<uint8_t>& context_map,
   }
 }
 
-void EncodeBlockCtxMap(const BlockCtxMap& block_ctx_map, BitWriter* writer,
-                       AuxOut* aux_out) {
+void EncodeBlockCtxMap(const BlockCtxMap& block_ctx_map, bool force_huffman,
+                       BitWriter* writer, AuxOut* aux_out) {
   auto& dct = block_ctx_map.dc_thresholds;
   auto& qft = block_ctx_map.qf_thresholds;
   auto& ctx_map = block_ctx_map.ctx_map;
@@ -132,7 +134,7 @@ void EncodeBlockCtxMap(const BlockCtxMap& block_ctx_map, BitWriter* writer,
   for (uint32_t i : qft) {
     JXL_CHECK(U32Coder::Write(kQFThresholdDist, i - 1, writer));
   }
-  EncodeContextMap(ctx_map, block_ctx_map.num_ctxs, writer);
+  EncodeContextMap(ctx_map, block_ctx_map.num_ctxs, force_huffman, writer);
   ReclaimAndCharge(writer, &allotment, kLayerAC, aux_out);
 }
 
@@ -22,12 +22,14 @@ namespace jxl {
 static const size_t kClustersLimit = 128;
 
 // Encodes the given context map to the bit stream. The number of different
-// histogram ids is given by num_histograms.
+// histogram ids is given by num_histograms. If force_huffman, the context map
+// itself is entropy-coded with prefix codes only.
 void EncodeContextMap(const std::vector<uint8_t>& context_map,
-                      size_t num_histograms, BitWriter* writer);
+                      size_t num_histograms, bool force_huffman,
+                      BitWriter* writer);
 
-void EncodeBlockCtxMap(const BlockCtxMap& block_ctx_map, BitWriter* writer,
-                       AuxOut* aux_out);
+void EncodeBlockCtxMap(const BlockCtxMap& block_ctx_map, bool force_huffman,
+                       BitWriter* writer, AuxOut* aux_out);
 }  // namespace jxl
 
 #endif  // LIB_JXL_ENC_CONTEXT_MAP_H_
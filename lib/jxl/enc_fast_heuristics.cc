@@ -33,139 +33,199 @@ using DF4 = HWY_CAPPED(float, 4);
 DF4 df4;
 HWY_FULL(float) df;
 
-Status Heuristics(PassesEncoderState* enc_state,
-                  ModularFrameEncoder* modular_frame_encoder,
-                  const ImageBundle* linear, Image3F* opsin, ThreadPool* pool,
-                  AuxOut* aux_out) {
-  PROFILER_ZONE("JxlLossyFrameHeuristics uninstrumented");
-  CompressParams& cparams = enc_state->cparams;
-  PassesSharedState& shared = enc_state->shared;
-  const FrameDimensions& frame_dim = enc_state->shared.frame_dim;
-  JXL_CHECK(cparams.butteraugli_distance > 0);
-
-  // TODO(veluca): make this tiled.
-  if (shared.frame_header.loop_filter.gab) {
-    GaborishInverse(opsin, 0.9908511000000001f, pool);
-  }
-  // Compute image of high frequencies by removing a blurred version.
-  // TODO(veluca): certainly can be made faster, and use less memory...
-  constexpr size_t pad = 16;
-  Image3F padded = PadImageMirror(*opsin, pad, pad);
-  // Make the image (X, Y, B-Y)
-  // TODO(veluca): SubtractFrom is not parallel *and* not SIMD-fied.
-  SubtractFrom(padded.Plane(1), &padded.Plane(2));
-  // Ensure that OOB access for CfL does nothing. Not necessary if doing things
-  // properly...
-  Image3F hf(padded.xsize() + 64, padded.ysize());
-  ZeroFillImage(&hf);
-  hf.ShrinkTo(padded.xsize(), padded.ysize());
-  ImageF temp(padded.xsize(), padded.ysize());
-  // TODO(veluca): consider some faster blurring method.
-  auto g = CreateRecursiveGaussian(11.415258091746161);
-  for (size_t c = 0; c < 3; c++) {
-    FastGaussian(g, padded.Plane(c), pool, &temp, &hf.Plane(c));
-    SubtractFrom(padded.Plane(c), &hf.Plane(c));
+void HighFrequencyCells(const Image3F& opsin, const FrameDimensions& frame_dim,
+                        ThreadPool* pool, ColorCorrelationMap* cmap,
+                        Image3F* pooled, Image3F* summed) {
+  // The image of high frequencies is the difference between the image and a
+  // blurred version of it. The blur is wide enough to be computed on a 4x
+  // downsampled image and upsampled bilinearly on the fly, so that the high
+  // frequencies never need to be stored at full resolution.
+  constexpr size_t kPool = 4;
+  static_assert(kColorTileDim % kPool == 0, "Tiles must contain whole cells");
+  const size_t xsize_cells = frame_dim.xsize_padded / kPool;
+  const size_t ysize_cells = frame_dim.ysize_padded / kPool;
+  Image3F cells(xsize_cells, ysize_cells);
+  RunOnPool(
+      pool, 0, ysize_cells, ThreadPool::SkipInit(),
+      [&](size_t y, size_t _) {
+        const auto inv_area = Set(df4, 1.0f / (kPool * kPool));
+        for (size_t c = 0; c < 3; c++) {
+          float* JXL_RESTRICT row_out = cells.PlaneRow(c, y);
+          for (size_t x = 0; x < xsize_cells; x++) {
+            auto sum = Zero(df4);
+            for (size_t iy = 0; iy < kPool; iy++) {
+              const float* row_in = opsin.ConstPlaneRow(c, kPool * y + iy);
+              for (size_t ix = 0; ix < kPool; ix += Lanes(df4)) {
+                sum += Load(df4, row_in + x * kPool + ix);
+              }
+            }
+            row_out[x] = GetLane(SumOfLanes(sum * inv_area));
+          }
+        }
+      },
+      "DownsampleForBlur");
+  // Mirrored border of the downsampled image, matching 16 pixels at full
+  // resolution; it also provides the neighbours for upsampling at the edges.
+  constexpr size_t pad = 4;
+  Image3F blurred(xsize_cells + 2 * pad, ysize_cells + 2 * pad);
+  {
+    // TODO(veluca): consider some faster blurring method.
+    auto g = CreateRecursiveGaussian(11.415258091746161 / kPool);
+    Image3F padded = PadImageMirror(cells, pad, pad);
+    ImageF temp(padded.xsize(), padded.ysize());
+    for (size_t c = 0; c < 3; c++) {
+      FastGaussian(g, padded.Plane(c), pool, &temp, &blurred.Plane(c));
+    }
   }
+
+  // For each tile: chroma from luma, and the maximum and sum of the absolute
+  // high frequencies of (X, Y, B-Y) in each 4x4 cell.
   // TODO(veluca): DC CfL?
   size_t xcolortiles = DivCeil(frame_dim.xsize_blocks, kColorTileDimInBlocks);
   size_t ycolortiles = DivCeil(frame_dim.ysize_blocks, kColorTileDimInBlocks);
+  *pooled = Image3F(xsize_cells, ysize_cells);
+  *summed = Image3F(xsize_cells, ysize_cells);
   RunOnPool(
       pool, 0, xcolortiles * ycolortiles, ThreadPool::SkipInit(),
       [&](size_t tile_id, size_t _) {
         size_t tx = tile_id % xcolortiles;
         size_t ty = tile_id / xcolortiles;
-        size_t x0 = tx * kColorTileDim;
-        size_t x1 = std::min(x0 + kColorTileDim, hf.xsize());
-        size_t y0 = ty * kColorTileDim;
-        size_t y1 = std::min(y0 + kColorTileDim, hf.ysize());
-        for (size_t c : {0, 2}) {
-          static constexpr float kInvColorFactor = 1.0f / kDefaultColorFactor;
-          auto ca = Zero(df);
-          auto cb = Zero(df);
-          const auto inv_color_factor = Set(df, kInvColorFactor);
-          for (size_t y = y0; y < y1; y++) {
-            const float* row_m = hf.PlaneRow(1, y);
-            const float* row_s = hf.PlaneRow(c, y);
-            for (size_t x = x0; x < x1; x += Lanes(df)) {
+        size_t cx0 = tx * kColorTileDim / kPool;
+        size_t cx1 = std::min(cx0 + kColorTileDim / kPool, xsize_cells);
+        size_t cy0 = ty * kColorTileDim / kPool;
+        size_t cy1 = std::min(cy0 + kColorTileDim / kPool, ysize_cells);
+        // Bilinear weights of the previous, current and next cell for the
+        // pixels of a cell.
+        HWY_ALIGN static constexpr float kWeightPrev[kPool] = {0.375f, 0.125f,
+                                                               0.0f, 0.0f};
+        HWY_ALIGN static constexpr float kWeightCur[kPool] = {0.625f, 0.875f,
+                                                              0.875f, 0.625f};
+        HWY_ALIGN static constexpr float kWeightNext[kPool] = {0.0f, 0.0f,
+                                                               0.125f, 0.375f};
+        static constexpr float kInvColorFactor = 1.0f / kDefaultColorFactor;
+        const auto inv_color_factor = Set(df4, kInvColorFactor);
+        // Blurred cells of the current row, vertically interpolated, including
+        // one neighbour on each side.
+        float blurred_row[3][kColorTileDim / kPool + 2];
+        auto ca = Zero(df4);
+        auto cb_x = Zero(df4);
+        auto cb_b = Zero(df4);
+        // Per-lane maximum and sum of each cell of the current row of cells.
+        HWY_ALIGN float abs_max[3][kColorTileDim];
+        HWY_ALIGN float abs_sum[3][kColorTileDim];
+        const size_t num_cells = cx1 - cx0;
+        for (size_t cy = cy0; cy < cy1; cy++) {
+          for (size_t c = 0; c < 3; c++) {
+            std::fill(abs_max[c], abs_max[c] + num_cells * kPool, 0.0f);
+            std::fill(abs_sum[c], abs_sum[c] + num_cells * kPool, 0.0f);
+          }
+          for (size_t iy = 0; iy < kPool; iy++) {
+            const size_t y = cy * kPool + iy;
+            for (size_t c = 0; c < 3; c++) {
+              const float* row_prev = blurred.ConstPlaneRow(c, cy + pad - 1);
+              const float* row_cur = blurred.ConstPlaneRow(c, cy + pad);
+              const float* row_next = blurred.ConstPlaneRow(c, cy + pad + 1);
+              for (size_t i = 0; i < num_cells + 2; i++) {
+                const size_t x = cx0 + pad - 1 + i;
+                blurred_row[c][i] = kWeightPrev[iy] * row_prev[x] +
+                                    kWeightCur[iy] * row_cur[x] +
+                                    kWeightNext[iy] * row_next[x];
+              }
+            }
+            const float* JXL_RESTRICT row_in[3] = {opsin.ConstPlaneRow(0, y),
+                                                   opsin.ConstPlaneRow(1, y),
+                                                   opsin.ConstPlaneRow(2, y)};
+            for (size_t x = 0; x < num_cells * kPool; x += Lanes(df4)) {
+              const size_t i = x / kPool;
+              const size_t ix = x % kPool;
+              const auto w_prev = Load(df4, kWeightPrev + ix);
+              const auto w_cur = Load(df4, kWeightCur + ix);
+              const auto w_next = Load(df4, kWeightNext + ix);
+              decltype(Zero(df4)) hf[3];
+              for (size_t c = 0; c < 3; c++) {
+                const float* b = &blurred_row[c][i];
+                const auto blur = MulAdd(
+                    Set(df4, b[0]), w_prev,
+                    MulAdd(Set(df4, b[1]), w_cur, Set(df4, b[2]) * w_next));
+                hf[c] = Load(df4, row_in[c] + cx0 * kPool + x) - blur;
+              }
+              // Make the image (X, Y, B-Y).
+              hf[2] = hf[2] - hf[1];
               // color residual = ax + b
-              const auto a = inv_color_factor * Load(df, row_m + x);
-              const auto b = Zero(df) - Load(df, row_s + x);
+              const auto a = inv_color_factor * hf[1];
               ca = MulAdd(a, a, ca);
-              cb = MulAdd(a, b, cb);
+              cb_x = MulAdd(a, Zero(df4) - hf[0], cb_x);
+              cb_b = MulAdd(a, Zero(df4) - hf[2], cb_b);
+              for (size_t c = 0; c < 3; c++) {
+                const auto nn = Abs(hf[c]);
+                const auto m = Load(df4, abs_max[c] + x);
+                Store(IfThenElse(m > nn, m, nn), df4, abs_max[c] + x);
+                Store(Load(df4, abs_sum[c] + x) + nn, df4, abs_sum[c] + x);
+              }
             }
           }
-          float best =
-              -GetLane(SumOfLanes(cb)) / (GetLane(SumOfLanes(ca)) + 1e-9f);
-          int8_t& res = (c == 0 ? shared.cmap.ytox_map : shared.cmap.ytob_map)
-                            .Row(ty)[tx];
-          res = std::max(-128.0f, std::min(127.0f, roundf(best)));
-        }
-      },
-      "CfL");
-  Image3F pooled(frame_dim.xsize_padded / 4, frame_dim.ysize_padded / 4);
-  Image3F summed(frame_dim.xsize_padded / 4, frame_dim.ysize_padded / 4);
-  RunOnPool(
-      pool, 0, frame_dim.ysize_padded / 4, ThreadPool::SkipInit(),
-      [&](size_t y, size_t _) {
-        for (size_t c = 0; c < 3; c++) {
-          float* JXL_RESTRICT row_out = pooled.PlaneRow(c, y);
-          float* JXL_RESTRICT row_out_avg = summed.PlaneRow(c, y);
-          const float* JXL_RESTRICT row_in[4];
-          for (size_t iy = 0; iy < 4; iy++) {
-            row_in[iy] = hf.PlaneRow(c, 4 * y + pad + iy);
-          }
-          for (size_t x = 0; x < frame_dim.xsize_padded / 4; x++) {
-            auto max = Zero(df4);
-            auto sum = Zero(df4);
-            for (size_t iy = 0; iy < 4; iy++) {
-              for (size_t ix = 0; ix < 4; ix += Lanes(df4)) {
-                const auto nn = Abs(Load(df4, row_in[iy] + x * 4 + ix + pad));
-                sum += nn;
-                max = IfThenElse(max > nn, max, nn);
+          for (size_t c = 0; c < 3; c++) {
+            float* JXL_RESTRICT row_out = pooled->PlaneRow(c, cy);
+            float* JXL_RESTRICT row_out_avg = summed->PlaneRow(c, cy);
+            for (size_t i = 0; i < num_cells; i++) {
+              auto cell_sum = Zero(df4);
+              auto cell_max = Zero(df4);
+              for (size_t ix = 0; ix < kPool; ix += Lanes(df4)) {
+                cell_sum += Load(df4, abs_sum[c] + i * kPool + ix);
+                const auto m = Load(df4, abs_max[c] + i * kPool + ix);
+                cell_max = IfThenElse(cell_max > m, cell_max, m);
               }
+              row_out_avg[cx0 + i] = GetLane(SumOfLanes(cell_sum));
+              row_out[cx0 + i] = GetLane(MaxOfLanes(cell_max));
             }
-            row_out_avg[x] = GetLane(SumOfLanes(sum));
-            row_out[x] = GetLane(MaxOfLanes(max));
           }
         }
+        const float ca_sum = GetLane(SumOfLanes(ca)) + 1e-9f;
+        for (size_t c : {0, 2}) {
+          const auto cb = c == 0 ? cb_x : cb_b;
+          float best = -GetLane(SumOfLanes(cb)) / ca_sum;
+          int8_t& res = (c == 0 ? cmap->ytox_map : cmap->ytob_map)
+                            .Row(ty)[tx];
+          res = std::max(-128.0f, std::min(127.0f, roundf(best)));
+        }
       },
-      "MaxPool");
+      "CfL+MaxPool");
+}
+
+Status Heuristics(PassesEncoderState* enc_state,
+                  ModularFrameEncoder* modular_frame_encoder,
+                  const ImageBundle* linear, Image3F* opsin, ThreadPool* pool,
+                  AuxOut* aux_out) {
+  PROFILER_ZONE("JxlLossyFrameHeuristics uninstrumented");
+  CompressParams& cparams = enc_state->cparams;
+  PassesSharedState& shared = enc_state->shared;
+  const FrameDimensions& frame_dim = enc_state->shared.frame_dim;
+  JXL_CHECK(cparams.butteraugli_distance > 0);
+
+  if (shared.frame_header.loop_filter.gab) {
+    GaborishInverse(opsin, 0.9908511000000001f, pool);
+  }
+  Image3F pooled;
+  Image3F summed;
+  HighFrequencyCells(*opsin, frame_dim, pool, &shared.cmap, &pooled, &summed);
+  size_t xcolortiles = DivCeil(frame_dim.xsize_blocks, kColorTileDimInBlocks);
+  size_t ycolortiles = DivCeil(frame_dim.ysize_blocks, kColorTileDimInBlocks);
+
   // TODO(veluca): better handling of the border
   // TODO(veluca): consider some faster blurring method.
-  // TODO(veluca): parallelize.
   // Remove noise from the resulting image.
   auto g2 = CreateRecursiveGaussian(2.0849544429861884);
   constexpr size_t pad2 = 16;
-  Image3F summed_pad = PadImageMirror(summed, pad2, pad2);
-  ImageF tmp_out(summed_pad.xsize(), summed_pad.ysize());
-  ImageF tmp2(summed_pad.xsize(), summed_pad.ysize());
-  Image3F pooled_pad = PadImageMirror(pooled, pad2, pad2);
-  for (size_t c = 0; c < 3; c++) {
-    FastGaussian(g2, summed_pad.Plane(c), pool, &tmp2, &tmp_out);
-    const auto unblurred_multiplier = Set(df, 0.5f);
-    for (size_t y = 0; y < summed.ysize(); y++) {
-      float* row = summed.PlaneRow(c, y);
-      const float* row_blur = tmp_out.Row(y + pad2);
-      for (size_t x = 0; x < summed.xsize(); x += Lanes(df)) {
-        const auto b = Load(df, row_blur + x + pad2);
-        const auto o = Load(df, row + x) * unblurred_multiplier;
-        const auto m = IfThenElse(b > o, b, o);
-        Store(m, df, row + x);
-      }
-    }
-  }
-  for (size_t c = 0; c < 3; c++) {
-    FastGaussian(g2, pooled_pad.Plane(c), pool, &tmp2, &tmp_out);
-    const auto unblurred_multiplier = Set(df, 0.5f);
-    for (size_t y = 0; y < pooled.ysize(); y++) {
-      float* row = pooled.PlaneRow(c, y);
-      const float* row_blur = tmp_out.Row(y + pad2);
-      for (size_t x = 0; x < pooled.xsize(); x += Lanes(df)) {
-        const auto b = Load(df, row_blur + x + pad2);
-        const auto o = Load(df, row + x) * unblurred_multiplier;
-        const auto m = IfThenElse(b > o, b, o);
-        Store(m, df, row + x);
-      }
+  Image3F summed_blur(summed.xsize() + 2 * pad2, summed.ysize() + 2 * pad2);
+  Image3F pooled_blur(pooled.xsize() + 2 * pad2, pooled.ysize() + 2 * pad2);
+  {
+    Image3F summed_pad = PadImageMirror(summed, pad2, pad2);
+    Image3F pooled_pad = PadImageMirror(pooled, pad2, pad2);
+    ImageF tmp(summed_pad.xsize(), summed_pad.ysize());
+    for (size_t c = 0; c < 3; c++) {
+      FastGaussian(g2, summed_pad.Plane(c), pool, &tmp,
+                   &summed_blur.Plane(c));
+      FastGaussian(g2, pooled_pad.Plane(c), pool, &tmp, &pooled_blur.Plane(c));
     }
   }
   const static float kChannelMul[3] = {
@@ -174,33 +234,34 @@ Status Heuristics(PassesEncoderState* enc_state,
       0.20267448837597055f,
   };
   ImageF pooledhf44(pooled.xsize(), pooled.ysize());
-  for (size_t y = 0; y < pooled.ysize(); y++) {
-    const float* row_in_x = pooled.ConstPlaneRow(0, y);
-    const float* row_in_y = pooled.ConstPlaneRow(1, y);
-    const float* row_in_b = pooled.ConstPlaneRow(2, y);
-    float* row_out = pooledhf44.Row(y);
-    for (size_t x = 0; x < pooled.xsize(); x += Lanes(df)) {
-      auto v = Set(df, kChannelMul[0]) * Load(df, row_in_x + x);
-      v = MulAdd(Set(df, kChannelMul[1]), Load(df, row_in_y + x), v);
-      v = MulAdd(Set(df, kChannelMul[2]), Load(df, row_in_b + x), v);
-      Store(v, df, row_out + x);
-    }
-  }
   ImageF summedhf44(summed.xsize(), summed.ysize());
-  for (size_t y = 0; y < summed.ysize(); y++) {
-    const float* row_in_x = summed.ConstPlaneRow(0, y);
-    const float* row_in_y = summed.ConstPlaneRow(1, y);
-    const float* row_in_b = summed.ConstPlaneRow(2, y);
-    float* row_out = summedhf44.Row(y);
-    for (size_t x = 0; x < summed.xsize(); x += Lanes(df)) {
-      auto v = Set(df, kChannelMul[0]) * Load(df, row_in_x + x);
-      v = MulAdd(Set(df, kChannelMul[1]), Load(df, row_in_y + x), v);
-      v = MulAdd(Set(df, kChannelMul[2]), Load(df, row_in_b + x), v);
-      Store(v, df, row_out + x);
-    }
+  RunOnPool(
+      pool, 0, summed.ysize(), ThreadPool::SkipInit(),
+      [&](size_t y, size_t _) {
+        const auto unblurred_multiplier = Set(df, 0.5f);
+        for (size_t i = 0; i < 2; i++) {
+          const Image3F& in = i == 0 ? summed : pooled;
+          const Image3F& blur = i == 0 ? summed_blur : pooled_blur;
+          float* row_out = (i == 0 ? summedhf44 : pooledhf44).Row(y);
+          for (size_t x = 0; x < in.xsize(); x += Lanes(df)) {
+            auto v = Zero(df);
+            for (size_t c = 0; c < 3; c++) {
+              const float* row_blur = blur.ConstPlaneRow(c, y + pad2);
+              const auto b = Load(df, row_blur + x + pad2);
+              const auto o =
+                  Load(df, in.ConstPlaneRow(c, y) + x) * unblurred_multiplier;
+              const auto m = IfThenElse(b > o, b, o);
+              v = MulAdd(Set(df, kChannelMul[c]), m, v);
+            }
+            Store(v, df, row_out + x);
+          }
+        }
+      },
+      "HF44");
+  if (aux_out != nullptr) {
+    aux_out->DumpPlaneNormalized("pooledhf44", pooledhf44);
+    aux_out->DumpPlaneNormalized("summedhf44", summedhf44);
   }
-  aux_out->DumpPlaneNormalized("pooledhf44", pooledhf44);
-  aux_out->DumpPlaneNormalized("summedhf44", summedhf44);
 
   static const float kDcQuantMul = 0.88170190420916206;
   static const float kAcQuantMul = 2.5165738934721524;
@@ -330,10 +391,12 @@ Status Heuristics(PassesEncoderState* enc_state,
         }
       },
       "QF+ACS+EPF");
-  aux_out->DumpPlaneNormalized("qf", quant_field);
-  aux_out->DumpPlaneNormalized("epf", shared.epf_sharpness);
-  DumpAcStrategy(shared.ac_strategy, frame_dim.xsize_padded,
-                 frame_dim.ysize_padded, "acs", aux_out);
+  if (aux_out != nullptr) {
+    aux_out->DumpPlaneNormalized("qf", quant_field);
+    aux_out->DumpPlaneNormalized("epf", shared.epf_sharpness);
+    DumpAcStrategy(shared.ac_strategy, frame_dim.xsize_padded,
+                   frame_dim.ysize_padded, "acs", aux_out);
+  }
 
   shared.quantizer.SetQuantField(dc_quant, quant_field,
                                  &shared.raw_quant_field);
@@ -349,6 +412,7 @@ HWY_AFTER_NAMESPACE();
 #if HWY_ONCE
 namespace jxl {
 HWY_EXPORT(Heuristics);
+HWY_EXPORT(HighFrequencyCells);
 Status FastEncoderHeuristics::LossyFrameHeuristics(
     PassesEncoderState* enc_state, ModularFrameEncoder* modular_frame_encoder,
     const ImageBundle* linear, Image3F* opsin, ThreadPool* pool,
@@ -357,5 +421,13 @@ Status FastEncoderHeuristics::LossyFrameHeuristics(
                                           linear, opsin, pool, aux_out);
 }
 
+void FastHighFrequencyCells(const Image3F& opsin,
+                            const FrameDimensions& frame_dim, ThreadPool* pool,
+                            ColorCorrelationMap* cmap, Image3F* pooled,
+                            Image3F* summed) {
+  HWY_DYNAMIC_DISPATCH(HighFrequencyCells)(opsin, frame_dim, pool, cmap, pooled,
+                                           summed);
+}
+
 }  // namespace jxl
 #endif
@@ -0,0 +1,200 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "gtest/gtest.h"
+#include "lib/jxl/base/thread_pool_internal.h"
+#include "lib/jxl/chroma_from_luma.h"
+#include "lib/jxl/common.h"
+#include "lib/jxl/enc_heuristics.h"
+#include "lib/jxl/gauss_blur.h"
+#include "lib/jxl/image_ops.h"
+#include "lib/jxl/image_test_utils.h"
+
+namespace jxl {
+namespace {
+
+// Smooth XYB-like gradients with texture and a few hard edges.
+Image3F MakeOpsin(const FrameDimensions& frame_dim) {
+  Image3F opsin(frame_dim.xsize_padded, frame_dim.ysize_padded);
+  std::mt19937 rng(123);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  const float kScale[3] = {0.01f, 0.1f, 0.1f};
+  for (size_t y = 0; y < opsin.ysize(); y++) {
+    for (size_t c = 0; c < 3; c++) {
+      float* JXL_RESTRICT row = opsin.PlaneRow(c, y);
+      for (size_t x = 0; x < opsin.xsize(); x++) {
+        const float smooth =
+            std::sin(0.02f * x + c) * std::cos(0.03f * y) + 0.5f * c;
+        const float edge = ((x / 40) + (y / 24)) % 3 == 0 ? 1.0f : 0.0f;
+        // Y (c == 1) correlates with X and B, as in actual images.
+        const float texture = 0.7f * dist(rng) + 0.3f * (c == 1 ? 0.0f : 1.0f);
+        row[x] = kScale[c] * (smooth + edge + texture);
+      }
+    }
+  }
+  return opsin;
+}
+
+// The frame-level computation that FastHighFrequencyCells replaced: blur of a
+// mirrored copy at full resolution, then the per-cell statistics of the whole
+// high-frequency image.
+void ReferenceHighFrequencyCells(const Image3F& opsin,
+                                 const FrameDimensions& frame_dim,
+                                 ColorCorrelationMap* cmap, Image3F* pooled,
+                                 Image3F* summed) {
+  constexpr size_t pad = 16;
+  Image3F padded = PadImageMirror(opsin, pad, pad);
+  SubtractFrom(padded.Plane(1), &padded.Plane(2));
+  Image3F hf(padded.xsize(), padded.ysize());
+  ImageF temp(padded.xsize(), padded.ysize());
+  auto g = CreateRecursiveGaussian(11.415258091746161);
+  for (size_t c = 0; c < 3; c++) {
+    ImageF blurred(padded.xsize(), padded.ysize());
+    FastGaussian(g, padded.Plane(c), /*pool=*/nullptr, &temp, &blurred);
+    for (size_t y = 0; y < hf.ysize(); y++) {
+      for (size_t x = 0; x < hf.xsize(); x++) {
+        hf.PlaneRow(c, y)[x] =
+            padded.ConstPlaneRow(c, y)[x] - blurred.ConstRow(y)[x];
+      }
+    }
+  }
+
+  const size_t xcolortiles =
+      DivCeil(frame_dim.xsize_blocks, kColorTileDimInBlocks);
+  const size_t ycolortiles =
+      DivCeil(frame_dim.ysize_blocks, kColorTileDimInBlocks);
+  for (size_t ty = 0; ty < ycolortiles; ty++) {
+    for (size_t tx = 0; tx < xcolortiles; tx++) {
+      const size_t x0 = tx * kColorTileDim;
+      const size_t x1 = std::min(x0 + kColorTileDim, frame_dim.xsize_padded);
+      const size_t y0 = ty * kColorTileDim;
+      const size_t y1 = std::min(y0 + kColorTileDim, frame_dim.ysize_padded);
+      for (size_t c : {0, 2}) {
+        double ca = 0;
+        double cb = 0;
+        for (size_t y = y0; y < y1; y++) {
+          for (size_t x = x0; x < x1; x++) {
+            const double a =
+                hf.ConstPlaneRow(1, y + pad)[x + pad] / kDefaultColorFactor;
+            ca += a * a;
+            cb -= a * hf.ConstPlaneRow(c, y + pad)[x + pad];
+          }
+        }
+        const float best = -cb / (ca + 1e-9);
+        (c == 0 ? cmap->ytox_map : cmap->ytob_map).Row(ty)[tx] =
+            std::max(-128.0f, std::min(127.0f, std::round(best)));
+      }
+    }
+  }
+
+  *pooled = Image3F(frame_dim.xsize_padded / 4, frame_dim.ysize_padded / 4);
+  *summed = Image3F(frame_dim.xsize_padded / 4, frame_dim.ysize_padded / 4);
+  for (size_t c = 0; c < 3; c++) {
+    for (size_t y = 0; y < pooled->ysize(); y++) {
+      for (size_t x = 0; x < pooled->xsize(); x++) {
+        float max = 0.0f;
+        float sum = 0.0f;
+        for (size_t iy = 0; iy < 4; iy++) {
+          for (size_t ix = 0; ix < 4; ix++) {
+            const float v = std::abs(
+                hf.ConstPlaneRow(c, 4 * y + iy + pad)[4 * x + ix + pad]);
+            max = std::max(max, v);
+            sum += v;
+          }
+        }
+        pooled->PlaneRow(c, y)[x] = max;
+        summed->PlaneRow(c, y)[x] = sum;
+      }
+    }
+  }
+}
+
+// Sum of absolute differences relative to the sum of absolute values.
+double RelativeError(const ImageF& expected, const ImageF& actual) {
+  double error = 0;
+  double total = 0;
+  for (size_t y = 0; y < expected.ysize(); y++) {
+    for (size_t x = 0; x < expected.xsize(); x++) {
+      error += std::abs(actual.ConstRow(y)[x] - expected.ConstRow(y)[x]);
+      total += std::abs(expected.ConstRow(y)[x]);
+    }
+  }
+  return error / std::max(total, 1e-9);
+}
+
+void TestMatchesFrameLevel(size_t xsize, size_t ysize) {
+  FrameDimensions frame_dim;
+  frame_dim.Set(xsize, ysize, /*group_size_shift=*/1, /*max_hshift=*/0,
+                /*max_vshift=*/0, /*modular_mode=*/false, /*upsampling=*/1);
+  const Image3F opsin = MakeOpsin(frame_dim);
+
+  ColorCorrelationMap expected_cmap(xsize, ysize);
+  Image3F expected_pooled;
+  Image3F expected_summed;
+  ReferenceHighFrequencyCells(opsin, frame_dim, &expected_cmap,
+                              &expected_pooled, &expected_summed);
+
+  ColorCorrelationMap cmap(xsize, ysize);
+  Image3F pooled;
+  Image3F summed;
+  FastHighFrequencyCells(opsin, frame_dim, /*pool=*/nullptr, &cmap, &pooled,
+                         &summed);
+
+  ASSERT_EQ(expected_pooled.xsize(), pooled.xsize());
+  ASSERT_EQ(expected_pooled.ysize(), pooled.ysize());
+  for (size_t c = 0; c < 3; c++) {
+    // The bilinearly upsampled blur only deviates from the full-resolution one
+    // by a small fraction of the high frequencies.
+    EXPECT_LT(RelativeError(expected_pooled.Plane(c), pooled.Plane(c)), 0.01)
+        << "c=" << c;
+    EXPECT_LT(RelativeError(expected_summed.Plane(c), summed.Plane(c)), 0.01)
+        << "c=" << c;
+  }
+  for (size_t ty = 0; ty < cmap.ytox_map.ysize(); ty++) {
+    for (size_t tx = 0; tx < cmap.ytox_map.xsize(); tx++) {
+      EXPECT_NEAR(expected_cmap.ytox_map.Row(ty)[tx], cmap.ytox_map.Row(ty)[tx],
+                  1)
+          << "tile " << tx << "," << ty;
+      EXPECT_NEAR(expected_cmap.ytob_map.Row(ty)[tx], cmap.ytob_map.Row(ty)[tx],
+                  1)
+          << "tile " << tx << "," << ty;
+    }
+  }
+
+  // Tiles are independent, so the partitioning among threads does not matter.
+  ThreadPoolInternal pool(4);
+  ColorCorrelationMap cmap_mt(xsize, ysize);
+  Image3F pooled_mt;
+  Image3F summed_mt;
+  FastHighFrequencyCells(opsin, frame_dim, &pool, &cmap_mt, &pooled_mt,
+                         &summed_mt);
+  VerifyEqual(pooled, pooled_mt);
+  VerifyEqual(summed, summed_mt);
+  for (size_t ty = 0; ty < cmap.ytox_map.ysize(); ty++) {
+    for (size_t tx = 0; tx < cmap.ytox_map.xsize(); tx++) {
+      EXPECT_EQ(cmap.ytox_map.Row(ty)[tx], cmap_mt.ytox_map.Row(ty)[tx]);
+      EXPECT_EQ(cmap.ytob_map.Row(ty)[tx], cmap_mt.ytob_map.Row(ty)[tx]);
+    }
+  }
+}
+
+TEST(EncFastHeuristicsTest, HighFrequencyCellsMatchFrameLevel) {
+  TestMatchesFrameLevel(256, 192);
+}
+
+TEST(EncFastHeuristicsTest, HighFrequencyCellsPartialTiles) {
+  // Neither a multiple of the color tile size nor of the group size.
+  TestMatchesFrameLevel(300, 140);
+}
+
+}  // namespace
+}  // namespace jxl
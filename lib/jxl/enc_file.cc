@@ -7,6 +7,7 @@
 
 #include <stddef.h>
 
+#include <algorithm>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -23,6 +24,7 @@
 #include "lib/jxl/frame_header.h"
 #include "lib/jxl/headers.h"
 #include "lib/jxl/image_bundle.h"
+#include "lib/jxl/image_ops.h"
 
 namespace jxl {
 
@@ -137,11 +139,46 @@ Status PrepareCodecMetadataFromIO(const CompressParams& cparams,
 
 }  // namespace
 
+Status GeneratePreview(const ImageBundle& ib, CodecMetadata* metadata,
+                       ImageBundle* preview) {
+  JXL_ASSERT(ib.HasColor());
+  const size_t factor =
+      DivCeil(std::max(ib.xsize(), ib.ysize()), kMaxGeneratedPreviewSize);
+  if (factor <= 1) return true;
+  const size_t xsize = DivCeil(ib.xsize(), factor);
+  const size_t ysize = DivCeil(ib.ysize(), factor);
+  JXL_RETURN_IF_ERROR(metadata->m.preview_size.Set(xsize, ysize));
+  metadata->m.have_preview = true;
+
+  Image3F color(xsize, ysize);
+  for (size_t c = 0; c < 3; c++) {
+    DownsampleImage(ib.color().Plane(c), factor, &color.Plane(c));
+  }
+  preview->SetFromImage(std::move(color), ib.c_current());
+  if (ib.HasExtraChannels()) {
+    std::vector<ImageF> extra_channels;
+    for (const ImageF& ec : ib.extra_channels()) {
+      extra_channels.emplace_back(DivCeil(ec.xsize(), factor),
+                                  DivCeil(ec.ysize(), factor));
+      DownsampleImage(ec, factor, &extra_channels.back());
+    }
+    preview->SetExtraChannels(std::move(extra_channels));
+  }
+  return true;
+}
+
+CompressParams GeneratedPreviewParams(const CompressParams& cparams) {
+  CompressParams preview_cparams = cparams;
+  preview_cparams.resampling = 1;
+  preview_cparams.ec_resampling = 1;
+  preview_cparams.already_downsampled = false;
+  return preview_cparams;
+}
+
 Status EncodePreview(const CompressParams& cparams, const ImageBundle& ib,
                      const CodecMetadata* metadata, ThreadPool* pool,
                      BitWriter* JXL_RESTRICT writer) {
   BitWriter preview_writer;
-  // TODO(janwas): also support generating preview by downsampling
   if (ib.HasColor()) {
     AuxOut aux_out;
     PassesEncoderState passes_enc_state;
@@ -199,6 +236,12 @@ Status EncodeFile(const CompressParams& cparams_orig, const CodecInOut* io,
 
   std::unique_ptr<CodecMetadata> metadata = jxl::make_unique<CodecMetadata>();
   JXL_RETURN_IF_ERROR(PrepareCodecMetadataFromIO(cparams, io, metadata.get()));
+  ImageBundle generated_preview(&metadata->m);
+  if (cparams.generate_preview && !metadata->m.have_preview &&
+      io->Main().HasColor()) {
+    JXL_RETURN_IF_ERROR(
+        GeneratePreview(io->Main(), metadata.get(), &generated_preview));
+  }
   JXL_RETURN_IF_ERROR(WriteHeaders(metadata.get(), &writer, aux_out));
 
   // Only send ICC (at least several hundred bytes) if fields aren't enough.
@@ -207,7 +250,11 @@ Status EncodeFile(const CompressParams& cparams_orig, const CodecInOut* io,
                                  kLayerHeader, aux_out));
   }
 
-  if (metadata->m.have_preview) {
+  if (generated_preview.HasColor()) {
+    JXL_RETURN_IF_ERROR(EncodePreview(GeneratedPreviewParams(cparams),
+                                      generated_preview, metadata.get(), pool,
+                                      &writer));
+  } else if (metadata->m.have_preview) {
     JXL_RETURN_IF_ERROR(EncodePreview(cparams, io->preview_frame,
                                       metadata.get(), pool, &writer));
   }
@@ -19,6 +19,18 @@
 
 namespace jxl {
 
+// Sets up `metadata` for a preview of `ib` at most kMaxGeneratedPreviewSize
+// pixels wide and high and fills `preview` (which must use metadata->m) with
+// a box-filtered downsampling of `ib`. Does nothing if `ib` is already small
+// enough.
+Status GeneratePreview(const ImageBundle& ib, CodecMetadata* metadata,
+                       ImageBundle* preview);
+
+// Returns the parameters for EncodePreview of a preview made by
+// GeneratePreview: it is already downsampled, so the resampling of the main
+// image does not apply to it.
+CompressParams GeneratedPreviewParams(const CompressParams& cparams);
+
 // Write preview from `io`.
 Status EncodePreview(const CompressParams& cparams, const ImageBundle& ib,
                      const CodecMetadata* metadata, ThreadPool* pool,
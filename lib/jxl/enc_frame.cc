@@ -68,14 +68,38 @@
 namespace jxl {
 namespace {
 
-void ClusterGroups(PassesEncoderState* enc_state) {
+// Returns the groups from which cparams.streaming_histograms estimates the AC
+// histograms: one per group row or column, whichever there are more of, along
+// the diagonal of the frame. Every row and column of groups is represented,
+// and the sampled tokens take no more memory than one band of groups.
+std::vector<uint32_t> StreamingHistogramSample(
+    const FrameDimensions& frame_dim) {
+  const size_t num_samples =
+      std::max(frame_dim.xsize_groups, frame_dim.ysize_groups);
+  std::vector<uint32_t> sample(num_samples);
+  for (size_t i = 0; i < num_samples; i++) {
+    const size_t gx = i * frame_dim.xsize_groups / num_samples;
+    const size_t gy = i * frame_dim.ysize_groups / num_samples;
+    sample[i] = gy * frame_dim.xsize_groups + gx;
+  }
+  return sample;
+}
+
+// Histogram parameters of the entropy-coded streams of a frame other than the
+// AC tokens and the modular streams, such as coefficient orders, patches,
+// splines and the TOC permutation.
+HistogramParams SmallStreamHistogramParams(const CompressParams& cparams) {
+  HistogramParams params;
+  params.force_huffman = cparams.UsePrefixCodes();
+  return params;
+}
+
+void ClusterGroups(PassesEncoderState* enc_state, ThreadPool* pool) {
   if (enc_state->shared.frame_header.passes.num_passes > 1) {
     // TODO(veluca): implement this for progressive modes.
     return;
   }
   // This only considers pass 0 for now.
-  std::vector<uint8_t> context_map;
-  EntropyEncodingData codes;
   auto& ac = enc_state->passes[0].ac_tokens;
   size_t limit = std::ceil(std::sqrt(ac.size()));
   if (limit == 1) return;
@@ -86,39 +110,70 @@ void ClusterGroups(PassesEncoderState* enc_state) {
   params.lz77_method = HistogramParams::LZ77Method::kNone;
   params.ans_histogram_strategy =
       HistogramParams::ANSHistogramStrategy::kApproximate;
-  size_t max = 0;
+  // Safe to call concurrently with a null `inner_pool`. Otherwise, histograms
+  // are built and tokens written on `inner_pool`, one token stream per task.
   auto token_cost = [&](std::vector<std::vector<Token>>& tokens, size_t num_ctx,
-                        bool estimate = true) {
+                        ThreadPool* inner_pool, bool estimate = true) {
     // TODO(veluca): not estimating is very expensive.
+    std::vector<uint8_t> context_map;
+    EntropyEncodingData codes;
     BitWriter writer;
     size_t c = BuildAndEncodeHistograms(
         params, num_ctx, tokens, &codes, &context_map,
-        estimate ? nullptr : &writer, 0, /*aux_out=*/0);
+        estimate ? nullptr : &writer, 0, /*aux_out=*/0, inner_pool);
     if (estimate) return c;
-    for (size_t i = 0; i < tokens.size(); i++) {
-      WriteTokens(tokens[i], codes, context_map, &writer, 0, nullptr);
-    }
-    return writer.BitsWritten();
+    std::vector<size_t> bits(tokens.size());
+    RunOnPool(
+        inner_pool, 0, tokens.size(), ThreadPool::SkipInit(),
+        [&](const uint32_t i, size_t /* thread */) {
+          BitWriter stream_writer;
+          WriteTokens(tokens[i], codes, context_map, &stream_writer, 0,
+                      nullptr);
+          bits[i] = stream_writer.BitsWritten();
+        },
+        "ClusterGroupsWriteTokens");
+    size_t total = writer.BitsWritten();
+    for (size_t b : bits) total += b;
+    return total;
   };
+  // Per-group costs and pairwise distances are independent of each other, and
+  // computed on the pool; the (cheap) selections that use them are serial, so
+  // the result does not depend on the number of threads.
+  RunOnPool(
+      pool, 0, ac.size(), ThreadPool::SkipInit(),
+      [&](const uint32_t i, size_t /* thread */) {
+        std::vector<std::vector<Token>> tokens{ac[i]};
+        costs[i] = token_cost(tokens, num_contexts, /*inner_pool=*/nullptr);
+      },
+      "ClusterGroupsCost");
+  size_t max = 0;
   for (size_t i = 0; i < ac.size(); i++) {
-    std::vector<std::vector<Token>> tokens{ac[i]};
-    costs[i] =
-        token_cost(tokens, enc_state->shared.block_ctx_map.NumACContexts());
     if (costs[i] > costs[max]) {
       max = i;
     }
   }
   auto dist = [&](int i, int j) {
     std::vector<std::vector<Token>> tokens{ac[i], ac[j]};
-    return token_cost(tokens, num_contexts) - costs[i] - costs[j];
+    return token_cost(tokens, num_contexts, /*inner_pool=*/nullptr) -
+           costs[i] - costs[j];
+  };
+  std::vector<float> new_dists(ac.size());
+  auto compute_dists = [&](size_t from) {
+    RunOnPool(
+        pool, 0, ac.size(), ThreadPool::SkipInit(),
+        [&](const uint32_t i, size_t /* thread */) {
+          new_dists[i] = dist(from, i);
+        },
+        "ClusterGroupsDist");
   };
   std::vector<size_t> out{max};
   std::vector<size_t> old_map(ac.size());
   std::vector<float> dists(ac.size());
   size_t farthest = 0;
+  compute_dists(max);
   for (size_t i = 0; i < ac.size(); i++) {
     if (i == max) continue;
-    dists[i] = dist(max, i);
+    dists[i] = new_dists[i];
     if (dists[i] > dists[farthest]) {
       farthest = i;
     }
@@ -128,8 +183,9 @@ void ClusterGroups(PassesEncoderState* enc_state) {
     out.push_back(farthest);
     dists[farthest] = 0;
     enc_state->histogram_idx[farthest] = out.size() - 1;
+    compute_dists(out.back());
     for (size_t i = 0; i < ac.size(); i++) {
-      float d = dist(out.back(), i);
+      float d = new_dists[i];
       if (d < dists[i]) {
         dists[i] = d;
         old_map[i] = enc_state->histogram_idx[i];
@@ -155,16 +211,22 @@ void ClusterGroups(PassesEncoderState* enc_state) {
       }
       remap[i] = re_remap[remap[i]];
     }
-    auto tokens = ac;
+    std::vector<std::vector<Token>> tokens(ac.size());
     size_t max_hist = 0;
     for (size_t i = 0; i < tokens.size(); i++) {
-      for (size_t j = 0; j < tokens[i].size(); j++) {
-        size_t hist = remap[enc_state->histogram_idx[i]];
-        tokens[i][j].context += hist * num_contexts;
-        max_hist = std::max(hist + 1, max_hist);
-      }
+      if (ac[i].empty()) continue;
+      max_hist = std::max(remap[enc_state->histogram_idx[i]] + 1, max_hist);
     }
-    return token_cost(tokens, max_hist * num_contexts, /*estimate=*/false);
+    RunOnPool(
+        pool, 0, ac.size(), ThreadPool::SkipInit(),
+        [&](const uint32_t i, size_t /* thread */) {
+          const size_t hist = remap[enc_state->histogram_idx[i]];
+          tokens[i] = ac[i];
+          for (Token& token : tokens[i]) token.context += hist * num_contexts;
+        },
+        "ClusterGroupsRemap");
+    return token_cost(tokens, max_hist * num_contexts, pool,
+                      /*estimate=*/false);
   };
 
   for (size_t src = 0; src < out.size(); src++) {
@@ -327,6 +389,11 @@ Status MakeFrameHeader(const CompressParams& cparams,
       cparams.ec_resampling != 4 && cparams.ec_resampling != 8) {
     return JXL_FAILURE("Invalid ec_resampling factor");
   }
+  if (cparams.butteraugli_proxy_downsampling != 1 &&
+      cparams.butteraugli_proxy_downsampling != 2 &&
+      cparams.butteraugli_proxy_downsampling != 4) {
+    return JXL_FAILURE("Invalid butteraugli proxy downsampling factor");
+  }
   // Resized frames.
   if (frame_info.frame_type != FrameType::kDCFrame) {
     frame_header->frame_origin = ib.origin;
@@ -508,34 +575,7 @@ class LossyFrameEncoder {
     ComputeAllCoeffOrders(shared.frame_dim);
     shared.num_histograms = 1;
 
-    const auto tokenize_group_init = [&](const size_t num_threads) {
-      group_caches_.resize(num_threads);
-      return true;
-    };
-    const auto tokenize_group = [&](const int group_index, const int thread) {
-      // Tokenize coefficients.
-      const Rect rect = shared.BlockGroupRect(group_index);
-      for (size_t idx_pass = 0; idx_pass < enc_state_->passes.size();
-           idx_pass++) {
-        JXL_ASSERT(enc_state_->coeffs[idx_pass]->Type() == ACType::k32);
-        const int32_t* JXL_RESTRICT ac_rows[3] = {
-            enc_state_->coeffs[idx_pass]->PlaneRow(0, group_index, 0).ptr32,
-            enc_state_->coeffs[idx_pass]->PlaneRow(1, group_index, 0).ptr32,
-            enc_state_->coeffs[idx_pass]->PlaneRow(2, group_index, 0).ptr32,
-        };
-        // Ensure group cache is initialized.
-        group_caches_[thread].InitOnce();
-        TokenizeCoefficients(
-            &shared.coeff_orders[idx_pass * shared.coeff_order_size], rect,
-            ac_rows, shared.ac_strategy, frame_header->chroma_subsampling,
-            &group_caches_[thread].num_nzeroes,
-            &enc_state_->passes[idx_pass].ac_tokens[group_index],
-            enc_state_->shared.quant_dc, enc_state_->shared.raw_quant_field,
-            enc_state_->shared.block_ctx_map);
-      }
-    };
-    RunOnPool(pool_, 0, shared.frame_dim.num_groups, tokenize_group_init,
-              tokenize_group, "TokenizeGroup");
+    TokenizeAllGroups(frame_header->chroma_subsampling);
 
     *frame_header = shared.frame_header;
     return true;
@@ -857,34 +897,7 @@ class LossyFrameEncoder {
     ComputeAllCoeffOrders(frame_dim);
     shared.num_histograms = 1;
 
-    const auto tokenize_group_init = [&](const size_t num_threads) {
-      group_caches_.resize(num_threads);
-      return true;
-    };
-    const auto tokenize_group = [&](const int group_index, const int thread) {
-      // Tokenize coefficients.
-      const Rect rect = shared.BlockGroupRect(group_index);
-      for (size_t idx_pass = 0; idx_pass < enc_state_->passes.size();
-           idx_pass++) {
-        JXL_ASSERT(enc_state_->coeffs[idx_pass]->Type() == ACType::k32);
-        const int32_t* JXL_RESTRICT ac_rows[3] = {
-            enc_state_->coeffs[idx_pass]->PlaneRow(0, group_index, 0).ptr32,
-            enc_state_->coeffs[idx_pass]->PlaneRow(1, group_index, 0).ptr32,
-            enc_state_->coeffs[idx_pass]->PlaneRow(2, group_index, 0).ptr32,
-        };
-        // Ensure group cache is initialized.
-        group_caches_[thread].InitOnce();
-        TokenizeCoefficients(
-            &shared.coeff_orders[idx_pass * shared.coeff_order_size], rect,
-            ac_rows, shared.ac_strategy, frame_header->chroma_subsampling,
-            &group_caches_[thread].num_nzeroes,
-            &enc_state_->passes[idx_pass].ac_tokens[group_index],
-            enc_state_->shared.quant_dc, enc_state_->shared.raw_quant_field,
-            enc_state_->shared.block_ctx_map);
-      }
-    };
-    RunOnPool(pool_, 0, shared.frame_dim.num_groups, tokenize_group_init,
-              tokenize_group, "TokenizeGroup");
+    TokenizeAllGroups(frame_header->chroma_subsampling);
     *frame_header = shared.frame_header;
     return true;
   }
@@ -894,7 +907,8 @@ class LossyFrameEncoder {
     // Encode quantizer DC and global scale.
     JXL_RETURN_IF_ERROR(
         enc_state_->shared.quantizer.Encode(writer, kLayerQuant, aux_out_));
-    EncodeBlockCtxMap(enc_state_->shared.block_ctx_map, writer, aux_out_);
+    EncodeBlockCtxMap(enc_state_->shared.block_ctx_map,
+                      enc_state_->cparams.UsePrefixCodes(), writer, aux_out_);
     ColorCorrelationMapEncodeDC(&enc_state_->shared.cmap, writer, kLayerDC,
                                 aux_out_);
     return true;
@@ -905,8 +919,9 @@ class LossyFrameEncoder {
     JXL_RETURN_IF_ERROR(DequantMatricesEncode(&enc_state_->shared.matrices,
                                               writer, kLayerDequantTables,
                                               aux_out_, modular_frame_encoder));
-    if (enc_state_->cparams.speed_tier <= SpeedTier::kTortoise) {
-      ClusterGroups(enc_state_);
+    if (enc_state_->cparams.speed_tier <= SpeedTier::kTortoise &&
+        !enc_state_->cparams.streaming_histograms) {
+      ClusterGroups(enc_state_, pool_);
     }
     size_t num_histo_bits =
         CeilLog2Nonzero(enc_state_->shared.frame_dim.num_groups);
@@ -929,24 +944,23 @@ class LossyFrameEncoder {
           enc_state_->used_orders[i],
           &enc_state_->shared
                .coeff_orders[i * enc_state_->shared.coeff_order_size],
-          writer, kLayerOrder, aux_out_);
+          writer, kLayerOrder,
+          SmallStreamHistogramParams(enc_state_->cparams), aux_out_);
 
       // Encode histograms.
-      HistogramParams hist_params(
-          enc_state_->cparams.speed_tier,
-          enc_state_->shared.block_ctx_map.NumACContexts());
-      if (enc_state_->cparams.speed_tier > SpeedTier::kTortoise) {
-        hist_params.lz77_method = HistogramParams::LZ77Method::kNone;
-      }
-      if (enc_state_->cparams.decoding_speed_tier >= 1) {
-        hist_params.max_histograms = 6;
+      if (enc_state_->cparams.streaming_histograms) {
+        // Already built (and charged) by TokenizeAndEncodeAllGroups.
+        *writer += enc_state_->passes[i].encoded_histograms;
+        enc_state_->passes[i].encoded_histograms = BitWriter();
+        continue;
       }
       BuildAndEncodeHistograms(
-          hist_params,
+          ACHistogramParams(),
           enc_state_->shared.num_histograms *
               enc_state_->shared.block_ctx_map.NumACContexts(),
           enc_state_->passes[i].ac_tokens, &enc_state_->passes[i].codes,
-          &enc_state_->passes[i].context_map, writer, kLayerAC, aux_out_);
+          &enc_state_->passes[i].context_map, writer, kLayerAC, aux_out_,
+          pool_);
     }
 
     return true;
@@ -954,6 +968,19 @@ class LossyFrameEncoder {
 
   Status EncodeACGroup(size_t pass, size_t group_index, BitWriter* group_code,
                        AuxOut* local_aux_out) {
+    if (enc_state_->cparams.streaming_histograms) {
+      // No histogram selector to write: ClusterGroups was skipped.
+      JXL_ASSERT(enc_state_->shared.num_histograms == 1);
+      BitWriter& encoded =
+          enc_state_->passes[pass].encoded_ac_groups[group_index];
+      if (local_aux_out != nullptr) {
+        local_aux_out->layers[kLayerACTokens].total_bits +=
+            encoded.BitsWritten();
+      }
+      *group_code += encoded;
+      encoded = BitWriter();
+      return true;
+    }
     return EncodeGroupTokenizedCoefficients(
         group_index, pass, enc_state_->histogram_idx[group_index], *enc_state_,
         group_code, local_aux_out);
@@ -962,23 +989,203 @@ class LossyFrameEncoder {
   PassesEncoderState* State() { return enc_state_; }
 
  private:
+  HistogramParams ACHistogramParams() const {
+    HistogramParams hist_params(
+        enc_state_->cparams.speed_tier,
+        enc_state_->shared.block_ctx_map.NumACContexts());
+    if (enc_state_->cparams.speed_tier > SpeedTier::kTortoise) {
+      hist_params.lz77_method = HistogramParams::LZ77Method::kNone;
+    }
+    if (enc_state_->cparams.decoding_speed_tier >= 1) {
+      hist_params.max_histograms = 6;
+    }
+    hist_params.force_huffman = enc_state_->cparams.UsePrefixCodes();
+    return hist_params;
+  }
+
+  // Tokenizes the AC coefficients of pass `pass` of the given group into the
+  // token buffer of `thread`, and returns that buffer.
+  std::vector<Token>& TokenizeGroup(size_t pass, size_t group_index,
+                                    const YCbCrChromaSubsampling& cs,
+                                    size_t thread) {
+    PassesSharedState& shared = enc_state_->shared;
+    const Rect rect = shared.BlockGroupRect(group_index);
+    JXL_ASSERT(enc_state_->coeffs[pass]->Type() == ACType::k32);
+    const int32_t* JXL_RESTRICT ac_rows[3] = {
+        enc_state_->coeffs[pass]->PlaneRow(0, group_index, 0).ptr32,
+        enc_state_->coeffs[pass]->PlaneRow(1, group_index, 0).ptr32,
+        enc_state_->coeffs[pass]->PlaneRow(2, group_index, 0).ptr32,
+    };
+    // Ensure group cache is initialized.
+    group_caches_[thread].InitOnce();
+    std::vector<Token>& tokens = group_caches_[thread].tokens;
+    tokens.clear();
+    TokenizeCoefficients(&shared.coeff_orders[pass * shared.coeff_order_size],
+                         rect, ac_rows, shared.ac_strategy, cs,
+                         &group_caches_[thread].num_nzeroes, &tokens,
+                         shared.quant_dc, shared.raw_quant_field,
+                         shared.block_ctx_map);
+    return tokens;
+  }
+
+  void TokenizeAllGroups(const YCbCrChromaSubsampling& cs) {
+    if (enc_state_->cparams.streaming_histograms) {
+      return TokenizeAndEncodeAllGroups(cs);
+    }
+    const auto tokenize_group_init = [&](const size_t num_threads) {
+      group_caches_.resize(num_threads);
+      return true;
+    };
+    const auto tokenize_group = [&](const int group_index, const int thread) {
+      for (size_t idx_pass = 0; idx_pass < enc_state_->passes.size();
+           idx_pass++) {
+        const std::vector<Token>& tokens =
+            TokenizeGroup(idx_pass, group_index, cs, thread);
+        enc_state_->passes[idx_pass].ac_tokens[group_index].assign(
+            tokens.begin(), tokens.end());
+      }
+    };
+    RunOnPool(pool_, 0, enc_state_->shared.frame_dim.num_groups,
+              tokenize_group_init, tokenize_group, "TokenizeGroup");
+  }
+
+  // Low-memory variant of TokenizeAllGroups: the histograms of each pass are
+  // built from the StreamingHistogramSample groups only, with room for every
+  // possible symbol, after which all groups are tokenized and immediately
+  // entropy-coded. Only the sampled tokens, at most one band of groups, and
+  // one group per thread are ever kept in memory. In realtime mode, the
+  // histograms of the previous frame are reused if possible, which leaves a
+  // single parallel pass over the groups.
+  void TokenizeAndEncodeAllGroups(const YCbCrChromaSubsampling& cs) {
+    PassesSharedState& shared = enc_state_->shared;
+    const size_t num_groups = shared.frame_dim.num_groups;
+    const auto tokenize_group_init = [&](const size_t num_threads) {
+      group_caches_.resize(num_threads);
+      return true;
+    };
+    const size_t num_contexts =
+        shared.num_histograms * shared.block_ctx_map.NumACContexts();
+    if (!RestoreRealtimeHistograms(num_contexts)) {
+      BuildSampledHistograms(cs, num_contexts);
+    }
+
+    const auto encode_group = [&](const int group_index, const int thread) {
+      for (size_t idx_pass = 0; idx_pass < enc_state_->passes.size();
+           idx_pass++) {
+        PassesEncoderState::PassData& pass = enc_state_->passes[idx_pass];
+        // Bits are charged to aux_out in EncodeACGroup.
+        WriteTokens(TokenizeGroup(idx_pass, group_index, cs, thread),
+                    pass.codes, pass.context_map,
+                    &pass.encoded_ac_groups[group_index], kLayerACTokens,
+                    /*aux_out=*/nullptr);
+      }
+    };
+    RunOnPool(pool_, 0, num_groups, tokenize_group_init, encode_group,
+              "TokenizeAndEncodeGroup");
+  }
+
+  // Builds the histograms of each pass from a sample of the groups, see
+  // TokenizeAndEncodeAllGroups. In realtime mode, also keeps them for the
+  // following frames.
+  void BuildSampledHistograms(const YCbCrChromaSubsampling& cs,
+                              size_t num_contexts) {
+    PassesSharedState& shared = enc_state_->shared;
+    const size_t num_groups = shared.frame_dim.num_groups;
+    const auto tokenize_group_init = [&](const size_t num_threads) {
+      group_caches_.resize(num_threads);
+      return true;
+    };
+    const std::vector<uint32_t> sample =
+        StreamingHistogramSample(shared.frame_dim);
+    const auto tokenize_sample = [&](const int sample_index, const int thread) {
+      const size_t group_index = sample[sample_index];
+      for (size_t idx_pass = 0; idx_pass < enc_state_->passes.size();
+           idx_pass++) {
+        const std::vector<Token>& tokens =
+            TokenizeGroup(idx_pass, group_index, cs, thread);
+        enc_state_->passes[idx_pass].ac_tokens[group_index].assign(
+            tokens.begin(), tokens.end());
+      }
+    };
+    RunOnPool(pool_, 0, sample.size(), tokenize_group_init, tokenize_sample,
+              "TokenizeSampleGroup");
+
+    // The histograms must be able to encode tokens that do not occur in the
+    // sample, which LZ77 would not allow.
+    HistogramParams hist_params = ACHistogramParams();
+    hist_params.lz77_method = HistogramParams::LZ77Method::kNone;
+    hist_params.add_missing_symbols = true;
+    for (PassesEncoderState::PassData& pass : enc_state_->passes) {
+      BuildAndEncodeHistograms(hist_params, num_contexts, pass.ac_tokens,
+                               &pass.codes, &pass.context_map,
+                               &pass.encoded_histograms, kLayerAC, aux_out_,
+                               pool_);
+      std::vector<std::vector<Token>>().swap(pass.ac_tokens);
+      pass.encoded_ac_groups.resize(num_groups);
+    }
+
+    if (!enc_state_->cparams.realtime) return;
+    enc_state_->realtime_histograms.resize(enc_state_->passes.size());
+    for (size_t i = 0; i < enc_state_->passes.size(); i++) {
+      const PassesEncoderState::PassData& pass = enc_state_->passes[i];
+      PassesEncoderState::RealtimeHistograms& saved =
+          enc_state_->realtime_histograms[i];
+      saved.num_contexts = num_contexts;
+      saved.context_map = pass.context_map;
+      saved.codes = pass.codes;
+      saved.encoded_histograms = BitWriter();
+      saved.encoded_histograms += pass.encoded_histograms;
+    }
+  }
+
+  // Sets up the histograms of every pass from the ones kept by a previous
+  // realtime frame. Returns false if there are none, or if they were built
+  // for a different number of contexts.
+  bool RestoreRealtimeHistograms(size_t num_contexts) {
+    if (!enc_state_->cparams.realtime) return false;
+    const auto& saved = enc_state_->realtime_histograms;
+    if (saved.size() != enc_state_->passes.size()) return false;
+    for (const PassesEncoderState::RealtimeHistograms& s : saved) {
+      if (s.num_contexts != num_contexts) return false;
+    }
+    for (size_t i = 0; i < saved.size(); i++) {
+      PassesEncoderState::PassData& pass = enc_state_->passes[i];
+      pass.context_map = saved[i].context_map;
+      pass.codes = saved[i].codes;
+      pass.encoded_histograms = BitWriter();
+      pass.encoded_histograms += saved[i].encoded_histograms;
+      if (aux_out_ != nullptr) {
+        aux_out_->layers[kLayerAC].total_bits +=
+            pass.encoded_histograms.BitsWritten();
+      }
+      std::vector<std::vector<Token>>().swap(pass.ac_tokens);
+      pass.encoded_ac_groups.resize(enc_state_->shared.frame_dim.num_groups);
+    }
+    return true;
+  }
+
   void ComputeAllCoeffOrders(const FrameDimensions& frame_dim) {
     PROFILER_FUNC;
     enc_state_->used_orders.resize(
         enc_state_->progressive_splitter.GetNumPasses());
+    // No coefficient reordering in Falcon or faster.
+    uint32_t used_orders = 0;
+    if (enc_state_->cparams.speed_tier < SpeedTier::kFalcon) {
+      used_orders = ComputeUsedOrders(
+          enc_state_->cparams.speed_tier, enc_state_->shared.ac_strategy,
+          Rect(enc_state_->shared.raw_quant_field), pool_);
+    }
     for (size_t i = 0; i < enc_state_->progressive_splitter.GetNumPasses();
          i++) {
-      // No coefficient reordering in Falcon or faster.
       if (enc_state_->cparams.speed_tier < SpeedTier::kFalcon) {
-        enc_state_->used_orders[i] = ComputeUsedOrders(
-            enc_state_->cparams.speed_tier, enc_state_->shared.ac_strategy,
-            Rect(enc_state_->shared.raw_quant_field));
+        enc_state_->used_orders[i] = used_orders;
       }
       ComputeCoeffOrder(
           enc_state_->cparams.speed_tier, *enc_state_->coeffs[i],
           enc_state_->shared.ac_strategy, frame_dim, enc_state_->used_orders[i],
           &enc_state_->shared
-               .coeff_orders[i * enc_state_->shared.coeff_order_size]);
+               .coeff_orders[i * enc_state_->shared.coeff_order_size],
+          pool_);
     }
   }
 
@@ -1016,6 +1223,19 @@ Status EncodeFrame(const CompressParams& cparams_orig,
 
   CompressParams cparams = cparams_orig;
 
+  if (cparams.realtime && !cparams.modular_mode) {
+    // Leave only the per-tile and per-group parts of the encoder: DCT8 with a
+    // uniform quant field, natural coefficient orders, and no detector or
+    // filter that needs a pass over the whole frame.
+    cparams.speed_tier = SpeedTier::kLightning;
+    cparams.gaborish = Override::kOff;
+    cparams.noise = Override::kOff;
+    cparams.patches = Override::kOff;
+    cparams.dots = Override::kOff;
+    cparams.progressive_dc = 0;
+    cparams.streaming_histograms = true;
+  }
+
   if (cparams.progressive_dc < 0) {
     if (cparams.progressive_dc != -1) {
       return JXL_FAILURE("Invalid progressive DC setting value (%d)",
@@ -1236,12 +1456,14 @@ Status EncodeFrame(const CompressParams& cparams_orig,
   if (frame_header->flags & FrameHeader::kPatches) {
     PatchDictionaryEncoder::Encode(
         lossy_frame_encoder.State()->shared.image_features.patches,
-        get_output(0), kLayerDictionary, aux_out);
+        get_output(0), kLayerDictionary, SmallStreamHistogramParams(cparams),
+        aux_out);
   }
 
   if (frame_header->flags & FrameHeader::kSplines) {
     EncodeSplines(lossy_frame_encoder.State()->shared.image_features.splines,
-                  get_output(0), kLayerSplines, HistogramParams(), aux_out);
+                  get_output(0), kLayerSplines,
+                  SmallStreamHistogramParams(cparams), aux_out);
   }
 
   if (frame_header->flags & FrameHeader::kNoise) {
@@ -1257,7 +1479,7 @@ Status EncodeFrame(const CompressParams& cparams_orig,
         lossy_frame_encoder.EncodeGlobalDCInfo(*frame_header, get_output(0)));
   }
   JXL_RETURN_IF_ERROR(
-      modular_frame_encoder->EncodeGlobalInfo(get_output(0), aux_out));
+      modular_frame_encoder->EncodeGlobalInfo(get_output(0), aux_out, pool));
   JXL_RETURN_IF_ERROR(modular_frame_encoder->EncodeStream(
       get_output(0), aux_out, kLayerModularGlobal, ModularStreamId::Global()));
 
@@ -1408,7 +1630,8 @@ Status EncodeFrame(const CompressParams& cparams_orig,
   }
 
   JXL_RETURN_IF_ERROR(
-      WriteGroupOffsets(group_codes, permutation_ptr, writer, aux_out));
+      WriteGroupOffsets(group_codes, permutation_ptr, writer,
+                        SmallStreamHistogramParams(cparams), aux_out));
   writer->AppendByteAligned(group_codes);
   writer->ZeroPadToByte();  // end of frame.
 
@@ -17,6 +17,7 @@
 #include "lib/jxl/enc_ar_control_field.h"
 #include "lib/jxl/enc_cache.h"
 #include "lib/jxl/enc_chroma_from_luma.h"
+#include "lib/jxl/enc_content_analysis.h"
 #include "lib/jxl/enc_modular.h"
 #include "lib/jxl/enc_noise.h"
 #include "lib/jxl/enc_patch_dictionary.h"
@@ -28,7 +29,8 @@
 
 namespace jxl {
 namespace {
-void FindBestBlockEntropyModel(PassesEncoderState& enc_state) {
+void FindBestBlockEntropyModel(PassesEncoderState& enc_state,
+                               ThreadPool* pool) {
   if (enc_state.cparams.decoding_speed_tier >= 1) {
     static constexpr uint8_t kSimpleCtxMap[] = {
         // Cluster all blocks together
@@ -58,17 +60,28 @@ void FindBestBlockEntropyModel(PassesEncoderState& enc_state) {
 
   struct OccCounters {
     // count the occurrences of each qf value and each strategy type.
-    OccCounters(const ImageI& rqf, const AcStrategyImage& ac_strategy) {
-      for (size_t y = 0; y < rqf.ysize(); y++) {
-        const int32_t* qf_row = rqf.Row(y);
-        AcStrategyRow acs_row = ac_strategy.ConstRow(y);
-        for (size_t x = 0; x < rqf.xsize(); x++) {
-          int ord = kStrategyOrder[acs_row[x].RawStrategy()];
-          int qf = qf_row[x] - 1;
-          qf_counts[qf]++;
-          qf_ord_counts[ord][qf]++;
-          ord_counts[ord]++;
+    void CountRow(const ImageI& rqf, const AcStrategyImage& ac_strategy,
+                  size_t y) {
+      const int32_t* qf_row = rqf.Row(y);
+      AcStrategyRow acs_row = ac_strategy.ConstRow(y);
+      for (size_t x = 0; x < rqf.xsize(); x++) {
+        int ord = kStrategyOrder[acs_row[x].RawStrategy()];
+        int qf = qf_row[x] - 1;
+        qf_counts[qf]++;
+        qf_ord_counts[ord][qf]++;
+        ord_counts[ord]++;
+      }
+    }
+
+    void Add(const OccCounters& other) {
+      for (size_t qf = 0; qf < 256; qf++) {
+        qf_counts[qf] += other.qf_counts[qf];
+      }
+      for (size_t ord = 0; ord < kNumOrders; ord++) {
+        for (size_t qf = 0; qf < 256; qf++) {
+          qf_ord_counts[ord][qf] += other.qf_ord_counts[ord][qf];
         }
+        ord_counts[ord] += other.ord_counts[ord];
       }
     }
 
@@ -76,9 +89,23 @@ void FindBestBlockEntropyModel(PassesEncoderState& enc_state) {
     size_t qf_ord_counts[kNumOrders][256] = {};
     size_t ord_counts[kNumOrders] = {};
   };
-  // The OccCounters struct is too big to allocate on the stack.
-  std::unique_ptr<OccCounters> counters(
-      new OccCounters(rqf, enc_state.shared.ac_strategy));
+  // The OccCounters struct is too big to allocate on the stack. Rows are
+  // counted on the pool into per-thread counters, which are then added up.
+  std::vector<std::unique_ptr<OccCounters>> thread_counters;
+  RunOnPool(
+      pool, 0, rqf.ysize(),
+      [&](const size_t num_threads) {
+        thread_counters.resize(num_threads);
+        for (auto& c : thread_counters) c.reset(new OccCounters());
+        return true;
+      },
+      [&](const uint32_t y, const size_t thread) {
+        thread_counters[thread]->CountRow(rqf, enc_state.shared.ac_strategy,
+                                          y);
+      },
+      "CountQfAndOrders");
+  std::unique_ptr<OccCounters> counters(new OccCounters());
+  for (const auto& c : thread_counters) counters->Add(*c);
 
   // Splitting the context model according to the quantization field seems to
   // mostly benefit only large images.
@@ -274,8 +301,18 @@ Status DefaultEncoderHeuristics::LossyFrameHeuristics(
   }
 
   // Find and subtract patches/dots.
-  if (ApplyOverride(cparams.patches,
-                    cparams.speed_tier <= SpeedTier::kSquirrel)) {
+  bool find_patches = ApplyOverride(cparams.patches,
+                                    cparams.speed_tier <= SpeedTier::kSquirrel);
+  if (find_patches && cparams.dots == Override::kDefault &&
+      opsin->xsize() != 0) {
+    // Unless explicitly requested, skip the dot search on content that a
+    // cheap per-block pass deems synthetic. The text-like patch search has
+    // its own pre-check for screenshot-like areas.
+    if (!AnalyzeContent(*opsin, pool).WantDots()) {
+      cparams.dots = Override::kOff;
+    }
+  }
+  if (find_patches) {
     FindBestPatchDictionary(*opsin, enc_state, pool, aux_out);
     PatchDictionaryEncoder::SubtractFrom(shared.image_features.patches, opsin);
   }
@@ -425,7 +462,7 @@ Status DefaultEncoderHeuristics::LossyFrameHeuristics(
 
   // Choose a context model that depends on the amount of quantization for AC.
   if (cparams.speed_tier < SpeedTier::kFalcon) {
-    FindBestBlockEntropyModel(*enc_state);
+    FindBestBlockEntropyModel(*enc_state, pool);
   }
   return true;
 }
@@ -21,6 +21,8 @@
 
 namespace jxl {
 
+struct ColorCorrelationMap;
+struct FrameDimensions;
 struct PassesEncoderState;
 class ImageBundle;
 class ModularFrameEncoder;
@@ -75,6 +77,17 @@ class FastEncoderHeuristics : public EncoderHeuristics {
                               ThreadPool* pool, AuxOut* aux_out) override;
 };
 
+// Part of FastEncoderHeuristics, exposed for testing: sets the chroma from luma
+// factors of each color tile of `opsin` (XYB, padded to whole blocks) in
+// `cmap`, and computes the maximum (`pooled`) and the sum (`summed`) of the
+// absolute high frequencies of (X, Y, B-Y) in each 4x4 cell. High frequencies
+// are the difference to a wide blur, which is computed at 1/4 resolution and
+// upsampled bilinearly, tile by tile.
+void FastHighFrequencyCells(const Image3F& opsin,
+                            const FrameDimensions& frame_dim, ThreadPool* pool,
+                            ColorCorrelationMap* cmap, Image3F* pooled,
+                            Image3F* summed);
+
 // Exposed here since it may be used by other EncoderHeuristics implementations
 // outside this project.
 void FindBestDequantMatrices(const CompressParams& cparams,
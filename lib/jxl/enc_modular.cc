@@ -8,6 +8,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <array>
 #include <limits>
 #include <queue>
@@ -1033,7 +1034,8 @@ Status ModularFrameEncoder::PrepareEncoding(ThreadPool* pool,
 }
 
 Status ModularFrameEncoder::EncodeGlobalInfo(BitWriter* writer,
-                                             AuxOut* aux_out) {
+                                             AuxOut* aux_out,
+                                             ThreadPool* pool) {
   BitWriter::Allotment allotment(writer, 1);
   // If we are using brotli, or not using modular mode.
   if (tree_tokens.empty() || tree_tokens[0].empty()) {
@@ -1074,6 +1076,7 @@ Status ModularFrameEncoder::EncodeGlobalInfo(BitWriter* writer,
   if (cparams.decoding_speed_tier >= 1) {
     params.max_histograms = 12;
   }
+  params.force_huffman = cparams.UsePrefixCodes();
   BuildAndEncodeHistograms(params, kNumTreeContexts, tree_tokens, &code,
                            &context_map, writer, kLayerModularTree, aux_out);
   WriteTokens(tree_tokens[0], code, context_map, writer, kLayerModularTree,
@@ -1081,7 +1084,8 @@ Status ModularFrameEncoder::EncodeGlobalInfo(BitWriter* writer,
   params.image_widths = image_widths;
   // Write histograms.
   BuildAndEncodeHistograms(params, (tree.size() + 1) / 2, tokens, &code,
-                           &context_map, writer, kLayerModularGlobal, aux_out);
+                           &context_map, writer, kLayerModularGlobal, aux_out,
+                           pool);
   return true;
 }
 
@@ -1148,42 +1152,187 @@ float EstimateWPCost(const Image& img, size_t i) {
   return histo_cost + extra_bits;
 }
 
-float EstimateCost(const Image& img) {
-  // TODO(veluca): consider SIMDfication of this code.
-  size_t extra_bits = 0;
-  float histo_cost = 0;
-  HybridUintConfig config;
-  uint32_t cutoffs[] = {0,  1,  3,  5,   7,   11,  15,  23, 31,
-                        47, 63, 95, 127, 191, 255, 392, 500};
-  constexpr size_t nc = sizeof(cutoffs) / sizeof(*cutoffs) + 1;
-  Histogram histo[nc] = {};
-  for (const Channel& ch : img.channel) {
-    const intptr_t onerow = ch.plane.PixelsPerRow();
+constexpr uint32_t kGradientCostCutoffs[] = {
+    0, 1, 3, 5, 7, 11, 15, 23, 31, 47, 63, 95, 127, 191, 255, 392, 500};
+
+// Entropy estimate of the residuals of the clamped gradient predictor in one
+// channel, with contexts given by the local gradient magnitude.
+class GradientCostStats {
+ public:
+  // `top_row` is the previous row of the channel, or nullptr for the first row.
+  void AddRow(const pixel_type* JXL_RESTRICT row,
+              const pixel_type* JXL_RESTRICT top_row, size_t xsize) {
+    // TODO(veluca): consider SIMDfication of this code.
+    for (size_t x = 0; x < xsize; x++) {
+      pixel_type_w left = (x ? row[x - 1] : top_row ? top_row[x] : 0);
+      pixel_type_w top = (top_row ? top_row[x] : left);
+      pixel_type_w topleft = (x && top_row ? top_row[x - 1] : left);
+      size_t maxdiff = std::max(std::max(left, top), topleft) -
+                       std::min(std::min(left, top), topleft);
+      size_t ctx = 0;
+      for (uint32_t c : kGradientCostCutoffs) {
+        ctx += c > maxdiff;
+      }
+      pixel_type res = row[x] - ClampedGradient(top, left, topleft);
+      uint32_t token, nbits, bits;
+      config_.Encode(PackSigned(res), &token, &nbits, &bits);
+      histo_[ctx].Add(token);
+      extra_bits_ += nbits;
+    }
+  }
+
+  void AddChannel(const Channel& ch) {
     for (size_t y = 0; y < ch.h; y++) {
-      const pixel_type* JXL_RESTRICT r = ch.Row(y);
-      for (size_t x = 0; x < ch.w; x++) {
-        pixel_type_w left = (x ? r[x - 1] : y ? *(r + x - onerow) : 0);
-        pixel_type_w top = (y ? *(r + x - onerow) : left);
-        pixel_type_w topleft = (x && y ? *(r + x - 1 - onerow) : left);
-        size_t maxdiff = std::max(std::max(left, top), topleft) -
-                         std::min(std::min(left, top), topleft);
-        size_t ctx = 0;
-        for (uint32_t c : cutoffs) {
-          ctx += c > maxdiff;
+      AddRow(ch.Row(y), y ? ch.Row(y - 1) : nullptr, ch.w);
+    }
+  }
+
+  // Adds the cost of the channel to the totals of the image.
+  void AddCost(float* histo_cost, size_t* extra_bits) const {
+    for (const Histogram& histo : histo_) {
+      *histo_cost += histo.ShannonEntropy();
+    }
+    *extra_bits += extra_bits_;
+  }
+
+ private:
+  static constexpr size_t kNumContexts =
+      sizeof(kGradientCostCutoffs) / sizeof(*kGradientCostCutoffs) + 1;
+  HybridUintConfig config_;
+  Histogram histo_[kNumContexts] = {};
+  size_t extra_bits_ = 0;
+};
+
+// One output channel of an RCT, as a function of the three input channels.
+struct RCTPlane {
+  enum Op { kCopy, kSubtract, kSubtractAvg, kYCoCgY, kYCoCgCo, kYCoCgCg };
+  Op op;
+  // Input channels, see ComputeRow.
+  int a, b, c;
+
+  bool operator==(const RCTPlane& other) const {
+    return op == other.op && a == other.a && b == other.b && c == other.c;
+  }
+
+  // Same arithmetic as FwdRCT.
+  void ComputeRow(const pixel_type* const* in, size_t xsize,
+                  pixel_type* JXL_RESTRICT out) const {
+    const pixel_type* JXL_RESTRICT in_a = in[a];
+    const pixel_type* JXL_RESTRICT in_b = in[b];
+    const pixel_type* JXL_RESTRICT in_c = in[c];
+    for (size_t x = 0; x < xsize; x++) {
+      switch (op) {
+        case kCopy:
+          out[x] = in_a[x];
+          break;
+        case kSubtract:
+          out[x] = in_a[x] - in_b[x];
+          break;
+        case kSubtractAvg:
+          out[x] = in_a[x] - ((in_b[x] + in_c[x]) >> 1);
+          break;
+        default: {
+          pixel_type co = in_a[x] - in_c[x];
+          pixel_type tmp = in_c[x] + (co >> 1);
+          pixel_type cg = in_b[x] - tmp;
+          out[x] = op == kYCoCgY ? tmp + (cg >> 1) : op == kYCoCgCo ? co : cg;
         }
-        pixel_type res = r[x] - ClampedGradient(top, left, topleft);
-        uint32_t token, nbits, bits;
-        config.Encode(PackSigned(res), &token, &nbits, &bits);
-        histo[ctx].Add(token);
-        extra_bits += nbits;
       }
     }
-    for (size_t h = 0; h < nc; h++) {
-      histo_cost += histo[h].ShannonEntropy();
-      histo[h].Clear();
+  }
+};
+
+// Output channels of FwdRCT with the given `rct_type`.
+std::array<RCTPlane, 3> RCTPlanes(int rct_type) {
+  const int permutation = rct_type / 7;
+  const int custom = rct_type % 7;
+  const int first = permutation % 3;
+  const int second = (permutation + 1 + permutation / 3) % 3;
+  const int third = (permutation + 2 - permutation / 3) % 3;
+  if (custom == 6) {
+    return {{{RCTPlane::kYCoCgY, first, second, third},
+             {RCTPlane::kYCoCgCo, first, second, third},
+             {RCTPlane::kYCoCgCg, first, second, third}}};
+  }
+  std::array<RCTPlane, 3> planes = {{{RCTPlane::kCopy, first, first, first},
+                                     {RCTPlane::kCopy, second, second, second},
+                                     {RCTPlane::kCopy, third, third, third}}};
+  if ((custom >> 1) == 1) {
+    planes[1] = {RCTPlane::kSubtract, second, first, first};
+  } else if ((custom >> 1) == 2) {
+    planes[1] = {RCTPlane::kSubtractAvg, second, std::min(first, third),
+                 std::max(first, third)};
+  }
+  if (custom & 1) planes[2] = {RCTPlane::kSubtract, third, first, first};
+  return planes;
+}
+
+// Returns the first of `rct_types` that minimizes the estimated cost of `img`
+// once applied to channels [begin_c, begin_c + 3). All the candidates are
+// evaluated in a single pass, without modifying `img`: each distinct output
+// channel is computed one row at a time.
+int FindBestRCT(const Image& img, size_t begin_c,
+                const std::vector<int>& rct_types) {
+  if (rct_types.empty() || !CheckEqualChannels(img, begin_c, begin_c + 2)) {
+    return 0;
+  }
+  std::vector<RCTPlane> planes;
+  std::vector<std::array<size_t, 3>> rct_planes;
+  for (int rct_type : rct_types) {
+    std::array<size_t, 3> indices;
+    const std::array<RCTPlane, 3> rct = RCTPlanes(rct_type);
+    for (size_t i = 0; i < 3; i++) {
+      indices[i] = std::find(planes.begin(), planes.end(), rct[i]) -
+                   planes.begin();
+      if (indices[i] == planes.size()) planes.push_back(rct[i]);
     }
+    rct_planes.push_back(indices);
   }
-  return histo_cost + extra_bits;
+
+  const size_t xsize = img.channel[begin_c].w;
+  const size_t ysize = img.channel[begin_c].h;
+  // All candidates cost the same on empty channels.
+  if (xsize == 0 || ysize == 0) return rct_types[0];
+  std::vector<GradientCostStats> plane_stats(planes.size());
+  // Current and previous row of each plane.
+  std::vector<pixel_type> rows(planes.size() * 2 * xsize);
+  for (size_t y = 0; y < ysize; y++) {
+    const pixel_type* in[3];
+    for (size_t i = 0; i < 3; i++) in[i] = img.channel[begin_c + i].Row(y);
+    for (size_t p = 0; p < planes.size(); p++) {
+      pixel_type* row = &rows[(2 * p + (y & 1)) * xsize];
+      const pixel_type* top_row =
+          y ? &rows[(2 * p + ((y - 1) & 1)) * xsize] : nullptr;
+      planes[p].ComputeRow(in, xsize, row);
+      plane_stats[p].AddRow(row, top_row, xsize);
+    }
+  }
+  // The other channels do not depend on the RCT.
+  std::vector<GradientCostStats> channel_stats(img.channel.size());
+  for (size_t i = 0; i < img.channel.size(); i++) {
+    if (i >= begin_c && i < begin_c + 3) continue;
+    channel_stats[i].AddChannel(img.channel[i]);
+  }
+
+  float best_cost = std::numeric_limits<float>::max();
+  int best_rct = 0;
+  for (size_t r = 0; r < rct_types.size(); r++) {
+    float histo_cost = 0;
+    size_t extra_bits = 0;
+    for (size_t i = 0; i < img.channel.size(); i++) {
+      const GradientCostStats& stats =
+          (i >= begin_c && i < begin_c + 3)
+              ? plane_stats[rct_planes[r][i - begin_c]]
+              : channel_stats[i];
+      stats.AddCost(&histo_cost, &extra_bits);
+    }
+    float cost = histo_cost + extra_bits;
+    if (cost < best_cost) {
+      best_rct = rct_types[r];
+      best_cost = cost;
+    }
+  }
+  return best_rct;
 }
 
 }  // namespace
@@ -1317,32 +1466,17 @@ Status ModularFrameEncoder::PrepareStreamParams(const Rect& rect,
         nb_rcts_to_try = 19;
         break;
     }
-    float best_cost = std::numeric_limits<float>::max();
-    size_t best_rct = 0;
     // These should be 19 actually different transforms; the remaining ones
     // are equivalent to one of these (note that the first two are do-nothing
     // and YCoCg) modulo channel reordering (which only matters in the case of
     // MA-with-prev-channels-properties) and/or sign (e.g. RmG vs GmR)
-    for (int i : {0 * 7 + 0, 0 * 7 + 6, 0 * 7 + 5, 1 * 7 + 3, 3 * 7 + 5,
-                  5 * 7 + 5, 1 * 7 + 5, 2 * 7 + 5, 1 * 7 + 1, 0 * 7 + 4,
-                  1 * 7 + 2, 2 * 7 + 1, 2 * 7 + 2, 2 * 7 + 3, 4 * 7 + 4,
-                  4 * 7 + 5, 0 * 7 + 2, 0 * 7 + 1, 0 * 7 + 3}) {
-      if (nb_rcts_to_try == 0) break;
-      int num_transforms_to_keep = gi.transform.size();
-      sg.rct_type = i;
-      do_transform(gi, sg, weighted::Header());
-      float cost = EstimateCost(gi);
-      if (cost < best_cost) {
-        best_rct = i;
-        best_cost = cost;
-      }
-      nb_rcts_to_try--;
-      // Ensure we do not clamp channels to their supposed range, as this
-      // otherwise breaks in the presence of patches.
-      gi.undo_transforms(weighted::Header(), num_transforms_to_keep == 0
-                                                 ? -1
-                                                 : num_transforms_to_keep);
-    }
+    std::vector<int> rct_types = {
+        0 * 7 + 0, 0 * 7 + 6, 0 * 7 + 5, 1 * 7 + 3, 3 * 7 + 5,
+        5 * 7 + 5, 1 * 7 + 5, 2 * 7 + 5, 1 * 7 + 1, 0 * 7 + 4,
+        1 * 7 + 2, 2 * 7 + 1, 2 * 7 + 2, 2 * 7 + 3, 4 * 7 + 4,
+        4 * 7 + 5, 0 * 7 + 2, 0 * 7 + 1, 0 * 7 + 3};
+    rct_types.resize(nb_rcts_to_try);
+    int best_rct = FindBestRCT(gi, gi.nb_meta_channels, rct_types);
     // Apply the best RCT to the image for future encoding.
     sg.rct_type = best_rct;
     do_transform(gi, sg, weighted::Header());
@@ -31,8 +31,10 @@ class ModularFrameEncoder {
                              const std::vector<ImageF>& extra_channels,
                              PassesEncoderState* JXL_RESTRICT enc_state,
                              ThreadPool* pool, AuxOut* aux_out, bool do_color);
-  // Encodes global info (tree + histograms) in the `writer`.
-  Status EncodeGlobalInfo(BitWriter* writer, AuxOut* aux_out);
+  // Encodes global info (tree + histograms) in the `writer`. `pool` is used
+  // for building the histograms of all the streams.
+  Status EncodeGlobalInfo(BitWriter* writer, AuxOut* aux_out,
+                          ThreadPool* pool);
   // Encodes a specific modular image (identified by `stream`) in the `writer`,
   // assigning bits to the provided `layer`.
   Status EncodeStream(BitWriter* writer, AuxOut* aux_out, size_t layer,
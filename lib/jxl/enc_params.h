@@ -133,8 +133,21 @@ struct CompressParams {
   // TODO(veluca): hook this up to the C API.
   size_t decoding_speed_tier = 0;
 
+  // Use prefix codes instead of ANS for all the entropy-coded streams of a
+  // frame: AC tokens, modular streams, context maps, coefficient orders,
+  // patches, splines and the TOC permutation. Prefix codes have no state
+  // carried between symbols and decode faster, at some cost in size.
+  // Implied by decoding_speed_tier >= 4.
+  bool force_prefix_codes = false;
+
   int max_butteraugli_iters = 4;
 
+  // Run the butteraugli loop of FindBestQuantization (kitten and tortoise) on
+  // images downsampled by this factor (1, 2 or 4), as a cheaper proxy of the
+  // full-resolution distance. Each comparison then costs about 1/factor^2 of
+  // the full one, at the price of a looser match of the distance target.
+  size_t butteraugli_proxy_downsampling = 1;
+
   int max_butteraugli_iters_guetzli_mode = 100;
 
   ColorTransform color_transform = ColorTransform::kXYB;
@@ -212,6 +225,18 @@ struct CompressParams {
   // exposure for a given ISO setting on a 35mm camera.
   float photon_noise_iso = 0;
 
+  // Estimate the AC histograms from a sample of the groups and entropy-code
+  // each group right after tokenizing it, instead of keeping the tokens of the
+  // whole frame in memory. Trades a small size overhead for bounded memory use.
+  bool streaming_histograms = false;
+
+  // Real-time VarDCT encoding of frame streams: DCT8 only with a uniform quant
+  // field, natural coefficient orders, and AC histograms that are estimated on
+  // the first frame and then reused for all following frames encoded with the
+  // same PassesEncoderState, so that those frames have no frame-wide
+  // entropy-coding stage. Implies streaming_histograms.
+  bool realtime = false;
+
   // modular mode options below
   ModularOptions options;
   int responsive = -1;
@@ -240,6 +265,10 @@ struct CompressParams {
     color_transform = jxl::ColorTransform::kNone;
   }
 
+  bool UsePrefixCodes() const {
+    return force_prefix_codes || decoding_speed_tier >= 4;
+  }
+
   bool use_new_heuristics = false;
 
   // Down/upsample the image before encoding / after decoding by this factor.
@@ -247,6 +276,10 @@ struct CompressParams {
   size_t ec_resampling = 1;
   // Skip the downsampling before encoding if this is true.
   bool already_downsampled = false;
+
+  // If the image has no preview, embed one obtained by downsampling the main
+  // image to at most kMaxGeneratedPreviewSize pixels in each dimension.
+  bool generate_preview = false;
 };
 
 static constexpr float kMinButteraugliForDynamicAR = 0.5f;
@@ -257,6 +290,8 @@ static constexpr float kMinButteraugliDistanceForProgressiveDc = 4.5f;
 // Always off
 static constexpr float kMinButteraugliForNoise = 99.0f;
 
+static constexpr size_t kMaxGeneratedPreviewSize = 256;
+
 // Minimum butteraugli distance the encoder accepts.
 static constexpr float kMinButteraugliDistance = 0.01f;
 
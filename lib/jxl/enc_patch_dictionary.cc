@@ -41,6 +41,7 @@ namespace jxl {
 // static
 void PatchDictionaryEncoder::Encode(const PatchDictionary& pdic,
                                     BitWriter* writer, size_t layer,
+                                    const HistogramParams& histogram_params,
                                     AuxOut* aux_out) {
   JXL_ASSERT(pdic.HasAny());
   std::vector<std::vector<Token>> tokens(1);
@@ -104,7 +105,7 @@ void PatchDictionaryEncoder::Encode(const PatchDictionary& pdic,
 
   EntropyEncodingData codes;
   std::vector<uint8_t> context_map;
-  BuildAndEncodeHistograms(HistogramParams(), kNumPatchDictionaryContexts,
+  BuildAndEncodeHistograms(histogram_params, kNumPatchDictionaryContexts,
                            tokens, &codes, &context_map, writer, layer,
                            aux_out);
   WriteTokens(tokens[0], codes, context_map, writer, layer, aux_out);
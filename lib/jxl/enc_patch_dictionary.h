@@ -22,6 +22,7 @@
 #include "lib/jxl/common.h"
 #include "lib/jxl/dec_bit_reader.h"
 #include "lib/jxl/dec_patch_dictionary.h"
+#include "lib/jxl/enc_ans_params.h"
 #include "lib/jxl/enc_bit_writer.h"
 #include "lib/jxl/enc_cache.h"
 #include "lib/jxl/enc_params.h"
@@ -35,7 +36,8 @@ class PatchDictionaryEncoder {
  public:
   // Only call if HasAny().
   static void Encode(const PatchDictionary& pdic, BitWriter* writer,
-                     size_t layer, AuxOut* aux_out);
+                     size_t layer, const HistogramParams& histogram_params,
+                     AuxOut* aux_out);
 
   static void SetPositions(PatchDictionary* pdic,
                            std::vector<PatchPosition> positions) {
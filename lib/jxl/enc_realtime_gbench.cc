@@ -0,0 +1,94 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <cmath>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "lib/jxl/base/padded_bytes.h"
+#include "lib/jxl/base/thread_pool_internal.h"
+#include "lib/jxl/codec_in_out.h"
+#include "lib/jxl/enc_cache.h"
+#include "lib/jxl/enc_file.h"
+#include "lib/jxl/enc_params.h"
+#include "lib/jxl/image_ops.h"
+
+namespace jxl {
+namespace {
+
+constexpr size_t kNumFrames = 8;
+
+// A short clip of a smooth background with a textured rectangle moving across
+// it, as a stand-in for camera or screen-capture frames.
+std::vector<CodecInOut> MakeFrames(size_t xsize, size_t ysize) {
+  std::vector<CodecInOut> frames(kNumFrames);
+  for (size_t i = 0; i < kNumFrames; i++) {
+    Image3F image(xsize, ysize);
+    const size_t x0 = i * xsize / (2 * kNumFrames);
+    const size_t y0 = ysize / 4;
+    for (size_t c = 0; c < 3; c++) {
+      for (size_t y = 0; y < ysize; y++) {
+        float* JXL_RESTRICT row = image.PlaneRow(c, y);
+        for (size_t x = 0; x < xsize; x++) {
+          float v = 0.5f + 0.25f * std::sin((x + 2 * y) * 0.004f * (c + 1));
+          if (x >= x0 && x < x0 + xsize / 2 && y >= y0 && y < y0 + ysize / 2) {
+            v += ((x + 3 * y + 7 * c) % 11) * 0.02f - 0.1f;
+          }
+          row[x] = v;
+        }
+      }
+    }
+    frames[i].SetFromImage(std::move(image), ColorEncoding::SRGB());
+  }
+  return frames;
+}
+
+// Encodes a stream of frames of size range(0) x range(1) with range(2)
+// threads, with (range(3) = 1) or without realtime mode. Reports frames per
+// second.
+void BM_EncodeStream(benchmark::State& state) {
+  const size_t xsize = state.range(0);
+  const size_t ysize = state.range(1);
+  ThreadPoolInternal pool(state.range(2));
+  const std::vector<CodecInOut> frames = MakeFrames(xsize, ysize);
+
+  CompressParams cparams;
+  cparams.speed_tier = SpeedTier::kLightning;
+  cparams.realtime = state.range(3) != 0;
+  // Histograms are kept across frames in realtime mode.
+  PassesEncoderState enc_state;
+  PaddedBytes compressed;
+  // The first frame of a realtime stream also builds the histograms that the
+  // following ones reuse: keep it out of the measurement.
+  JXL_CHECK(EncodeFile(cparams, &frames[0], &enc_state, &compressed,
+                       /*aux_out=*/nullptr, &pool));
+  size_t frame = 1;
+  size_t total_size = 0;
+  for (auto _ : state) {
+    JXL_CHECK(EncodeFile(cparams, &frames[frame], &enc_state, &compressed,
+                         /*aux_out=*/nullptr, &pool));
+    total_size += compressed.size();
+    frame = (frame + 1) % kNumFrames;
+  }
+
+  state.SetItemsProcessed(state.iterations() * xsize * ysize);
+  state.counters["fps"] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+  state.counters["bpp"] =
+      total_size * 8.0 / (state.iterations() * xsize * ysize);
+}
+
+BENCHMARK(BM_EncodeStream)
+    ->ArgNames({"xsize", "ysize", "threads", "realtime"})
+    ->Args({1920, 1080, 4, 0})
+    ->Args({1920, 1080, 4, 1})
+    ->Args({3840, 2160, 4, 0})
+    ->Args({3840, 2160, 4, 1})
+    ->Args({3840, 2160, 8, 1})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace jxl
@@ -19,14 +19,16 @@
 namespace jxl {
 Status WriteGroupOffsets(const std::vector<BitWriter>& group_codes,
                          const std::vector<coeff_order_t>* permutation,
-                         BitWriter* JXL_RESTRICT writer, AuxOut* aux_out) {
+                         BitWriter* JXL_RESTRICT writer,
+                         const HistogramParams& histogram_params,
+                         AuxOut* aux_out) {
   BitWriter::Allotment allotment(writer, MaxBits(group_codes.size()));
   if (permutation && !group_codes.empty()) {
     // Don't write a permutation at all for an empty group_codes.
     writer->Write(1, 1);  // permutation
     JXL_DASSERT(permutation->size() == group_codes.size());
     EncodePermutation(permutation->data(), /*skip=*/0, permutation->size(),
-                      writer, /* layer= */ 0, aux_out);
+                      writer, /* layer= */ 0, histogram_params, aux_out);
 
   } else {
     writer->Write(1, 0);  // no permutation
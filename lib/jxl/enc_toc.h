@@ -14,15 +14,18 @@
 #include "lib/jxl/aux_out.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/status.h"
+#include "lib/jxl/enc_ans_params.h"
 #include "lib/jxl/enc_bit_writer.h"
 
 namespace jxl {
 
 // Writes the group offsets. If the permutation vector is nullptr, the identity
-// permutation will be used.
+// permutation will be used. `histogram_params` apply to the permutation.
 Status WriteGroupOffsets(const std::vector<BitWriter>& group_codes,
                          const std::vector<coeff_order_t>* permutation,
-                         BitWriter* JXL_RESTRICT writer, AuxOut* aux_out);
+                         BitWriter* JXL_RESTRICT writer,
+                         const HistogramParams& histogram_params,
+                         AuxOut* aux_out);
 
 }  // namespace jxl
 
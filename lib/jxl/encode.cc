@@ -49,6 +49,15 @@ JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
 
   jxl::BitWriter writer;
 
+  if (metadata.m.xyb_encoded) {
+    input_frame->option_values.cparams.color_transform =
+        jxl::ColorTransform::kXYB;
+  } else {
+    // TODO(zond): Figure out when to use kYCbCr instead.
+    input_frame->option_values.cparams.color_transform =
+        jxl::ColorTransform::kNone;
+  }
+
   if (!wrote_bytes) {
     if (use_container) {
       output_byte_queue.insert(
@@ -61,6 +70,14 @@ JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
                                  jpeg_metadata.end());
       }
     }
+    const jxl::CompressParams& cparams = input_frame->option_values.cparams;
+    jxl::ImageBundle preview(&metadata.m);
+    if (cparams.generate_preview && !metadata.m.have_preview &&
+        input_frame->frame.HasColor()) {
+      if (!jxl::GeneratePreview(input_frame->frame, &metadata, &preview)) {
+        return JXL_ENC_ERROR;
+      }
+    }
     if (!WriteHeaders(&metadata, &writer, nullptr)) {
       return JXL_ENC_ERROR;
     }
@@ -72,10 +89,16 @@ JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
       }
     }
 
-    // TODO(lode): preview should be added here if a preview image is added
+    // TODO(lode): support previews given by the user, too.
+    if (preview.HasColor()) {
+      if (!jxl::EncodePreview(jxl::GeneratedPreviewParams(cparams), preview,
+                              &metadata, thread_pool.get(), &writer)) {
+        return JXL_ENC_ERROR;
+      }
+    }
 
-	// Each frame should start on byte boundaries.
-	writer.ZeroPadToByte();
+    // Each frame should start on byte boundaries.
+    writer.ZeroPadToByte();
   }
 
   // TODO(zond): Handle progressive mode like EncodeFile does it.
@@ -83,18 +106,13 @@ JxlEncoderStatus JxlEncoderStruct::RefillOutputByteQueue() {
   //             JxlEncoderCloseInput has been called and if the frame queue is
   //             empty (to see if it's the last animation frame).
 
-  if (metadata.m.xyb_encoded) {
-    input_frame->option_values.cparams.color_transform =
-        jxl::ColorTransform::kXYB;
-  } else {
-    // TODO(zond): Figure out when to use kYCbCr instead.
-    input_frame->option_values.cparams.color_transform =
-        jxl::ColorTransform::kNone;
+  if (!enc_state) {
+    enc_state =
+        jxl::MemoryManagerMakeUnique<jxl::PassesEncoderState>(&memory_manager);
+    if (!enc_state) return JXL_ENC_ERROR;
   }
-
-  jxl::PassesEncoderState enc_state;
   if (!jxl::EncodeFrame(input_frame->option_values.cparams, jxl::FrameInfo{},
-                        &metadata, input_frame->frame, &enc_state,
+                        &metadata, input_frame->frame, enc_state.get(),
                         thread_pool.get(), &writer,
                         /*aux_out=*/nullptr)) {
     return JXL_ENC_ERROR;
@@ -138,6 +156,7 @@ JxlEncoderStatus JxlEncoderSetColorEncoding(JxlEncoder* enc,
 JxlEncoderStatus JxlEncoderSetICCProfile(JxlEncoder* enc,
                                          const uint8_t* icc_profile,
                                          size_t size) {
+  jxl::ScopedAllocationTarget allocation_scope(&enc->allocation_target);
   if (enc->color_encoding_set) {
     // Already set
     return JXL_ENC_ERROR;
@@ -246,14 +265,14 @@ JxlEncoder* JxlEncoderCreate(const JxlMemoryManager* memory_manager) {
   void* alloc =
       jxl::MemoryManagerAlloc(&local_memory_manager, sizeof(JxlEncoder));
   if (!alloc) return nullptr;
-  JxlEncoder* enc = new (alloc) JxlEncoder();
-  enc->memory_manager = local_memory_manager;
+  JxlEncoder* enc = new (alloc) JxlEncoder(local_memory_manager);
 
   return enc;
 }
 
 void JxlEncoderReset(JxlEncoder* enc) {
   enc->thread_pool.reset();
+  enc->enc_state.reset();
   enc->input_frame_queue.clear();
   enc->encoder_options.clear();
   enc->output_byte_queue.clear();
@@ -273,6 +292,15 @@ void JxlEncoderDestroy(JxlEncoder* enc) {
   }
 }
 
+JxlEncoderStatus JxlEncoderGetMemoryUsage(const JxlEncoder* enc,
+                                          JxlMemoryCategory category,
+                                          JxlMemoryUsage* usage) {
+  if (!jxl::GetMemoryUsage(enc->allocation_target, category, usage)) {
+    return JXL_API_ERROR("Invalid memory category");
+  }
+  return JXL_ENC_SUCCESS;
+}
+
 JxlEncoderStatus JxlEncoderUseContainer(JxlEncoder* enc,
                                         JXL_BOOL use_container) {
   enc->use_container = static_cast<bool>(use_container);
@@ -299,6 +327,8 @@ JxlEncoderStatus JxlEncoderSetParallelRunner(JxlEncoder* enc,
 
 JxlEncoderStatus JxlEncoderAddJPEGFrame(const JxlEncoderOptions* options,
                                         const uint8_t* buffer, size_t size) {
+  jxl::ScopedAllocationTarget allocation_scope(
+      &options->enc->allocation_target);
   if (options->enc->input_closed) {
     return JXL_ENC_ERROR;
   }
@@ -370,6 +400,8 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(const JxlEncoderOptions* options,
 JxlEncoderStatus JxlEncoderAddImageFrame(const JxlEncoderOptions* options,
                                          const JxlPixelFormat* pixel_format,
                                          const void* buffer, size_t size) {
+  jxl::ScopedAllocationTarget allocation_scope(
+      &options->enc->allocation_target);
   if (!options->enc->basic_info_set || !options->enc->color_encoding_set) {
     return JXL_ENC_ERROR;
   }
@@ -424,6 +456,7 @@ void JxlEncoderCloseInput(JxlEncoder* enc) { enc->input_closed = true; }
 
 JxlEncoderStatus JxlEncoderProcessOutput(JxlEncoder* enc, uint8_t** next_out,
                                          size_t* avail_out) {
+  jxl::ScopedAllocationTarget allocation_scope(&enc->allocation_target);
   while (*avail_out > 0 &&
          (!enc->output_byte_queue.empty() || !enc->input_frame_queue.empty())) {
     if (!enc->output_byte_queue.empty()) {
@@ -456,6 +489,18 @@ JxlEncoderStatus JxlEncoderOptionsSetDecodingSpeed(JxlEncoderOptions* options,
   return JXL_ENC_SUCCESS;
 }
 
+JxlEncoderStatus JxlEncoderOptionsSetGeneratePreview(
+    JxlEncoderOptions* options, JXL_BOOL generate_preview) {
+  options->values.cparams.generate_preview = generate_preview;
+  return JXL_ENC_SUCCESS;
+}
+
+JxlEncoderStatus JxlEncoderOptionsSetRealtime(JxlEncoderOptions* options,
+                                              JXL_BOOL realtime) {
+  options->values.cparams.realtime = realtime;
+  return JXL_ENC_SUCCESS;
+}
+
 void JxlColorEncodingSetToSRGB(JxlColorEncoding* color_encoding,
                                JXL_BOOL is_gray) {
   ConvertInternalToExternalColorEncoding(jxl::ColorEncoding::SRGB(is_gray),
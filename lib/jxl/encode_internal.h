@@ -14,6 +14,7 @@
 #include "jxl/parallel_runner.h"
 #include "jxl/types.h"
 #include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/enc_cache.h"
 #include "lib/jxl/enc_frame.h"
 #include "lib/jxl/memory_manager_internal.h"
 
@@ -81,10 +82,21 @@ void AppendBoxHeader(const jxl::BoxType& type, size_t size, bool unbounded,
 }  // namespace jxl
 
 struct JxlEncoderStruct {
+  explicit JxlEncoderStruct(const JxlMemoryManager& manager)
+      : memory_manager(manager),
+        allocation_target(manager, jxl::MemoryManagerIsDefault(manager)) {}
+
   JxlMemoryManager memory_manager;
+  // Receives the large internal allocations; must be destroyed after all
+  // members that may own such allocations.
+  jxl::AllocationTarget allocation_target;
   jxl::MemoryManagerUniquePtr<jxl::ThreadPool> thread_pool{
       nullptr, jxl::MemoryManagerDeleteHelper(&memory_manager)};
   std::vector<jxl::MemoryManagerUniquePtr<JxlEncoderOptions>> encoder_options;
+  // Shared by all frames, so that realtime frames can reuse the histograms of
+  // the previous ones.
+  jxl::MemoryManagerUniquePtr<jxl::PassesEncoderState> enc_state{
+      nullptr, jxl::MemoryManagerDeleteHelper(&memory_manager)};
 
   std::vector<jxl::MemoryManagerUniquePtr<jxl::JxlEncoderQueuedFrame>>
       input_frame_queue;
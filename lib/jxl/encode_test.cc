@@ -153,7 +153,8 @@ TEST(EncodeTest, DefaultParallelRunnerTest) {
 }
 
 void VerifyFrameEncoding(size_t xsize, size_t ysize, JxlEncoder* enc,
-                         const JxlEncoderOptions* options) {
+                         const JxlEncoderOptions* options,
+                         jxl::CodecMetadata* decoded_metadata = nullptr) {
   JxlPixelFormat pixel_format = {4, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
   std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 4, 0);
 
@@ -205,6 +206,7 @@ void VerifyFrameEncoding(size_t xsize, size_t ysize, JxlEncoder* enc,
   EXPECT_LE(ButteraugliDistance(input_io, decoded_io, ba,
                                 /*distmap=*/nullptr, nullptr),
             3.0f);
+  if (decoded_metadata != nullptr) *decoded_metadata = decoded_io.metadata;
 }
 
 void VerifyFrameEncoding(JxlEncoder* enc, const JxlEncoderOptions* options) {
@@ -282,6 +284,36 @@ TEST(EncodeTest, OptionsTest) {
     VerifyFrameEncoding(enc.get(), options);
     EXPECT_EQ(2, enc->last_used_cparams.decoding_speed_tier);
   }
+
+  {
+    JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+    EXPECT_NE(nullptr, enc.get());
+    JxlEncoderOptions* options = JxlEncoderOptionsCreate(enc.get(), NULL);
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderOptionsSetGeneratePreview(options, JXL_TRUE));
+    jxl::CodecMetadata metadata;
+    VerifyFrameEncoding(600, 300, enc.get(), options, &metadata);
+    EXPECT_TRUE(enc->last_used_cparams.generate_preview);
+    EXPECT_TRUE(metadata.m.have_preview);
+    EXPECT_EQ(200u, metadata.m.preview_size.xsize());
+    EXPECT_EQ(100u, metadata.m.preview_size.ysize());
+  }
+
+  {
+    JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+    EXPECT_NE(nullptr, enc.get());
+    JxlEncoderOptions* options = JxlEncoderOptionsCreate(enc.get(), NULL);
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderOptionsSetRealtime(options, JXL_TRUE));
+    // The uniform quantization of realtime mode has a larger max error.
+    EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderOptionsSetDistance(options, 0.5));
+    VerifyFrameEncoding(enc.get(), options);
+    EXPECT_TRUE(enc->last_used_cparams.realtime);
+    // The histograms are kept for the next frames until the encoder is reset.
+    ASSERT_NE(nullptr, enc->enc_state.get());
+    EXPECT_FALSE(enc->enc_state->realtime_histograms.empty());
+    JxlEncoderReset(enc.get());
+    EXPECT_EQ(nullptr, enc->enc_state.get());
+  }
 }
 
 namespace {
@@ -63,11 +63,20 @@ JXL_INLINE Vec<DF> Weight(Vec<DF> sad, Vec<DF> inv_sigma, Vec<DF> thres) {
   return IfThenZeroElse(v <= thres, v2);
 }
 
+JXL_INLINE void AddPixel(Vec<DF> weight, Vec<DF> cx, Vec<DF> cy, Vec<DF> cb,
+                         Vec<DF>* JXL_RESTRICT X, Vec<DF>* JXL_RESTRICT Y,
+                         Vec<DF>* JXL_RESTRICT B, Vec<DF>* JXL_RESTRICT w) {
+  *w += weight;
+  *X = MulAdd(weight, cx, *X);
+  *Y = MulAdd(weight, cy, *Y);
+  *B = MulAdd(weight, cb, *B);
+}
+
 template <bool aligned>
 JXL_INLINE void AddPixelStep1(int row, const FilterRows& rows, size_t x,
-                              Vec<DF> sad, Vec<DF> inv_sigma,
-                              const LoopFilter& lf, Vec<DF>* JXL_RESTRICT X,
-                              Vec<DF>* JXL_RESTRICT Y, Vec<DF>* JXL_RESTRICT B,
+                              Vec<DF> sad, Vec<DF> inv_sigma, Vec<DF> zeroflush,
+                              Vec<DF>* JXL_RESTRICT X, Vec<DF>* JXL_RESTRICT Y,
+                              Vec<DF>* JXL_RESTRICT B,
                               Vec<DF>* JXL_RESTRICT w) {
   auto cx = aligned ? Load(DF(), rows.GetInputRow(row, 0) + x)
                     : LoadU(DF(), rows.GetInputRow(row, 0) + x);
@@ -76,19 +85,15 @@ JXL_INLINE void AddPixelStep1(int row, const FilterRows& rows, size_t x,
   auto cb = aligned ? Load(DF(), rows.GetInputRow(row, 2) + x)
                     : LoadU(DF(), rows.GetInputRow(row, 2) + x);
 
-  auto weight = Weight(sad, inv_sigma, Set(df, lf.epf_pass1_zeroflush));
-  *w += weight;
-  *X = MulAdd(weight, cx, *X);
-  *Y = MulAdd(weight, cy, *Y);
-  *B = MulAdd(weight, cb, *B);
+  AddPixel(Weight(sad, inv_sigma, zeroflush), cx, cy, cb, X, Y, B, w);
 }
 
 template <bool aligned>
 JXL_INLINE void AddPixelStep2(int row, const FilterRows& rows, size_t x,
                               Vec<DF> rx, Vec<DF> ry, Vec<DF> rb,
-                              Vec<DF> inv_sigma, const LoopFilter& lf,
-                              Vec<DF>* JXL_RESTRICT X, Vec<DF>* JXL_RESTRICT Y,
-                              Vec<DF>* JXL_RESTRICT B,
+                              Vec<DF> inv_sigma, const Vec<DF>* scales,
+                              Vec<DF> zeroflush, Vec<DF>* JXL_RESTRICT X,
+                              Vec<DF>* JXL_RESTRICT Y, Vec<DF>* JXL_RESTRICT B,
                               Vec<DF>* JXL_RESTRICT w) {
   auto cx = aligned ? Load(DF(), rows.GetInputRow(row, 0) + x)
                     : LoadU(DF(), rows.GetInputRow(row, 0) + x);
@@ -97,16 +102,11 @@ JXL_INLINE void AddPixelStep2(int row, const FilterRows& rows, size_t x,
   auto cb = aligned ? Load(DF(), rows.GetInputRow(row, 2) + x)
                     : LoadU(DF(), rows.GetInputRow(row, 2) + x);
 
-  auto sad = AbsDiff(cx, rx) * Set(df, lf.epf_channel_scale[0]);
-  sad = MulAdd(AbsDiff(cy, ry), Set(df, lf.epf_channel_scale[1]), sad);
-  sad = MulAdd(AbsDiff(cb, rb), Set(df, lf.epf_channel_scale[2]), sad);
-
-  auto weight = Weight(sad, inv_sigma, Set(df, lf.epf_pass2_zeroflush));
+  auto sad = AbsDiff(cx, rx) * scales[0];
+  sad = MulAdd(AbsDiff(cy, ry), scales[1], sad);
+  sad = MulAdd(AbsDiff(cb, rb), scales[2], sad);
 
-  *w += weight;
-  *X = MulAdd(weight, cx, *X);
-  *Y = MulAdd(weight, cy, *Y);
-  *B = MulAdd(weight, cb, *B);
+  AddPixel(Weight(sad, inv_sigma, zeroflush), cx, cy, cb, X, Y, B, w);
 }
 
 template <class D, class V>
@@ -207,6 +207,18 @@ void Epf0Row(const FilterRows& rows, const LoopFilter& lf,
     }
   }
 
+  const auto zeroflush = Set(df, lf.epf_pass1_zeroflush);
+  const decltype(Zero(df)) scales[3] = {Set(df, lf.epf_channel_scale[0]),
+                                        Set(df, lf.epf_channel_scale[1]),
+                                        Set(df, lf.epf_channel_scale[2])};
+
+  constexpr std::array<int, 2> sads_off[12] = {
+      {-2, 0}, {-1, -1}, {-1, 0}, {-1, 1}, {0, -2}, {0, -1},
+      {0, 1},  {0, 2},   {1, -1}, {1, 0},  {1, 1},  {2, 0},
+  };
+  constexpr std::array<int, 2> plus_off[] = {
+      {0, 0}, {-1, 0}, {0, -1}, {1, 0}, {0, 1}};
+
   for (size_t x = x0; x < x1; x += Lanes(df)) {
     size_t bx = (x + sigma_x_offset) / kBlockDim;
     size_t ix = (x + sigma_x_offset) % kBlockDim;
@@ -221,45 +233,52 @@ void Epf0Row(const FilterRows& rows, const LoopFilter& lf,
     const auto sm = Load(df, sad_mul + ix);
     const auto inv_sigma = Set(DF(), row_sigma[bx]) * sm;
 
+    // Pixels of the 7x7 diamond around x, indexed by [c][dy + 3][dx + 3].
+    // Only the entries with |dy| + |dx| <= 3 are loaded.
+    decltype(Zero(df)) p[3][7][7];
     decltype(Zero(df)) sads[12];
     for (size_t i = 0; i < 12; i++) sads[i] = Zero(df);
-    constexpr std::array<int, 2> sads_off[12] = {
-        {-2, 0}, {-1, -1}, {-1, 0}, {-1, 1}, {0, -2}, {0, -1},
-        {0, 1},  {0, 2},   {1, -1}, {1, 0},  {1, 1},  {2, 0},
-    };
 
     // compute sads
-    // TODO(veluca): consider unrolling and optimizing this.
+    // Each pixel is loaded once per channel and shared by all the SADs that
+    // use it. sads_off[11 - i] == -sads_off[i], so the SADs are computed in
+    // pairs. The floating point operations are the same, in the same order, as
+    // computing each SAD separately.
     for (size_t c = 0; c < 3; c++) {
-      auto scale = Set(df, lf.epf_channel_scale[c]);
-      for (size_t i = 0; i < 12; i++) {
+      for (int dy = -3; dy <= 3; dy++) {
+        const float* JXL_RESTRICT row = rows.GetInputRow(dy, c) + x;
+        const int r = 3 - std::abs(dy);
+        for (int dx = -r; dx <= r; dx++) {
+          p[c][dy + 3][dx + 3] = LoadU(df, row + dx);
+        }
+      }
+      for (size_t i = 6; i < 12; i++) {
+        const int ty = sads_off[i][0];
+        const int tx = sads_off[i][1];
         auto sad = Zero(df);
-        constexpr std::array<int, 2> plus_off[] = {
-            {0, 0}, {-1, 0}, {0, -1}, {1, 0}, {0, 1}};
+        auto sad_opposite = Zero(df);
         for (size_t j = 0; j < 5; j++) {
-          const auto r11 = LoadU(
-              df, rows.GetInputRow(plus_off[j][0], c) + x + plus_off[j][1]);
-          const auto c11 =
-              LoadU(df, rows.GetInputRow(sads_off[i][0] + plus_off[j][0], c) +
-                            x + sads_off[i][1] + plus_off[j][1]);
-          sad += AbsDiff(r11, c11);
+          const int ry = plus_off[j][0] + 3;
+          const int rx = plus_off[j][1] + 3;
+          const auto r11 = p[c][ry][rx];
+          sad += AbsDiff(r11, p[c][ry + ty][rx + tx]);
+          sad_opposite += AbsDiff(r11, p[c][ry - ty][rx - tx]);
         }
-        sads[i] = MulAdd(sad, scale, sads[i]);
+        sads[i] = MulAdd(sad, scales[c], sads[i]);
+        sads[11 - i] = MulAdd(sad_opposite, scales[c], sads[11 - i]);
       }
     }
-    const auto x_cc = LoadU(df, rows.GetInputRow(0, 0) + x);
-    const auto y_cc = LoadU(df, rows.GetInputRow(0, 1) + x);
-    const auto b_cc = LoadU(df, rows.GetInputRow(0, 2) + x);
 
     auto w = Set(df, 1);
-    auto X = x_cc;
-    auto Y = y_cc;
-    auto B = b_cc;
+    auto X = p[0][3][3];
+    auto Y = p[1][3][3];
+    auto B = p[2][3][3];
 
     for (size_t i = 0; i < 12; i++) {
-      AddPixelStep1</*aligned=*/false>(/*row=*/sads_off[i][0], rows,
-                                       x + sads_off[i][1], sads[i], inv_sigma,
-                                       lf, &X, &Y, &B, &w);
+      const int cy = sads_off[i][0] + 3;
+      const int cx = sads_off[i][1] + 3;
+      AddPixel(Weight(sads[i], inv_sigma, zeroflush), p[0][cy][cx],
+               p[1][cy][cx], p[2][cy][cx], &X, &Y, &B, &w);
     }
 
 #if JXL_HIGH_PRECISION
@@ -292,6 +311,11 @@ void Epf1Row(const FilterRows& rows, const LoopFilter& lf,
     }
   }
 
+  const auto zeroflush = Set(df, lf.epf_pass1_zeroflush);
+  const decltype(Zero(df)) scales[3] = {Set(df, lf.epf_channel_scale[0]),
+                                        Set(df, lf.epf_channel_scale[1]),
+                                        Set(df, lf.epf_channel_scale[2])};
+
   for (size_t x = x0; x < x1; x += Lanes(df)) {
     size_t bx = (x + sigma_x_offset) / kBlockDim;
     size_t ix = (x + sigma_x_offset) % kBlockDim;
@@ -363,11 +387,10 @@ void Epf1Row(const FilterRows& rows, const LoopFilter& lf,
       const auto p24 = Load(df, rows.GetInputRow(2, c) + x);
       sad3c += AbsDiff(p24, p23);  // SAD 2, 3
 
-      auto scale = Set(df, lf.epf_channel_scale[c]);
-      sad0 = MulAdd(sad0c, scale, sad0);
-      sad1 = MulAdd(sad1c, scale, sad1);
-      sad2 = MulAdd(sad2c, scale, sad2);
-      sad3 = MulAdd(sad3c, scale, sad3);
+      sad0 = MulAdd(sad0c, scales[c], sad0);
+      sad1 = MulAdd(sad1c, scales[c], sad1);
+      sad2 = MulAdd(sad2c, scales[c], sad2);
+      sad3 = MulAdd(sad3c, scales[c], sad3);
     }
     const auto x_cc = Load(df, rows.GetInputRow(0, 0) + x);
     const auto y_cc = Load(df, rows.GetInputRow(0, 1) + x);
@@ -379,16 +402,16 @@ void Epf1Row(const FilterRows& rows, const LoopFilter& lf,
     auto B = b_cc;
 
     // Top row
-    AddPixelStep1</*aligned=*/true>(/*row=*/-1, rows, x, sad0, inv_sigma, lf,
-                                    &X, &Y, &B, &w);
+    AddPixelStep1</*aligned=*/true>(/*row=*/-1, rows, x, sad0, inv_sigma,
+                                    zeroflush, &X, &Y, &B, &w);
     // Center
     AddPixelStep1</*aligned=*/false>(/*row=*/0, rows, x - 1, sad1, inv_sigma,
-                                     lf, &X, &Y, &B, &w);
+                                     zeroflush, &X, &Y, &B, &w);
     AddPixelStep1</*aligned=*/false>(/*row=*/0, rows, x + 1, sad2, inv_sigma,
-                                     lf, &X, &Y, &B, &w);
+                                     zeroflush, &X, &Y, &B, &w);
     // Bottom
-    AddPixelStep1</*aligned=*/true>(/*row=*/1, rows, x, sad3, inv_sigma, lf, &X,
-                                    &Y, &B, &w);
+    AddPixelStep1</*aligned=*/true>(/*row=*/1, rows, x, sad3, inv_sigma,
+                                    zeroflush, &X, &Y, &B, &w);
 #if JXL_HIGH_PRECISION
     auto inv_w = Set(df, 1.0f) / w;
 #else
@@ -419,6 +442,11 @@ void Epf2Row(const FilterRows& rows, const LoopFilter& lf,
     }
   }
 
+  const auto zeroflush = Set(df, lf.epf_pass2_zeroflush);
+  const decltype(Zero(df)) scales[3] = {Set(df, lf.epf_channel_scale[0]),
+                                        Set(df, lf.epf_channel_scale[1]),
+                                        Set(df, lf.epf_channel_scale[2])};
+
   for (size_t x = x0; x < x1; x += Lanes(df)) {
     size_t bx = (x + sigma_x_offset) / kBlockDim;
     size_t ix = (x + sigma_x_offset) % kBlockDim;
@@ -445,15 +473,19 @@ void Epf2Row(const FilterRows& rows, const LoopFilter& lf,
 
     // Top row
     AddPixelStep2</*aligned=*/true>(/*row=*/-1, rows, x, x_cc, y_cc, b_cc,
-                                    inv_sigma, lf, &X, &Y, &B, &w);
+                                    inv_sigma, scales, zeroflush, &X, &Y, &B,
+                                    &w);
     // Center
     AddPixelStep2</*aligned=*/false>(/*row=*/0, rows, x - 1, x_cc, y_cc, b_cc,
-                                     inv_sigma, lf, &X, &Y, &B, &w);
+                                     inv_sigma, scales, zeroflush, &X, &Y, &B,
+                                     &w);
     AddPixelStep2</*aligned=*/false>(/*row=*/0, rows, x + 1, x_cc, y_cc, b_cc,
-                                     inv_sigma, lf, &X, &Y, &B, &w);
+                                     inv_sigma, scales, zeroflush, &X, &Y, &B,
+                                     &w);
     // Bottom
     AddPixelStep2</*aligned=*/true>(/*row=*/1, rows, x, x_cc, y_cc, b_cc,
-                                    inv_sigma, lf, &X, &Y, &B, &w);
+                                    inv_sigma, scales, zeroflush, &X, &Y, &B,
+                                    &w);
 
 #if JXL_HIGH_PRECISION
     auto inv_w = Set(df, 1.0f) / w;
@@ -0,0 +1,265 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// 8x8 IDCT in 16-bit fixed point, with the same structure and scaling as
+// ComputeTransposedScaledIDCT<8>. Only precise enough for 8-bit output of
+// frames whose sample range is [0, 1] (i.e. recompressed JPEGs), and only
+// usable for blocks accepted by LoadCoefficientsInt16.
+
+#if defined(LIB_JXL_IDCT_INT16_INL_H_) == defined(HWY_TARGET_TOGGLE)
+#ifdef LIB_JXL_IDCT_INT16_INL_H_
+#undef LIB_JXL_IDCT_INT16_INL_H_
+#else
+#define LIB_JXL_IDCT_INT16_INL_H_
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hwy/highway.h>
+#include <utility>
+
+#include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/status.h"
+
+HWY_BEFORE_NAMESPACE();
+namespace jxl {
+namespace HWY_NAMESPACE {
+namespace {
+
+// These templates are not found via ADL.
+using hwy::HWY_NAMESPACE::MulHigh;
+using hwy::HWY_NAMESPACE::Rebind;
+using hwy::HWY_NAMESPACE::Repartition;
+using hwy::HWY_NAMESPACE::ShiftRight;
+
+// One unit of the fixed point values is 1/64 of an 8-bit sample, and the
+// result is within a quarter of an 8-bit level of the float transform.
+constexpr float kIDCTInt16Scale = 255.0f * 64;
+
+// Largest magnitude (in units of kIDCTInt16Weights times samples) that every
+// step of the transform can reach without overflowing 16 bits. The margin
+// covers the rounding of the coefficients and of the multiplications.
+constexpr float kIDCTInt16MaxMagnitude = 32000.0f / kIDCTInt16Scale;
+
+// Bound on the magnitude of every intermediate value of the transform per unit
+// of each (transposed) coefficient, over both passes: max(g[y] * o[x],
+// g[x] * o[y], g[x], g[y]), where g[i] and o[i] are the largest gains of
+// coefficient i to any intermediate value and to any output of the 1D
+// transform. Rounded up. The DC coefficient only ever has a gain of 1.
+HWY_ALIGN constexpr float kIDCTInt16Weights[64] = {
+    1.0000f, 2.4143f, 2.4143f, 2.4143f, 1.0000f, 1.3871f, 1.3066f, 1.3871f,
+    2.4143f, 3.3487f, 3.3487f, 3.3487f, 2.4143f, 3.3487f, 3.1544f, 3.3487f,
+    2.4143f, 3.3487f, 3.1544f, 3.3487f, 2.4143f, 3.3487f, 3.1544f, 3.3487f,
+    2.4143f, 3.3487f, 3.3487f, 3.3487f, 2.4143f, 3.3487f, 3.1544f, 3.3487f,
+    1.0000f, 2.4143f, 2.4143f, 2.4143f, 1.0000f, 1.3871f, 1.3066f, 1.3871f,
+    1.3871f, 3.3487f, 3.3487f, 3.3487f, 1.3871f, 1.9240f, 1.8124f, 1.9240f,
+    1.3066f, 3.1544f, 3.1544f, 3.1544f, 1.3066f, 1.8124f, 1.7072f, 1.8124f,
+    1.3871f, 3.3487f, 3.3487f, 3.3487f, 1.3871f, 1.9240f, 1.8124f, 1.9240f,
+};
+
+// Number of blocks transformed together, so that targets with 256-bit vectors
+// can hold a row of each block in one vector. Row r of block b is stored at
+// r * kIDCTInt16Stride + b * 8 in the (aligned) scratch memory.
+constexpr size_t kIDCTInt16Blocks = 2;
+constexpr size_t kIDCTInt16Stride = 8 * kIDCTInt16Blocks;
+constexpr size_t kIDCTInt16MemSize = 8 * kIDCTInt16Stride;
+
+using DI16IDCT = HWY_CAPPED(int16_t, kIDCTInt16Stride);
+
+// Returns v * k / 65536, rounded to nearest (MulHigh alone rounds down, which
+// biases the outputs by several units).
+template <class D, class V>
+JXL_INLINE V MulHighRound(D d, V v, int16_t k) {
+  const V vk = Set(d, k);
+  // Bit 15 of the low half of the product is the rounding bit.
+  return MulHigh(v, vk) - ShiftRight<15>(v * vk);
+}
+
+// Returns v * (1 + k / 65536).
+template <class D, class V>
+JXL_INLINE V MulOnePlus(D d, V v, int16_t k) {
+  return MulHighRound(d, v, k) + v;
+}
+
+// Same as IDCT1DImpl<4, SZ>.
+template <class D, class V>
+JXL_INLINE void IDCT4Int16(D d, V c0, V c1, V c2, V c3, V* JXL_RESTRICT o0,
+                           V* JXL_RESTRICT o1, V* JXL_RESTRICT o2,
+                           V* JXL_RESTRICT o3) {
+  const V e0 = c0 + c2;
+  const V e1 = c0 - c2;
+  const V d0 = MulOnePlus(d, c1, 27146);  // sqrt(2)
+  const V d1 = c3 + c1;
+  // WcMultipliers<4>
+  const V m0 = MulOnePlus(d, d0 + d1, -30068);
+  const V m1 = MulOnePlus(d, d0 - d1, 20091);
+  *o0 = e0 + m0;
+  *o3 = e0 - m0;
+  *o1 = e1 + m1;
+  *o2 = e1 - m1;
+}
+
+// Same as IDCT1DImpl<8, SZ>, applied to all the columns of `mem`.
+JXL_INLINE void IDCT1DInt16(int16_t* JXL_RESTRICT mem) {
+  const DI16IDCT d;
+  for (size_t x = 0; x < kIDCTInt16Stride; x += Lanes(d)) {
+    const auto c0 = Load(d, mem + 0 * kIDCTInt16Stride + x);
+    const auto c1 = Load(d, mem + 1 * kIDCTInt16Stride + x);
+    const auto c2 = Load(d, mem + 2 * kIDCTInt16Stride + x);
+    const auto c3 = Load(d, mem + 3 * kIDCTInt16Stride + x);
+    const auto c4 = Load(d, mem + 4 * kIDCTInt16Stride + x);
+    const auto c5 = Load(d, mem + 5 * kIDCTInt16Stride + x);
+    const auto c6 = Load(d, mem + 6 * kIDCTInt16Stride + x);
+    const auto c7 = Load(d, mem + 7 * kIDCTInt16Stride + x);
+    auto e0 = Undefined(d), e1 = Undefined(d), e2 = Undefined(d),
+         e3 = Undefined(d);
+    IDCT4Int16(d, c0, c2, c4, c6, &e0, &e1, &e2, &e3);
+    auto o0 = Undefined(d), o1 = Undefined(d), o2 = Undefined(d),
+         o3 = Undefined(d);
+    IDCT4Int16(d, MulOnePlus(d, c1, 27146), c3 + c1, c5 + c3, c7 + c5, &o0,
+               &o1, &o2, &o3);
+    // WcMultipliers<8>; the last one is 3 - 28645 / 65536. The partial sums
+    // are smaller than the final one.
+    o0 = MulOnePlus(d, o0, -32126);
+    o1 = MulOnePlus(d, o1, -26126);
+    o2 = MulOnePlus(d, o2, -6555);
+    o3 = MulHighRound(d, o3, -28645) + o3 + o3 + o3;
+    Store(e0 + o0, d, mem + 0 * kIDCTInt16Stride + x);
+    Store(e1 + o1, d, mem + 1 * kIDCTInt16Stride + x);
+    Store(e2 + o2, d, mem + 2 * kIDCTInt16Stride + x);
+    Store(e3 + o3, d, mem + 3 * kIDCTInt16Stride + x);
+    Store(e3 - o3, d, mem + 4 * kIDCTInt16Stride + x);
+    Store(e2 - o2, d, mem + 5 * kIDCTInt16Stride + x);
+    Store(e1 - o1, d, mem + 6 * kIDCTInt16Stride + x);
+    Store(e0 - o0, d, mem + 7 * kIDCTInt16Stride + x);
+  }
+}
+
+// Transposes each of the 8x8 blocks of `mem` in place.
+JXL_INLINE void TransposeInt16(int16_t* JXL_RESTRICT mem) {
+#if HWY_TARGET == HWY_SCALAR
+  for (size_t b = 0; b < kIDCTInt16Blocks; b++) {
+    int16_t* JXL_RESTRICT block = mem + b * 8;
+    for (size_t y = 0; y < 8; y++) {
+      for (size_t x = y + 1; x < 8; x++) {
+        std::swap(block[y * kIDCTInt16Stride + x],
+                  block[x * kIDCTInt16Stride + y]);
+      }
+    }
+  }
+#else
+  // Each 128-bit part of a vector holds one row of one block, and the
+  // interleaves never cross 128-bit parts.
+  const DI16IDCT d;
+  const Repartition<int32_t, DI16IDCT> d32;
+  const Repartition<int64_t, DI16IDCT> d64;
+  JXL_DASSERT(Lanes(d) % 8 == 0);
+  for (size_t x = 0; x < kIDCTInt16Stride; x += Lanes(d)) {
+    const auto r0 = Load(d, mem + 0 * kIDCTInt16Stride + x);
+    const auto r1 = Load(d, mem + 1 * kIDCTInt16Stride + x);
+    const auto r2 = Load(d, mem + 2 * kIDCTInt16Stride + x);
+    const auto r3 = Load(d, mem + 3 * kIDCTInt16Stride + x);
+    const auto r4 = Load(d, mem + 4 * kIDCTInt16Stride + x);
+    const auto r5 = Load(d, mem + 5 * kIDCTInt16Stride + x);
+    const auto r6 = Load(d, mem + 6 * kIDCTInt16Stride + x);
+    const auto r7 = Load(d, mem + 7 * kIDCTInt16Stride + x);
+
+    const auto a0 = BitCast(d32, InterleaveLower(r0, r1));
+    const auto a1 = BitCast(d32, InterleaveUpper(r0, r1));
+    const auto a2 = BitCast(d32, InterleaveLower(r2, r3));
+    const auto a3 = BitCast(d32, InterleaveUpper(r2, r3));
+    const auto a4 = BitCast(d32, InterleaveLower(r4, r5));
+    const auto a5 = BitCast(d32, InterleaveUpper(r4, r5));
+    const auto a6 = BitCast(d32, InterleaveLower(r6, r7));
+    const auto a7 = BitCast(d32, InterleaveUpper(r6, r7));
+
+    const auto b0 = BitCast(d64, InterleaveLower(a0, a2));
+    const auto b1 = BitCast(d64, InterleaveUpper(a0, a2));
+    const auto b2 = BitCast(d64, InterleaveLower(a1, a3));
+    const auto b3 = BitCast(d64, InterleaveUpper(a1, a3));
+    const auto b4 = BitCast(d64, InterleaveLower(a4, a6));
+    const auto b5 = BitCast(d64, InterleaveUpper(a4, a6));
+    const auto b6 = BitCast(d64, InterleaveLower(a5, a7));
+    const auto b7 = BitCast(d64, InterleaveUpper(a5, a7));
+
+    Store(BitCast(d, InterleaveLower(b0, b4)), d,
+          mem + 0 * kIDCTInt16Stride + x);
+    Store(BitCast(d, InterleaveUpper(b0, b4)), d,
+          mem + 1 * kIDCTInt16Stride + x);
+    Store(BitCast(d, InterleaveLower(b1, b5)), d,
+          mem + 2 * kIDCTInt16Stride + x);
+    Store(BitCast(d, InterleaveUpper(b1, b5)), d,
+          mem + 3 * kIDCTInt16Stride + x);
+    Store(BitCast(d, InterleaveLower(b2, b6)), d,
+          mem + 4 * kIDCTInt16Stride + x);
+    Store(BitCast(d, InterleaveUpper(b2, b6)), d,
+          mem + 5 * kIDCTInt16Stride + x);
+    Store(BitCast(d, InterleaveLower(b3, b7)), d,
+          mem + 6 * kIDCTInt16Stride + x);
+    Store(BitCast(d, InterleaveUpper(b3, b7)), d,
+          mem + 7 * kIDCTInt16Stride + x);
+  }
+#endif
+}
+
+// Converts the 64 (transposed, as for ComputeTransposedScaledIDCT<8>) float
+// coefficients to fixed point and stores them as block `b` of `mem`. Returns
+// false, leaving `mem` unchanged, if the transform of the block could overflow
+// 16 bits; such blocks must use the float transform instead.
+JXL_INLINE bool LoadCoefficientsInt16(const float* JXL_RESTRICT coefficients,
+                                      size_t b, int16_t* JXL_RESTRICT mem) {
+  const HWY_CAPPED(float, 8) df;
+  const Rebind<int32_t, decltype(df)> di32;
+  const Rebind<int16_t, decltype(df)> di16;
+  auto magnitude = Zero(df);
+  for (size_t i = 0; i < 64; i += Lanes(df)) {
+    magnitude = MulAdd(Abs(Load(df, coefficients + i)),
+                       Load(df, kIDCTInt16Weights + i), magnitude);
+  }
+  if (GetLane(SumOfLanes(magnitude)) > kIDCTInt16MaxMagnitude) return false;
+
+  const auto scale = Set(df, kIDCTInt16Scale);
+  for (size_t y = 0; y < 8; y++) {
+    for (size_t x = 0; x < 8; x += Lanes(df)) {
+      const auto v = Load(df, coefficients + y * 8 + x) * scale;
+      StoreU(DemoteTo(di16, ConvertTo(di32, Round(v))), di16,
+             mem + y * kIDCTInt16Stride + b * 8 + x);
+    }
+  }
+  return true;
+}
+
+// Transforms the first num_blocks blocks of `mem` and stores block b to
+// pixels[b], with the given stride. `mem` is clobbered.
+JXL_INLINE void IDCT8x8Int16(int16_t* JXL_RESTRICT mem,
+                             float* JXL_RESTRICT const* pixels,
+                             size_t num_blocks, size_t pixels_stride) {
+  IDCT1DInt16(mem);
+  TransposeInt16(mem);
+  IDCT1DInt16(mem);
+
+  const HWY_CAPPED(float, 8) df;
+  const Rebind<int32_t, decltype(df)> di32;
+  const Rebind<int16_t, decltype(df)> di16;
+  const auto inv_scale = Set(df, 1.0f / kIDCTInt16Scale);
+  for (size_t b = 0; b < num_blocks; b++) {
+    for (size_t y = 0; y < 8; y++) {
+      for (size_t x = 0; x < 8; x += Lanes(df)) {
+        const auto v = LoadU(di16, mem + y * kIDCTInt16Stride + b * 8 + x);
+        StoreU(ConvertTo(df, PromoteTo(di32, v)) * inv_scale, df,
+               pixels[b] + y * pixels_stride + x);
+      }
+    }
+  }
+}
+
+}  // namespace
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace jxl
+HWY_AFTER_NAMESPACE();
+
+#endif  // LIB_JXL_IDCT_INT16_INL_H_
@@ -90,7 +90,7 @@ PlaneBase::PlaneBase(const size_t xsize, const size_t ysize,
   // if nonzero, because "zero" bytes still have padding/bookkeeping overhead.
   if (xsize != 0 && ysize != 0) {
     bytes_per_row_ = BytesPerRow(xsize, sizeof_t);
-    bytes_ = AllocateArray(bytes_per_row_ * ysize);
+    bytes_ = AllocateArray(bytes_per_row_ * ysize, AllocationKind::kImage);
     JXL_CHECK(bytes_.get());
     InitializePadding(sizeof_t, Padding::kRoundUp);
   }
@@ -263,8 +263,7 @@ float DotProduct(const ImageF& a, const ImageF& b) {
   return sum;
 }
 
-static void DownsampleImage(const ImageF& input, size_t factor,
-                            ImageF* output) {
+void DownsampleImage(const ImageF& input, size_t factor, ImageF* output) {
   JXL_ASSERT(factor != 1);
   output->ShrinkTo(DivCeil(input.xsize(), factor),
                    DivCeil(input.ysize(), factor));
@@ -808,6 +808,9 @@ void PadImageToBlockMultipleInPlace(Image3F* JXL_RESTRICT in);
 // Downsamples an image by a given factor.
 void DownsampleImage(Image3F* opsin, size_t factor);
 void DownsampleImage(ImageF* image, size_t factor);
+// Same as above, but leaves `input` unchanged. `output` must be at least
+// DivCeil(input.xsize(), factor) x DivCeil(input.ysize(), factor).
+void DownsampleImage(const ImageF& input, size_t factor, ImageF* output);
 
 }  // namespace jxl
 
@@ -73,6 +73,65 @@ TEST(ImageTest, TestAllocator) {
   }
 }
 
+// Same for allocations above the huge-page threshold.
+TEST(ImageTest, TestHugePageAllocator) {
+  const size_t old_threshold = CacheAligned::HugePageThreshold();
+  CacheAligned::SetHugePageThreshold(1 << 16);
+  const size_t kAlign = CacheAligned::kAlignment;
+  for (size_t size : {size_t{1} << 16, (size_t{3} << 20) + 7}) {
+    for (size_t offset = 0; offset <= CacheAligned::kAlias; offset += kAlign) {
+      uint8_t* bytes =
+          static_cast<uint8_t*>(CacheAligned::Allocate(size, offset));
+      JXL_CHECK(reinterpret_cast<uintptr_t>(bytes) % kAlign == 0);
+#if defined(__linux__)
+      // The mapping starts at a huge page boundary.
+      EXPECT_EQ(offset == 0 ? kAlign : offset,
+                reinterpret_cast<uintptr_t>(bytes) % (size_t{2} << 20));
+#endif
+      memset(bytes, 0, size);
+      bytes[size - 1] = 1;
+      JXL_CHECK(bytes[0] < bytes[size - 1]);
+      CacheAligned::Free(bytes);
+    }
+  }
+  CacheAligned::SetHugePageThreshold(old_threshold);
+}
+
+// Allocation targets only allowing the memory manager bypass huge pages, but
+// the usage is counted either way.
+TEST(ImageTest, TestHugePageAllocationTarget) {
+  const size_t old_threshold = CacheAligned::HugePageThreshold();
+  CacheAligned::SetHugePageThreshold(1 << 16);
+  JxlMemoryManager memory_manager;
+  memory_manager.opaque = nullptr;
+  memory_manager.alloc = [](void*, size_t size) { return malloc(size); };
+  memory_manager.free = [](void*, void* address) { free(address); };
+  const size_t size = (size_t{3} << 20) + 7;
+  for (bool allow_huge_pages : {false, true}) {
+    AllocationTarget target(memory_manager, allow_huge_pages);
+    const AllocationTarget::Usage& usage =
+        target.GetUsage(AllocationKind::kImage);
+    {
+      ScopedAllocationTarget scoped(&target);
+      uint8_t* bytes = static_cast<uint8_t*>(
+          CacheAligned::Allocate(size, 0, AllocationKind::kImage));
+#if defined(__linux__)
+      if (allow_huge_pages) {
+        EXPECT_EQ(CacheAligned::kAlignment,
+                  reinterpret_cast<uintptr_t>(bytes) % (size_t{2} << 20));
+      }
+#endif
+      EXPECT_EQ(1u, usage.num_allocations.load());
+      EXPECT_GE(usage.bytes_in_use.load(), size);
+      memset(bytes, 0, size);
+      CacheAligned::Free(bytes);
+    }
+    EXPECT_EQ(0u, usage.bytes_in_use.load());
+    EXPECT_GE(usage.max_bytes_in_use.load(), size);
+  }
+  CacheAligned::SetHugePageThreshold(old_threshold);
+}
+
 template <typename T>
 void TestFillImpl(Image3<T>* img, const char* layout) {
   FillImage(T(1), img);
@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <array>
 #include <string>
@@ -357,6 +358,148 @@ TEST(JxlTest, RoundtripMultiGroup) {
             3.0f);
 }
 
+TEST(JxlTest, RoundtripStreamingHistograms) {
+  ThreadPoolInternal pool(4);
+  const PaddedBytes orig =
+      ReadTestData("imagecompression.info/flower_foveon.png");
+  CodecInOut io;
+  ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io, &pool));
+  io.ShrinkTo(600, 1024);
+
+  CompressParams cparams;
+  DecompressParams dparams;
+  cparams.butteraugli_distance = 1.0f;
+  CodecInOut io2;
+  const size_t size = Roundtrip(&io, cparams, dparams, &pool, &io2);
+
+  // Histograms estimated from a sample of the groups cost a little extra.
+  cparams.streaming_histograms = true;
+  CodecInOut io3;
+  EXPECT_LE(Roundtrip(&io, cparams, dparams, &pool, &io3), size * 1.05);
+  EXPECT_LE(ButteraugliDistance(io, io3, cparams.ba_params,
+                                /*distmap=*/nullptr, &pool),
+            1.99f);
+}
+
+TEST(JxlTest, RoundtripRealtime) {
+  ThreadPoolInternal pool(4);
+  const PaddedBytes orig =
+      ReadTestData("imagecompression.info/flower_foveon.png");
+  CodecInOut io;
+  ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io, &pool));
+  io.ShrinkTo(600, 1024);
+  CodecInOut io_small;
+  ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io_small, &pool));
+  io_small.ShrinkTo(300, 200);
+
+  CompressParams cparams;
+  cparams.butteraugli_distance = 1.0f;
+  cparams.realtime = true;
+  DecompressParams dparams;
+
+  // Frames after the first one reuse its histograms, even if their size and
+  // contents are different.
+  PassesEncoderState enc_state;
+  PaddedBytes first, second, third;
+  ASSERT_TRUE(EncodeFile(cparams, &io, &enc_state, &first, /*aux_out=*/nullptr,
+                         &pool));
+  ASSERT_TRUE(EncodeFile(cparams, &io_small, &enc_state, &second,
+                         /*aux_out=*/nullptr, &pool));
+  ASSERT_TRUE(EncodeFile(cparams, &io, &enc_state, &third, /*aux_out=*/nullptr,
+                         &pool));
+  ASSERT_EQ(first.size(), third.size());
+  EXPECT_EQ(0, memcmp(first.data(), third.data(), first.size()));
+
+  CodecInOut io2;
+  ASSERT_TRUE(DecodeFile(dparams, second, &io2, &pool));
+  EXPECT_LE(ButteraugliDistance(io_small, io2, cparams.ba_params,
+                                /*distmap=*/nullptr, &pool),
+            3.0f);
+  CodecInOut io3;
+  ASSERT_TRUE(DecodeFile(dparams, third, &io3, &pool));
+  EXPECT_LE(ButteraugliDistance(io, io3, cparams.ba_params,
+                                /*distmap=*/nullptr, &pool),
+            3.0f);
+}
+
+TEST(JxlTest, RoundtripPrefixCodes) {
+  ThreadPoolInternal pool(4);
+  const PaddedBytes orig =
+      ReadTestData("imagecompression.info/flower_foveon.png");
+  CodecInOut io;
+  ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io, &pool));
+  io.ShrinkTo(600, 1024);
+
+  CompressParams cparams;
+  DecompressParams dparams;
+  cparams.butteraugli_distance = 1.0f;
+  CodecInOut io2;
+  const size_t size = Roundtrip(&io, cparams, dparams, &pool, &io2);
+
+  // Prefix codes in all the streams cost about 15% more.
+  cparams.force_prefix_codes = true;
+  CodecInOut io3;
+  EXPECT_LE(Roundtrip(&io, cparams, dparams, &pool, &io3), size * 1.2);
+  EXPECT_LE(ButteraugliDistance(io, io3, cparams.ba_params,
+                                /*distmap=*/nullptr, &pool),
+            1.99f);
+}
+
+TEST(JxlTest, RoundtripButteraugliProxy) {
+  ThreadPoolInternal pool(4);
+  const PaddedBytes orig =
+      ReadTestData("imagecompression.info/flower_foveon.png");
+  CodecInOut io;
+  ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io, &pool));
+  io.ShrinkTo(600, 1024);
+
+  CompressParams cparams;
+  DecompressParams dparams;
+
+  // Same limits as the full-resolution butteraugli loop in RoundtripMultiGroup.
+  cparams.butteraugli_distance = 1.0f;
+  cparams.speed_tier = SpeedTier::kKitten;
+  cparams.butteraugli_proxy_downsampling = 2;
+  CodecInOut io2;
+  EXPECT_LE(Roundtrip(&io, cparams, dparams, &pool, &io2), 40000);
+  EXPECT_LE(ButteraugliDistance(io, io2, cparams.ba_params,
+                                /*distmap=*/nullptr, &pool),
+            1.99f);
+
+  cparams.butteraugli_distance = 2.0f;
+  cparams.butteraugli_proxy_downsampling = 4;
+  CodecInOut io3;
+  EXPECT_LE(Roundtrip(&io, cparams, dparams, &pool, &io3), 22100);
+  EXPECT_LE(ButteraugliDistance(io, io3, cparams.ba_params,
+                                /*distmap=*/nullptr, &pool),
+            3.0f);
+}
+
+TEST(JxlTest, RoundtripButteraugliProxySmall) {
+  ThreadPoolInternal pool(4);
+  const PaddedBytes orig =
+      ReadTestData("imagecompression.info/flower_foveon.png");
+  CodecInOut io;
+  ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io, &pool));
+  // Too small to be downsampled by 4 and still be measured by butteraugli, so
+  // the proxy must not be used.
+  io.ShrinkTo(100, 20);
+
+  CompressParams cparams;
+  DecompressParams dparams;
+  cparams.butteraugli_distance = 1.0f;
+  cparams.speed_tier = SpeedTier::kKitten;
+  CodecInOut io_full;
+  const size_t full_size = Roundtrip(&io, cparams, dparams, &pool, &io_full);
+
+  cparams.butteraugli_proxy_downsampling = 4;
+  CodecInOut io_proxy;
+  EXPECT_EQ(full_size, Roundtrip(&io, cparams, dparams, &pool, &io_proxy));
+  EXPECT_LE(ButteraugliDistance(io, io_proxy, cparams.ba_params,
+                                /*distmap=*/nullptr, &pool),
+            1.5f);
+}
+
 TEST(JxlTest, RoundtripLargeFast) {
   ThreadPoolInternal pool(8);
   const PaddedBytes orig =
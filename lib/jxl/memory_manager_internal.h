@@ -17,6 +17,7 @@
 #include <memory>
 
 #include "jxl/memory_manager.h"
+#include "lib/jxl/base/cache_aligned.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/status.h"
 
@@ -47,6 +48,13 @@ static JXL_INLINE Status MemoryManagerInit(
   return true;
 }
 
+// Whether `memory_manager` uses the default functions, i.e. malloc and free.
+static JXL_INLINE bool MemoryManagerIsDefault(
+    const JxlMemoryManager& memory_manager) {
+  return memory_manager.alloc == jxl::MemoryManagerDefaultAlloc &&
+         memory_manager.free == jxl::MemoryManagerDefaultFree;
+}
+
 static JXL_INLINE void* MemoryManagerAlloc(
     const JxlMemoryManager* memory_manager, size_t size) {
   return memory_manager->alloc(memory_manager->opaque, size);
@@ -57,6 +65,26 @@ static JXL_INLINE void MemoryManagerFree(const JxlMemoryManager* memory_manager,
   return memory_manager->free(memory_manager->opaque, address);
 }
 
+// Copies the statistics of `category` from `target`. Returns false if
+// `category` is not a valid JxlMemoryCategory.
+static JXL_INLINE bool GetMemoryUsage(const AllocationTarget& target,
+                                      JxlMemoryCategory category,
+                                      JxlMemoryUsage* usage) {
+  static_assert(kNumAllocationKinds == JXL_MEMORY_OTHER + 1,
+                "AllocationKind must match JxlMemoryCategory");
+  if (static_cast<uint32_t>(category) >= kNumAllocationKinds) {
+    return false;
+  }
+  const AllocationTarget::Usage& kind_usage =
+      target.GetUsage(static_cast<AllocationKind>(category));
+  usage->bytes_in_use = kind_usage.bytes_in_use.load(std::memory_order_relaxed);
+  usage->max_bytes_in_use =
+      kind_usage.max_bytes_in_use.load(std::memory_order_relaxed);
+  usage->num_allocations =
+      kind_usage.num_allocations.load(std::memory_order_relaxed);
+  return true;
+}
+
 // Helper class to be used as a deleter in a unique_ptr<T> call.
 class MemoryManagerDeleteHelper {
  public:
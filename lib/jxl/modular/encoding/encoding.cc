@@ -123,6 +123,16 @@ FlatTree FilterTree(const Tree &global_tree,
   return output;
 }
 
+// Reads a symbol of a *clustered* context. `uses_fast_prefix_path` is chosen
+// once per channel, see ANSSymbolReader::UsesFastPrefixPath.
+template <bool uses_fast_prefix_path>
+JXL_INLINE uint64_t ReadChannelSymbol(size_t ctx, BitReader *JXL_RESTRICT br,
+                                      ANSSymbolReader *JXL_RESTRICT reader) {
+  return uses_fast_prefix_path ? reader->ReadHybridUintClusteredPrefix(ctx, br)
+                               : reader->ReadHybridUintClustered(ctx, br);
+}
+
+template <bool uses_fast_prefix_path>
 Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
                                  const std::vector<uint8_t> &context_map,
                                  const Tree &global_tree,
@@ -190,7 +200,8 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
         for (size_t y = 0; y < channel.h; y++) {
           pixel_type *JXL_RESTRICT r = channel.Row(y);
           for (size_t x = 0; x < channel.w; x++) {
-            uint32_t v = reader->ReadHybridUintClustered(ctx_id, br);
+            uint32_t v =
+                ReadChannelSymbol<uses_fast_prefix_path>(ctx_id, br, reader);
             r[x] = make_pixel(v, multiplier, offset);
           }
         }
@@ -206,7 +217,8 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
           pixel_type top = (y ? *(r + x - onerow) : left);
           pixel_type topleft = (x && y ? *(r + x - 1 - onerow) : left);
           pixel_type guess = ClampedGradient(top, left, topleft);
-          uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
+          uint64_t v =
+              ReadChannelSymbol<uses_fast_prefix_path>(ctx_id, br, reader);
           r[x] = make_pixel(v, 1, guess);
         }
       }
@@ -220,7 +232,8 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
           PredictionResult pred =
               PredictNoTreeNoWP(channel.w, r + x, onerow, x, y, predictor);
           pixel_type_w g = pred.guess + offset;
-          uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
+          uint64_t v =
+              ReadChannelSymbol<uses_fast_prefix_path>(ctx_id, br, reader);
           // NOTE: pred.multiplier is unset.
           r[x] = make_pixel(v, multiplier, g);
         }
@@ -236,7 +249,8 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
                                            predictor, &wp_state)
                                .guess +
                            offset;
-          uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
+          uint64_t v =
+              ReadChannelSymbol<uses_fast_prefix_path>(ctx_id, br, reader);
           r[x] = make_pixel(v, multiplier, g);
           wp_state.UpdateErrors(r[x], x, y, channel.w);
         }
@@ -275,7 +289,8 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
                 std::max<pixel_type_w>(-kPropRangeFast, top + left - topleft),
                 kPropRangeFast - 1);
         uint32_t ctx_id = context_lookup[pos];
-        uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
+        uint64_t v =
+            ReadChannelSymbol<uses_fast_prefix_path>(ctx_id, br, reader);
         r[x] = make_pixel(v, multipliers[pos],
                           static_cast<pixel_type_w>(offsets[pos]) + guess);
       }
@@ -302,7 +317,8 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
             kPropRangeFast + std::min(std::max(-kPropRangeFast, properties[0]),
                                       kPropRangeFast - 1);
         uint32_t ctx_id = context_lookup[pos];
-        uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
+        uint64_t v =
+            ReadChannelSymbol<uses_fast_prefix_path>(ctx_id, br, reader);
         r[x] = make_pixel(v, multipliers[pos],
                           static_cast<pixel_type_w>(offsets[pos]) + guess);
         wp_state.UpdateErrors(r[x], x, y, channel.w);
@@ -324,7 +340,8 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
         PredictionResult res =
             PredictTreeNoWP(&properties, channel.w, p + x, onerow, x, y,
                             tree_lookup, references);
-        uint64_t v = reader->ReadHybridUintClustered(res.context, br);
+        uint64_t v =
+            ReadChannelSymbol<uses_fast_prefix_path>(res.context, br, reader);
         p[x] = make_pixel(v, res.multiplier, res.guess);
       }
     }
@@ -343,7 +360,8 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
         PredictionResult res =
             PredictTreeWP(&properties, channel.w, p + x, onerow, x, y,
                           tree_lookup, references, &wp_state);
-        uint64_t v = reader->ReadHybridUintClustered(res.context, br);
+        uint64_t v =
+            ReadChannelSymbol<uses_fast_prefix_path>(res.context, br, reader);
         p[x] = make_pixel(v, res.multiplier, res.guess);
         wp_state.UpdateErrors(p[x], x, y, channel.w);
       }
@@ -352,6 +370,20 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
   return true;
 }
 
+Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
+                                 const std::vector<uint8_t> &context_map,
+                                 const Tree &global_tree,
+                                 const weighted::Header &wp_header,
+                                 pixel_type chan, size_t group_id,
+                                 Image *image) {
+  if (reader->UsesFastPrefixPath()) {
+    return DecodeModularChannelMAANS</*uses_fast_prefix_path=*/true>(
+        br, reader, context_map, global_tree, wp_header, chan, group_id, image);
+  }
+  return DecodeModularChannelMAANS</*uses_fast_prefix_path=*/false>(
+      br, reader, context_map, global_tree, wp_header, chan, group_id, image);
+}
+
 GroupHeader::GroupHeader() { Bundle::Init(this); }
 
 Status ValidateChannelDimensions(const Image &image,
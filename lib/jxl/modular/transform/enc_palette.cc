@@ -5,7 +5,9 @@
 
 #include "lib/jxl/modular/transform/enc_palette.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <map>
 #include <set>
 
@@ -154,11 +156,208 @@ struct PaletteIterationData {
   }
 };
 
+namespace {
+
+// Packs colors of up to 4 channels, each spanning fewer than 2^16 values, into
+// 64-bit keys. Keys compare like the colors they represent in lexicographic
+// order.
+struct ColorPacker {
+  static constexpr size_t kMaxChannels = 4;
+  static constexpr size_t kBits = 16;
+
+  bool Init(const Image &input, uint32_t begin_c, uint32_t num_c) {
+    if (num_c > kMaxChannels) return false;
+    nb = num_c;
+    for (size_t c = 0; c < nb; c++) {
+      pixel_type maxval;
+      compute_minmax(input.channel[begin_c + c], &minval[c], &maxval);
+      if (static_cast<int64_t>(maxval) - minval[c] >= (1 << kBits)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  uint64_t Pack(const pixel_type *const *rows, size_t x) const {
+    uint64_t key = 0;
+    for (size_t c = 0; c < nb; c++) {
+      key = (key << kBits) | static_cast<uint64_t>(rows[c][x] - minval[c]);
+    }
+    return key;
+  }
+
+  std::vector<pixel_type> Unpack(uint64_t key) const {
+    std::vector<pixel_type> color(nb);
+    for (size_t c = nb; c-- > 0;) {
+      color[c] = minval[c] + static_cast<pixel_type>(key & ((1 << kBits) - 1));
+      key >>= kBits;
+    }
+    return color;
+  }
+
+  size_t nb = 0;
+  pixel_type minval[kMaxChannels];
+};
+
+// Open-addressing hash table counting occurrences of packed colors. A count of
+// zero marks an empty slot.
+class ColorCounts {
+ public:
+  ColorCounts() { Rehash(64); }
+
+  // Adds `n` > 0 occurrences of `key`; returns whether `key` is new.
+  bool Add(uint64_t key, size_t n = 1) {
+    size_t i = Slot(key);
+    while (counts_[i] != 0) {
+      if (keys_[i] == key) {
+        counts_[i] += n;
+        return false;
+      }
+      i = (i + 1) & (keys_.size() - 1);
+    }
+    keys_[i] = key;
+    counts_[i] = n;
+    if (++size_ * 2 > keys_.size()) Rehash(keys_.size() * 2);
+    return true;
+  }
+
+  size_t size() const { return size_; }
+
+  template <typename Visitor>
+  void ForEach(const Visitor &visit) const {
+    for (size_t i = 0; i < keys_.size(); i++) {
+      if (counts_[i] != 0) visit(keys_[i], counts_[i]);
+    }
+  }
+
+ private:
+  size_t Slot(uint64_t key) const {
+    return (key * 0x9E3779B97F4A7C15ull) >> shift_;
+  }
+
+  void Rehash(size_t num_slots) {
+    std::vector<uint64_t> keys(num_slots);
+    std::vector<size_t> counts(num_slots);
+    keys_.swap(keys);
+    counts_.swap(counts);
+    shift_ = 64 - CeilLog2Nonzero(num_slots);
+    size_ = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (counts[i] != 0) Add(keys[i], counts[i]);
+    }
+  }
+
+  std::vector<uint64_t> keys_;
+  std::vector<size_t> counts_;
+  size_t size_ = 0;
+  size_t shift_ = 0;
+};
+
+// Rows per stripe when counting colors on the thread pool.
+constexpr size_t kColorStripeRows = 64;
+
+// Counts, for each color of channels [begin_c, begin_c + packer.nb), the
+// pixels not on the image border whose four neighbours have the same color.
+void CountCrossColors(const Image &input, uint32_t begin_c,
+                      const ColorPacker &packer, ThreadPool *pool,
+                      ColorCounts *color_freq) {
+  const size_t w = input.channel[begin_c].w;
+  const size_t h = input.channel[begin_c].h;
+  if (w < 3 || h < 3) return;
+  const size_t num_stripes = DivCeil(h - 2, kColorStripeRows);
+  std::vector<ColorCounts> stripe_freq(num_stripes);
+  const auto count_stripe = [&](const uint32_t stripe, size_t /* thread */) {
+    const size_t y0 = 1 + stripe * kColorStripeRows;
+    const size_t y1 = std::min(y0 + kColorStripeRows, h - 1);
+    const pixel_type *rows[3][ColorPacker::kMaxChannels];
+    for (size_t y = y0; y < y1; y++) {
+      for (size_t i = 0; i < 3; i++) {
+        for (size_t c = 0; c < packer.nb; c++) {
+          rows[i][c] = input.channel[begin_c + c].Row(y + i - 1);
+        }
+      }
+      for (size_t x = 1; x + 1 < w; x++) {
+        const uint64_t color = packer.Pack(rows[1], x);
+        if (packer.Pack(rows[1], x - 1) == color &&
+            packer.Pack(rows[1], x + 1) == color &&
+            packer.Pack(rows[0], x) == color &&
+            packer.Pack(rows[2], x) == color) {
+          stripe_freq[stripe].Add(color);
+        }
+      }
+    }
+  };
+  RunOnPool(pool, 0, num_stripes, ThreadPool::SkipInit(), count_stripe,
+            "CountCrossColors");
+  for (const ColorCounts &freq : stripe_freq) {
+    freq.ForEach(
+        [&](uint64_t key, size_t count) { color_freq->Add(key, count); });
+  }
+}
+
+// Adds the colors of channels [begin_c, begin_c + packer.nb) to `palette`,
+// appending the new ones to `imageorder` in order of first appearance. When
+// `lossy`, stops once `palette` holds `max_colors` colors; otherwise returns
+// false as soon as it holds more than that.
+bool CollectColors(const Image &input, uint32_t begin_c,
+                   const ColorPacker &packer, size_t max_colors, bool lossy,
+                   ThreadPool *pool, ColorCounts *palette,
+                   std::vector<uint64_t> *imageorder) {
+  const size_t w = input.channel[begin_c].w;
+  const size_t h = input.channel[begin_c].h;
+  const size_t num_stripes = DivCeil(h, kColorStripeRows);
+  // Colors of each stripe in order of first appearance within the stripe.
+  // Merging them stripe by stripe yields the global order of first appearance.
+  // A stripe with more than `max_colors` colors either makes the whole palette
+  // too large, or (if `lossy`) already contains all the colors that will be
+  // added from it.
+  std::vector<std::vector<uint64_t>> stripe_colors(num_stripes);
+  std::atomic<bool> too_many_colors{false};
+  const auto collect_stripe = [&](const uint32_t stripe, size_t /* thread */) {
+    const size_t y0 = stripe * kColorStripeRows;
+    const size_t y1 = std::min(y0 + kColorStripeRows, h);
+    ColorCounts seen;
+    std::vector<uint64_t> &colors = stripe_colors[stripe];
+    const pixel_type *rows[ColorPacker::kMaxChannels];
+    for (size_t y = y0; y < y1; y++) {
+      if (too_many_colors.load(std::memory_order_relaxed)) return;
+      for (size_t c = 0; c < packer.nb; c++) {
+        rows[c] = input.channel[begin_c + c].Row(y);
+      }
+      for (size_t x = 0; x < w; x++) {
+        const uint64_t color = packer.Pack(rows, x);
+        if (!seen.Add(color)) continue;
+        colors.push_back(color);
+        if (colors.size() > max_colors) {
+          if (!lossy) too_many_colors = true;
+          return;
+        }
+      }
+    }
+  };
+  if (!lossy || palette->size() < max_colors) {
+    RunOnPool(pool, 0, num_stripes, ThreadPool::SkipInit(), collect_stripe,
+              "CollectColors");
+  }
+  if (too_many_colors) return false;
+  for (const std::vector<uint64_t> &colors : stripe_colors) {
+    for (uint64_t color : colors) {
+      if (lossy && palette->size() >= max_colors) return true;
+      if (palette->Add(color)) imageorder->push_back(color);
+      if (palette->size() > max_colors) return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
 Status FwdPaletteIteration(Image &input, uint32_t begin_c, uint32_t end_c,
                            uint32_t &nb_colors, uint32_t &nb_deltas,
                            bool ordered, bool lossy, Predictor &predictor,
                            const weighted::Header &wp_header,
-                           PaletteIterationData &palette_iteration_data) {
+                           PaletteIterationData &palette_iteration_data,
+                           ThreadPool *pool) {
   JXL_QUIET_RETURN_IF_ERROR(CheckEqualChannels(input, begin_c, end_c));
   JXL_ASSERT(begin_c >= input.nb_meta_channels);
   uint32_t nb = end_c - begin_c + 1;
@@ -226,8 +425,8 @@ Status FwdPaletteIteration(Image &input, uint32_t begin_c, uint32_t end_c,
       begin_c, end_c, nb_colors);
   nb_deltas = 0;
   bool delta_used = false;
-  std::set<std::vector<pixel_type>>
-      candidate_palette;  // ordered lexicographically
+  // Colors in lexicographic order and in order of first appearance.
+  std::vector<std::vector<pixel_type>> candidate_palette;
   std::vector<std::vector<pixel_type>> candidate_palette_imageorder;
   std::vector<pixel_type> color(nb);
   std::vector<float> color_with_error(nb);
@@ -236,59 +435,91 @@ Status FwdPaletteIteration(Image &input, uint32_t begin_c, uint32_t end_c,
   if (lossy) {
     palette_iteration_data.FindFrequentColorDeltas(w * h);
     nb_deltas = palette_iteration_data.frequent_deltas[0].size();
-
-    // Count color frequency for colors that make a cross.
-    std::map<std::vector<pixel_type>, size_t> color_freq_map;
-    for (size_t y = 1; y + 1 < h; y++) {
-      for (uint32_t c = 0; c < nb; c++) {
-        p_in[c] = input.channel[begin_c + c].Row(y);
-      }
-      for (size_t x = 1; x + 1 < w; x++) {
+  }
+  // In the lossy case, colors that often make a cross are added to the palette
+  // first.
+  constexpr float kImageFraction = 0.01f;
+  const size_t color_frequency_lower_bound =
+      5 + input.h * input.w * kImageFraction;
+
+  ColorPacker packer;
+  if (packer.Init(input, begin_c, nb)) {
+    ColorCounts palette;
+    std::vector<uint64_t> imageorder;
+    if (lossy) {
+      ColorCounts color_freq;
+      CountCrossColors(input, begin_c, packer, pool, &color_freq);
+      color_freq.ForEach([&](uint64_t key, size_t count) {
+        if (count > color_frequency_lower_bound) imageorder.push_back(key);
+      });
+      std::sort(imageorder.begin(), imageorder.end());
+      for (uint64_t key : imageorder) palette.Add(key);
+    }
+    if (!CollectColors(input, begin_c, packer, nb_colors, lossy, pool,
+                       &palette, &imageorder)) {
+      return false;  // too many colors
+    }
+    for (uint64_t key : imageorder) {
+      candidate_palette_imageorder.push_back(packer.Unpack(key));
+    }
+    std::sort(imageorder.begin(), imageorder.end());
+    for (uint64_t key : imageorder) {
+      candidate_palette.push_back(packer.Unpack(key));
+    }
+  } else {
+    // Colors that do not fit in 64 bits.
+    std::set<std::vector<pixel_type>> palette;
+    if (lossy) {
+      // Count color frequency for colors that make a cross.
+      std::map<std::vector<pixel_type>, size_t> color_freq_map;
+      for (size_t y = 1; y + 1 < h; y++) {
         for (uint32_t c = 0; c < nb; c++) {
-          color[c] = p_in[c][x];
+          p_in[c] = input.channel[begin_c + c].Row(y);
         }
-        int offsets[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
-        bool makes_cross = true;
-        for (int i = 0; i < 4 && makes_cross; ++i) {
-          int dx = offsets[i][0];
-          int dy = offsets[i][1];
-          for (uint32_t c = 0; c < nb && makes_cross; c++) {
-            if (input.channel[begin_c + c].Row(y + dy)[x + dx] != color[c]) {
-              makes_cross = false;
+        for (size_t x = 1; x + 1 < w; x++) {
+          for (uint32_t c = 0; c < nb; c++) {
+            color[c] = p_in[c][x];
+          }
+          int offsets[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+          bool makes_cross = true;
+          for (int i = 0; i < 4 && makes_cross; ++i) {
+            int dx = offsets[i][0];
+            int dy = offsets[i][1];
+            for (uint32_t c = 0; c < nb && makes_cross; c++) {
+              if (input.channel[begin_c + c].Row(y + dy)[x + dx] != color[c]) {
+                makes_cross = false;
+              }
             }
           }
+          if (makes_cross) color_freq_map[color] += 1;
         }
-        if (makes_cross) color_freq_map[color] += 1;
       }
-    }
-    // Add colors satisfying frequency condition to the palette.
-    constexpr float kImageFraction = 0.01f;
-    size_t color_frequency_lower_bound = 5 + input.h * input.w * kImageFraction;
-    for (const auto &color_freq : color_freq_map) {
-      if (color_freq.second > color_frequency_lower_bound) {
-        candidate_palette.insert(color_freq.first);
-        candidate_palette_imageorder.push_back(color_freq.first);
+      for (const auto &color_freq : color_freq_map) {
+        if (color_freq.second > color_frequency_lower_bound) {
+          palette.insert(color_freq.first);
+          candidate_palette_imageorder.push_back(color_freq.first);
+        }
       }
     }
-  }
-
-  for (size_t y = 0; y < h; y++) {
-    for (uint32_t c = 0; c < nb; c++) {
-      p_in[c] = input.channel[begin_c + c].Row(y);
-    }
-    for (size_t x = 0; x < w; x++) {
-      if (lossy && candidate_palette.size() >= nb_colors) break;
+    for (size_t y = 0; y < h; y++) {
       for (uint32_t c = 0; c < nb; c++) {
-        color[c] = p_in[c][x];
-      }
-      const bool new_color = candidate_palette.insert(color).second;
-      if (new_color) {
-        candidate_palette_imageorder.push_back(color);
+        p_in[c] = input.channel[begin_c + c].Row(y);
       }
-      if (candidate_palette.size() > nb_colors) {
-        return false;  // too many colors
+      for (size_t x = 0; x < w; x++) {
+        if (lossy && palette.size() >= nb_colors) break;
+        for (uint32_t c = 0; c < nb; c++) {
+          color[c] = p_in[c][x];
+        }
+        const bool new_color = palette.insert(color).second;
+        if (new_color) {
+          candidate_palette_imageorder.push_back(color);
+        }
+        if (palette.size() > nb_colors) {
+          return false;  // too many colors
+        }
       }
     }
+    candidate_palette.assign(palette.begin(), palette.end());
   }
 
   nb_colors = nb_deltas + candidate_palette.size();
@@ -315,7 +546,7 @@ Status FwdPaletteIteration(Image &input, uint32_t begin_c, uint32_t end_c,
   if (ordered) {
     JXL_DEBUG_V(7, "Palette of %i colors, using lexicographic order",
                 nb_colors);
-    for (auto pcol : candidate_palette) {
+    for (const auto &pcol : candidate_palette) {
       JXL_DEBUG_V(9, "  Color %i :  ", x);
       for (size_t i = 0; i < nb; i++) {
         p_palette[nb_deltas + i * onerow + x] = pcol[i];
@@ -327,7 +558,7 @@ Status FwdPaletteIteration(Image &input, uint32_t begin_c, uint32_t end_c,
     }
   } else {
     JXL_DEBUG_V(7, "Palette of %i colors, using image order", nb_colors);
-    for (auto pcol : candidate_palette_imageorder) {
+    for (const auto &pcol : candidate_palette_imageorder) {
       JXL_DEBUG_V(9, "  Color %i :  ", x);
       for (size_t i = 0; i < nb; i++)
         p_palette[nb_deltas + i * onerow + x] = pcol[i];
@@ -537,7 +768,7 @@ Status FwdPaletteIteration(Image &input, uint32_t begin_c, uint32_t end_c,
 Status FwdPalette(Image &input, uint32_t begin_c, uint32_t end_c,
                   uint32_t &nb_colors, uint32_t &nb_deltas, bool ordered,
                   bool lossy, Predictor &predictor,
-                  const weighted::Header &wp_header) {
+                  const weighted::Header &wp_header, ThreadPool *pool) {
   PaletteIterationData palette_iteration_data;
   uint32_t nb = end_c - begin_c + 1;
   uint32_t nb_colors_orig = nb_colors;
@@ -548,14 +779,15 @@ Status FwdPalette(Image &input, uint32_t begin_c, uint32_t end_c,
       input.bitdepth == 8) {  // if no channel palette special case
     status = FwdPaletteIteration(input, begin_c, end_c, nb_colors, nb_deltas,
                                  ordered, lossy, predictor, wp_header,
-                                 palette_iteration_data);
+                                 palette_iteration_data, pool);
   }
   palette_iteration_data.final_run = true;
   nb_colors = nb_colors_orig;
   nb_deltas = nb_deltas_orig;
   status =
       FwdPaletteIteration(input, begin_c, end_c, nb_colors, nb_deltas, ordered,
-                          lossy, predictor, wp_header, palette_iteration_data);
+                          lossy, predictor, wp_header, palette_iteration_data,
+                          pool);
   return status;
 }
 
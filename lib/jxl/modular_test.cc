@@ -35,6 +35,7 @@
 #include "lib/jxl/image_test_utils.h"
 #include "lib/jxl/modular/encoding/enc_encoding.h"
 #include "lib/jxl/modular/encoding/encoding.h"
+#include "lib/jxl/modular/transform/enc_palette.h"
 #include "lib/jxl/test_utils.h"
 #include "lib/jxl/testdata.h"
 
@@ -124,6 +125,78 @@ TEST(ModularTest, RoundtripLossy16) {
             1.5);
 }
 
+TEST(ModularTest, PaletteColorOrder) {
+  constexpr size_t kXSize = 217;
+  constexpr size_t kYSize = 301;
+  constexpr size_t kNumColors = 37;
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<> dist(-1000, 40000);
+  std::vector<std::array<pixel_type, 3>> colors(kNumColors);
+  for (auto& color : colors) {
+    for (pixel_type& v : color) v = dist(rng);
+  }
+  std::uniform_int_distribution<> color_dist(0, kNumColors - 1);
+  std::vector<size_t> pixel_colors(kXSize * kYSize);
+  for (size_t& i : pixel_colors) i = color_dist(rng);
+  const auto make_image = [&]() {
+    Image image(kXSize, kYSize, /*bitdepth=*/16, 3);
+    for (size_t y = 0; y < kYSize; y++) {
+      for (size_t x = 0; x < kXSize; x++) {
+        const auto& color = colors[pixel_colors[y * kXSize + x]];
+        for (size_t c = 0; c < 3; c++) image.channel[c].Row(y)[x] = color[c];
+      }
+    }
+    return image;
+  };
+  const weighted::Header wp_header;
+  ThreadPoolInternal pool(4);
+
+  // Too many colors.
+  {
+    Image image = make_image();
+    uint32_t nb_colors = kNumColors - 1;
+    uint32_t nb_deltas = 0;
+    Predictor predictor = Predictor::Zero;
+    EXPECT_FALSE(FwdPalette(image, 0, 2, nb_colors, nb_deltas,
+                            /*ordered=*/true, /*lossy=*/false, predictor,
+                            wp_header, &pool));
+  }
+
+  for (bool ordered : {true, false}) {
+    Image image = make_image();
+    uint32_t nb_colors = kNumColors;
+    uint32_t nb_deltas = 0;
+    Predictor predictor = Predictor::Zero;
+    ASSERT_TRUE(FwdPalette(image, 0, 2, nb_colors, nb_deltas, ordered,
+                           /*lossy=*/false, predictor, wp_header, &pool));
+    ASSERT_EQ(nb_colors, kNumColors);
+    ASSERT_EQ(image.channel.size(), 2u);
+    const Channel& palette = image.channel[0];
+    const auto palette_color = [&](pixel_type index) {
+      std::array<pixel_type, 3> color;
+      for (size_t c = 0; c < 3; c++) color[c] = palette.Row(c)[index];
+      return color;
+    };
+    if (ordered) {
+      for (size_t i = 1; i < kNumColors; i++) {
+        EXPECT_LT(palette_color(i - 1), palette_color(i));
+      }
+    }
+    // Without ordering, indices appear in increasing order in the image.
+    pixel_type next_index = 0;
+    for (size_t y = 0; y < kYSize; y++) {
+      for (size_t x = 0; x < kXSize; x++) {
+        const pixel_type index = image.channel[1].Row(y)[x];
+        ASSERT_EQ(palette_color(index), colors[pixel_colors[y * kXSize + x]]);
+        if (!ordered) {
+          ASSERT_LE(index, next_index);
+          if (index == next_index) next_index++;
+        }
+      }
+    }
+  }
+}
+
 TEST(ModularTest, RoundtripExtraProperties) {
   constexpr size_t kSize = 250;
   Image image(kSize, kSize, /*bitdepth=*/8, 3);
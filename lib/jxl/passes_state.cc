@@ -45,6 +45,7 @@ Status InitializePassesSharedState(const FrameHeader& frame_header,
   if (!(frame_header.flags & FrameHeader::kUseDcFrame) || encoder) {
     shared->dc_storage =
         Image3F(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
+    shared->dc = &shared->dc_storage;
   } else {
     if (frame_header.dc_level == 4) {
       return JXL_FAILURE("Invalid DC level for kUseDcFrame: %u",
@@ -58,10 +59,10 @@ Status InitializePassesSharedState(const FrameHeader& frame_header,
           frame_header.dc_level, frame_header.dc_level + 1);
     }
     ZeroFillImage(&shared->quant_dc);
+    // The DC comes from the already decoded DC frame.
+    shared->dc_storage = Image3F();
   }
 
-  shared->dc_storage = Image3F(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
-
   return true;
 }
 
@@ -3,6 +3,8 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+#include <string.h>
+
 #include <string>
 
 #include "gtest/gtest.h"
@@ -108,5 +110,35 @@ TEST_P(SpeedTierTest, Roundtrip) {
                                 /*distmap=*/nullptr, /*pool=*/nullptr),
             2.8);
 }
+
+TEST_P(SpeedTierTest, SameOutputWithThreads) {
+  const PaddedBytes orig =
+      ReadTestData("wesaturate/500px/u76c0g_bliznaca_srgb8.png");
+  CodecInOut io;
+  ThreadPoolInternal pool(8);
+  ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io, &pool));
+
+  const SpeedTierTestParams& params = GetParam();
+
+  if (params.shrink8) {
+    io.ShrinkTo(io.xsize() / 8, io.ysize() / 8);
+  }
+
+  CompressParams cparams;
+  cparams.speed_tier = params.speed_tier;
+
+  // Statistics that are gathered in parallel (coefficient orders, block
+  // context map, group clustering) must not depend on the number of threads.
+  PaddedBytes serial;
+  PassesEncoderState serial_state;
+  ASSERT_TRUE(EncodeFile(cparams, &io, &serial_state, &serial,
+                         /*aux_out=*/nullptr, /*pool=*/nullptr));
+  PaddedBytes parallel;
+  PassesEncoderState parallel_state;
+  ASSERT_TRUE(EncodeFile(cparams, &io, &parallel_state, &parallel,
+                         /*aux_out=*/nullptr, &pool));
+  ASSERT_EQ(serial.size(), parallel.size());
+  EXPECT_EQ(0, memcmp(serial.data(), parallel.data(), serial.size()));
+}
 }  // namespace
 }  // namespace jxl
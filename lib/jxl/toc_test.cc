@@ -52,7 +52,7 @@ void Roundtrip(size_t num_entries, bool permute, std::mt19937* rng) {
   BitWriter writer;
   AuxOut aux_out;
   ASSERT_TRUE(WriteGroupOffsets(group_codes, permute ? &permutation : nullptr,
-                                &writer, &aux_out));
+                                &writer, HistogramParams(), &aux_out));
 
   BitReader reader(writer.GetSpan());
   std::vector<uint64_t> group_offsets;
@@ -5,6 +5,7 @@
 
 set(TEST_FILES
   extras/codec_test.cc
+  extras/codestream_stats_test.cc
   jxl/ac_strategy_test.cc
   jxl/adaptive_reconstruction_test.cc
   jxl/alpha_test.cc
@@ -24,7 +25,9 @@ set(TEST_FILES
   jxl/dct_test.cc
   jxl/decode_test.cc
   jxl/descriptive_statistics_test.cc
+  jxl/enc_content_analysis_test.cc
   jxl/enc_external_image_test.cc
+  jxl/enc_fast_heuristics_test.cc
   jxl/enc_photon_noise_test.cc
   jxl/encode_test.cc
   jxl/entropy_coder_test.cc
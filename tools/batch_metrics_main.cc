@@ -0,0 +1,221 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Computes the butteraugli distance, its p-norm and the SSIMULACRA score of
+// many distorted images listed in a manifest. Each reference image is loaded
+// and preprocessed once, then all of its distorted images are scored in
+// parallel.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lib/extras/codec.h"
+#include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/status.h"
+#include "lib/jxl/base/thread_pool_internal.h"
+#include "lib/jxl/butteraugli/butteraugli.h"
+#include "lib/jxl/codec_in_out.h"
+#include "lib/jxl/color_encoding_internal.h"
+#include "lib/jxl/color_management.h"
+#include "lib/jxl/enc_butteraugli_comparator.h"
+#include "lib/jxl/enc_butteraugli_pnorm.h"
+#include "lib/jxl/image.h"
+#include "lib/jxl/image_bundle.h"
+#include "tools/ssimulacra.h"
+
+namespace jxl {
+namespace {
+
+struct ManifestEntry {
+  std::string reference;
+  std::string distorted;
+};
+
+struct Scores {
+  bool ok = false;
+  float butteraugli = 0.0f;
+  double pnorm = 0.0;
+  double ssimulacra = 0.0;
+};
+
+// One "<reference> <distorted>" pair per line. Empty lines and lines starting
+// with '#' are skipped.
+Status ReadManifest(const char* pathname, std::vector<ManifestEntry>* entries) {
+  std::ifstream in(pathname);
+  if (!in) {
+    fprintf(stderr, "Failed to open manifest %s\n", pathname);
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    ManifestEntry entry;
+    if (!(fields >> entry.reference >> entry.distorted)) {
+      fprintf(stderr, "Invalid manifest line \"%s\"\n", line.c_str());
+      return false;
+    }
+    entries->push_back(entry);
+  }
+  return true;
+}
+
+Status LoadLinear(const std::string& pathname,
+                  const std::string& colorspace_hint, ThreadPool* pool,
+                  CodecInOut* io) {
+  if (!colorspace_hint.empty()) {
+    io->dec_hints.Add("color_space", colorspace_hint);
+  }
+  if (!SetFromFile(pathname, io, pool)) {
+    fprintf(stderr, "Failed to read image from %s\n", pathname.c_str());
+    return false;
+  }
+  return io->TransformTo(ColorEncoding::LinearSRGB(io->Main().IsGray()), pool);
+}
+
+Status RunBatch(const char* manifest, const std::string& colorspace_hint,
+                double p, float intensity_target, size_t num_threads) {
+  std::vector<ManifestEntry> entries;
+  JXL_RETURN_IF_ERROR(ReadManifest(manifest, &entries));
+
+  ButteraugliParams ba_params;
+  ba_params.hf_asymmetry = 0.8f;
+  ba_params.xmul = 1.0f;
+  ba_params.intensity_target = intensity_target;
+
+  // Indices of the entries of each reference, in order of first occurrence.
+  std::vector<std::vector<size_t>> groups;
+  std::unordered_map<std::string, size_t> group_index;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const auto inserted =
+        group_index.emplace(entries[i].reference, groups.size());
+    if (inserted.second) groups.emplace_back();
+    groups[inserted.first->second].push_back(i);
+  }
+
+  ThreadPoolInternal pool(num_threads);
+  std::vector<Scores> scores(entries.size());
+  for (const std::vector<size_t>& group : groups) {
+    const std::string& reference_name = entries[group[0]].reference;
+    CodecInOut io_reference;
+    if (!LoadLinear(reference_name, colorspace_hint, &pool, &io_reference)) {
+      continue;
+    }
+    const ImageBundle& reference = io_reference.Main();
+    if (reference.xsize() < 8 || reference.ysize() < 8) {
+      fprintf(stderr, "Minimum image size is 8x8 pixels: %s\n",
+              reference_name.c_str());
+      continue;
+    }
+    const ButteraugliComparator butteraugli(reference.color(), ba_params);
+    const ssimulacra::SsimulacraReference ssimulacra(reference.color(),
+                                                     &pool);
+
+    // Butteraugli comparators have per-instance temporary storage: each
+    // thread scores with its own copy of the preprocessed reference.
+    std::vector<std::unique_ptr<ButteraugliComparator>> comparators;
+    const auto init_comparators = [&](const size_t num_threads) {
+      comparators.resize(num_threads);
+      return true;
+    };
+    const auto score = [&](const int task, const int thread) {
+      const ManifestEntry& entry = entries[group[task]];
+      CodecInOut io_distorted;
+      if (!LoadLinear(entry.distorted, colorspace_hint, /*pool=*/nullptr,
+                      &io_distorted)) {
+        return;
+      }
+      const ImageBundle& distorted = io_distorted.Main();
+      if (!SameSize(reference, distorted)) {
+        fprintf(stderr, "Image size mismatch: %s %s\n",
+                entry.reference.c_str(), entry.distorted.c_str());
+        return;
+      }
+      Scores& result = scores[group[task]];
+      ImageF distmap;
+      if (reference.HasAlpha() || distorted.HasAlpha()) {
+        // Blending on black and white backgrounds changes the reference too.
+        result.butteraugli = ButteraugliDistance(reference, distorted,
+                                                 ba_params, &distmap);
+      } else {
+        if (!comparators[thread]) comparators[thread] = butteraugli.Clone();
+        distmap = ImageF(reference.xsize(), reference.ysize());
+        comparators[thread]->Diffmap(distorted.color(), distmap);
+        result.butteraugli = ButteraugliScoreFromDiffmap(distmap, &ba_params);
+      }
+      result.pnorm = ComputeDistanceP(distmap, ba_params, p);
+      result.ssimulacra = ssimulacra.Compare(distorted.color()).Score();
+      result.ok = true;
+    };
+    RunOnPool(&pool, 0, group.size(), init_comparators, score, "Score");
+  }
+
+  bool all_ok = true;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (!scores[i].ok) {
+      printf("%s %s error\n", entries[i].reference.c_str(),
+             entries[i].distorted.c_str());
+      all_ok = false;
+      continue;
+    }
+    printf("%s %s %.10f %f %.8f\n", entries[i].reference.c_str(),
+           entries[i].distorted.c_str(), scores[i].butteraugli,
+           scores[i].pnorm, scores[i].ssimulacra);
+  }
+  return all_ok;
+}
+
+}  // namespace
+}  // namespace jxl
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr,
+            "Usage: %s <manifest> [--num_threads <n>] [--pnorm <p>]\n"
+            "[--intensity_target <intensity_target>]\n"
+            "[--colorspace <colorspace_hint>]\n"
+            "The manifest lists one \"<reference> <distorted>\" pair per "
+            "line. Prints one line per pair, in the same order: both paths, "
+            "the butteraugli distance, its p-norm and the SSIMULACRA score. "
+            "Each reference is preprocessed once for all of its pairs, which "
+            "are scored in parallel.\n",
+            argv[0]);
+    return 1;
+  }
+  std::string colorspace;
+  double p = 3;
+  float intensity_target = 80.0;  // sRGB intensity target.
+  size_t num_threads = 4;
+  for (int i = 2; i < argc; i++) {
+    if (std::string(argv[i]) == "--colorspace" && i + 1 < argc) {
+      colorspace = argv[++i];
+    } else if (std::string(argv[i]) == "--intensity_target" && i + 1 < argc) {
+      intensity_target = std::stof(std::string(argv[++i]));
+    } else if (std::string(argv[i]) == "--num_threads" && i + 1 < argc) {
+      num_threads = std::stoul(std::string(argv[++i]));
+    } else if (std::string(argv[i]) == "--pnorm" && i + 1 < argc) {
+      char* end;
+      p = strtod(argv[++i], &end);
+      if (end == argv[i]) {
+        fprintf(stderr, "Failed to parse pnorm \"%s\".\n", argv[i]);
+        return 1;
+      }
+    } else {
+      fprintf(stderr, "Unrecognized flag \"%s\".\n", argv[i]);
+      return 1;
+    }
+  }
+
+  return jxl::RunBatch(argv[1], colorspace, p, intensity_target, num_threads)
+             ? 0
+             : 1;
+}
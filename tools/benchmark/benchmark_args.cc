@@ -172,6 +172,33 @@ Status BenchmarkArgs::AddCommandLineOptions() {
               "How many times to decode (>1 for more precise measurements). "
               "Defaults to 1.",
               1);
+  AddUnsigned(&warmup_reps, "warmup_reps",
+              "How many untimed encodes and decodes to run before the timed "
+              "ones, e.g. to fill caches. Defaults to 0.",
+              0);
+
+  AddString(&json_output, "json_output",
+            "If not empty, write the size and the per-repetition encode and "
+            "decode times of every method and image to this JSON file.");
+  AddString(&baseline, "baseline",
+            "If not empty, compare the timings with this file written by "
+            "--json_output (e.g. by another build), and fail if speed "
+            "regressed.");
+  AddDouble(&regression_threshold, "regression_threshold",
+            "Relative slowdown above which a significant change of the median "
+            "(per image) or geometric mean (per method) time vs --baseline is "
+            "a regression.",
+            0.05);
+  AddDouble(&significance_level, "significance_level",
+            "Maximum p-value for a slowdown vs --baseline to be a regression.",
+            0.05);
+
+  AddFlag(&stage_timings, "stage_timings",
+          "If true, also time each kind of TOC section (and the frame "
+          "finalization) of JPEG XL outputs, decode_reps times, with a "
+          "separate single-threaded decode, for --json_output and "
+          "--baseline.",
+          false);
 
   AddString(&sample_tmp_dir, "sample_tmp_dir",
             "Directory to put samples from input images.");
@@ -251,6 +278,13 @@ Status BenchmarkArgs::ValidateArgs() {
 
   if (print_details_csv) print_details = true;
 
+  if (regression_threshold < 0) {
+    return JXL_FAILURE("regression_threshold must be >= 0");
+  }
+  if (significance_level <= 0 || significance_level >= 1) {
+    return JXL_FAILURE("significance_level must be in (0, 1)");
+  }
+
   if (override_bitdepth > 32) {
     return JXL_FAILURE("override_bitdepth must be <= 32");
   }
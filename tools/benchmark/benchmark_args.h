@@ -136,6 +136,13 @@ struct BenchmarkArgs {
   int num_threads;
   int inner_threads;
   size_t decode_reps;
+  size_t warmup_reps;
+
+  std::string json_output;
+  std::string baseline;
+  double regression_threshold;
+  double significance_level;
+  bool stage_timings;
   size_t encode_reps;
 
   std::string sample_tmp_dir;
@@ -0,0 +1,513 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "tools/benchmark/benchmark_regression.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+
+namespace jxl {
+namespace {
+
+// Not StringPrintf from benchmark_stats.h, which would pull in the benchmark
+// arguments and thus all codecs; this file is also linked into the tests.
+std::string Format(const char* format, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  return buf;
+}
+
+std::string QuoteJSON(const std::string& s) {
+  std::string out = "\"";
+  for (const char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out += Format("\\u%04x", c);
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+std::string TimesToJSON(const std::vector<double>& seconds) {
+  std::string out = "[";
+  for (size_t i = 0; i < seconds.size(); ++i) {
+    out += Format(i == 0 ? "%.9g" : ", %.9g", seconds[i]);
+  }
+  return out + "]";
+}
+
+// Only what TimingsFromJSON needs: the full JSON syntax, but \u escapes are
+// limited to ASCII.
+struct JSONValue {
+  enum class Type { kNull, kBool, kNumber, kString, kArray, kObject };
+  Type type = Type::kNull;
+  double number = 0.0;
+  std::string string;
+  std::vector<JSONValue> array;
+  std::vector<std::pair<std::string, JSONValue>> object;
+
+  const JSONValue* Get(const char* key) const {
+    for (const auto& member : object) {
+      if (member.first == key) return &member.second;
+    }
+    return nullptr;
+  }
+};
+
+class JSONParser {
+ public:
+  explicit JSONParser(const std::string& text) : text_(text) {}
+
+  Status Parse(JSONValue* value) {
+    JXL_RETURN_IF_ERROR(ParseValue(value, /*depth=*/0));
+    SkipSpace();
+    if (pos_ != text_.size()) return JXL_FAILURE("Trailing JSON data");
+    return true;
+  }
+
+ private:
+  static constexpr size_t kMaxDepth = 64;
+
+  void SkipSpace() {
+    while (pos_ < text_.size() &&
+           (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' ||
+            text_[pos_] == '\r')) {
+      ++pos_;
+    }
+  }
+
+  bool Consume(const char* literal) {
+    const size_t len = strlen(literal);
+    if (text_.compare(pos_, len, literal) != 0) return false;
+    pos_ += len;
+    return true;
+  }
+
+  Status ParseString(std::string* out) {
+    if (!Consume("\"")) return JXL_FAILURE("Expected JSON string");
+    while (pos_ < text_.size() && text_[pos_] != '"') {
+      char c = text_[pos_++];
+      if (c != '\\') {
+        *out += c;
+        continue;
+      }
+      if (pos_ >= text_.size()) break;
+      c = text_[pos_++];
+      switch (c) {
+        case 'b':
+          *out += '\b';
+          break;
+        case 'f':
+          *out += '\f';
+          break;
+        case 'n':
+          *out += '\n';
+          break;
+        case 'r':
+          *out += '\r';
+          break;
+        case 't':
+          *out += '\t';
+          break;
+        case 'u': {
+          if (pos_ + 4 > text_.size()) return JXL_FAILURE("Invalid escape");
+          const std::string hex = text_.substr(pos_, 4);
+          char* end;
+          const long code = strtol(hex.c_str(), &end, 16);
+          if (end != hex.c_str() + 4 || code >= 0x80) {
+            return JXL_FAILURE("Unsupported JSON escape \\u%s", hex.c_str());
+          }
+          *out += static_cast<char>(code);
+          pos_ += 4;
+          break;
+        }
+        default:
+          *out += c;
+      }
+    }
+    if (!Consume("\"")) return JXL_FAILURE("Unterminated JSON string");
+    return true;
+  }
+
+  Status ParseValue(JSONValue* value, size_t depth) {
+    if (depth > kMaxDepth) return JXL_FAILURE("JSON nested too deeply");
+    SkipSpace();
+    if (pos_ >= text_.size()) return JXL_FAILURE("Unexpected end of JSON");
+    const char c = text_[pos_];
+    if (c == '{') {
+      ++pos_;
+      value->type = JSONValue::Type::kObject;
+      SkipSpace();
+      if (Consume("}")) return true;
+      do {
+        SkipSpace();
+        std::pair<std::string, JSONValue> member;
+        JXL_RETURN_IF_ERROR(ParseString(&member.first));
+        SkipSpace();
+        if (!Consume(":")) return JXL_FAILURE("Expected ':' in JSON object");
+        JXL_RETURN_IF_ERROR(ParseValue(&member.second, depth + 1));
+        value->object.push_back(std::move(member));
+        SkipSpace();
+      } while (Consume(","));
+      if (!Consume("}")) return JXL_FAILURE("Expected '}' in JSON object");
+    } else if (c == '[') {
+      ++pos_;
+      value->type = JSONValue::Type::kArray;
+      SkipSpace();
+      if (Consume("]")) return true;
+      do {
+        value->array.emplace_back();
+        JXL_RETURN_IF_ERROR(ParseValue(&value->array.back(), depth + 1));
+        SkipSpace();
+      } while (Consume(","));
+      if (!Consume("]")) return JXL_FAILURE("Expected ']' in JSON array");
+    } else if (c == '"') {
+      value->type = JSONValue::Type::kString;
+      JXL_RETURN_IF_ERROR(ParseString(&value->string));
+    } else if (Consume("true")) {
+      value->type = JSONValue::Type::kBool;
+      value->number = 1.0;
+    } else if (Consume("false")) {
+      value->type = JSONValue::Type::kBool;
+    } else if (Consume("null")) {
+      value->type = JSONValue::Type::kNull;
+    } else {
+      const char* begin = text_.c_str() + pos_;
+      char* end;
+      value->number = strtod(begin, &end);
+      if (end == begin) return JXL_FAILURE("Invalid JSON value");
+      value->type = JSONValue::Type::kNumber;
+      pos_ += end - begin;
+    }
+    return true;
+  }
+
+  const std::string& text_;
+  size_t pos_ = 0;
+};
+
+template <typename T>
+Status GetNumber(const JSONValue& object, const char* key, T* out) {
+  const JSONValue* value = object.Get(key);
+  if (value == nullptr) return true;  // Keep default.
+  if (value->type != JSONValue::Type::kNumber) {
+    return JXL_FAILURE("JSON field %s is not a number", key);
+  }
+  *out = static_cast<T>(value->number);
+  return true;
+}
+
+Status GetTimes(const JSONValue& object, const char* key,
+                std::vector<double>* out) {
+  const JSONValue* value = object.Get(key);
+  if (value == nullptr) return true;
+  if (value->type != JSONValue::Type::kArray) {
+    return JXL_FAILURE("JSON field %s is not an array", key);
+  }
+  for (const JSONValue& element : value->array) {
+    if (element.type != JSONValue::Type::kNumber) {
+      return JXL_FAILURE("JSON field %s has non-numeric elements", key);
+    }
+    out->push_back(element.number);
+  }
+  return true;
+}
+
+// Ranks of `values` in ascending order, starting at 1, with tied values
+// getting their average rank. Also returns sum(t^3 - t) over groups of t ties.
+std::vector<double> Ranks(const std::vector<double>& values,
+                          double* tie_correction) {
+  std::vector<size_t> order(values.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return values[a] < values[b]; });
+  std::vector<double> ranks(values.size());
+  *tie_correction = 0.0;
+  for (size_t begin = 0; begin < order.size();) {
+    size_t end = begin + 1;
+    while (end < order.size() && values[order[end]] == values[order[begin]]) {
+      ++end;
+    }
+    const double average_rank = 0.5 * (begin + 1 + end);
+    for (size_t i = begin; i < end; ++i) ranks[order[i]] = average_rank;
+    const double ties = end - begin;
+    *tie_correction += ties * ties * ties - ties;
+    begin = end;
+  }
+  return ranks;
+}
+
+// Two-sided p-value of a normally distributed statistic, with continuity
+// correction.
+double NormalPValue(double statistic, double mean, double variance) {
+  if (variance <= 0.0) return 1.0;
+  const double z =
+      std::max(0.0, std::abs(statistic - mean) - 0.5) / std::sqrt(variance);
+  return std::erfc(z / std::sqrt(2.0));
+}
+
+double Median(std::vector<double> values) {
+  JXL_ASSERT(!values.empty());
+  std::sort(values.begin(), values.end());
+  const size_t half = values.size() / 2;
+  if (values.size() % 2 == 1) return values[half];
+  return 0.5 * (values[half - 1] + values[half]);
+}
+
+// Prints the change of the median time of a task from `before` to `after` and
+// returns whether it is a regression. Returns false without printing anything
+// if either has no positive median.
+bool CompareTaskTimes(const TaskTimings& t, const std::string& stage,
+                      const std::vector<double>& before,
+                      const std::vector<double>& after, double threshold,
+                      double significance_level, double* log_ratio,
+                      bool* regression) {
+  if (before.empty() || after.empty()) return false;
+  const double median_before = Median(before);
+  const double median_after = Median(after);
+  if (median_before <= 0.0 || median_after <= 0.0) return false;
+  *log_ratio = std::log(median_after) - std::log(median_before);
+  const double change = median_after / median_before - 1.0;
+  const double p = MannWhitneyPValue(before, after);
+  *regression = change > threshold && p < significance_level;
+  printf("%-30s %-15s %12.6f %12.6f %+8.2f%% %9.4f  %s%s\n", t.method.c_str(),
+         stage.c_str(), median_before, median_after, change * 100, p,
+         t.image.c_str(), *regression ? "  REGRESSION" : "");
+  return true;
+}
+
+struct MethodSummary {
+  size_t num_images = 0;
+  size_t baseline_size = 0;
+  size_t current_size = 0;
+  std::vector<double> log_ratios[2];  // encode, decode
+};
+
+}  // namespace
+
+std::string TimingsToJSON(const TimingsReport& report) {
+  std::string out = "{\n";
+  out += Format("  \"warmup_reps\": %zu,\n", report.warmup_reps);
+  out += Format("  \"encode_reps\": %zu,\n", report.encode_reps);
+  out += Format("  \"decode_reps\": %zu,\n", report.decode_reps);
+  out += Format("  \"num_threads\": %d,\n", report.num_threads);
+  out += Format("  \"inner_threads\": %d,\n", report.inner_threads);
+  out += "  \"tasks\": [";
+  for (size_t i = 0; i < report.tasks.size(); ++i) {
+    const TaskTimings& t = report.tasks[i];
+    out += i == 0 ? "\n" : ",\n";
+    out += "    {\"method\": " + QuoteJSON(t.method) +
+           ", \"image\": " + QuoteJSON(t.image) + ",\n";
+    out += Format(
+        "     \"compressed_size\": %zu, \"pixels\": %zu, \"errors\": %zu,\n",
+        t.compressed_size, t.pixels, t.errors);
+    out += "     \"encode_seconds\": " + TimesToJSON(t.encode_seconds) + ",\n";
+    out += "     \"decode_seconds\": " + TimesToJSON(t.decode_seconds);
+    if (!t.decode_stages.empty()) {
+      out += ",\n     \"decode_stages\": {";
+      for (size_t j = 0; j < t.decode_stages.size(); ++j) {
+        out += j == 0 ? "" : ", ";
+        out += QuoteJSON(t.decode_stages[j].stage) + ": " +
+               TimesToJSON(t.decode_stages[j].seconds);
+      }
+      out += "}";
+    }
+    out += "}";
+  }
+  out += "\n  ]\n}\n";
+  return out;
+}
+
+Status TimingsFromJSON(const std::string& json, TimingsReport* report) {
+  JSONValue root;
+  JXL_RETURN_IF_ERROR(JSONParser(json).Parse(&root));
+  if (root.type != JSONValue::Type::kObject) {
+    return JXL_FAILURE("JSON timings must be an object");
+  }
+  JXL_RETURN_IF_ERROR(GetNumber(root, "warmup_reps", &report->warmup_reps));
+  JXL_RETURN_IF_ERROR(GetNumber(root, "encode_reps", &report->encode_reps));
+  JXL_RETURN_IF_ERROR(GetNumber(root, "decode_reps", &report->decode_reps));
+  JXL_RETURN_IF_ERROR(GetNumber(root, "num_threads", &report->num_threads));
+  JXL_RETURN_IF_ERROR(GetNumber(root, "inner_threads", &report->inner_threads));
+  const JSONValue* tasks = root.Get("tasks");
+  if (tasks == nullptr || tasks->type != JSONValue::Type::kArray) {
+    return JXL_FAILURE("JSON timings have no tasks array");
+  }
+  for (const JSONValue& task : tasks->array) {
+    const JSONValue* method = task.Get("method");
+    const JSONValue* image = task.Get("image");
+    if (method == nullptr || method->type != JSONValue::Type::kString ||
+        image == nullptr || image->type != JSONValue::Type::kString) {
+      return JXL_FAILURE("JSON task without method or image");
+    }
+    TaskTimings t;
+    t.method = method->string;
+    t.image = image->string;
+    JXL_RETURN_IF_ERROR(GetNumber(task, "compressed_size", &t.compressed_size));
+    JXL_RETURN_IF_ERROR(GetNumber(task, "pixels", &t.pixels));
+    JXL_RETURN_IF_ERROR(GetNumber(task, "errors", &t.errors));
+    JXL_RETURN_IF_ERROR(GetTimes(task, "encode_seconds", &t.encode_seconds));
+    JXL_RETURN_IF_ERROR(GetTimes(task, "decode_seconds", &t.decode_seconds));
+    const JSONValue* stages = task.Get("decode_stages");
+    if (stages != nullptr) {
+      if (stages->type != JSONValue::Type::kObject) {
+        return JXL_FAILURE("JSON field decode_stages is not an object");
+      }
+      for (const auto& member : stages->object) {
+        t.decode_stages.emplace_back();
+        t.decode_stages.back().stage = member.first;
+        JXL_RETURN_IF_ERROR(GetTimes(*stages, member.first.c_str(),
+                                     &t.decode_stages.back().seconds));
+      }
+    }
+    report->tasks.push_back(std::move(t));
+  }
+  return true;
+}
+
+double MannWhitneyPValue(const std::vector<double>& a,
+                         const std::vector<double>& b) {
+  if (a.empty() || b.empty()) return 1.0;
+  std::vector<double> values = a;
+  values.insert(values.end(), b.begin(), b.end());
+  double tie_correction;
+  const std::vector<double> ranks = Ranks(values, &tie_correction);
+  double rank_sum_a = 0.0;
+  for (size_t i = 0; i < a.size(); ++i) rank_sum_a += ranks[i];
+  const double n1 = a.size();
+  const double n2 = b.size();
+  const double n = n1 + n2;
+  const double u = rank_sum_a - n1 * (n1 + 1) / 2;
+  const double variance =
+      n1 * n2 / 12.0 * ((n + 1) - tie_correction / (n * (n - 1)));
+  return NormalPValue(u, n1 * n2 / 2, variance);
+}
+
+double MinMannWhitneyPValue(size_t n1, size_t n2) {
+  std::vector<double> a(n1), b(n2);
+  for (size_t i = 0; i < n1; ++i) a[i] = i;
+  for (size_t i = 0; i < n2; ++i) b[i] = n1 + i;
+  return MannWhitneyPValue(a, b);
+}
+
+double WilcoxonSignedRankPValue(const std::vector<double>& diffs) {
+  std::vector<double> magnitudes;
+  std::vector<bool> positive;
+  for (const double d : diffs) {
+    if (d == 0.0) continue;
+    magnitudes.push_back(std::abs(d));
+    positive.push_back(d > 0.0);
+  }
+  if (magnitudes.empty()) return 1.0;
+  double tie_correction;
+  const std::vector<double> ranks = Ranks(magnitudes, &tie_correction);
+  double positive_rank_sum = 0.0;
+  for (size_t i = 0; i < ranks.size(); ++i) {
+    if (positive[i]) positive_rank_sum += ranks[i];
+  }
+  const double n = magnitudes.size();
+  const double variance =
+      n * (n + 1) * (2 * n + 1) / 24 - tie_correction / 48;
+  return NormalPValue(positive_rank_sum, n * (n + 1) / 4, variance);
+}
+
+size_t CompareToBaseline(const TimingsReport& baseline,
+                         const TimingsReport& current, double threshold,
+                         double significance_level) {
+  static const char* kStages[2] = {"encode", "decode"};
+  std::map<std::pair<std::string, std::string>, const TaskTimings*> previous;
+  for (const TaskTimings& t : baseline.tasks) {
+    previous[std::make_pair(t.method, t.image)] = &t;
+  }
+
+  size_t num_regressions = 0;
+  std::vector<std::string> methods;
+  std::map<std::string, MethodSummary> summaries;
+  printf("Comparison with baseline (threshold %.1f%%, p < %g):\n",
+         threshold * 100, significance_level);
+  printf("%-30s %-15s %12s %12s %9s %9s  %s\n", "method", "stage",
+         "base_median", "median", "change", "p", "image");
+  for (const TaskTimings& t : current.tasks) {
+    const auto it = previous.find(std::make_pair(t.method, t.image));
+    if (it == previous.end()) continue;
+    const TaskTimings& base = *it->second;
+    if (t.errors != 0 || base.errors != 0) continue;
+    if (summaries.count(t.method) == 0) methods.push_back(t.method);
+    MethodSummary& summary = summaries[t.method];
+    summary.num_images++;
+    summary.baseline_size += base.compressed_size;
+    summary.current_size += t.compressed_size;
+    const std::vector<double>* times[2][2] = {
+        {&base.encode_seconds, &t.encode_seconds},
+        {&base.decode_seconds, &t.decode_seconds}};
+    double log_ratio;
+    bool regression;
+    for (size_t stage = 0; stage < 2; ++stage) {
+      if (CompareTaskTimes(t, kStages[stage], *times[stage][0],
+                           *times[stage][1], threshold, significance_level,
+                           &log_ratio, &regression)) {
+        summary.log_ratios[stage].push_back(log_ratio);
+        num_regressions += regression;
+      }
+    }
+    // Decode stages only count per task: they are not available for every
+    // method.
+    for (const StageTimings& stage : t.decode_stages) {
+      for (const StageTimings& base_stage : base.decode_stages) {
+        if (base_stage.stage != stage.stage) continue;
+        if (CompareTaskTimes(t, "decode:" + stage.stage, base_stage.seconds,
+                             stage.seconds, threshold, significance_level,
+                             &log_ratio, &regression)) {
+          num_regressions += regression;
+        }
+      }
+    }
+  }
+
+  for (const std::string& method : methods) {
+    const MethodSummary& summary = summaries[method];
+    printf("%s: %zu images, size %+.3f%%", method.c_str(), summary.num_images,
+           summary.baseline_size == 0
+               ? 0.0
+               : (static_cast<double>(summary.current_size) /
+                      summary.baseline_size -
+                  1.0) * 100);
+    for (size_t stage = 0; stage < 2; ++stage) {
+      const std::vector<double>& log_ratios = summary.log_ratios[stage];
+      if (log_ratios.empty()) continue;
+      double mean = 0.0;
+      for (const double r : log_ratios) mean += r;
+      mean /= log_ratios.size();
+      const double change = std::exp(mean) - 1.0;
+      const double p = WilcoxonSignedRankPValue(log_ratios);
+      const bool regression = change > threshold && p < significance_level;
+      num_regressions += regression;
+      printf(", %s time %+.2f%% (p %.4f)%s", kStages[stage], change * 100, p,
+             regression ? " REGRESSION" : "");
+    }
+    printf("\n");
+  }
+  if (methods.empty()) {
+    printf("No tasks in common with the baseline.\n");
+  }
+  fflush(stdout);
+  return num_regressions;
+}
+
+}  // namespace jxl
@@ -0,0 +1,86 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef TOOLS_BENCHMARK_BENCHMARK_REGRESSION_H_
+#define TOOLS_BENCHMARK_BENCHMARK_REGRESSION_H_
+
+// Machine-readable per-task timings of benchmark_xl, and their comparison
+// against the timings of a previous run (e.g. of another build).
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "lib/jxl/base/status.h"
+
+namespace jxl {
+
+// Time of one stage of a task, per repetition, in seconds.
+struct StageTimings {
+  std::string stage;
+  std::vector<double> seconds;
+};
+
+// Results of one (method, image) task. Times are per repetition, in seconds,
+// and exclude warm-up repetitions.
+struct TaskTimings {
+  std::string method;
+  std::string image;  // Path as given on the command line.
+  size_t compressed_size = 0;
+  size_t pixels = 0;
+  size_t errors = 0;
+  std::vector<double> encode_seconds;
+  std::vector<double> decode_seconds;
+  // Only with --stage_timings and if the compressed file is a JPEG XL
+  // codestream: single-threaded decode time of each kind of TOC section (see
+  // SectionKindName) summed over all frames, and of "Finalize".
+  std::vector<StageTimings> decode_stages;
+};
+
+struct TimingsReport {
+  size_t warmup_reps = 0;
+  size_t encode_reps = 0;
+  size_t decode_reps = 0;
+  int num_threads = 0;
+  int inner_threads = 0;
+  std::vector<TaskTimings> tasks;
+};
+
+std::string TimingsToJSON(const TimingsReport& report);
+
+// Parses the output of TimingsToJSON. Unknown keys are ignored.
+Status TimingsFromJSON(const std::string& json, TimingsReport* report);
+
+// Two-sided p-value of the Mann-Whitney U test that `a` and `b` are samples
+// of the same distribution. Uses the normal approximation with tie and
+// continuity correction, so it needs at least 4 samples on each side to report
+// p < 0.05 (see MinMannWhitneyPValue).
+double MannWhitneyPValue(const std::vector<double>& a,
+                         const std::vector<double>& b);
+
+// Smallest p-value MannWhitneyPValue can return for samples of these sizes,
+// i.e. that of two samples without any overlap. If it is not below the
+// significance level, no per-task change can be significant.
+double MinMannWhitneyPValue(size_t n1, size_t n2);
+
+// Two-sided p-value of the Wilcoxon signed-rank test that the median of
+// `diffs` is zero (normal approximation, zeros are dropped).
+double WilcoxonSignedRankPValue(const std::vector<double>& diffs);
+
+// Prints, for every task present in both reports, the change of the median
+// encode, decode and decode stage time, and per method the change of the geometric mean
+// time and of the total compressed size over all common images. A time is a
+// regression if it grows by more than `threshold` (relative) and the change is
+// significant at `significance_level`: per task with the Mann-Whitney U test
+// over repetitions, per method with the signed-rank test over the images'
+// log time ratios. Returns the number of regressions.
+size_t CompareToBaseline(const TimingsReport& baseline,
+                         const TimingsReport& current, double threshold,
+                         double significance_level);
+
+}  // namespace jxl
+
+#endif  // TOOLS_BENCHMARK_BENCHMARK_REGRESSION_H_
@@ -0,0 +1,185 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "tools/benchmark/benchmark_regression.h"
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace jxl {
+namespace {
+
+TEST(BenchmarkRegressionTest, MannWhitneyPValue) {
+  const std::vector<double> a = {1.0, 2.0, 3.0, 4.0, 5.0};
+  EXPECT_NEAR(1.0, MannWhitneyPValue(a, a), 1E-12);
+  EXPECT_EQ(1.0, MannWhitneyPValue(a, {}));
+  EXPECT_EQ(1.0, MannWhitneyPValue({}, a));
+  // All values tied: no information at all.
+  EXPECT_EQ(1.0, MannWhitneyPValue({2.0, 2.0, 2.0}, {2.0, 2.0, 2.0}));
+
+  // Separated samples, in either order.
+  const std::vector<double> b = {6.0, 7.0, 8.0, 9.0, 10.0};
+  const double p = MannWhitneyPValue(a, b);
+  EXPECT_LT(p, 0.05);
+  EXPECT_NEAR(p, MannWhitneyPValue(b, a), 1E-12);
+  // Interleaved samples are not significantly different.
+  EXPECT_GT(MannWhitneyPValue({1.0, 3.0, 5.0, 7.0}, {2.0, 4.0, 6.0, 8.0}),
+            0.5);
+}
+
+TEST(BenchmarkRegressionTest, MinMannWhitneyPValue) {
+  // A single repetition can never be significant, and 4 are the minimum for
+  // p < 0.05.
+  EXPECT_NEAR(1.0, MinMannWhitneyPValue(1, 1), 1E-12);
+  EXPECT_GT(MinMannWhitneyPValue(3, 3), 0.05);
+  EXPECT_LT(MinMannWhitneyPValue(4, 4), 0.05);
+  EXPECT_LT(MinMannWhitneyPValue(10, 10), MinMannWhitneyPValue(4, 4));
+  EXPECT_EQ(MinMannWhitneyPValue(4, 4),
+            MannWhitneyPValue({1.0, 2.0, 3.0, 4.0}, {5.0, 6.0, 7.0, 8.0}));
+}
+
+TEST(BenchmarkRegressionTest, WilcoxonSignedRankPValue) {
+  EXPECT_EQ(1.0, WilcoxonSignedRankPValue({}));
+  EXPECT_EQ(1.0, WilcoxonSignedRankPValue({0.0, 0.0, 0.0}));
+
+  std::vector<double> positive;
+  for (int i = 1; i <= 20; ++i) positive.push_back(0.01 * i);
+  const double p = WilcoxonSignedRankPValue(positive);
+  EXPECT_LT(p, 1E-3);
+  std::vector<double> negative;
+  for (const double d : positive) negative.push_back(-d);
+  EXPECT_NEAR(p, WilcoxonSignedRankPValue(negative), 1E-12);
+
+  // Symmetric around zero.
+  std::vector<double> symmetric = positive;
+  symmetric.insert(symmetric.end(), negative.begin(), negative.end());
+  EXPECT_GT(WilcoxonSignedRankPValue(symmetric), 0.9);
+}
+
+TimingsReport MakeReport() {
+  TimingsReport report;
+  report.warmup_reps = 1;
+  report.encode_reps = 3;
+  report.decode_reps = 2;
+  report.num_threads = 8;
+  report.inner_threads = -1;
+  TaskTimings t;
+  t.method = "jxl:d1:squirrel";
+  t.image = "dir with \"quotes\"\\and\tcontrol\n/image.png";
+  t.compressed_size = 12345;
+  t.pixels = 640 * 480;
+  t.errors = 0;
+  t.encode_seconds = {0.125, 1.0 / 3, 1E-7};
+  t.decode_seconds = {0.01, 123.456789};
+  t.decode_stages = {{"DCGlobal", {0.001, 0.002}}, {"ACGroup", {0.25, 0.5}}};
+  report.tasks.push_back(t);
+  t.decode_stages.clear();
+  t.method = "png";
+  t.image = "other/image.png";
+  t.errors = 1;
+  t.encode_seconds.clear();
+  t.decode_seconds = {2.5};
+  report.tasks.push_back(t);
+  return report;
+}
+
+TEST(BenchmarkRegressionTest, JSONRoundTrip) {
+  const TimingsReport report = MakeReport();
+  TimingsReport parsed;
+  ASSERT_TRUE(TimingsFromJSON(TimingsToJSON(report), &parsed));
+  EXPECT_EQ(report.warmup_reps, parsed.warmup_reps);
+  EXPECT_EQ(report.encode_reps, parsed.encode_reps);
+  EXPECT_EQ(report.decode_reps, parsed.decode_reps);
+  EXPECT_EQ(report.num_threads, parsed.num_threads);
+  EXPECT_EQ(report.inner_threads, parsed.inner_threads);
+  ASSERT_EQ(report.tasks.size(), parsed.tasks.size());
+  for (size_t i = 0; i < report.tasks.size(); ++i) {
+    const TaskTimings& expected = report.tasks[i];
+    const TaskTimings& actual = parsed.tasks[i];
+    EXPECT_EQ(expected.method, actual.method);
+    EXPECT_EQ(expected.image, actual.image);
+    EXPECT_EQ(expected.compressed_size, actual.compressed_size);
+    EXPECT_EQ(expected.pixels, actual.pixels);
+    EXPECT_EQ(expected.errors, actual.errors);
+    // Times are written with 9 significant digits.
+    ASSERT_EQ(expected.encode_seconds.size(), actual.encode_seconds.size());
+    for (size_t j = 0; j < expected.encode_seconds.size(); ++j) {
+      EXPECT_NEAR(expected.encode_seconds[j], actual.encode_seconds[j],
+                  expected.encode_seconds[j] * 1E-8);
+    }
+    ASSERT_EQ(expected.decode_seconds.size(), actual.decode_seconds.size());
+    for (size_t j = 0; j < expected.decode_seconds.size(); ++j) {
+      EXPECT_NEAR(expected.decode_seconds[j], actual.decode_seconds[j],
+                  expected.decode_seconds[j] * 1E-8);
+    }
+    ASSERT_EQ(expected.decode_stages.size(), actual.decode_stages.size());
+    for (size_t j = 0; j < expected.decode_stages.size(); ++j) {
+      EXPECT_EQ(expected.decode_stages[j].stage, actual.decode_stages[j].stage);
+      EXPECT_EQ(expected.decode_stages[j].seconds,
+                actual.decode_stages[j].seconds);
+    }
+  }
+}
+
+TEST(BenchmarkRegressionTest, JSONRejectsInvalidInput) {
+  TimingsReport parsed;
+  EXPECT_FALSE(TimingsFromJSON("", &parsed));
+  EXPECT_FALSE(TimingsFromJSON("[]", &parsed));
+  EXPECT_FALSE(TimingsFromJSON("{\"encode_reps\": 3}", &parsed));
+  EXPECT_FALSE(TimingsFromJSON("{\"tasks\": [{\"method\": \"a\"}]}", &parsed));
+  EXPECT_FALSE(TimingsFromJSON("{\"tasks\": []} trailing", &parsed));
+  const std::string json = TimingsToJSON(MakeReport());
+  EXPECT_FALSE(TimingsFromJSON(json.substr(0, json.size() / 2), &parsed));
+}
+
+TEST(BenchmarkRegressionTest, CompareToBaseline) {
+  TimingsReport baseline;
+  TaskTimings t;
+  t.method = "jxl";
+  t.image = "a/image.png";
+  t.encode_seconds = {1.0, 1.01, 0.99, 1.02, 0.98};
+  t.decode_seconds = {0.1, 0.101, 0.099, 0.102, 0.098};
+  baseline.tasks.push_back(t);
+  // Same name in another directory: must not be matched with the first one.
+  t.image = "b/image.png";
+  baseline.tasks.push_back(t);
+
+  EXPECT_EQ(0u, CompareToBaseline(baseline, baseline, 0.05, 0.05));
+
+  // Encoding of a/image.png is twice as slow.
+  TimingsReport current = baseline;
+  for (double& s : current.tasks[0].encode_seconds) s *= 2;
+  // Per task for a/image.png only; two images are too few for the per-method
+  // signed-rank test.
+  EXPECT_EQ(1u, CompareToBaseline(baseline, current, 0.05, 0.05));
+  // Below the threshold.
+  EXPECT_EQ(0u, CompareToBaseline(baseline, current, 1.5, 0.05));
+
+  // Decode stages are compared per task.
+  current = baseline;
+  for (TaskTimings& task : current.tasks) {
+    task.decode_stages = {{"ACGroup", task.decode_seconds}};
+  }
+  TimingsReport with_stages = current;
+  EXPECT_EQ(0u, CompareToBaseline(with_stages, current, 0.05, 0.05));
+  for (double& s : current.tasks[1].decode_stages[0].seconds) s *= 2;
+  EXPECT_EQ(1u, CompareToBaseline(with_stages, current, 0.05, 0.05));
+  // Stages missing from the baseline are not compared.
+  EXPECT_EQ(0u, CompareToBaseline(baseline, current, 0.05, 0.05));
+
+  // With a single repetition, no change is significant.
+  TimingsReport single = baseline;
+  for (TaskTimings& task : single.tasks) task.encode_seconds.resize(1);
+  current = single;
+  for (double& s : current.tasks[0].encode_seconds) s *= 2;
+  EXPECT_EQ(0u, CompareToBaseline(single, current, 0.05, 0.05));
+}
+
+}  // namespace
+}  // namespace jxl
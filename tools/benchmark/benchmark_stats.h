@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "lib/jxl/aux_out.h"
+#include "tools/benchmark/benchmark_regression.h"
 
 namespace jxl {
 
@@ -67,6 +68,12 @@ struct BenchmarkStats {
   size_t total_errors = 0;
   JxlStats jxl_stats;
   std::vector<float> extra_metrics;
+  // Seconds per repetition of a single task, excluding warm-up. Not
+  // assimilated: only times of the same image are comparable.
+  std::vector<double> encode_seconds;
+  std::vector<double> decode_seconds;
+  // See TaskTimings::decode_stages.
+  std::vector<StageTimings> decode_stages;
 };
 
 std::string PrintHeader();
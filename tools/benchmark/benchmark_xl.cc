@@ -21,6 +21,7 @@
 #include "jxl/decode.h"
 #include "lib/extras/codec.h"
 #include "lib/extras/codec_png.h"
+#include "lib/extras/codestream_stats.h"
 #include "lib/extras/time.h"
 #include "lib/jxl/alpha.h"
 #include "lib/jxl/base/cache_aligned.h"
@@ -44,6 +45,7 @@
 #include "tools/benchmark/benchmark_args.h"
 #include "tools/benchmark/benchmark_codec.h"
 #include "tools/benchmark/benchmark_file_io.h"
+#include "tools/benchmark/benchmark_regression.h"
 #include "tools/benchmark/benchmark_stats.h"
 #include "tools/benchmark/benchmark_utils.h"
 #include "tools/codec_config.h"
@@ -72,6 +74,42 @@ Status ReadPNG(const std::string& filename, Image3F* image) {
   return true;
 }
 
+// Decodes `compressed` decode_reps times one TOC section at a time, if it is
+// a JPEG XL codestream, and appends the time of each kind of section to
+// s->decode_stages.
+void AddDecodeStageTimings(const Span<const uint8_t> compressed,
+                           BenchmarkStats* s) {
+  if (JxlSignatureCheck(compressed.data(), compressed.size()) !=
+      JXL_SIG_CODESTREAM) {
+    return;
+  }
+  std::vector<StageTimings>& stages = s->decode_stages;
+  for (size_t i = 0; i < Args()->decode_reps; ++i) {
+    CodestreamStats stats;
+    if (!ComputeCodestreamStats(compressed, /*count_ac_tokens=*/false,
+                                &stats)) {
+      stages.clear();
+      return;
+    }
+    for (StageTimings& stage : stages) stage.seconds.push_back(0.0);
+    // Time of the current repetition of a stage; stages not seen so far took
+    // no time in the previous repetitions.
+    const auto stage_seconds = [&stages, i](const char* name) -> double& {
+      for (StageTimings& stage : stages) {
+        if (stage.stage == name) return stage.seconds.back();
+      }
+      stages.push_back(StageTimings{name, std::vector<double>(i + 1, 0.0)});
+      return stages.back().seconds.back();
+    };
+    for (const FrameStats& frame : stats.frames) {
+      for (const SectionStats& section : frame.sections) {
+        stage_seconds(SectionKindName(section.kind)) += section.decode_seconds;
+      }
+      stage_seconds("Finalize") += frame.finalize_seconds;
+    }
+  }
+}
+
 void DoCompress(const std::string& filename, const CodecInOut& io,
                 const std::vector<std::string>& extra_metrics_commands,
                 ImageCodec* codec, ThreadPoolInternal* inner_pool,
@@ -93,6 +131,9 @@ void DoCompress(const std::string& filename, const CodecInOut& io,
 
   jpegxl::tools::SpeedStats speed_stats;
   jpegxl::tools::SpeedStats::Summary summary;
+  // Warm-up repetitions are timed separately and then ignored.
+  jpegxl::tools::SpeedStats warmup_stats;
+  const size_t warmup_reps = Args()->warmup_reps;
 
   bool valid = true;  // false if roundtrip, encoding or decoding errors occur.
 
@@ -105,15 +146,16 @@ void DoCompress(const std::string& filename, const CodecInOut& io,
 
   std::string ext = FileExtension(filename);
   if (valid && !Args()->decode_only) {
-    for (size_t i = 0; i < Args()->encode_reps; ++i) {
+    for (size_t i = 0; i < warmup_reps + Args()->encode_reps; ++i) {
+      jpegxl::tools::SpeedStats* stats =
+          i < warmup_reps ? &warmup_stats : &speed_stats;
       if (codec->CanRecompressJpeg() && (ext == ".jpg" || ext == ".jpeg")) {
         std::string data_in;
         JXL_CHECK(ReadFile(filename, &data_in));
-        JXL_CHECK(
-            codec->RecompressJpeg(filename, data_in, compressed, &speed_stats));
+        JXL_CHECK(codec->RecompressJpeg(filename, data_in, compressed, stats));
       } else {
-        Status status = codec->Compress(filename, &io, inner_pool, compressed,
-                                        &speed_stats);
+        Status status =
+            codec->Compress(filename, &io, inner_pool, compressed, stats);
         if (!status) {
           valid = false;
           if (!Args()->silent_errors) {
@@ -129,6 +171,7 @@ void DoCompress(const std::string& filename, const CodecInOut& io,
         }
       }
     }
+    s->encode_seconds = speed_stats.Elapsed();
     JXL_CHECK(speed_stats.GetSummary(&summary));
     s->total_time_encode += summary.central_tendency;
   }
@@ -145,9 +188,11 @@ void DoCompress(const std::string& filename, const CodecInOut& io,
   io2.metadata.m = io.metadata.m;
   if (valid) {
     speed_stats = jpegxl::tools::SpeedStats();
-    for (size_t i = 0; i < Args()->decode_reps; ++i) {
+    for (size_t i = 0; i < warmup_reps + Args()->decode_reps; ++i) {
+      jpegxl::tools::SpeedStats* stats =
+          i < warmup_reps ? &warmup_stats : &speed_stats;
       if (!codec->Decompress(filename, Span<const uint8_t>(*compressed),
-                             inner_pool, &io2, &speed_stats)) {
+                             inner_pool, &io2, stats)) {
         if (!Args()->silent_errors) {
           fprintf(stderr,
                   "%s failed to decompress encoded image. Original source:"
@@ -161,10 +206,15 @@ void DoCompress(const std::string& filename, const CodecInOut& io,
       // of decode_reps, so only take the value from the first iteration.
       if (i == 0) s->total_input_pixels += io2.dec_pixels;
     }
+    s->decode_seconds = speed_stats.Elapsed();
     JXL_CHECK(speed_stats.GetSummary(&summary));
     s->total_time_decode += summary.central_tendency;
   }
 
+  if (valid && Args()->stage_timings) {
+    AddDecodeStageTimings(Span<const uint8_t>(*compressed), s);
+  }
+
   std::string name = FileBaseName(filename);
   std::string codec_name = codec->description();
 
@@ -756,6 +806,18 @@ class Benchmark {
           fprintf(stderr, "There were error(s) in the benchmark.\n");
         }
       }
+
+      if (!Args()->json_output.empty() || !Args()->baseline.empty()) {
+        const TimingsReport report = GetTimings(methods, fnames, tasks);
+        if (!Args()->json_output.empty() &&
+            !WriteFile(TimingsToJSON(report), Args()->json_output)) {
+          fprintf(stderr, "Failed to write %s\n", Args()->json_output.c_str());
+          ret = EXIT_FAILURE;
+        }
+        if (!Args()->baseline.empty() && !CompareTimings(report)) {
+          ret = EXIT_FAILURE;
+        }
+      }
     }
 
     // Must have exited profiler zone above before calling.
@@ -767,6 +829,74 @@ class Benchmark {
   }
 
  private:
+  static TimingsReport GetTimings(const StringVec& methods,
+                                  const StringVec& fnames,
+                                  const std::vector<Task>& tasks) {
+    TimingsReport report;
+    report.warmup_reps = Args()->warmup_reps;
+    report.encode_reps = Args()->encode_reps;
+    report.decode_reps = Args()->decode_reps;
+    report.num_threads = Args()->num_threads;
+    report.inner_threads = Args()->inner_threads;
+    for (const Task& t : tasks) {
+      TaskTimings timings;
+      timings.method = methods[t.idx_method];
+      // Full paths: images in different directories may share a name.
+      timings.image = fnames[t.idx_image];
+      timings.compressed_size = t.stats.total_compressed_size;
+      timings.pixels = t.stats.total_input_pixels;
+      timings.errors = t.stats.total_errors;
+      timings.encode_seconds = t.stats.encode_seconds;
+      timings.decode_seconds = t.stats.decode_seconds;
+      timings.decode_stages = t.stats.decode_stages;
+      report.tasks.push_back(std::move(timings));
+    }
+    return report;
+  }
+
+  // Returns false if the baseline cannot be read or speed regressed.
+  static bool CompareTimings(const TimingsReport& report) {
+    std::string json;
+    TimingsReport baseline;
+    if (!ReadFile(Args()->baseline, &json) ||
+        !TimingsFromJSON(json, &baseline)) {
+      fprintf(stderr, "Failed to read baseline %s\n",
+              Args()->baseline.c_str());
+      return false;
+    }
+    if (baseline.num_threads != report.num_threads ||
+        baseline.inner_threads != report.inner_threads) {
+      fprintf(stderr,
+              "WARNING: baseline used %d threads, %d inner threads; timings "
+              "may not be comparable.\n",
+              baseline.num_threads, baseline.inner_threads);
+    }
+    const size_t reps[2][2] = {{baseline.encode_reps, report.encode_reps},
+                               {baseline.decode_reps, report.decode_reps}};
+    const char* kStages[2] = {"encode", "decode"};
+    for (size_t stage = 0; stage < 2; ++stage) {
+      if (reps[stage][0] == 0 || reps[stage][1] == 0) continue;
+      if (MinMannWhitneyPValue(reps[stage][0], reps[stage][1]) >=
+          Args()->significance_level) {
+        fprintf(stderr,
+                "WARNING: with %zu baseline and %zu current %s repetitions, "
+                "no per-image change can be significant at p < %g; use "
+                "--%s_reps=4 or more for both runs.\n",
+                reps[stage][0], reps[stage][1], kStages[stage],
+                Args()->significance_level, kStages[stage]);
+      }
+    }
+    const size_t num_regressions =
+        CompareToBaseline(baseline, report, Args()->regression_threshold,
+                          Args()->significance_level);
+    if (num_regressions != 0) {
+      fprintf(stderr, "%zu speed regression(s) vs baseline.\n",
+              num_regressions);
+      return false;
+    }
+    return true;
+  }
+
   static int NumCores() {
     jpegxl::tools::cpu::ProcessorTopology topology;
     JXL_CHECK(DetectProcessorTopology(&topology));
@@ -851,6 +981,14 @@ class Benchmark {
     // Pin all actual worker threads to available CPUs.
     const std::vector<int> cpus = jpegxl::tools::cpu::AvailableCPUs();
     size_t next_index = 0;
+    // Without outer worker threads, the main thread runs all tasks: pin it
+    // too, so that timings of serial runs do not include CPU migrations.
+    if ((*pool)->NumWorkerThreads() == 0 && !cpus.empty()) {
+      if (!jpegxl::tools::cpu::PinThreadToCPU(cpus[next_index])) {
+        fprintf(stderr, "WARNING: failed to pin main thread.\n");
+      }
+      ++next_index;
+    }
     PinThreads(pool->get(), cpus, &next_index);
     for (std::unique_ptr<ThreadPoolInternal>& inner : *inner_pools) {
       PinThreads(inner.get(), cpus, &next_index);
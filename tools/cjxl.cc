@@ -351,6 +351,10 @@ void CompressArgs::AddCommandLineOptions(CommandLineParser* cmdline) {
                           "Favour higher decoding speed. 0 = default, higher "
                           "values give higher speed at the expense of quality",
                           &params.decoding_speed_tier, &ParseUnsigned, 2);
+  cmdline->AddOptionFlag('\0', "prefix_codes",
+                         "Use prefix codes instead of ANS for entropy coding. "
+                         "Decodes faster, at some cost in size.",
+                         &params.force_prefix_codes, &SetBooleanTrue, 2);
 
   cmdline->AddOptionFlag('p', "progressive",
                          "Enable progressive/responsive decoding.",
@@ -432,6 +436,26 @@ void CompressArgs::AddCommandLineOptions(CommandLineParser* cmdline) {
                          "Do not downsample the given input before encoding, "
                          "but still signal that the decoder should upsample.",
                          &params.already_downsampled, &SetBooleanTrue, 2);
+  cmdline->AddOptionFlag('\0', "streaming_histograms",
+                         "Estimate AC histograms from a sample of the groups "
+                         "and write each group as soon as it is tokenized, to "
+                         "reduce memory usage.",
+                         &params.streaming_histograms, &SetBooleanTrue, 2);
+  cmdline->AddOptionFlag('\0', "realtime",
+                         "Real-time VarDCT mode for frame streams: DCT8 only, "
+                         "uniform quantization, and AC histograms reused from "
+                         "the first frame.",
+                         &params.realtime, &SetBooleanTrue, 2);
+  cmdline->AddOptionValue('\0', "butteraugli_proxy", "1|2|4",
+                          "Run the butteraugli loop of -e 8 and 9 on images "
+                          "downsampled by this factor: faster, but follows "
+                          "the distance target less closely (default 1).",
+                          &params.butteraugli_proxy_downsampling,
+                          &ParseUnsigned, 2);
+  cmdline->AddOptionFlag('\0', "generate_preview",
+                         "Embed a preview image of at most 256x256 pixels, "
+                         "obtained by downsampling the input.",
+                         &params.generate_preview, &SetBooleanTrue, 2);
 
   cmdline->AddOptionValue(
       '\0', "epf", "-1..3",
@@ -0,0 +1,236 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Prints where the bytes and the decoding time of a JPEG XL codestream go:
+// per frame, per kind of TOC section, per pass, optionally per section, and
+// which AC contexts receive the most tokens.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "lib/extras/codestream_stats.h"
+#include "lib/jxl/ac_context.h"
+#include "lib/jxl/base/file_io.h"
+#include "lib/jxl/base/padded_bytes.h"
+#include "lib/jxl/base/status.h"
+
+namespace jxl {
+namespace {
+
+const char* EncodingName(FrameEncoding encoding) {
+  return encoding == FrameEncoding::kVarDCT ? "VarDCT" : "Modular";
+}
+
+const char* FrameTypeName(FrameType frame_type) {
+  switch (frame_type) {
+    case FrameType::kRegularFrame:
+      return "regular";
+    case FrameType::kDCFrame:
+      return "DC";
+    case FrameType::kReferenceOnly:
+      return "reference-only";
+    case FrameType::kSkipProgressive:
+      return "skip-progressive";
+  }
+  return "?";
+}
+
+double Percent(uint64_t part, uint64_t total) {
+  return total == 0 ? 0.0 : 100.0 * part / total;
+}
+
+struct Totals {
+  size_t count = 0;
+  uint64_t size = 0;
+  double seconds = 0.0;
+  uint64_t num_ac_tokens = 0;
+
+  void Add(const SectionStats& section) {
+    ++count;
+    size += section.size;
+    seconds += section.decode_seconds;
+    num_ac_tokens += section.num_ac_tokens;
+  }
+};
+
+void PrintTotalsHeader(const char* label) {
+  printf("  %-14s %6s %12s %7s %10s %12s\n", label, "count", "bytes", "%",
+         "ms", "AC tokens");
+}
+
+void PrintTotals(const std::string& label, const Totals& totals,
+                 uint64_t frame_size) {
+  printf("  %-14s %6zu %12llu %6.2f%% %10.3f %12llu\n", label.c_str(),
+         totals.count, static_cast<unsigned long long>(totals.size),
+         Percent(totals.size, frame_size), totals.seconds * 1E3,
+         static_cast<unsigned long long>(totals.num_ac_tokens));
+}
+
+void PrintSections(const FrameStats& frame) {
+  printf("  %5s %-8s %6s %4s %10s %10s %10s %9s %12s\n", "id", "kind", "group",
+         "pass", "offset", "bytes", "ms", "MB/s", "AC tokens");
+  for (const SectionStats& section : frame.sections) {
+    const double mb_per_second =
+        section.decode_seconds == 0.0
+            ? 0.0
+            : section.size * 1E-6 / section.decode_seconds;
+    printf("  %5zu %-8s %6zu %4zu %10llu %10llu %10.3f %9.2f %12llu\n",
+           section.id, SectionKindName(section.kind), section.group,
+           section.pass, static_cast<unsigned long long>(section.offset),
+           static_cast<unsigned long long>(section.size),
+           section.decode_seconds * 1E3, mb_per_second,
+           static_cast<unsigned long long>(section.num_ac_tokens));
+  }
+}
+
+// Prints the `max_contexts` AC contexts with most tokens of each pass.
+void PrintACContexts(const FrameStats& frame, size_t max_contexts) {
+  if (frame.num_ac_contexts == 0) return;
+  const size_t num_nonzero_ctxs = frame.num_block_ctxs * kNonZeroBuckets;
+  for (size_t pass = 0; pass < frame.ac_token_counts.size(); pass++) {
+    const std::vector<uint64_t>& counts = frame.ac_token_counts[pass];
+    const uint64_t total = std::accumulate(counts.begin(), counts.end(),
+                                           static_cast<uint64_t>(0));
+    if (total == 0) continue;
+    std::vector<size_t> order;
+    for (size_t ctx = 0; ctx < counts.size(); ctx++) {
+      if (counts[ctx] != 0) order.push_back(ctx);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return counts[a] > counts[b];
+    });
+    printf("  Pass %zu: %llu AC tokens in %zu contexts\n", pass,
+           static_cast<unsigned long long>(total), order.size());
+    printf("  %8s %9s %-9s %9s %12s %7s\n", "context", "histogram", "kind",
+           "block ctx", "tokens", "%");
+    for (size_t i = 0; i < std::min(order.size(), max_contexts); i++) {
+      const size_t ctx = order[i];
+      const size_t histogram = ctx / frame.num_ac_contexts;
+      const size_t local_ctx = ctx % frame.num_ac_contexts;
+      const bool is_nonzeros = local_ctx < num_nonzero_ctxs;
+      const size_t block_ctx =
+          is_nonzeros ? local_ctx % frame.num_block_ctxs
+                      : (local_ctx - num_nonzero_ctxs) /
+                            kZeroDensityContextCount;
+      printf("  %8zu %9zu %-9s %9zu %12llu %6.2f%%\n", ctx, histogram,
+             is_nonzeros ? "nonzeros" : "coeffs", block_ctx,
+             static_cast<unsigned long long>(counts[ctx]),
+             Percent(counts[ctx], total));
+    }
+  }
+}
+
+void PrintFrame(size_t index, const FrameStats& frame, bool print_sections,
+                size_t max_contexts) {
+  const uint64_t frame_size = frame.TotalSize();
+  double seconds = frame.finalize_seconds;
+  for (const SectionStats& section : frame.sections) {
+    seconds += section.decode_seconds;
+  }
+  printf("\nFrame %zu%s%s: %s, %s, %zux%zu, %zu pass(es), %zu group(s) of "
+         "%zu, %zu DC group(s)%s\n",
+         index, frame.name.empty() ? "" : " ", frame.name.c_str(),
+         EncodingName(frame.encoding), FrameTypeName(frame.frame_type),
+         frame.xsize, frame.ysize, frame.num_passes, frame.num_groups,
+         frame.group_dim, frame.num_dc_groups, frame.is_last ? ", last" : "");
+  printf("  %llu bytes at offset %llu (header and TOC: %llu), "
+         "decoded in %.3f ms (finalize: %.3f ms)\n",
+         static_cast<unsigned long long>(frame_size),
+         static_cast<unsigned long long>(frame.offset),
+         static_cast<unsigned long long>(frame.header_size), seconds * 1E3,
+         frame.finalize_seconds * 1E3);
+
+  Totals by_kind[5];
+  std::vector<Totals> by_pass(frame.num_passes);
+  for (const SectionStats& section : frame.sections) {
+    by_kind[static_cast<size_t>(section.kind)].Add(section);
+    if (section.kind == SectionKind::kACGroup) {
+      by_pass[section.pass].Add(section);
+    }
+  }
+  PrintTotalsHeader("section kind");
+  for (size_t kind = 0; kind < 5; kind++) {
+    if (by_kind[kind].count == 0) continue;
+    PrintTotals(SectionKindName(static_cast<SectionKind>(kind)),
+                by_kind[kind], frame_size);
+  }
+  if (by_kind[static_cast<size_t>(SectionKind::kACGroup)].count != 0) {
+    PrintTotalsHeader("AC pass");
+    for (size_t pass = 0; pass < by_pass.size(); pass++) {
+      PrintTotals("pass " + std::to_string(pass), by_pass[pass], frame_size);
+    }
+  }
+  if (print_sections) PrintSections(frame);
+  if (max_contexts != 0) PrintACContexts(frame, max_contexts);
+}
+
+int PrintUsage(char** argv) {
+  fprintf(stderr,
+          "Usage: %s <codestream.jxl> [--sections] [--contexts <n>]\n"
+          "Decodes the codestream one TOC section at a time and prints, per "
+          "frame, the size and decoding time of its sections grouped by kind "
+          "and by pass.\n"
+          "  --sections: also prints every section.\n"
+          "  --contexts <n>: prints the n AC contexts with most tokens per "
+          "pass (default 10, 0 disables AC token counting, which slows down "
+          "decoding).\n",
+          argv[0]);
+  return 1;
+}
+
+int Run(int argc, char** argv) {
+  if (argc < 2) return PrintUsage(argv);
+  bool print_sections = false;
+  size_t max_contexts = 10;
+  for (int i = 2; i < argc; i++) {
+    if (std::string(argv[i]) == "--sections") {
+      print_sections = true;
+    } else if (std::string(argv[i]) == "--contexts" && i + 1 < argc) {
+      char* end;
+      max_contexts = strtoul(argv[++i], &end, 10);
+      if (end == argv[i] || *end != '\0') {
+        fprintf(stderr, "Failed to parse number of contexts \"%s\".\n",
+                argv[i]);
+        return 1;
+      }
+    } else {
+      fprintf(stderr, "Unrecognized flag \"%s\".\n", argv[i]);
+      return PrintUsage(argv);
+    }
+  }
+
+  PaddedBytes compressed;
+  if (!ReadFile(argv[1], &compressed)) {
+    fprintf(stderr, "Failed to read %s\n", argv[1]);
+    return 1;
+  }
+  CodestreamStats stats;
+  if (!ComputeCodestreamStats(Span<const uint8_t>(compressed),
+                              /*count_ac_tokens=*/max_contexts != 0, &stats)) {
+    fprintf(stderr, "Failed to decode %s\n", argv[1]);
+    return 1;
+  }
+
+  printf("%s: %zu bytes, %zux%zu, headers: %llu bytes, preview: %llu bytes, "
+         "%zu frame(s)\n",
+         argv[1], compressed.size(), stats.xsize, stats.ysize,
+         static_cast<unsigned long long>(stats.header_size),
+         static_cast<unsigned long long>(stats.preview_size),
+         stats.frames.size());
+  for (size_t i = 0; i < stats.frames.size(); i++) {
+    PrintFrame(i, stats.frames[i], print_sections, max_contexts);
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace jxl
+
+int main(int argc, char** argv) { return jxl::Run(argc, argv); }
@@ -72,6 +72,12 @@ void DecompressArgs::AddCommandLineOptions(CommandLineParser* cmdline) {
                                                "The number of threads to use",
                                                &num_threads, &ParseUnsigned);
 
+  cmdline->AddOptionValue('\0', "huge_page_threshold", "BYTES",
+                          "allocate internal buffers (image planes, but also "
+                          "e.g. entropy tables) of at least BYTES bytes on "
+                          "huge pages (Linux only; default 0 = disabled)",
+                          &huge_page_threshold, &ParseUnsigned);
+
   cmdline->AddOptionValue('\0', "print_profile", "0|1",
                           "print timing information before exiting",
                           &print_profile, &ParseOverride);
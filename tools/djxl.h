@@ -49,6 +49,10 @@ struct DecompressArgs {
 
   size_t num_reps = 1;
 
+  // Internal buffers of at least this many bytes use huge pages; 0 disables
+  // this.
+  size_t huge_page_threshold = 0;
+
   // Format parameters:
 
   size_t bits_per_sample = 0;
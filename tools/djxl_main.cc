@@ -89,6 +89,7 @@ int DecompressMain(int argc, const char* argv[]) {
     container.codestream_size = compressed.size();
   }
 
+  jxl::CacheAligned::SetHugePageThreshold(args.huge_page_threshold);
   jxl::ThreadPoolInternal pool(args.num_threads);
   SpeedStats stats;
 
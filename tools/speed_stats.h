@@ -47,6 +47,10 @@ class SpeedStats {
   // once before this can be used.
   jxl::Status Print(size_t worker_threads);
 
+  // Elapsed times in the order of NotifyElapsed, unless reordered by
+  // GetSummary.
+  const std::vector<double>& Elapsed() const { return elapsed_; }
+
  private:
   std::vector<double> elapsed_;
   size_t xsize_ = 0;
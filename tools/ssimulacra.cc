@@ -8,19 +8,217 @@
 
 #include "tools/ssimulacra.h"
 
+#include <algorithm>
 #include <cmath>
 
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "tools/ssimulacra.cc"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+#include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/fast_math-inl.h"
 #include "lib/jxl/gauss_blur.h"
 #include "lib/jxl/image_ops.h"
 
+HWY_BEFORE_NAMESPACE();
 namespace ssimulacra {
-namespace {
+namespace HWY_NAMESPACE {
 
 using jxl::Image3F;
 using jxl::ImageF;
+using jxl::ThreadPool;
+using jxl::HWY_NAMESPACE::FastPowf;
 
 static const float kC1 = 0.0001f;
 static const float kC2 = 0.0004f;
+
+// Cube root for v > epsilon: FastPowf followed by one Newton step, which
+// brings the error down to a few ulp. SSIM subtracts nearly equal blurred
+// values, so this keeps the score close to the scalar powf version.
+template <class DF, class V>
+V LabNonlinearity(const DF df, const V v) {
+  const float epsilon = 0.00885645167903563081f;
+  const float s = 0.13793103448275862068f;
+  const float k = 7.78703703703703703703f;
+  const V approx = FastPowf(df, v, Set(df, 1.0f / 3.0f));
+  const V approx2 = approx * approx;
+  const V cube_root =
+      approx - (approx2 * approx - v) / (Set(df, 3.0f) * approx2);
+  return IfThenElse(v > Set(df, epsilon), cube_root - Set(df, s),
+                    v * Set(df, k));
+}
+
+Image3F Rgb2Lab(const Image3F& in, ThreadPool* pool) {
+  HWY_FULL(float) df;
+  using V = decltype(Zero(df));
+  Image3F out(in.xsize(), in.ysize());
+  JXL_CHECK(RunOnPool(
+      pool, 0, in.ysize(), ThreadPool::SkipInit(),
+      [&](const int y, const int thread) {
+        const float* JXL_RESTRICT row_in0 = in.PlaneRow(0, y);
+        const float* JXL_RESTRICT row_in1 = in.PlaneRow(1, y);
+        const float* JXL_RESTRICT row_in2 = in.PlaneRow(2, y);
+        float* JXL_RESTRICT row_out0 = out.PlaneRow(0, y);
+        float* JXL_RESTRICT row_out1 = out.PlaneRow(1, y);
+        float* JXL_RESTRICT row_out2 = out.PlaneRow(2, y);
+        for (size_t x = 0; x < in.xsize(); x += Lanes(df)) {
+          const V r = Load(df, row_in0 + x);
+          const V g = Load(df, row_in1 + x);
+          const V b = Load(df, row_in2 + x);
+          // Same operation order as the scalar version, without MulAdd.
+          const V fx = r * Set(df, 0.43393624408206207259f) +
+                       g * Set(df, 0.37619779063650710152f) +
+                       b * Set(df, 0.18983429773803261441f);
+          const V fy = r * Set(df, 0.2126729f) + g * Set(df, 0.7151522f) +
+                       b * Set(df, 0.0721750f);
+          const V fz = r * Set(df, 0.01775381083562901744f) +
+                       g * Set(df, 0.10945087235996326905f) +
+                       b * Set(df, 0.87263921028466483011f);
+          const V X = LabNonlinearity(df, fx);
+          const V Y = LabNonlinearity(df, fy);
+          const V Z = LabNonlinearity(df, fz);
+          Store(Y * Set(df, 1.16f), df, row_out0 + x);
+          Store(Set(df, 0.39181818181818181818f) +
+                    Set(df, 2.27272727272727272727f) * (X - Y),
+                df, row_out1 + x);
+          Store(Set(df, 0.49045454545454545454f) +
+                    Set(df, 0.90909090909090909090f) * (Y - Z),
+                df, row_out2 + x);
+        }
+      },
+      "Rgb2Lab"));
+  return out;
+}
+
+void Multiply(const Image3F& a, const Image3F& b, Image3F* mul,
+              ThreadPool* pool) {
+  HWY_FULL(float) df;
+  const size_t ysize = a.ysize();
+  JXL_CHECK(RunOnPool(
+      pool, 0, 3 * ysize, ThreadPool::SkipInit(),
+      [&](const int task, const int thread) {
+        const size_t c = task / ysize;
+        const size_t y = task % ysize;
+        const float* JXL_RESTRICT in1 = a.PlaneRow(c, y);
+        const float* JXL_RESTRICT in2 = b.PlaneRow(c, y);
+        float* JXL_RESTRICT out = mul->PlaneRow(c, y);
+        for (size_t x = 0; x < a.xsize(); x += Lanes(df)) {
+          Store(Load(df, in1 + x) * Load(df, in2 + x), df, out + x);
+        }
+      },
+      "Multiply"));
+}
+
+// Sums each plane of `map` in double precision. Rows are summed in parallel
+// and then added in a fixed order, so the result does not depend on the
+// number of threads.
+void PlaneAverages(const Image3F& map, const std::vector<double>& row_sums,
+                   double* plane_averages) {
+  const size_t ysize = map.ysize();
+  for (size_t c = 0; c < 3; ++c) {
+    double sum = 0.0;
+    for (size_t y = 0; y < ysize; ++y) {
+      sum += row_sums[c * ysize + y];
+    }
+    plane_averages[c] = sum / (map.xsize() * ysize);
+  }
+}
+
+double RowSum(const float* JXL_RESTRICT row, const size_t xsize) {
+  double sum = 0.0;
+  for (size_t x = 0; x < xsize; ++x) {
+    sum += row[x];
+  }
+  return sum;
+}
+
+void EdgeDiffMap(const Image3F& img1, const Image3F& mu1, const Image3F& img2,
+                 const Image3F& mu2, Image3F* out, double* plane_avg,
+                 ThreadPool* pool) {
+  HWY_FULL(float) df;
+  using V = decltype(Zero(df));
+  const size_t ysize = img1.ysize();
+  std::vector<double> row_sums(3 * ysize);
+  JXL_CHECK(RunOnPool(
+      pool, 0, 3 * ysize, ThreadPool::SkipInit(),
+      [&](const int task, const int thread) {
+        const size_t c = task / ysize;
+        const size_t y = task % ysize;
+        const float* JXL_RESTRICT row1 = img1.PlaneRow(c, y);
+        const float* JXL_RESTRICT row2 = img2.PlaneRow(c, y);
+        const float* JXL_RESTRICT rowm1 = mu1.PlaneRow(c, y);
+        const float* JXL_RESTRICT rowm2 = mu2.PlaneRow(c, y);
+        float* JXL_RESTRICT row_out = out->PlaneRow(c, y);
+        for (size_t x = 0; x < img1.xsize(); x += Lanes(df)) {
+          const V edge1 = Abs(Load(df, row1 + x) - Load(df, rowm1 + x));
+          const V edge2 = Abs(Load(df, row2 + x) - Load(df, rowm2 + x));
+          const V edgediff = ZeroIfNegative(edge2 - edge1);
+          Store(Set(df, 1.0f) - edgediff, df, row_out + x);
+        }
+        row_sums[task] = RowSum(row_out, img1.xsize());
+      },
+      "EdgeDiffMap"));
+  PlaneAverages(*out, row_sums, plane_avg);
+}
+
+void SSIMMap(const Image3F& m1, const Image3F& m2, const Image3F& s11,
+             const Image3F& s22, const Image3F& s12, Image3F* out,
+             double* plane_averages, ThreadPool* pool) {
+  HWY_FULL(float) df;
+  using V = decltype(Zero(df));
+  const size_t ysize = out->ysize();
+  std::vector<double> row_sums(3 * ysize);
+  JXL_CHECK(RunOnPool(
+      pool, 0, 3 * ysize, ThreadPool::SkipInit(),
+      [&](const int task, const int thread) {
+        const size_t c = task / ysize;
+        const size_t y = task % ysize;
+        const float* JXL_RESTRICT row_m1 = m1.PlaneRow(c, y);
+        const float* JXL_RESTRICT row_m2 = m2.PlaneRow(c, y);
+        const float* JXL_RESTRICT row_s11 = s11.PlaneRow(c, y);
+        const float* JXL_RESTRICT row_s22 = s22.PlaneRow(c, y);
+        const float* JXL_RESTRICT row_s12 = s12.PlaneRow(c, y);
+        float* JXL_RESTRICT row_out = out->PlaneRow(c, y);
+        for (size_t x = 0; x < out->xsize(); x += Lanes(df)) {
+          const V mu1 = Load(df, row_m1 + x);
+          const V mu2 = Load(df, row_m2 + x);
+          const V mu11 = mu1 * mu1;
+          const V mu22 = mu2 * mu2;
+          const V mu12 = mu1 * mu2;
+          const V nom_m = Set(df, 2.0f) * mu12 + Set(df, kC1);
+          const V nom_s =
+              Set(df, 2.0f) * (Load(df, row_s12 + x) - mu12) + Set(df, kC2);
+          const V denom_m = mu11 + mu22 + Set(df, kC1);
+          const V denom_s = (Load(df, row_s11 + x) - mu11) +
+                            (Load(df, row_s22 + x) - mu22) + Set(df, kC2);
+          Store((nom_m * nom_s) / (denom_m * denom_s), df, row_out + x);
+        }
+        row_sums[task] = RowSum(row_out, out->xsize());
+      },
+      "SSIMMap"));
+  PlaneAverages(*out, row_sums, plane_averages);
+}
+
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace ssimulacra
+HWY_AFTER_NAMESPACE();
+
+#if HWY_ONCE
+namespace ssimulacra {
+
+HWY_EXPORT(Rgb2Lab);
+HWY_EXPORT(Multiply);
+HWY_EXPORT(EdgeDiffMap);
+HWY_EXPORT(SSIMMap);
+
+namespace {
+
+using jxl::Image3F;
+using jxl::ImageF;
+using jxl::ThreadPool;
+
 static const int kNumScales = 6;
 // Premultiplied by chroma weight 0.2
 static const double kScaleWeights[kNumScales][3] = {
@@ -37,79 +235,55 @@ const double kMinScaleWeights[kNumScales][3] = {
 const double kEdgeWeight[3] = {1.5, 0.1, 0.1};
 const double kGridWeight[3] = {1.0, 0.1, 0.1};
 
-inline void Rgb2Lab(float r, float g, float b, float* L, float* A, float* B) {
-  const float epsilon = 0.00885645167903563081f;
-  const float s = 0.13793103448275862068f;
-  const float k = 7.78703703703703703703f;
-  float fx = (r * 0.43393624408206207259f + g * 0.37619779063650710152f +
-              b * 0.18983429773803261441f);
-  float fy = (r * 0.2126729f + g * 0.7151522f + b * 0.0721750f);
-  float fz = (r * 0.01775381083562901744f + g * 0.10945087235996326905f +
-              b * 0.87263921028466483011f);
-  const float gamma = 1.0f / 3.0f;
-  float X = (fx > epsilon) ? powf(fx, gamma) - s : k * fx;
-  float Y = (fy > epsilon) ? powf(fy, gamma) - s : k * fy;
-  float Z = (fz > epsilon) ? powf(fz, gamma) - s : k * fz;
-  *L = Y * 1.16f;
-  *A = (0.39181818181818181818f + 2.27272727272727272727f * (X - Y));
-  *B = (0.49045454545454545454f + 0.90909090909090909090f * (Y - Z));
+Image3F Rgb2Lab(const Image3F& in, ThreadPool* pool) {
+  return HWY_DYNAMIC_DISPATCH(Rgb2Lab)(in, pool);
 }
 
-Image3F Rgb2Lab(const Image3F& in) {
-  Image3F out(in.xsize(), in.ysize());
-  for (size_t y = 0; y < in.ysize(); ++y) {
-    const float* JXL_RESTRICT row_in0 = in.PlaneRow(0, y);
-    const float* JXL_RESTRICT row_in1 = in.PlaneRow(1, y);
-    const float* JXL_RESTRICT row_in2 = in.PlaneRow(2, y);
-    float* JXL_RESTRICT row_out0 = out.PlaneRow(0, y);
-    float* JXL_RESTRICT row_out1 = out.PlaneRow(1, y);
-    float* JXL_RESTRICT row_out2 = out.PlaneRow(2, y);
+void Multiply(const Image3F& a, const Image3F& b, Image3F* mul,
+              ThreadPool* pool) {
+  HWY_DYNAMIC_DISPATCH(Multiply)(a, b, mul, pool);
+}
 
-    for (size_t x = 0; x < in.xsize(); ++x) {
-      Rgb2Lab(row_in0[x], row_in1[x], row_in2[x], &row_out0[x], &row_out1[x],
-              &row_out2[x]);
-    }
-  }
-  return out;
+void EdgeDiffMap(const Image3F& img1, const Image3F& mu1, const Image3F& img2,
+                 const Image3F& mu2, Image3F* out, double* plane_avg,
+                 ThreadPool* pool) {
+  HWY_DYNAMIC_DISPATCH(EdgeDiffMap)(img1, mu1, img2, mu2, out, plane_avg, pool);
+}
+
+void SSIMMap(const Image3F& m1, const Image3F& m2, const Image3F& s11,
+             const Image3F& s22, const Image3F& s12, Image3F* out,
+             double* plane_averages, ThreadPool* pool) {
+  HWY_DYNAMIC_DISPATCH(SSIMMap)(m1, m2, s11, s22, s12, out, plane_averages,
+                                pool);
 }
 
-Image3F Downsample(const Image3F& in, size_t fx, size_t fy) {
+Image3F Downsample(const Image3F& in, size_t fx, size_t fy, ThreadPool* pool) {
   const size_t out_xsize = (in.xsize() + fx - 1) / fx;
   const size_t out_ysize = (in.ysize() + fy - 1) / fy;
   Image3F out(out_xsize, out_ysize);
   const float normalize = 1.0f / (fx * fy);
-  for (size_t c = 0; c < 3; ++c) {
-    for (size_t oy = 0; oy < out_ysize; ++oy) {
-      float* JXL_RESTRICT row_out = out.PlaneRow(c, oy);
-      for (size_t ox = 0; ox < out_xsize; ++ox) {
-        float sum = 0.0f;
-        for (size_t iy = 0; iy < fy; ++iy) {
-          for (size_t ix = 0; ix < fx; ++ix) {
-            const size_t x = std::min(ox * fx + ix, in.xsize() - 1);
-            const size_t y = std::min(oy * fy + iy, in.ysize() - 1);
-            sum += in.PlaneRow(c, y)[x];
+  JXL_CHECK(RunOnPool(
+      pool, 0, 3 * out_ysize, ThreadPool::SkipInit(),
+      [&](const int task, const int thread) {
+        const size_t c = task / out_ysize;
+        const size_t oy = task % out_ysize;
+        float* JXL_RESTRICT row_out = out.PlaneRow(c, oy);
+        for (size_t ox = 0; ox < out_xsize; ++ox) {
+          float sum = 0.0f;
+          for (size_t iy = 0; iy < fy; ++iy) {
+            for (size_t ix = 0; ix < fx; ++ix) {
+              const size_t x = std::min(ox * fx + ix, in.xsize() - 1);
+              const size_t y = std::min(oy * fy + iy, in.ysize() - 1);
+              sum += in.PlaneRow(c, y)[x];
+            }
           }
+          row_out[ox] = sum * normalize;
         }
-        row_out[ox] = sum * normalize;
-      }
-    }
-  }
+      },
+      "Downsample"));
   return out;
 }
 
-void Multiply(const Image3F& a, const Image3F& b, Image3F* mul) {
-  for (size_t c = 0; c < 3; ++c) {
-    for (size_t y = 0; y < a.ysize(); ++y) {
-      const float* JXL_RESTRICT in1 = a.PlaneRow(c, y);
-      const float* JXL_RESTRICT in2 = b.PlaneRow(c, y);
-      float* JXL_RESTRICT out = mul->PlaneRow(c, y);
-      for (size_t x = 0; x < a.xsize(); ++x) {
-        out[x] = in1[x] * in2[x];
-      }
-    }
-  }
-}
-
 void RowColAvgP2(const ImageF& in, double* rp2, double* cp2) {
   std::vector<double> ravg(in.ysize());
   std::vector<double> cavg(in.xsize());
@@ -127,52 +301,16 @@ void RowColAvgP2(const ImageF& in, double* rp2, double* cp2) {
   *cp2 = cavg[cavg.size() / 50] / in.ysize();
 }
 
-class StreamingAverage {
- public:
-  void Add(const float v) {
-    // Numerically stable method.
-    double delta = v - result_;
-    n_ += 1;
-    result_ += delta / n_;
-  }
-
-  double Get() const { return result_; }
-
- private:
-  double result_ = 0.0;
-  size_t n_ = 0;
-};
-
-void EdgeDiffMap(const Image3F& img1, const Image3F& mu1, const Image3F& img2,
-                 const Image3F& mu2, Image3F* out, double* plane_avg) {
-  for (size_t c = 0; c < 3; ++c) {
-    StreamingAverage avg;
-    for (size_t y = 0; y < img1.ysize(); ++y) {
-      const float* JXL_RESTRICT row1 = img1.PlaneRow(c, y);
-      const float* JXL_RESTRICT row2 = img2.PlaneRow(c, y);
-      const float* JXL_RESTRICT rowm1 = mu1.PlaneRow(c, y);
-      const float* JXL_RESTRICT rowm2 = mu2.PlaneRow(c, y);
-      float* JXL_RESTRICT row_out = out->PlaneRow(c, y);
-      for (size_t x = 0; x < img1.xsize(); ++x) {
-        float edgediff = std::max(
-            std::abs(row2[x] - rowm2[x]) - std::abs(row1[x] - rowm1[x]), 0.0f);
-        row_out[x] = 1.0f - edgediff;
-        avg.Add(row_out[x]);
-      }
-    }
-    plane_avg[c] = avg.Get();
-  }
-}
-
 // Temporary storage for Gaussian blur, reused for multiple images.
 class Blur {
  public:
-  Blur(const size_t xsize, const size_t ysize)
-      : rg_(jxl::CreateRecursiveGaussian(1.5)), temp_(xsize, ysize) {}
+  Blur(const size_t xsize, const size_t ysize, ThreadPool* pool)
+      : rg_(jxl::CreateRecursiveGaussian(1.5)),
+        temp_(xsize, ysize),
+        pool_(pool) {}
 
   void operator()(const ImageF& in, ImageF* JXL_RESTRICT out) {
-    jxl::ThreadPool* null_pool = nullptr;
-    FastGaussian(rg_, in, null_pool, &temp_, out);
+    FastGaussian(rg_, in, pool_, &temp_, out);
   }
 
   Image3F operator()(const Image3F& in) {
@@ -191,38 +329,9 @@ class Blur {
  private:
   hwy::AlignedUniquePtr<jxl::RecursiveGaussian> rg_;
   ImageF temp_;
+  ThreadPool* pool_;
 };
 
-void SSIMMap(const Image3F& m1, const Image3F& m2, const Image3F& s11,
-             const Image3F& s22, const Image3F& s12, Image3F* out,
-             double* plane_averages) {
-  for (size_t c = 0; c < 3; ++c) {
-    StreamingAverage avg;
-    for (size_t y = 0; y < out->ysize(); ++y) {
-      const float* JXL_RESTRICT row_m1 = m1.PlaneRow(c, y);
-      const float* JXL_RESTRICT row_m2 = m2.PlaneRow(c, y);
-      const float* JXL_RESTRICT row_s11 = s11.PlaneRow(c, y);
-      const float* JXL_RESTRICT row_s22 = s22.PlaneRow(c, y);
-      const float* JXL_RESTRICT row_s12 = s12.PlaneRow(c, y);
-      float* JXL_RESTRICT row_out = out->PlaneRow(c, y);
-      for (size_t x = 0; x < out->xsize(); ++x) {
-        float mu1 = row_m1[x];
-        float mu2 = row_m2[x];
-        float mu11 = mu1 * mu1;
-        float mu22 = mu2 * mu2;
-        float mu12 = mu1 * mu2;
-        float nom_m = 2 * mu12 + kC1;
-        float nom_s = 2 * (row_s12[x] - mu12) + kC2;
-        float denom_m = mu11 + mu22 + kC1;
-        float denom_s = (row_s11[x] - mu11) + (row_s22[x] - mu22) + kC2;
-        row_out[x] = (nom_m * nom_s) / (denom_m * denom_s);
-        avg.Add(row_out[x]);
-      }
-    }
-    plane_averages[c] = avg.Get();
-  }
-}
-
 }  // namespace
 
 double Ssimulacra::Score() const {
@@ -265,42 +374,64 @@ void Ssimulacra::PrintDetails() const {
   }
 }
 
-Ssimulacra ComputeDiff(const Image3F& orig, const Image3F& distorted) {
-  Ssimulacra ssimulacra;
-
-  Image3F img1 = Rgb2Lab(orig);
-  Image3F img2 = Rgb2Lab(distorted);
+SsimulacraReference::SsimulacraReference(const Image3F& orig,
+                                         ThreadPool* pool) {
+  Image3F img1 = Rgb2Lab(orig, pool);
 
   Image3F mul(orig.xsize(), orig.ysize());
-  Blur blur(img1.xsize(), img1.ysize());
+  Blur blur(img1.xsize(), img1.ysize(), pool);
 
   for (int scale = 0; scale < kNumScales; scale++) {
     if (img1.xsize() < 8 || img1.ysize() < 8) {
       break;
     }
     if (scale) {
-      img1 = Downsample(img1, 2, 2);
-      img2 = Downsample(img2, 2, 2);
+      img1 = Downsample(img1, 2, 2, pool);
     }
-    mul.ShrinkTo(img1.xsize(), img2.ysize());
-    blur.ShrinkTo(img1.xsize(), img2.ysize());
+    mul.ShrinkTo(img1.xsize(), img1.ysize());
+    blur.ShrinkTo(img1.xsize(), img1.ysize());
+
+    Scale reference_scale;
+    Multiply(img1, img1, &mul, pool);
+    reference_scale.sigma_sq = blur(mul);
+    reference_scale.mu = blur(img1);
+    reference_scale.img = CopyImage(img1);
+    scales_.push_back(std::move(reference_scale));
+  }
+}
+
+Ssimulacra SsimulacraReference::Compare(const Image3F& distorted,
+                                        ThreadPool* pool) const {
+  Ssimulacra ssimulacra;
 
-    Multiply(img1, img1, &mul);
-    Image3F sigma1_sq = blur(mul);
+  Image3F img2 = Rgb2Lab(distorted, pool);
 
-    Multiply(img2, img2, &mul);
+  Image3F mul(distorted.xsize(), distorted.ysize());
+  Blur blur(img2.xsize(), img2.ysize(), pool);
+
+  for (size_t scale = 0; scale < scales_.size(); scale++) {
+    const Image3F& img1 = scales_[scale].img;
+    const Image3F& mu1 = scales_[scale].mu;
+    if (scale) {
+      img2 = Downsample(img2, 2, 2, pool);
+    }
+    JXL_ASSERT(SameSize(img1, img2));
+    mul.ShrinkTo(img2.xsize(), img2.ysize());
+    blur.ShrinkTo(img2.xsize(), img2.ysize());
+
+    Multiply(img2, img2, &mul, pool);
     Image3F sigma2_sq = blur(mul);
 
-    Multiply(img1, img2, &mul);
+    Multiply(img1, img2, &mul, pool);
     Image3F sigma12 = blur(mul);
 
-    Image3F mu1 = blur(img1);
     Image3F mu2 = blur(img2);
     // Reuse mul as "ssim_map".
     SsimulacraScale sscale;
-    SSIMMap(mu1, mu2, sigma1_sq, sigma2_sq, sigma12, &mul, sscale.avg_ssim);
+    SSIMMap(mu1, mu2, scales_[scale].sigma_sq, sigma2_sq, sigma12, &mul,
+            sscale.avg_ssim, pool);
 
-    const Image3F ssim_map = Downsample(mul, 4, 4);
+    const Image3F ssim_map = Downsample(mul, 4, 4, pool);
     for (size_t c = 0; c < 3; c++) {
       float minval, maxval;
       ImageMinMax(ssim_map.Plane(c), &minval, &maxval);
@@ -309,8 +440,9 @@ Ssimulacra ComputeDiff(const Image3F& orig, const Image3F& distorted) {
     ssimulacra.scales.push_back(sscale);
 
     if (scale == 0) {
-      Image3F* edgediff = &sigma1_sq;  // reuse
-      EdgeDiffMap(img1, mu1, img2, mu2, edgediff, ssimulacra.avg_edgediff);
+      Image3F* edgediff = &sigma2_sq;  // reuse
+      EdgeDiffMap(img1, mu1, img2, mu2, edgediff, ssimulacra.avg_edgediff,
+                  pool);
       for (size_t c = 0; c < 3; c++) {
         RowColAvgP2(ssim_map.Plane(c), &ssimulacra.row_p2[0][c],
                     &ssimulacra.col_p2[0][c]);
@@ -322,4 +454,10 @@ Ssimulacra ComputeDiff(const Image3F& orig, const Image3F& distorted) {
   return ssimulacra;
 }
 
+Ssimulacra ComputeDiff(const Image3F& orig, const Image3F& distorted,
+                       ThreadPool* pool) {
+  return SsimulacraReference(orig, pool).Compare(distorted, pool);
+}
+
 }  // namespace ssimulacra
+#endif
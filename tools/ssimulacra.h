@@ -8,6 +8,7 @@
 
 #include <vector>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/image.h"
 
 namespace ssimulacra {
@@ -27,7 +28,31 @@ struct Ssimulacra {
   void PrintDetails() const;
 };
 
-Ssimulacra ComputeDiff(const jxl::Image3F& orig, const jxl::Image3F& distorted);
+// The parts of the computation that only depend on the reference image: its
+// Lab representation, blurred mean and blurred square at each scale. Compare()
+// may be called concurrently for several distorted images. All per-pixel
+// stages are vectorized and, when `pool` is not null, run on its threads;
+// the score does not depend on the number of threads.
+class SsimulacraReference {
+ public:
+  explicit SsimulacraReference(const jxl::Image3F& orig,
+                               jxl::ThreadPool* pool = nullptr);
+
+  // `distorted` must have the same size as the reference.
+  Ssimulacra Compare(const jxl::Image3F& distorted,
+                     jxl::ThreadPool* pool = nullptr) const;
+
+ private:
+  struct Scale {
+    jxl::Image3F img;
+    jxl::Image3F mu;
+    jxl::Image3F sigma_sq;
+  };
+  std::vector<Scale> scales_;
+};
+
+Ssimulacra ComputeDiff(const jxl::Image3F& orig, const jxl::Image3F& distorted,
+                       jxl::ThreadPool* pool = nullptr);
 
 }  // namespace ssimulacra
 
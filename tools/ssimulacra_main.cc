@@ -6,6 +6,7 @@
 #include <stdio.h>
 
 #include "lib/extras/codec.h"
+#include "lib/jxl/base/thread_pool_internal.h"
 #include "lib/jxl/color_management.h"
 #include "tools/ssimulacra.h"
 
@@ -28,14 +29,15 @@ int Run(int argc, char** argv) {
   }
   if (argc < input_arg + 2) return PrintUsage(argv);
 
+  jxl::ThreadPoolInternal pool(4);
   jxl::CodecInOut io1;
   jxl::CodecInOut io2;
-  JXL_CHECK(SetFromFile(argv[input_arg], &io1));
-  JXL_CHECK(SetFromFile(argv[input_arg + 1], &io2));
-  JXL_CHECK(
-      io1.TransformTo(jxl::ColorEncoding::LinearSRGB(io1.Main().IsGray())));
-  JXL_CHECK(
-      io2.TransformTo(jxl::ColorEncoding::LinearSRGB(io2.Main().IsGray())));
+  JXL_CHECK(SetFromFile(argv[input_arg], &io1, &pool));
+  JXL_CHECK(SetFromFile(argv[input_arg + 1], &io2, &pool));
+  JXL_CHECK(io1.TransformTo(
+      jxl::ColorEncoding::LinearSRGB(io1.Main().IsGray()), &pool));
+  JXL_CHECK(io2.TransformTo(
+      jxl::ColorEncoding::LinearSRGB(io2.Main().IsGray()), &pool));
 
   if (io1.xsize() != io2.xsize() || io1.ysize() != io2.ysize()) {
     fprintf(stderr, "Image size mismatch\n");
@@ -46,7 +48,8 @@ int Run(int argc, char** argv) {
     return 1;
   }
 
-  Ssimulacra ssimulacra = ComputeDiff(*io1.Main().color(), *io2.Main().color());
+  Ssimulacra ssimulacra =
+      ComputeDiff(*io1.Main().color(), *io2.Main().color(), &pool);
 
   if (verbose) {
     ssimulacra.PrintDetails();